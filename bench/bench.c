@@ -0,0 +1,2019 @@
+//
+// Created by ZiXuan on 2022/7/2.
+//
+
+/**
+ * sparrow-bench: 基准测试
+ *      1 微基准：直接调用mapSet/mapGet、map预留空间、元组作key分组、Set集合运算、newObjString、字符串拼接、list批量插入删除、list排序、数值数组、range迭代、持久化向量及HAMT快照、单次请求的分配区域、getIndexFromSymbolTable、词法分析器、线程池、事件循环、vm间消息及共享堆
+ *      2 宏基准：执行bench/scripts下的.sp脚本
+ *      3 编译基准：生成1KB到100MB的模块源码，统计compileModule各阶段耗时；并行编译相互import的一组模块；
+ *        立即编译与延迟编译函数体的对比
+ * 每项结果输出一行JSON，字段为
+ *      name, iterations, ns_per_op, allocs_per_op, bytes_per_op, peak_rss_kb
+ * 便于与基线结果逐项对比
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "../include/utils.h"
+#include "../include/unicodeUtf8.h"
+#include "../parser/parser.h"
+#include "../vm/vm.h"
+#include "../vm/core.h"
+#include "../object/class.h"
+#include "../object/obj_fn.h"
+#include "../object/obj_thread.h"
+#include "../vm/event_loop.h"
+#include "../vm/message.h"
+#include "../vm/mailbox.h"
+#include "../vm/shared_heap.h"
+#include "../vm/preload.h"
+#include "../object/obj_list.h"
+#include "../object/obj_string_builder.h"
+#include "../object/obj_typed_array.h"
+#include "../object/obj_set.h"
+#include "../object/obj_tuple.h"
+#include "../object/obj_vector.h"
+#include "../object/obj_hash_map.h"
+#include "../vm/arena.h"
+
+#define DEFAULT_SCRIPTS_DIR "bench/scripts"
+#define MAX_BENCH_PATH_LEN 1024
+
+// 默认只编译到1MB，符号表为线性查找，更大的模块需用--compile-max-bytes显式开启
+#define DEFAULT_COMPILE_MAX_BYTES (1u << 20)
+#define GEN_METHODS_PER_CLASS 8
+#define GEN_MAX_SIGNATURES 4096
+#define GEN_MODULE_NUM 32
+#define GEN_MODULE_BYTES (64u << 10)
+
+typedef struct {
+    const char *filter; // 只运行名字中含有filter的基准项
+    const char *scriptsDir; // 脚本语料所在目录
+    uint32_t scale; // 微基准迭代次数的倍数
+    uint32_t compileMaxBytes; // 编译基准生成源码的上限
+    bool runMicro;
+    bool runScripts;
+    bool runCompile;
+} BenchOptions;
+
+typedef struct {
+    VM *vm;
+    uint64_t startNs;
+    uint64_t startAllocatedNum;
+    uint32_t startAllocatedBytes;
+} BenchTimer;
+
+/**
+ * 返回进程的峰值常驻内存，单位KB
+ * @return
+ */
+static long peakRssKb(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static bool benchSelected(BenchOptions *opts, const char *name) {
+    return opts->filter == NULL || strstr(name, opts->filter) != NULL;
+}
+
+static void timerStart(BenchTimer *timer, VM *vm) {
+    timer->vm = vm;
+    timer->startAllocatedNum = vm->allocatedNum;
+    timer->startAllocatedBytes = vm->allocatedBytes;
+    timer->startNs = getNowNs();
+}
+
+/**
+ * 结束计时并输出一行JSON结果
+ * @param timer
+ * @param name
+ * @param ops 本次计时内完成的操作数
+ */
+static void timerReport(BenchTimer *timer, const char *name, uint64_t ops) {
+    uint64_t elapsed = getNowNs() - timer->startNs;
+    uint64_t allocs = timer->vm->allocatedNum - timer->startAllocatedNum;
+    uint32_t bytes = timer->vm->allocatedBytes - timer->startAllocatedBytes;
+    if (ops == 0) {
+        ops = 1;
+    }
+    printf("{\"name\":\"%s\",\"iterations\":%llu,\"ns_per_op\":%.3f,"
+           "\"allocs_per_op\":%.3f,\"bytes_per_op\":%.3f,\"peak_rss_kb\":%ld}\n",
+           name, (unsigned long long)ops,
+           (double)elapsed / ops, (double)allocs / ops, (double)bytes / ops, peakRssKb());
+    fflush(stdout);
+}
+
+/***********************************************************************************************
+ ********************************* 微基准 ********************************************************
+ ***********************************************************************************************/
+
+/**
+ * 生成n个形如"key_123"的字符串对象
+ * @param vm
+ * @param n
+ * @return
+ */
+static Value* makeStringKeys(VM *vm, uint32_t n) {
+    Value *keys = (Value *)malloc(sizeof(Value) * n);
+    char buf[32];
+    uint32_t idx = 0;
+    while (idx < n) {
+        int len = snprintf(buf, sizeof(buf), "key_%u", idx);
+        keys[idx] = OBJ_TO_VALUE(newObjString(vm, buf, (uint32_t)len));
+        idx ++;
+    }
+    return keys;
+}
+
+/**
+ * 把对象从vm->allObjects中摘下，之后由调用者自行释放，freeVM不会再释放它
+ * 刚创建的对象在表头附近，通常只需查看前几个
+ * @param vm
+ * @param objHeader
+ */
+static void unlinkObject(VM *vm, ObjHeader *objHeader) {
+    ObjHeader **link = &vm->allObjects;
+    while (*link != NULL && *link != objHeader) {
+        link = &(*link)->next;
+    }
+    if (*link != NULL) {
+        *link = objHeader->next;
+    }
+}
+
+static void benchMap(BenchOptions *opts) {
+    uint32_t n = 100000 * opts->scale;
+    BenchTimer timer;
+
+    if (benchSelected(opts, "micro/mapSet/num") || benchSelected(opts, "micro/mapGet/num")) {
+        VM *vm = newVM();
+        ObjMap *objMap = newObjMap(vm);
+        timerStart(&timer, vm);
+        uint32_t idx = 0;
+        while (idx < n) {
+            mapSet(vm, objMap, NUM_TO_VALUE(idx), NUM_TO_VALUE(idx));
+            idx ++;
+        }
+        timerReport(&timer, "micro/mapSet/num", n);
+
+        timerStart(&timer, vm);
+        double sum = 0;
+        idx = 0;
+        while (idx < n) {
+            sum += mapGet(vm, objMap, NUM_TO_VALUE(idx)).num;
+            idx ++;
+        }
+        timerReport(&timer, "micro/mapGet/num", n);
+        ASSERT(sum > 0, "mapGet returned nothing!");
+        freeVM(vm);
+    }
+
+    if (benchSelected(opts, "micro/mapSet/str") || benchSelected(opts, "micro/mapGet/str") ||
+        benchSelected(opts, "micro/mapGet/freshStr")) {
+        VM *vm = newVM();
+        ObjMap *objMap = newObjMap(vm);
+        Value *keys = makeStringKeys(vm, n);
+        timerStart(&timer, vm);
+        uint32_t idx = 0;
+        while (idx < n) {
+            mapSet(vm, objMap, keys[idx], NUM_TO_VALUE(idx));
+            idx ++;
+        }
+        timerReport(&timer, "micro/mapSet/str", n);
+
+        timerStart(&timer, vm);
+        uint32_t found = 0;
+        idx = 0;
+        while (idx < n) {
+            found += !VALUE_IS_UNDEFINED(mapGet(vm, objMap, keys[idx]));
+            idx ++;
+        }
+        timerReport(&timer, "micro/mapGet/str", n);
+        ASSERT(found == n, "mapGet missed some keys!");
+
+        // 每次查找前重新构造key，短key取自驻留池，不应有分配
+        timerStart(&timer, vm);
+        char buf[32];
+        found = 0;
+        idx = 0;
+        while (idx < n) {
+            int len = snprintf(buf, sizeof(buf), "key_%u", idx);
+            Value key = OBJ_TO_VALUE(newObjString(vm, buf, (uint32_t)len));
+            found += !VALUE_IS_UNDEFINED(mapGet(vm, objMap, key));
+            idx ++;
+        }
+        timerReport(&timer, "micro/mapGet/freshStr", n);
+        ASSERT(found == n, "mapGet missed some keys!");
+        free(keys);
+        freeVM(vm);
+    }
+}
+
+/**
+ * 插入n个key，删除其中三分之一再插入n/3个新key，然后按插入顺序遍历全部有效entry
+ * @param opts
+ */
+static void benchMapOrder(BenchOptions *opts) {
+    uint32_t n = 100000 * opts->scale;
+    BenchTimer timer;
+
+    if (!benchSelected(opts, "micro/map/churn") && !benchSelected(opts, "micro/map/iterate")) {
+        return;
+    }
+    VM *vm = newVM();
+    ObjMap *objMap = newObjMap(vm);
+    uint32_t total = n + n / 3;
+    // keys按插入顺序记录插入的key，供删除时使用
+    double *keys = (double *)malloc(sizeof(double) * n);
+
+    timerStart(&timer, vm);
+    uint32_t idx = 0;
+    while (idx < n) {
+        // 乱序的key，检验顺序与哈希值无关
+        double key = (double)(((uint64_t)idx * 2654435761u) % 1000003u);
+        mapSet(vm, objMap, NUM_TO_VALUE(key), NUM_TO_VALUE(idx));
+        keys[idx] = key;
+        idx ++;
+    }
+    idx = 0;
+    while (idx < n) {
+        removeKey(vm, objMap, NUM_TO_VALUE(keys[idx]));
+        idx += 3;
+    }
+    idx = n;
+    while (idx < total) {
+        mapSet(vm, objMap, NUM_TO_VALUE(1000003.0 + idx), NUM_TO_VALUE(idx));
+        idx ++;
+    }
+    timerReport(&timer, "micro/map/churn", total);
+
+    timerStart(&timer, vm);
+    uint32_t rounds = 10;
+    uint32_t visited = 0;
+    double sum = 0;
+    uint32_t round = 0;
+    while (round < rounds) {
+        uint32_t entryIdx = mapNextEntry(objMap, 0);
+        while (entryIdx < objMap->entryNum) {
+            sum += objMap->entries[entryIdx].value.num;
+            visited ++;
+            entryIdx = mapNextEntry(objMap, entryIdx + 1);
+        }
+        round ++;
+    }
+    timerReport(&timer, "micro/map/iterate", visited);
+    ASSERT(sum > 0, "map iteration visited nothing!");
+    free(keys);
+    freeVM(vm);
+}
+
+/**
+ * 批量装载：往新map中逐个插入n个key，对比从空map逐步扩容与先mapReserve(n)一次预留
+ * @param opts
+ */
+static void benchMapReserve(BenchOptions *opts) {
+    uint32_t n = 100000 * opts->scale;
+    BenchTimer timer;
+    const char *names[2] = {"micro/map/bulkLoad/grow", "micro/map/bulkLoad/reserve"};
+
+    if (!benchSelected(opts, names[0]) && !benchSelected(opts, names[1])) {
+        return;
+    }
+    VM *vm = newVM();
+    uint32_t variant = 0;
+    while (variant < 2) {
+        timerStart(&timer, vm);
+        ObjMap *objMap = newObjMap(vm);
+        if (variant == 1) {
+            mapReserve(vm, objMap, n);
+        }
+        uint32_t idx = 0;
+        while (idx < n) {
+            mapSet(vm, objMap, NUM_TO_VALUE(idx), NUM_TO_VALUE(idx * 2));
+            idx ++;
+        }
+        timerReport(&timer, names[variant], n);
+        variant ++;
+    }
+    freeVM(vm);
+}
+
+/**
+ * 按(城市名, 年份)两列分组计数，城市名为100个不同的长字符串，年份为i % 37：
+ * 像脚本中"%(city)|%(year)"那样把两列插值成字符串作key，与直接以二元组作key对比
+ * @param opts
+ */
+static void benchMapGroupBy(BenchOptions *opts) {
+    uint32_t n = 100000 * opts->scale;
+    uint32_t cityNum = 100;
+    BenchTimer timer;
+
+    if (!benchSelected(opts, "micro/map/groupBy/string") && !benchSelected(opts, "micro/map/groupBy/tuple")) {
+        return;
+    }
+    VM *vm = newVM();
+    ObjMap *byString = newObjMap(vm);
+    ObjMap *byTuple = newObjMap(vm);
+    Value *cities = (Value *)malloc(sizeof(Value) * cityNum);
+    char buf[32];
+    uint32_t idx = 0;
+    while (idx < cityNum) {
+        int len = snprintf(buf, sizeof(buf), "city-of-the-plain-%u", idx);
+        cities[idx ++] = OBJ_TO_VALUE(newObjString(vm, buf, (uint32_t)len));
+    }
+    Value separator = OBJ_TO_VALUE(newObjString(vm, "|", 1));
+
+    timerStart(&timer, vm);
+    idx = 0;
+    while (idx < n) {
+        int len = snprintf(buf, sizeof(buf), "%u", idx % 37);
+        Value pieces[3] = {cities[idx % cityNum], separator, OBJ_TO_VALUE(newObjString(vm, buf, (uint32_t)len))};
+        Value key = OBJ_TO_VALUE(newObjStringFromPieces(vm, pieces, 3));
+        Value count = mapGet(vm, byString, key);
+        mapSet(vm, byString, key, NUM_TO_VALUE(VALUE_IS_UNDEFINED(count) ? 1 : count.num + 1));
+        idx ++;
+    }
+    timerReport(&timer, "micro/map/groupBy/string", n);
+
+    timerStart(&timer, vm);
+    idx = 0;
+    while (idx < n) {
+        Value columns[2] = {cities[idx % cityNum], NUM_TO_VALUE(idx % 37)};
+        Value key = OBJ_TO_VALUE(newObjTuple(vm, columns, 2));
+        Value count = mapGet(vm, byTuple, key);
+        mapSet(vm, byTuple, key, NUM_TO_VALUE(VALUE_IS_UNDEFINED(count) ? 1 : count.num + 1));
+        idx ++;
+    }
+    timerReport(&timer, "micro/map/groupBy/tuple", n);
+    free(cities);
+    freeVM(vm);
+}
+
+/**
+ * 集合：n个key分别建Set与value为null的map，比较耗时及每个key占用的内存；
+ * 再与只有n/10个key、其中一半与前者重叠的集合求交集，比较由较大集合驱动探测与集合运算的耗时
+ * @param opts
+ */
+static void benchSet(BenchOptions *opts) {
+    uint32_t n = 100000 * opts->scale;
+    uint32_t m = n / 10;
+    BenchTimer timer;
+
+    if (!benchSelected(opts, "micro/set/build/map") && !benchSelected(opts, "micro/set/build/set") &&
+        !benchSelected(opts, "micro/set/intersect/naive") && !benchSelected(opts, "micro/set/intersect/native")) {
+        return;
+    }
+    VM *vm = newVM();
+
+    timerStart(&timer, vm);
+    ObjMap *objMap = newObjMap(vm);
+    uint32_t idx = 0;
+    while (idx < n) {
+        mapSet(vm, objMap, NUM_TO_VALUE(idx), VT_TO_VALUE(VT_NULL));
+        idx ++;
+    }
+    timerReport(&timer, "micro/set/build/map", n);
+
+    timerStart(&timer, vm);
+    ObjSet *large = newObjSet(vm);
+    idx = 0;
+    while (idx < n) {
+        setAdd(vm, large, NUM_TO_VALUE(idx));
+        idx ++;
+    }
+    timerReport(&timer, "micro/set/build/set", n);
+
+    // small的前一半在large中
+    ObjSet *small = newObjSet(vm);
+    idx = 0;
+    while (idx < m) {
+        setAdd(vm, small, NUM_TO_VALUE(n - m / 2 + idx));
+        idx ++;
+    }
+
+    uint32_t rounds = 20;
+    uint32_t found = 0;
+    timerStart(&timer, vm);
+    uint32_t round = 0;
+    while (round < rounds) {
+        ObjSet *result = newObjSet(vm);
+        uint32_t keyIdx = setNextKey(large, 0);
+        while (keyIdx < large->keyNum) {
+            if (setContains(vm, small, large->keys[keyIdx])) {
+                setAdd(vm, result, large->keys[keyIdx]);
+            }
+            keyIdx = setNextKey(large, keyIdx + 1);
+        }
+        found += result->count;
+        unlinkObject(vm, (ObjHeader *)result);
+        freeObjSet(vm, result);
+        round ++;
+    }
+    timerReport(&timer, "micro/set/intersect/naive", rounds);
+
+    timerStart(&timer, vm);
+    round = 0;
+    while (round < rounds) {
+        ObjSet *result = setIntersect(vm, large, small);
+        found += result->count;
+        unlinkObject(vm, (ObjHeader *)result);
+        freeObjSet(vm, result);
+        round ++;
+    }
+    timerReport(&timer, "micro/set/intersect/native", rounds);
+    ASSERT(found > 0, "set intersect found nothing!");
+    freeVM(vm);
+}
+
+/**
+ * 逐段追加构造长字符串：每次整体拷贝、拼接串及StringBuilder
+ * @param opts
+ */
+static void benchStringConcat(BenchOptions *opts) {
+    uint32_t n = 5000 * opts->scale;
+    BenchTimer timer;
+
+    if (benchSelected(opts, "micro/string/concat/copy")) {
+        VM *vm = newVM();
+        ObjString *piece = newObjString(vm, "0123456789", 10);
+        char *buf = (char *)malloc((size_t)n * piece->value.length);
+        ObjString *result = newObjString(vm, "", 0);
+        timerStart(&timer, vm);
+        uint32_t idx = 0;
+        while (idx < n) {
+            memcpy(buf, result->value.start, result->value.length);
+            memcpy(buf + result->value.length, piece->value.start, piece->value.length);
+            result = newObjString(vm, buf, result->value.length + piece->value.length);
+            idx ++;
+        }
+        timerReport(&timer, "micro/string/concat/copy", n);
+        free(buf);
+        freeVM(vm);
+    }
+
+    if (benchSelected(opts, "micro/string/concat/rope")) {
+        VM *vm = newVM();
+        ObjString *piece = newObjString(vm, "0123456789", 10);
+        ObjString *result = newObjString(vm, "", 0);
+        timerStart(&timer, vm);
+        uint32_t idx = 0;
+        while (idx < n) {
+            result = newObjStringConcat(vm, result, piece);
+            idx ++;
+        }
+        flattenObjString(vm, result);
+        timerReport(&timer, "micro/string/concat/rope", n);
+        freeVM(vm);
+    }
+
+    if (benchSelected(opts, "micro/string/builder")) {
+        VM *vm = newVM();
+        ObjString *piece = newObjString(vm, "0123456789", 10);
+        timerStart(&timer, vm);
+        ObjStringBuilder *builder = newObjStringBuilder(vm);
+        uint32_t idx = 0;
+        while (idx < n) {
+            stringBuilderAppend(vm, builder, piece);
+            idx ++;
+        }
+        stringBuilderToString(vm, builder);
+        timerReport(&timer, "micro/string/builder", n);
+        freeVM(vm);
+    }
+}
+
+/**
+ * 字符串插值"id=%(a) name=%(b) done"的两种实现：旧的List加逐段拼接，及OPCODE_INTERPOLATE所用的一次拼接
+ * @param opts
+ */
+static void benchInterpolate(BenchOptions *opts) {
+    uint32_t n = 200000 * opts->scale;
+    BenchTimer timer;
+
+    VM *vm = newVM();
+    Value pieces[5] = {
+        OBJ_TO_VALUE(newObjString(vm, "id=", 3)),
+        OBJ_TO_VALUE(newObjString(vm, "12345", 5)),
+        OBJ_TO_VALUE(newObjString(vm, " name=", 6)),
+        OBJ_TO_VALUE(newObjString(vm, "sparrow", 7)),
+        OBJ_TO_VALUE(newObjString(vm, " done", 5))
+    };
+
+    if (benchSelected(opts, "micro/string/interpolate/list")) {
+        timerStart(&timer, vm);
+        uint32_t idx = 0;
+        while (idx < n) {
+            ObjList *list = newObjList(vm, 0);
+            uint32_t pieceIdx = 0;
+            while (pieceIdx < 5) {
+                ValueBufferAdd(vm, &list->elements, pieces[pieceIdx ++]);
+            }
+            ObjString *result = newObjString(vm, "", 0);
+            pieceIdx = 0;
+            while (pieceIdx < list->elements.count) {
+                result = newObjStringConcat(vm, result, VALUE_TO_OBJSTR(list->elements.datas[pieceIdx ++]));
+            }
+            idx ++;
+        }
+        timerReport(&timer, "micro/string/interpolate/list", n);
+    }
+
+    if (benchSelected(opts, "micro/string/interpolate/opcode")) {
+        timerStart(&timer, vm);
+        uint32_t idx = 0;
+        while (idx < n) {
+            newObjStringFromPieces(vm, pieces, 5);
+            idx ++;
+        }
+        timerReport(&timer, "micro/string/interpolate/opcode", n);
+    }
+    freeVM(vm);
+}
+
+/**
+ * 改用wyhash之前的哈希函数，乘数误写为1677619，仅用于对比
+ * @param str
+ * @param length
+ * @return
+ */
+static uint32_t oldFnvHash(const char *str, uint32_t length) {
+    uint32_t hashCode = 2166136261, idx = 0;
+    while (idx < length) {
+        hashCode ^= str[idx];
+        hashCode *= 1677619;
+        idx ++;
+    }
+    return hashCode;
+}
+
+/**
+ * 把n个哈希码按低位放入2n向上取整到2的幂个桶中，返回实际冲突数与随机分布下期望冲突数之比
+ * 与ObjMap一样只用低位定位，比值明显大于1说明低位分布不均
+ * @param hashes
+ * @param n
+ * @return
+ */
+static double collisionRatio(uint32_t *hashes, uint32_t n) {
+    uint32_t bucketNum = ceilToPowerOf2(n * 2);
+    uint8_t *used = (uint8_t *)calloc(bucketNum, 1);
+    uint32_t collisions = 0;
+    uint32_t idx = 0;
+    while (idx < n) {
+        uint32_t bucket = hashes[idx ++] & (bucketNum - 1);
+        collisions += used[bucket];
+        used[bucket] = 1;
+    }
+    free(used);
+
+    // 期望占用的桶数为m(1-(1-1/m)^n)，幂用平方求得
+    double base = 1.0 - 1.0 / bucketNum, empty = 1.0;
+    uint32_t exp = n;
+    while (exp > 0) {
+        if (exp & 1) {
+            empty *= base;
+        }
+        base *= base;
+        exp >>= 1;
+    }
+    double expected = n - bucketNum * (1.0 - empty);
+    return expected > 0 ? collisions / expected : 0;
+}
+
+/**
+ * 哈希质量：在几类常见key上比较新旧哈希函数的桶冲突
+ * 哈希速度：不同长度的串每次哈希的耗时
+ * @param opts
+ */
+static void benchHash(BenchOptions *opts) {
+    static const char *corpora[] = {"key_%u", "%u", "user.%u.name", "/usr/lib/sparrow/module_%u.sp"};
+    uint32_t n = 100000;
+    char buf[64];
+
+    if (benchSelected(opts, "micro/hash/quality")) {
+        uint32_t *newHashes = (uint32_t *)malloc(sizeof(uint32_t) * n);
+        uint32_t *oldHashes = (uint32_t *)malloc(sizeof(uint32_t) * n);
+        uint32_t corpus = 0;
+        while (corpus < sizeof(corpora) / sizeof(corpora[0])) {
+            uint32_t idx = 0;
+            while (idx < n) {
+                int len = snprintf(buf, sizeof(buf), corpora[corpus], idx);
+                newHashes[idx] = hashString(buf, (uint32_t)len);
+                oldHashes[idx] = oldFnvHash(buf, (uint32_t)len);
+                idx ++;
+            }
+            double newRatio = collisionRatio(newHashes, n);
+            double oldRatio = collisionRatio(oldHashes, n);
+            printf("{\"name\":\"micro/hash/quality\",\"corpus\":\"%s\",\"keys\":%u,"
+                   "\"collision_ratio\":%.3f,\"old_collision_ratio\":%.3f}\n",
+                   corpora[corpus], n, newRatio, oldRatio);
+            corpus ++;
+        }
+        fflush(stdout);
+        free(newHashes);
+        free(oldHashes);
+    }
+
+    static const uint32_t lengths[] = {8, 64, 1024};
+    char *data = (char *)malloc(1024);
+    memset(data, 'k', 1024);
+    uint32_t lenIdx = 0;
+    while (lenIdx < sizeof(lengths) / sizeof(lengths[0])) {
+        uint32_t length = lengths[lenIdx ++];
+        char name[64];
+        snprintf(name, sizeof(name), "micro/hash/%uB", length);
+        if (!benchSelected(opts, name)) {
+            continue;
+        }
+        VM *vm = newVM();
+        BenchTimer timer;
+        uint32_t rounds = 1000000 * opts->scale;
+        volatile uint32_t sink = 0;
+        timerStart(&timer, vm);
+        uint32_t idx = 0;
+        while (idx < rounds) {
+            data[idx & 7] = (char)idx;
+            sink ^= hashString(data, length);
+            idx ++;
+        }
+        timerReport(&timer, name, rounds);
+        freeVM(vm);
+    }
+    free(data);
+}
+
+/**
+ * 按下标遍历ASCII及中英混排字符串的全部码点
+ * @param opts
+ */
+static void benchStringIndex(BenchOptions *opts) {
+    static const char *samples[] = {"sparrow ", "麻雀sparrow编程语言 "};
+    static const char *names[] = {"micro/string/index/ascii", "micro/string/index/utf8"};
+    uint32_t repeat = 4096;
+
+    uint32_t sample = 0;
+    while (sample < 2) {
+        if (!benchSelected(opts, names[sample])) {
+            sample ++;
+            continue;
+        }
+        VM *vm = newVM();
+        uint32_t sampleLen = strlen(samples[sample]);
+        char *text = (char *)malloc(sampleLen * repeat);
+        uint32_t idx = 0;
+        while (idx < repeat) {
+            memcpy(text + idx * sampleLen, samples[sample], sampleLen);
+            idx ++;
+        }
+        ObjString *objString = newObjString(vm, text, sampleLen * repeat);
+        uint32_t length = objString->value.length;
+
+        BenchTimer timer;
+        timerStart(&timer, vm);
+        uint32_t count = objStringCodePointCount(vm, objString);
+        volatile int sink = 0;
+        uint32_t round = 0;
+        while (round < opts->scale) {
+            idx = 0;
+            while (idx < count) {
+                uint32_t offset = objStringCodePointOffset(vm, objString, idx);
+                sink ^= decodeUtf8((const uint8_t *)objString->value.start + offset, length - offset);
+                idx ++;
+            }
+            round ++;
+        }
+        timerReport(&timer, names[sample], (uint64_t)count * opts->scale);
+        free(text);
+        freeVM(vm);
+        sample ++;
+    }
+}
+
+static void benchString(BenchOptions *opts) {
+    uint32_t n = 200000 * opts->scale;
+    BenchTimer timer;
+    char longStr[256];
+    memset(longStr, 'x', sizeof(longStr));
+
+    if (benchSelected(opts, "micro/newObjString/short")) {
+        VM *vm = newVM();
+        timerStart(&timer, vm);
+        uint32_t idx = 0;
+        while (idx < n) {
+            newObjString(vm, "shortkey", 8);
+            idx ++;
+        }
+        timerReport(&timer, "micro/newObjString/short", n);
+        freeVM(vm);
+    }
+
+    if (benchSelected(opts, "micro/newObjString/long")) {
+        VM *vm = newVM();
+        timerStart(&timer, vm);
+        uint32_t idx = 0;
+        while (idx < n) {
+            newObjString(vm, longStr, sizeof(longStr));
+            idx ++;
+        }
+        timerReport(&timer, "micro/newObjString/long", n);
+        freeVM(vm);
+    }
+
+    benchStringConcat(opts);
+    benchInterpolate(opts);
+    benchHash(opts);
+    benchStringIndex(opts);
+}
+
+/**
+ * 经事件循环在一对fd间往返一条消息：线程挂起在读端，写端写入后由事件循环唤醒
+ * @param vm
+ * @param objThread 挂起的线程
+ * @param readFd
+ * @param writeFd
+ * @param msg
+ */
+static void ioRoundTrip(VM *vm, ObjThread *objThread, int readFd, int writeFd, ObjString *msg) {
+    IoOp op = {IO_OP_READ, objThread, msg->value.length, NULL, 0, NULL, NULL};
+    ioWait(vm, readFd, op);
+
+    uint32_t written = 0;
+    Value result;
+    if (ioTryWrite(vm, writeFd, msg, &written, &result) != IO_DONE) {
+        fprintf(stderr, "io bench: write failed!\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (nextRunnableThread(vm) != objThread) {
+        fprintf(stderr, "io bench: thread not woken!\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * 事件循环唤醒挂起线程的开销，分别基于管道、unix socket对及回环tcp连接
+ * @param opts
+ */
+static void benchIo(BenchOptions *opts) {
+    uint32_t n = 20000 * opts->scale;
+    BenchTimer timer;
+    const char *names[] = {"micro/io/pipe", "micro/io/socketPair", "micro/io/loopback"};
+
+    uint32_t kind = 0;
+    while (kind < 3) {
+        if (!benchSelected(opts, names[kind])) {
+            kind ++;
+            continue;
+        }
+
+        int fds[2];
+        int listenFd = -1;
+        if (kind == 0) {
+            if (pipe(fds) == -1) {
+                IO_ERROR("pipe failed!");
+            }
+        }
+        else if (kind == 1) {
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+                IO_ERROR("socketpair failed!");
+            }
+        }
+        else {
+            struct sockaddr_in addr;
+            socklen_t len = sizeof(addr);
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            listenFd = socket(AF_INET, SOCK_STREAM, 0);
+            if (listenFd == -1 || bind(listenFd, (struct sockaddr *)&addr, len) == -1 ||
+                listen(listenFd, 1) == -1 || getsockname(listenFd, (struct sockaddr *)&addr, &len) == -1) {
+                IO_ERROR("listen on loopback failed!");
+            }
+            fds[1] = socket(AF_INET, SOCK_STREAM, 0);
+            if (fds[1] == -1 || connect(fds[1], (struct sockaddr *)&addr, len) == -1) {
+                IO_ERROR("connect to loopback failed!");
+            }
+            fds[0] = accept(listenFd, NULL, NULL);
+        }
+        setNonBlocking(fds[0]);
+        setNonBlocking(fds[1]);
+
+        VM *vm = newVM();
+        ObjModule *objModule = newObjModule(vm, "bench");
+        ObjThread *objThread = newObjThread(vm, newObjClosure(vm, newObjFn(vm, objModule, 16)));
+        objThread->esp ++;
+        ObjString *msg = newObjString(vm, "ping from sparrow", 17);
+
+        timerStart(&timer, vm);
+        uint32_t idx = 0;
+        while (idx < n) {
+            ioRoundTrip(vm, objThread, fds[0], fds[1], msg);
+            idx ++;
+        }
+        timerReport(&timer, names[kind], n);
+
+        close(fds[0]);
+        close(fds[1]);
+        if (listenFd != -1) {
+            close(listenFd);
+        }
+        freeVM(vm);
+        kind ++;
+    }
+}
+
+/**
+ * 按旧实现逐个元素后移，插入一个元素
+ * @param vm
+ * @param objList
+ * @param index
+ * @param value
+ */
+static void loopInsert(VM *vm, ObjList *objList, uint32_t index, Value value) {
+    ValueBufferAdd(vm, &objList->elements, VT_TO_VALUE(VT_NULL));
+    uint32_t idx = objList->elements.count - 1;
+    while (idx > index) {
+        objList->elements.datas[idx] = objList->elements.datas[idx - 1];
+        idx --;
+    }
+    objList->elements.datas[index] = value;
+}
+
+/**
+ * 按旧实现逐个元素前移，删除一个元素
+ * @param objList
+ * @param index
+ */
+static void loopRemove(ObjList *objList, uint32_t index) {
+    uint32_t idx = index;
+    while (idx + 1 < objList->elements.count) {
+        objList->elements.datas[idx] = objList->elements.datas[idx + 1];
+        idx ++;
+    }
+    objList->elements.count --;
+}
+
+/**
+ * 在10000个元素的list中部反复插入再删除100个元素：逐个元素移动与insertElements/removeRange对比
+ * @param opts
+ */
+static void benchList(BenchOptions *opts) {
+    uint32_t n = 2000 * opts->scale;
+    const uint32_t listNum = 10000, chunkNum = 100, at = listNum / 2;
+    const char *names[2] = {"micro/list/splice/loop", "micro/list/splice/memmove"};
+    BenchTimer timer;
+
+    uint32_t kind = 0;
+    while (kind < 2) {
+        if (!benchSelected(opts, names[kind])) {
+            kind ++;
+            continue;
+        }
+        VM *vm = newVM();
+        ObjList *objList = newObjList(vm, listNum);
+        ObjList *chunk = newObjList(vm, chunkNum);
+        uint32_t idx = 0;
+        while (idx < listNum) {
+            objList->elements.datas[idx] = NUM_TO_VALUE(idx);
+            idx ++;
+        }
+        idx = 0;
+        while (idx < chunkNum) {
+            chunk->elements.datas[idx] = NUM_TO_VALUE(-1.0 - idx);
+            idx ++;
+        }
+
+        timerStart(&timer, vm);
+        uint32_t round = 0;
+        while (round < n) {
+            if (kind == 0) {
+                idx = 0;
+                while (idx < chunkNum) {
+                    loopInsert(vm, objList, at + idx, chunk->elements.datas[idx]);
+                    idx ++;
+                }
+                idx = 0;
+                while (idx < chunkNum) {
+                    loopRemove(objList, at);
+                    idx ++;
+                }
+            } else {
+                insertElements(vm, objList, at, chunk->elements.datas, chunkNum);
+                removeRange(vm, objList, at, chunkNum);
+            }
+            round ++;
+        }
+        timerReport(&timer, names[kind], n);
+        freeVM(vm);
+        kind ++;
+    }
+}
+
+/**
+ * qsort的比较函数，模拟逐次按类型分派的通用比较
+ * @param a
+ * @param b
+ * @return
+ */
+static int compareValues(const void *a, const void *b) {
+    const Value *left = (const Value *)a;
+    const Value *right = (const Value *)b;
+    if (VALUE_IS_NUM(*left) && VALUE_IS_NUM(*right)) {
+        return (left->num > right->num) - (left->num < right->num);
+    }
+    ObjString *leftStr = VALUE_TO_OBJSTR((*left));
+    ObjString *rightStr = VALUE_TO_OBJSTR((*right));
+    uint32_t minLength = leftStr->value.length < rightStr->value.length ? leftStr->value.length : rightStr->value.length;
+    int cmp = memcmp(leftStr->value.start, rightStr->value.start, minLength);
+    return cmp != 0 ? cmp : (leftStr->value.length > rightStr->value.length) - (leftStr->value.length < rightStr->value.length);
+}
+
+/**
+ * 对10万个数字或字符串排序：qsort加通用比较函数与sortListNatural对比，
+ * 数字分随机、有序、逆序、大量重复四种分布
+ * @param opts
+ */
+static void benchSort(BenchOptions *opts) {
+    static const char *names[] = {
+        "micro/sort/num/random/qsort", "micro/sort/num/random/native",
+        "micro/sort/num/sorted/qsort", "micro/sort/num/sorted/native",
+        "micro/sort/num/reversed/qsort", "micro/sort/num/reversed/native",
+        "micro/sort/num/dups/qsort", "micro/sort/num/dups/native",
+        "micro/sort/str/random/qsort", "micro/sort/str/random/native"
+    };
+    uint32_t n = 100000;
+    uint32_t rounds = opts->scale;
+    BenchTimer timer;
+
+    uint32_t kind = 0;
+    while (kind < 5) {
+        bool runQsort = benchSelected(opts, names[kind * 2]);
+        bool runNative = benchSelected(opts, names[kind * 2 + 1]);
+        if (!runQsort && !runNative) {
+            kind ++;
+            continue;
+        }
+        VM *vm = newVM();
+        ObjList *input = newObjList(vm, n);
+        uint32_t seed = 42;
+        uint32_t idx = 0;
+        while (idx < n) {
+            seed = seed * 1103515245 + 12345;
+            switch (kind) {
+                case 0: input->elements.datas[idx] = NUM_TO_VALUE(seed >> 8); break;
+                case 1: input->elements.datas[idx] = NUM_TO_VALUE(idx); break;
+                case 2: input->elements.datas[idx] = NUM_TO_VALUE(n - idx); break;
+                case 3: input->elements.datas[idx] = NUM_TO_VALUE((seed >> 8) % 16); break;
+                default: {
+                    char key[24];
+                    int len = snprintf(key, sizeof(key), "user-%u", seed >> 8);
+                    input->elements.datas[idx] = OBJ_TO_VALUE(newObjString(vm, key, len));
+                }
+            }
+            idx ++;
+        }
+
+        if (runQsort) {
+            timerStart(&timer, vm);
+            uint32_t round = 0;
+            while (round < rounds) {
+                ObjList *work = newObjListSlice(vm, input, 0, n);
+                qsort(work->elements.datas, n, sizeof(Value), compareValues);
+                round ++;
+            }
+            timerReport(&timer, names[kind * 2], (uint64_t)n * rounds);
+        }
+        if (runNative) {
+            timerStart(&timer, vm);
+            uint32_t round = 0;
+            while (round < rounds) {
+                ObjList *work = newObjListSlice(vm, input, 0, n);
+                sortListNatural(vm, work);
+                round ++;
+            }
+            timerReport(&timer, names[kind * 2 + 1], (uint64_t)n * rounds);
+        }
+        freeVM(vm);
+        kind ++;
+    }
+}
+
+/**
+ * 对100万个数求和及点积：装箱的ObjList逐个取值与Float64Array的批量运算对比
+ * @param opts
+ */
+static void benchTypedArray(BenchOptions *opts) {
+    static const char *names[] = {"micro/typed/sumDot/list", "micro/typed/sumDot/float64"};
+    uint32_t n = 1000000;
+    uint32_t rounds = 10 * opts->scale;
+    BenchTimer timer;
+
+    uint32_t kind = 0;
+    while (kind < 2) {
+        if (!benchSelected(opts, names[kind])) {
+            kind ++;
+            continue;
+        }
+        VM *vm = newVM();
+        ObjList *objList = newObjList(vm, n);
+        ObjTypedArray *array = newObjTypedArray(vm, TA_FLOAT64, n);
+        uint32_t idx = 0;
+        while (idx < n) {
+            double value = (idx % 1000) * 0.5;
+            objList->elements.datas[idx] = NUM_TO_VALUE(value);
+            typedArraySet(array, idx, value);
+            idx ++;
+        }
+
+        timerStart(&timer, vm);
+        volatile double result = 0;
+        uint32_t round = 0;
+        while (round < rounds) {
+            if (kind == 0) {
+                double sum = 0, dot = 0;
+                idx = 0;
+                while (idx < n) {
+                    Value value = objList->elements.datas[idx];
+                    if (!VALUE_IS_NUM(value)) {
+                        exit(EXIT_FAILURE);
+                    }
+                    sum += VALUE_TO_NUM(value);
+                    dot += VALUE_TO_NUM(value) * VALUE_TO_NUM(value);
+                    idx ++;
+                }
+                result += sum + dot;
+            } else {
+                result += typedArraySum(array) + typedArrayDot(array, array);
+            }
+            round ++;
+        }
+        timerReport(&timer, names[kind], (uint64_t)n * rounds);
+        freeVM(vm);
+        kind ++;
+    }
+}
+
+/**
+ * for i (0..n)每一步的开销：按方法索引派发iterate(_)与iteratorValue(_)原生方法，
+ * 与OPCODE_ITERATE/OPCODE_ITERATOR_VALUE的快速路径对比
+ * @param opts
+ */
+static void benchRange(BenchOptions *opts) {
+    static const char *names[] = {"micro/range/iterate/dispatch", "micro/range/iterate/fast"};
+    uint32_t n = 10000000 * opts->scale;
+    BenchTimer timer;
+
+    uint32_t kind = 0;
+    while (kind < 2) {
+        if (!benchSelected(opts, names[kind])) {
+            kind ++;
+            continue;
+        }
+        VM *vm = newVM();
+        uint32_t iterateIdx = getIndexFromSymbolTable(&vm->allMethodNames, "iterate(_)", 10);
+        uint32_t valueIdx = getIndexFromSymbolTable(&vm->allMethodNames, "iteratorValue(_)", 16);
+        Value seq = OBJ_TO_VALUE(newObjRange(vm, 0, n - 1, 1));
+        Value iter = VT_TO_VALUE(VT_NULL);
+        volatile double sum = 0;
+
+        timerStart(&timer, vm);
+        if (kind == 0) {
+            Class *class = VALUE_TO_OBJ(seq)->class;
+            Value args[2];
+            while (true) {
+                args[0] = seq;
+                args[1] = iter;
+                class->methods.datas[iterateIdx].primFn(vm, args);
+                iter = args[0];
+                if (VALUE_IS_FALSE(iter)) {
+                    break;
+                }
+                args[0] = seq;
+                args[1] = iter;
+                class->methods.datas[valueIdx].primFn(vm, args);
+                sum += VALUE_TO_NUM(args[0]);
+            }
+        } else {
+            Value value;
+            while (rangeIterateFast(seq, iter, iterateIdx, &iter) && !VALUE_IS_FALSE(iter)) {
+                rangeIteratorValueFast(seq, iter, valueIdx, &value);
+                sum += VALUE_TO_NUM(value);
+            }
+        }
+        timerReport(&timer, names[kind], n);
+        freeVM(vm);
+        kind ++;
+    }
+}
+
+/**
+ * 快照：n个元素的容器连续保存snapshotNum个版本，每个版本在上一版本基础上改4个元素。
+ * list及map每次整体复制，Vector及HashMap只复制修改路径
+ * @param opts
+ */
+static void benchPersistent(BenchOptions *opts) {
+    static const char *names[] = {"micro/persistent/snapshot/listCopy", "micro/persistent/snapshot/vector",
+                                  "micro/persistent/snapshot/mapCopy", "micro/persistent/snapshot/hashMap"};
+    uint32_t n = 10000 * opts->scale;
+    uint32_t snapshotNum = 200;
+    uint32_t editNum = 4;
+    BenchTimer timer;
+
+    uint32_t kind = 0;
+    while (kind < 4) {
+        if (!benchSelected(opts, names[kind])) {
+            kind ++;
+            continue;
+        }
+        VM *vm = newVM();
+        Value *snapshots = (Value *)malloc(sizeof(Value) * (snapshotNum + 1));
+
+        // 初始版本，元素idx的值为idx
+        ObjList *objList = newObjList(vm, n);
+        ObjVector *objVector = vectorTransient(vm, newObjVector(vm));
+        ObjMap *objMap = newObjMap(vm);
+        ObjHashMap *objHashMap = hashMapTransient(vm, newObjHashMap(vm));
+        mapReserve(vm, objMap, n);
+        uint32_t idx = 0;
+        while (idx < n) {
+            objList->elements.datas[idx] = NUM_TO_VALUE(idx);
+            vectorAdd(vm, objVector, NUM_TO_VALUE(idx));
+            mapSet(vm, objMap, NUM_TO_VALUE(idx), NUM_TO_VALUE(idx));
+            hashMapSet(vm, objHashMap, NUM_TO_VALUE(idx), NUM_TO_VALUE(idx));
+            idx ++;
+        }
+        objVector->isTransient = false;
+        objHashMap->isTransient = false;
+        snapshots[0] = kind == 0 ? OBJ_TO_VALUE(objList) : kind == 1 ? OBJ_TO_VALUE(objVector) :
+                       kind == 2 ? OBJ_TO_VALUE(objMap) : OBJ_TO_VALUE(objHashMap);
+
+        // 第s个版本把下标(s * 7919 + e) % n的元素改为-s
+        timerStart(&timer, vm);
+        uint32_t snapshot = 1;
+        while (snapshot <= snapshotNum) {
+            Value prev = snapshots[snapshot - 1];
+            Value next = prev;
+            if (kind == 0) {
+                next = OBJ_TO_VALUE(newObjListSlice(vm, VALUE_TO_OBJLIST(prev), 0, n));
+            } else if (kind == 2) {
+                ObjMap *copy = newObjMap(vm);
+                ObjMap *prevMap = VALUE_TO_OBJMAP(prev);
+                mapReserve(vm, copy, prevMap->count);
+                uint32_t entryIdx = mapNextEntry(prevMap, 0);
+                while (entryIdx < prevMap->entryNum) {
+                    mapSet(vm, copy, prevMap->entries[entryIdx].key, prevMap->entries[entryIdx].value);
+                    entryIdx = mapNextEntry(prevMap, entryIdx + 1);
+                }
+                next = OBJ_TO_VALUE(copy);
+            }
+            uint32_t edit = 0;
+            while (edit < editNum) {
+                uint32_t target = (snapshot * 7919 + edit) % n;
+                Value value = NUM_TO_VALUE(-(double)snapshot);
+                if (kind == 0) {
+                    VALUE_TO_OBJLIST(next)->elements.datas[target] = value;
+                } else if (kind == 1) {
+                    ObjVector *updated = vectorSet(vm, VALUE_TO_OBJVECTOR(next), target, value);
+                    if (edit > 0) {
+                        unlinkObject(vm, (ObjHeader *)VALUE_TO_OBJVECTOR(next));
+                        freeObjVector(vm, VALUE_TO_OBJVECTOR(next));
+                    }
+                    next = OBJ_TO_VALUE(updated);
+                } else if (kind == 2) {
+                    mapSet(vm, VALUE_TO_OBJMAP(next), NUM_TO_VALUE(target), value);
+                } else {
+                    ObjHashMap *updated = hashMapSet(vm, VALUE_TO_OBJHASHMAP(next), NUM_TO_VALUE(target), value);
+                    if (edit > 0) {
+                        unlinkObject(vm, (ObjHeader *)VALUE_TO_OBJHASHMAP(next));
+                        freeObjHashMap(vm, VALUE_TO_OBJHASHMAP(next));
+                    }
+                    next = OBJ_TO_VALUE(updated);
+                }
+                edit ++;
+            }
+            snapshots[snapshot ++] = next;
+        }
+        timerReport(&timer, names[kind], snapshotNum);
+
+        free(snapshots);
+        freeVM(vm);
+        kind ++;
+    }
+}
+
+/**
+ * 模拟单次请求：建16个字段的map，每个字段为8个数的list，再拼出一段摘要字符串。
+ * 每16个请求把摘要存入请求外的list，即逃逸到区域外，关闭区域时须迁出。
+ * heap在堆上逐个分配且没有回收；arena每个请求打开一次区域，关闭时整体释放
+ * @param opts
+ */
+static void benchArena(BenchOptions *opts) {
+    static const char *names[] = {"micro/arena/request/arena", "micro/arena/request/heap"};
+    uint32_t requestNum = 2000 * opts->scale;
+    uint32_t fieldNum = 16;
+    BenchTimer timer;
+
+    uint32_t kind = 0;
+    while (kind < 2) {
+        if (!benchSelected(opts, names[kind])) {
+            kind ++;
+            continue;
+        }
+        VM *vm = newVM();
+        ObjList *kept = newObjList(vm, 0);
+        char buf[64];
+
+        timerStart(&timer, vm);
+        uint32_t request = 0;
+        while (request < requestNum) {
+            if (kind == 0) {
+                openArena(vm);
+            }
+            ObjMap *response = newObjMap(vm);
+            ObjString *summary = newObjString(vm, "", 0);
+            uint32_t field = 0;
+            while (field < fieldNum) {
+                int len = snprintf(buf, sizeof(buf), "request-%u-field-%u-with-a-long-name", request, field);
+                ObjString *key = newObjString(vm, buf, len);
+                ObjList *values = newObjList(vm, 0);
+                uint32_t idx = 0;
+                while (idx < 8) {
+                    ValueBufferAdd(vm, &values->elements, NUM_TO_VALUE(request * field + idx));
+                    idx ++;
+                }
+                mapSet(vm, response, OBJ_TO_VALUE(key), OBJ_TO_VALUE(values));
+                summary = newObjStringConcat(vm, summary, key);
+                field ++;
+            }
+            if (request % 16 == 0) {
+                ARENA_REMEMBER(vm, kept);
+                ValueBufferAdd(vm, &kept->elements, OBJ_TO_VALUE(summary));
+            }
+            if (kind == 0) {
+                closeArena(vm);
+            }
+            request ++;
+        }
+        timerReport(&timer, names[kind], requestNum);
+
+        freeVM(vm);
+        kind ++;
+    }
+}
+
+/**
+ * 在两个vm之间经序列化传递一个含字符串和数字的list与map
+ * @param opts
+ */
+static void benchMessage(BenchOptions *opts) {
+    uint32_t n = 20000 * opts->scale;
+    BenchTimer timer;
+
+    if (!benchSelected(opts, "micro/message/roundTrip")) {
+        return;
+    }
+
+    VM *src = newVM();
+    VM *dst = newVM();
+    ObjMap *objMap = newObjMap(src);
+    ObjList *objList = newObjList(src, 64);
+    uint32_t idx = 0;
+    while (idx < 64) {
+        char key[16];
+        int len = snprintf(key, sizeof(key), "key%u", idx);
+        Value keyValue = OBJ_TO_VALUE(newObjString(src, key, len));
+        objList->elements.datas[idx] = keyValue;
+        mapSet(src, objMap, keyValue, NUM_TO_VALUE(idx));
+        idx ++;
+    }
+    Value payload = OBJ_TO_VALUE(objList);
+
+    timerStart(&timer, dst);
+    idx = 0;
+    while (idx < n) {
+        // 每条消息只有一个value
+        Message *listMsg = newMessage();
+        Message *mapMsg = newMessage();
+        serializeValue(src, payload, listMsg);
+        serializeValue(src, OBJ_TO_VALUE(objMap), mapMsg);
+        deserializeValue(dst, listMsg);
+        deserializeValue(dst, mapMsg);
+        freeMessage(listMsg);
+        freeMessage(mapMsg);
+        idx ++;
+    }
+    timerReport(&timer, "micro/message/roundTrip", n);
+    freeVM(src);
+    freeVM(dst);
+}
+
+/**
+ * 冻结一张查找表后反复经消息发给另一vm并查表，消息中只有指针，不随表的大小增长
+ * @param opts
+ */
+static void benchShared(BenchOptions *opts) {
+    uint32_t n = 100000 * opts->scale;
+    BenchTimer timer;
+
+    if (!benchSelected(opts, "micro/shared/lookup")) {
+        return;
+    }
+
+    VM *src = newVM();
+    VM *dst = newVM();
+    ObjMap *table = newObjMap(src);
+    Value keys[1024];
+    uint32_t idx = 0;
+    while (idx < 1024) {
+        char key[16];
+        int len = snprintf(key, sizeof(key), "key%u", idx);
+        keys[idx] = OBJ_TO_VALUE(newObjString(src, key, len));
+        mapSet(src, table, keys[idx], NUM_TO_VALUE(idx));
+        idx ++;
+    }
+    Value frozen = freezeValue(src, OBJ_TO_VALUE(table));
+
+    timerStart(&timer, dst);
+    idx = 0;
+    while (idx < n) {
+        Message *msg = newMessage();
+        serializeValue(src, frozen, msg);
+        Value got = deserializeValue(dst, msg);
+        mapGet(dst, VALUE_TO_OBJMAP(got), keys[idx & 1023]);
+        freeMessage(msg);
+        idx ++;
+    }
+    timerReport(&timer, "micro/shared/lookup", n);
+    freeVM(src);
+    freeVM(dst);
+}
+
+typedef struct {
+    Mailbox *mailbox;
+    uint32_t num;
+    VM *vm;
+} ChannelProducer;
+
+/**
+ * 生产者线程：以64个为一批发送num个数字
+ * @param arg
+ * @return
+ */
+static void* channelProducerMain(void *arg) {
+    ChannelProducer *producer = (ChannelProducer *)arg;
+    Value batch[64];
+    uint32_t sent = 0;
+    while (sent < producer->num) {
+        uint32_t num = producer->num - sent < 64 ? producer->num - sent : 64;
+        uint32_t idx = 0;
+        while (idx < num) {
+            batch[idx] = NUM_TO_VALUE(sent + idx);
+            idx ++;
+        }
+        bool unsupported;
+        uint32_t batchSent = mailboxSend(producer->vm, producer->mailbox, batch, num, &unsupported);
+        if (batchSent == 0) {
+            // 邮箱已满，让出cpu给消费者
+            sched_yield();
+        }
+        sent += batchSent;
+    }
+    return NULL;
+}
+
+/**
+ * 多个os线程向同一邮箱批量发送，单个消费者批量接收
+ * @param opts
+ */
+static void benchChannel(BenchOptions *opts) {
+    if (!benchSelected(opts, "micro/channel/mpsc")) {
+        return;
+    }
+
+    uint32_t producerNum = 4;
+    uint32_t perProducer = 250000 * opts->scale;
+    BenchTimer timer;
+    VM *vm = newVM();
+    Mailbox *mailbox = newMailbox(4096);
+
+    pthread_t tids[4];
+    ChannelProducer producers[4];
+    timerStart(&timer, vm);
+    uint32_t idx = 0;
+    while (idx < producerNum) {
+        // 只发送数字，不会用到生产者vm的分配器
+        producers[idx].mailbox = mailbox;
+        producers[idx].num = perProducer;
+        producers[idx].vm = vm;
+        pthread_create(&tids[idx], NULL, channelProducerMain, &producers[idx]);
+        idx ++;
+    }
+
+    uint64_t total = (uint64_t)producerNum * perProducer;
+    uint64_t received = 0;
+    Value batch[256];
+    while (received < total) {
+        uint32_t num = mailboxReceive(vm, mailbox, batch, 256);
+        if (num == 0 && mailboxPrepareWait(mailbox)) {
+            // 与脚本中的receive一样挂起在eventfd上等待生产者唤醒
+            struct pollfd pfd = {mailbox->eventFd, POLLIN, 0};
+            poll(&pfd, 1, -1);
+            mailboxDrainEvent(mailbox);
+        }
+        received += num;
+    }
+    idx = 0;
+    while (idx < producerNum) {
+        pthread_join(tids[idx], NULL);
+        idx ++;
+    }
+    timerReport(&timer, "micro/channel/mpsc", total);
+    releaseMailbox(mailbox);
+    freeVM(vm);
+}
+
+/**
+ * 线程的创建、运行结束与回收，及就绪队列的轮转
+ * 线程池预热后allocs_per_op应接近0
+ * @param opts
+ */
+static void benchThread(BenchOptions *opts) {
+    uint32_t n = 200000 * opts->scale;
+    BenchTimer timer;
+
+    if (benchSelected(opts, "micro/thread/spawn")) {
+        VM *vm = newVM();
+        ObjModule *objModule = newObjModule(vm, "bench");
+        ObjClosure *objClosure = newObjClosure(vm, newObjFn(vm, objModule, 16));
+        timerStart(&timer, vm);
+        uint32_t idx = 0;
+        while (idx < n) {
+            ObjThread *objThread = newObjThread(vm, objClosure);
+            // 模拟线程运行结束后再被gc回收
+            objThread->usedFrameNum = 0;
+            finishThread(vm, objThread);
+            unlinkObject(vm, (ObjHeader *)objThread);
+            freeObjThread(vm, objThread);
+            idx ++;
+        }
+        timerReport(&timer, "micro/thread/spawn", n);
+        freeVM(vm);
+    }
+
+    if (benchSelected(opts, "micro/thread/schedule")) {
+        VM *vm = newVM();
+        ObjModule *objModule = newObjModule(vm, "bench");
+        ObjClosure *objClosure = newObjClosure(vm, newObjFn(vm, objModule, 16));
+        uint32_t idx = 0;
+        while (idx < 64) {
+            scheduleThread(vm, newObjThread(vm, objClosure));
+            idx ++;
+        }
+        timerStart(&timer, vm);
+        idx = 0;
+        while (idx < n) {
+            scheduleThread(vm, nextReadyThread(vm));
+            idx ++;
+        }
+        timerReport(&timer, "micro/thread/schedule", n);
+        freeVM(vm);
+    }
+
+    if (benchSelected(opts, "micro/thread/deepCall")) {
+        VM *vm = newVM();
+        ObjModule *objModule = newObjModule(vm, "bench");
+        ObjClosure *objClosure = newObjClosure(vm, newObjFn(vm, objModule, 16));
+        uint32_t depth = 10000;
+        uint32_t rounds = 20 * opts->scale;
+        timerStart(&timer, vm);
+        uint32_t round = 0;
+        while (round < rounds) {
+            ObjThread *objThread = newObjThread(vm, objClosure);
+            uint32_t idx = 0;
+            while (idx < depth) {
+                // 模拟压入接收者及局部变量后发起调用，栈和frame数组随之扩容
+                objThread->esp += 16;
+                createFrame(vm, objThread, objClosure, 1);
+                idx ++;
+            }
+            objThread->usedFrameNum = 0;
+            finishThread(vm, objThread);
+            unlinkObject(vm, (ObjHeader *)objThread);
+            freeObjThread(vm, objThread);
+            round ++;
+        }
+        timerReport(&timer, "micro/thread/deepCall", (uint64_t)rounds * depth);
+        freeVM(vm);
+    }
+}
+
+static void benchSymbolTable(BenchOptions *opts) {
+    static const uint32_t tableSizes[] = {16, 256, 2048};
+    uint32_t n = 100000 * opts->scale;
+    BenchTimer timer;
+    char name[64];
+    char buf[32];
+
+    uint32_t sizeIdx = 0;
+    while (sizeIdx < sizeof(tableSizes) / sizeof(tableSizes[0])) {
+        uint32_t size = tableSizes[sizeIdx ++];
+        snprintf(name, sizeof(name), "micro/getIndexFromSymbolTable/%u", size);
+        if (!benchSelected(opts, name)) {
+            continue;
+        }
+
+        VM *vm = newVM();
+        SymbolTable table;
+        StringBufferInit(&table);
+        uint32_t idx = 0;
+        while (idx < size) {
+            int len = snprintf(buf, sizeof(buf), "method%u(_,_)", idx);
+            addSymbol(vm, &table, buf, (uint32_t)len);
+            idx ++;
+        }
+
+        // 按固定步长遍历各符号，使命中位置均匀分布
+        timerStart(&timer, vm);
+        int hits = 0;
+        idx = 0;
+        while (idx < n) {
+            String *symbol = &table.datas[(idx * 7919) % size];
+            hits += getIndexFromSymbolTable(&table, symbol->str, symbol->length) >= 0;
+            idx ++;
+        }
+        timerReport(&timer, name, n);
+        ASSERT(hits == (int)n, "symbol lookup missed!");
+        symbolTableClear(vm, &table);
+        freeVM(vm);
+    }
+}
+
+/**
+ * 读取目录下全部.sp脚本并拼接，用作词法分析的语料
+ * @param dir
+ * @return
+ */
+static char* loadCorpus(const char *dir) {
+    CharBuffer corpus;
+    CharBufferInit(&corpus);
+    VM *vm = newVM();
+
+    DIR *dirp = opendir(dir);
+    if (dirp != NULL) {
+        struct dirent *entry;
+        char path[MAX_BENCH_PATH_LEN];
+        while ((entry = readdir(dirp)) != NULL) {
+            const char *dot = strrchr(entry->d_name, '.');
+            if (dot == NULL || strcmp(dot, ".sp") != 0) {
+                continue;
+            }
+            snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+            char *source = readFile(path);
+            uint32_t len = strlen(source);
+            uint32_t idx = 0;
+            while (idx < len) {
+                CharBufferAdd(vm, &corpus, source[idx ++]);
+            }
+            CharBufferAdd(vm, &corpus, '\n');
+            free(source);
+        }
+        closedir(dirp);
+    }
+    CharBufferAdd(vm, &corpus, '\0');
+    // 语料由malloc分配，vm释放后仍可用
+    freeVM(vm);
+    return corpus.datas;
+}
+
+static void benchLexer(BenchOptions *opts) {
+    if (!benchSelected(opts, "micro/lexer")) {
+        return;
+    }
+
+    char *corpus = loadCorpus(opts->scriptsDir);
+    uint32_t rounds = 20 * opts->scale;
+    VM *vm = newVM();
+    BenchTimer timer;
+    uint64_t tokens = 0;
+
+    timerStart(&timer, vm);
+    uint32_t round = 0;
+    while (round < rounds) {
+        Parser parser;
+        initParser(vm, &parser, "lexer", corpus, NULL);
+        getNextToken(&parser);
+        while (parser.curToken.type != TOKEN_EOF) {
+            tokens ++;
+            getNextToken(&parser);
+        }
+        round ++;
+    }
+    timerReport(&timer, "micro/lexer/token", tokens);
+    free(corpus);
+    freeVM(vm);
+}
+
+/***********************************************************************************************
+ ********************************* 宏基准 ********************************************************
+ ***********************************************************************************************/
+
+/**
+ * 执行脚本语料中的每个.sp文件，每个脚本使用独立的虚拟机
+ * @param opts
+ */
+static void benchScripts(BenchOptions *opts) {
+    DIR *dirp = opendir(opts->scriptsDir);
+    if (dirp == NULL) {
+        IO_ERROR("Could'n open benchmark directory \"%s\".", opts->scriptsDir);
+    }
+
+    // 模块导入以脚本所在目录为根目录
+    char *root = (char *)malloc(strlen(opts->scriptsDir) + 2);
+    sprintf(root, "%s/", opts->scriptsDir);
+    rootDir = root;
+
+    struct dirent *entry;
+    char path[MAX_BENCH_PATH_LEN];
+    char name[MAX_BENCH_PATH_LEN];
+    while ((entry = readdir(dirp)) != NULL) {
+        const char *dot = strrchr(entry->d_name, '.');
+        if (dot == NULL || strcmp(dot, ".sp") != 0) {
+            continue;
+        }
+        snprintf(name, sizeof(name), "script/%.*s", (int)(dot - entry->d_name), entry->d_name);
+        if (!benchSelected(opts, name)) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", opts->scriptsDir, entry->d_name);
+
+        char *sourceCode = readFile(path);
+        VM *vm = newVM();
+        BenchTimer timer;
+        timerStart(&timer, vm);
+        executeModule(vm, OBJ_TO_VALUE(newObjString(vm, path, strlen(path))), sourceCode);
+        timerReport(&timer, name, 1);
+        freeVM(vm);
+        free(sourceCode);
+    }
+    closedir(dirp);
+    rootDir = NULL;
+    free(root);
+}
+
+/***********************************************************************************************
+ ********************************* 编译基准 ******************************************************
+ ***********************************************************************************************/
+
+/**
+ * 生成约targetBytes字节的模块源码
+ * 函数、类及方法签名的数量随源码规模线性增长，签名数不超过GEN_MAX_SIGNATURES
+ * @param vm
+ * @param targetBytes
+ * @param buf
+ */
+static void generateModule(VM *vm, uint32_t targetBytes, CharBuffer *buf) {
+    char line[256];
+    uint32_t unit = 0;
+    uint32_t signature = 0;
+
+    while (buf->count < targetBytes) {
+        int len = snprintf(line, sizeof(line),
+                           "fun fn%u(a, b) {\n"
+                           "    var x = a + b * %u\n"
+                           "    if (x > 10) return x - 1\n"
+                           "    return \"s%u\"\n"
+                           "}\n"
+                           "class C%u {\n"
+                           "    var f\n"
+                           "    new(a) {\n"
+                           "        f = a\n"
+                           "    }\n",
+                           unit, unit, unit, unit);
+        uint32_t idx = 0;
+        while (idx < (uint32_t)len) {
+            CharBufferAdd(vm, buf, line[idx ++]);
+        }
+
+        uint32_t method = 0;
+        while (method < GEN_METHODS_PER_CLASS) {
+            len = snprintf(line, sizeof(line),
+                           "    m%u(a, b) {\n"
+                           "        return f + a * b + %u\n"
+                           "    }\n",
+                           signature, method);
+            signature = (signature + 1) % GEN_MAX_SIGNATURES;
+            idx = 0;
+            while (idx < (uint32_t)len) {
+                CharBufferAdd(vm, buf, line[idx ++]);
+            }
+            method ++;
+        }
+        CharBufferAdd(vm, buf, '}');
+        CharBufferAdd(vm, buf, '\n');
+        unit ++;
+    }
+    CharBufferAdd(vm, buf, '\0');
+}
+
+/**
+ * 新建名为generated的模块，与loadModule一致，新模块先继承核心模块的变量
+ * @param vm
+ * @return
+ */
+static ObjModule* newGeneratedModule(VM *vm) {
+    ObjModule *module = newObjModule(vm, "generated");
+    ObjModule *coreModule = VALUE_TO_OBJMODULE(mapGet(vm, vm->allModules, VT_TO_VALUE(VT_NULL)));
+    uint32_t idx = 0;
+    while (idx < coreModule->moduleVarName.count) {
+        defineModuleVar(vm, module, coreModule->moduleVarName.datas[idx].str,
+                        coreModule->moduleVarName.datas[idx].length,
+                        coreModule->moduelVarValue.datas[idx]);
+        idx ++;
+    }
+    return module;
+}
+
+static void benchCompile(BenchOptions *opts) {
+    static const uint32_t sizes[] = {
+        1u << 10, 10u << 10, 100u << 10, 1u << 20, 10u << 20, 100u << 20
+    };
+    char name[64];
+
+    uint32_t sizeIdx = 0;
+    while (sizeIdx < sizeof(sizes) / sizeof(sizes[0])) {
+        uint32_t size = sizes[sizeIdx ++];
+        if (size > opts->compileMaxBytes) {
+            break;
+        }
+        snprintf(name, sizeof(name), "compile/%uKB", size >> 10);
+        if (!benchSelected(opts, name)) {
+            continue;
+        }
+
+        VM *vm = newVM();
+        CharBuffer source;
+        CharBufferInit(&source);
+        generateModule(vm, size, &source);
+
+        ObjModule *module = newGeneratedModule(vm);
+
+        vm->compileStats.enabled = true;
+        BenchTimer timer;
+        timerStart(&timer, vm);
+        compileModule(vm, module, source.datas);
+        // 统计词法分析时单独扫描的耗时不计入totalNs
+        uint64_t elapsed = vm->compileStats.totalNs;
+
+        CompileStats *stats = &vm->compileStats;
+        uint64_t otherNs = stats->lexNs + stats->symbolNs;
+        printf("{\"name\":\"%s\",\"source_bytes\":%llu,\"ns\":%llu,\"mb_per_s\":%.3f,"
+               "\"lex_ns\":%llu,\"parse_codegen_ns\":%llu,\"symbol_ns\":%llu,\"tokens\":%llu,"
+               "\"constants\":%llu,\"constant_pool_grows\":%llu,\"constant_pool_grow_bytes\":%llu,"
+               "\"allocs\":%llu,\"peak_rss_kb\":%ld}\n",
+               name,
+               (unsigned long long)stats->sourceBytes,
+               (unsigned long long)elapsed,
+               elapsed > 0 ? (stats->sourceBytes / 1048576.0) / (elapsed / 1e9) : 0.0,
+               (unsigned long long)stats->lexNs,
+               (unsigned long long)(stats->totalNs > otherNs ? stats->totalNs - otherNs : 0),
+               (unsigned long long)stats->symbolNs,
+               (unsigned long long)stats->tokenNum,
+               (unsigned long long)stats->constantNum,
+               (unsigned long long)stats->constantGrowNum,
+               (unsigned long long)stats->constantGrowBytes,
+               (unsigned long long)(vm->allocatedNum - timer.startAllocatedNum),
+               peakRssKb());
+        fflush(stdout);
+        CharBufferClear(vm, &source);
+        freeVM(vm);
+    }
+}
+
+/**
+ * 生成GEN_MODULE_NUM个相互import的模块文件，分别用1个及全部cpu核并行编译
+ * @param opts
+ */
+static void benchCompileModules(BenchOptions *opts) {
+    if (!benchSelected(opts, "compile/modules")) {
+        return;
+    }
+
+    char dir[] = "/tmp/sparrow-bench-XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        IO_ERROR("Could'n create module directory.");
+    }
+    char *root = (char *)malloc(strlen(dir) + 2);
+    sprintf(root, "%s/", dir);
+    rootDir = root;
+
+    // 模块m_i导入m_2i+1及m_2i+2，构成一棵二叉树
+    VM *genVm = newVM();
+    char path[MAX_BENCH_PATH_LEN];
+    char line[64];
+    CharBuffer rootSource;
+    uint32_t moduleIdx = 0;
+    while (moduleIdx < GEN_MODULE_NUM) {
+        CharBuffer source;
+        CharBufferInit(&source);
+        uint32_t child = moduleIdx * 2 + 1;
+        while (child < GEN_MODULE_NUM && child <= moduleIdx * 2 + 2) {
+            int len = snprintf(line, sizeof(line), "import m%u\n", child);
+            uint32_t idx = 0;
+            while (idx < (uint32_t)len) {
+                CharBufferAdd(genVm, &source, line[idx ++]);
+            }
+            child ++;
+        }
+        generateModule(genVm, GEN_MODULE_BYTES, &source);
+        if (moduleIdx == 0) {
+            rootSource = source;
+        }
+        else {
+            snprintf(path, sizeof(path), "%sm%u.sp", root, moduleIdx);
+            FILE *file = fopen(path, "w");
+            if (file == NULL) {
+                IO_ERROR("Could'n write module \"%s\".", path);
+            }
+            fputs(source.datas, file);
+            fclose(file);
+            CharBufferClear(genVm, &source);
+        }
+        moduleIdx ++;
+    }
+
+    uint32_t threadNums[2] = {1, (uint32_t)sysconf(_SC_NPROCESSORS_ONLN)};
+    uint32_t run = 0;
+    while (run < 2) {
+        VM *vm = newVM();
+        BenchTimer timer;
+        timerStart(&timer, vm);
+        uint32_t moduleNum = preloadModules(vm, "m0", rootSource.datas, threadNums[run]);
+        char name[64];
+        snprintf(name, sizeof(name), "compile/modules/threads%u", threadNums[run]);
+        timerReport(&timer, name, moduleNum);
+        freeVM(vm);
+        run ++;
+    }
+
+    moduleIdx = 1;
+    while (moduleIdx < GEN_MODULE_NUM) {
+        snprintf(path, sizeof(path), "%sm%u.sp", root, moduleIdx);
+        unlink(path);
+        moduleIdx ++;
+    }
+    rmdir(dir);
+    CharBufferClear(genVm, &rootSource);
+    freeVM(genVm);
+    rootDir = NULL;
+    free(root);
+}
+
+/**
+ * 统计fn及其常量中的函数的指令字节数，force为真时先编译尚未编译的函数体
+ * @param vm
+ * @param fn
+ * @param force
+ * @param lazyNum 累加尚未编译的函数个数
+ * @return
+ */
+static uint64_t sumInstrBytes(VM *vm, ObjFn *fn, bool force, uint32_t *lazyNum) {
+    if (fn->lazyBody != NULL) {
+        (*lazyNum) ++;
+        if (force) {
+            compileLazyFn(vm, fn);
+        }
+    }
+    uint64_t bytes = fn->instrStream.count;
+    uint32_t idx = 0;
+    while (idx < fn->constants.count) {
+        Value constant = fn->constants.datas[idx ++];
+        if (VALUE_IS_CREATIN_OBJ(constant, OT_FUNCTION)) {
+            bytes += sumInstrBytes(vm, VALUE_TO_OBJFN(constant), force, lazyNum);
+        }
+    }
+    return bytes;
+}
+
+/**
+ * 分别立即编译及延迟编译同一模块，比较编译耗时及分配量
+ * @param opts
+ */
+static void benchCompileLazy(BenchOptions *opts) {
+    if (!benchSelected(opts, "compile/lazy")) {
+        return;
+    }
+    uint32_t size = opts->compileMaxBytes < (1u << 20) ? opts->compileMaxBytes : (1u << 20);
+
+    uint32_t run = 0;
+    while (run < 2) {
+        VM *vm = newVM();
+        vm->lazyCompile = run == 1;
+        CharBuffer source;
+        CharBufferInit(&source);
+        generateModule(vm, size, &source);
+        ObjModule *module = newGeneratedModule(vm);
+
+        BenchTimer timer;
+        timerStart(&timer, vm);
+        ObjFn *fn = compileModule(vm, module, source.datas);
+        timerReport(&timer, run == 0 ? "compile/lazy/eager" : "compile/lazy/deferred", 1);
+
+        // 延迟编译的函数体用到时才编译，计入其字节数以便与立即编译对照
+        uint32_t lazyNum = 0;
+        uint64_t instrBytes = sumInstrBytes(vm, fn, true, &lazyNum);
+        printf("{\"name\":\"%s/instr\",\"instr_bytes\":%llu,\"lazy_bodies\":%u}\n",
+               run == 0 ? "compile/lazy/eager" : "compile/lazy/deferred",
+               (unsigned long long)instrBytes, lazyNum);
+        fflush(stdout);
+        CharBufferClear(vm, &source);
+        freeVM(vm);
+        run ++;
+    }
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [--filter name] [--scripts-dir dir] [--scale n] [--compile-max-bytes n]\n"
+            "          [--micro-only] [--scripts-only] [--compile-only]\n",
+            prog);
+    exit(1);
+}
+
+int main(int argc, const char **argv) {
+    BenchOptions opts = {NULL, DEFAULT_SCRIPTS_DIR, 1, DEFAULT_COMPILE_MAX_BYTES, true, true, true};
+
+    int idx = 1;
+    while (idx < argc) {
+        if (strcmp(argv[idx], "--filter") == 0 && idx + 1 < argc) {
+            opts.filter = argv[++ idx];
+        }
+        else if (strcmp(argv[idx], "--scripts-dir") == 0 && idx + 1 < argc) {
+            opts.scriptsDir = argv[++ idx];
+        }
+        else if (strcmp(argv[idx], "--scale") == 0 && idx + 1 < argc) {
+            opts.scale = (uint32_t)atoi(argv[++ idx]);
+            if (opts.scale == 0) {
+                usage(argv[0]);
+            }
+        }
+        else if (strcmp(argv[idx], "--compile-max-bytes") == 0 && idx + 1 < argc) {
+            opts.compileMaxBytes = (uint32_t)strtoul(argv[++ idx], NULL, 10);
+        }
+        else if (strcmp(argv[idx], "--micro-only") == 0) {
+            opts.runScripts = opts.runCompile = false;
+        }
+        else if (strcmp(argv[idx], "--scripts-only") == 0) {
+            opts.runMicro = opts.runCompile = false;
+        }
+        else if (strcmp(argv[idx], "--compile-only") == 0) {
+            opts.runMicro = opts.runScripts = false;
+        }
+        else {
+            usage(argv[0]);
+        }
+        idx ++;
+    }
+
+    if (opts.runMicro) {
+        benchMap(&opts);
+        benchMapOrder(&opts);
+        benchMapReserve(&opts);
+        benchMapGroupBy(&opts);
+        benchSet(&opts);
+        benchString(&opts);
+        benchList(&opts);
+        benchSort(&opts);
+        benchTypedArray(&opts);
+        benchRange(&opts);
+        benchPersistent(&opts);
+        benchArena(&opts);
+        benchThread(&opts);
+        benchIo(&opts);
+        benchMessage(&opts);
+        benchShared(&opts);
+        benchChannel(&opts);
+        benchSymbolTable(&opts);
+        benchLexer(&opts);
+    }
+    if (opts.runCompile) {
+        benchCompile(&opts);
+        benchCompileModules(&opts);
+        benchCompileLazy(&opts);
+    }
+    if (opts.runScripts) {
+        benchScripts(&opts);
+    }
+    return 0;
+}
@@ -6,9 +6,10 @@
 #include "../vm/vm.h"
 #include "../vm/core.h"
 #include "../object/class.h"
+#include "../vm/preload.h"
 
 
-static void runFile(const char *path) {
+static VMResult runFile(const char *path, bool compileStats, uint32_t jobs, bool lazy) {
     const char *lastSlash = strrchr(path, '/');
     if (lastSlash != NULL) {  // 设置脚本文件的根目录
         char *root = (char *)malloc(lastSlash - path + 2);
@@ -20,7 +21,17 @@ static void runFile(const char *path) {
     VM *vm = newVM();
     const char *sourceCode = readFile(path);
 
-    executeModule(vm, OBJ_TO_VALUE(newObjString(vm, path, strlen(path))), sourceCode);
+    vm->compileStats.enabled = compileStats;
+    vm->lazyCompile = lazy;
+    if (jobs > 1) {
+        // 先并行编译脚本import的全部模块
+        preloadModules(vm, path, sourceCode, jobs);
+    }
+    VMResult result = executeModule(vm, OBJ_TO_VALUE(newObjString(vm, path, strlen(path))), sourceCode);
+    if (compileStats) {
+        dumpCompileStats(vm, stderr);
+    }
+    return result;
 
     // struct parser parser;
     // initParser(vm, &parser, path, sourceCode, NULL);
@@ -43,9 +54,36 @@ int main(int argc, const char **argv) {
         ;
     }
     else {
-        printf("%s\n", argv[0]);
-        printf("%s\n", argv[1]);
-        runFile(argv[1]);
+        // --compile-stats: 编译结束后输出各阶段耗时
+        // --jobs n: 用n个线程并行编译脚本import的模块
+        // --lazy: 函数及方法体在首次调用时才编译
+        bool compileStats = false;
+        bool lazy = false;
+        uint32_t jobs = 1;
+        int argIdx = 1;
+        while (argIdx < argc && argv[argIdx][0] == '-') {
+            if (strcmp(argv[argIdx], "--compile-stats") == 0) {
+                compileStats = true;
+            }
+            else if (strcmp(argv[argIdx], "--jobs") == 0 && argIdx + 1 < argc) {
+                jobs = (uint32_t)atoi(argv[++ argIdx]);
+            }
+            else if (strcmp(argv[argIdx], "--lazy") == 0) {
+                lazy = true;
+            }
+            else {
+                break;
+            }
+            argIdx ++;
+        }
+        if (argIdx >= argc) {
+            fprintf(stderr, "usage: %s [--compile-stats] [--jobs n] [--lazy] file\n", argv[0]);
+            return 1;
+        }
+        // 运行出错时以非0值退出，便于脚本及测试判断
+        if (runFile(argv[argIdx], compileStats, jobs, lazy) != VM_RESULT_SUCCESS) {
+            return 1;
+        }
     }
     return 0;
 }
@@ -2,6 +2,9 @@
 
 #define __SPARROW_CLI_H__
 
-static void runFile(const char *path);
+#include "../include/common.h"
+#include "../vm/vm.h"
+
+static VMResult runFile(const char *path, bool compileStats, uint32_t jobs, bool lazy);
 
 #endif // !__SPARROW_CLI_H__
\ No newline at end of file
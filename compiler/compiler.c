@@ -5,6 +5,7 @@
 #include "../parser/parser.h"
 #include "../vm/core.h"
 #include "../object/class.h"
+#include "../vm/arena.h"
 
 #include <string.h>
 
@@ -43,22 +44,260 @@ struct compileUnit {
 
 }; // 编译单元
 
+typedef struct lazyBody {
+    const char *file;
+    const char *bodyStart; // 函数体中第一个token的起始地址，指向模块保留的源码
+    uint32_t lineNo;
+    LocalVar localVars[MAX_ARG_NUM + 1]; // 第0个为this或空位，其后为形参
+    uint32_t localVarNum;
+    bool isMethod;
+    bool isConstruct;
+    bool inStatic;
+    Signature signature; // 方法的签名，编译super调用时用到
+    ClassBookKeep *classBK; // 方法所属类的副本，函数为NULL
+    Class *class; // 绑定方法时记下所属的类，编译后据此修正操作数
+} LazyBody;  // 延迟编译的函数体
+
+typedef enum {
+    BP_NONE, // 无绑定能力
+
+    // 从上到下，优先级越来越高
+    BP_LOWEST, // 最低绑定能力
+    BP_ASSIGN, // =
+    BP_CONDITION, // ?:
+    BP_LOGIC_OR, // ||
+    BP_LOGIC_AND, // &&
+    BP_EQUAL, // == !=
+    BP_IS, // is
+    BP_CMP, // < >  <= >=
+    BP_BIT_OR, // |
+    BP_BIT_AND, // &
+    BP_BIT_SHIFT, // << >>
+    BP_RANGE, // ..
+    BP_TERM, // + -
+    BP_FACTOR, // * / %
+    BP_UNARY, // - ! ~
+    BP_CALL, // .() []
+    BP_HIGHEST
+} BindPower; // 定义了操作符的绑定权值，即优先级
+
+// 指示符函数指针
+typedef void (*DenotationFn) (CompileUnit *CU, bool canAssign);
+
+// 签名函数指针
+typedef void (*methodSignatureFn) (CompileUnit *cu, Signature *signature);
+
+typedef struct {
+    const char *id; // 符号
+
+    // 左绑定权值，不关注左边操作数的符号此值为0
+    BindPower lbp;
+
+    //字面量，变量，前缀运算符等不关注左操作符的Token调用的方法
+    DenotationFn nud;
+
+    // 中缀运算符等关注左操作数的Token调用方法
+    DenotationFn led;
+
+    // 表示本符号在类中被视为一个方法
+    // 为其生成一个方法签名
+    methodSignatureFn methodSign;
+
+} SymbolBindRule; // 符号绑定规则
+
+static void initCompileUint(Parser *parser, CompileUnit *cu, CompileUnit *enclosingUnit, bool isMethod);
+static int writeByte(CompileUnit *cu, int byte);
+static void writeOpCode(CompileUnit *cu, OpCode opCode);
+static int writeByteOperand(CompileUnit *cu, int operand);
+inline static void writeShortOperand(CompileUnit *cu, int operand);
+static int writeOpCodeByteOperand(CompileUnit *cu, OpCode opCode, int operand);
+static void writeOpCodeShortOperand(CompileUnit *cu, OpCode opCode, int operand);
+static uint32_t addConstant(CompileUnit *cu, Value constant);
+static void emitLoadConstant(CompileUnit *cu, Value value);
+static void literal(CompileUnit *cu, bool canAssign UNUSED);
+static uint32_t sign2String(Signature *sign, char *buf);
+static void expression(CompileUnit *cu, BindPower rbp);
+static void emitCallBySignature(CompileUnit *cu, Signature *sign, OpCode opcode);
+static void emitCall(CompileUnit *cu, int numArgs, const char *name, int length);
+static void infixOperator(CompileUnit *cu, bool canAssign UNUSED);
+static void unaryOperator(CompileUnit *cu, bool canAssign UNUSED);
+static uint32_t addLocalVar(CompileUnit *cu, const char *name, uint32_t length);
+static int declareLocalVar(CompileUnit *cu, const char *name, uint32_t length);
+static int declareVariable(CompileUnit *cu, const char *name, uint32_t length);
+static void unaryMethodSignature(CompileUnit *cu UNUSED, Signature *sign UNUSED);
+static void infixMethodSignature(CompileUnit *cu, Signature *sign);
+static void mixMethodSignature(CompileUnit *cu, Signature *sign);
+static int declareModuleVar(VM *vm, ObjModule *objModule, const char *name, uint32_t length, Value value);
+static CompileUnit* getEnclosingBKUnit(CompileUnit *cu);
+static ClassBookKeep* getEnclosingClassBK(CompileUnit *cu);
+static void processArgList(CompileUnit *cu, Signature *sign);
+static void processParaList(CompileUnit *cu, Signature *sign);
+static bool trySetter(CompileUnit *cu, Signature *sign);
+static void idMethodSignature(CompileUnit *cu, Signature *sign);
+static int findLocal(CompileUnit *cu, const char *name, uint32_t length);
+static int addUpvalue(CompileUnit *cu, bool isEnclosingLocalVar, uint32_t index);
+static int findUpvalue(CompileUnit *cu, const char *name, uint32_t length);
+static Variable getVarFromLocalOrUpvalue(CompileUnit *cu, const char *name, uint32_t length);
+static void emitLoadVariable(CompileUnit *cu, Variable var);
+static void emitStoreVariable(CompileUnit *cu, Variable var);
+static void emitLoadOrStoreVariable(CompileUnit *cu, bool canAssign, Variable var);
+static void emitLoadThis(CompileUnit *cu);
+static void compileBlock(CompileUnit *cu);
+static void compileBody(CompileUnit *cu, bool isConstruct);
+#if DEBUG
+static ObjFn* endCompileUnit(CompileUnit *cu, const char *debugName, uint32_t debugNameLen);
+#else
+static ObjFn* endCompileUnit(CompileUnit *cu);
+#endif
+static void emitGetterMethodCall(CompileUnit *cu, Signature *sign, OpCode opCode);
+static void emitMethodCall(CompileUnit *cu, const char *name, uint32_t length, OpCode opCode, bool canAssign);
+static bool isLocalName(const char *name);
+static void id(CompileUnit *cu, bool canAssign);
+static void emitLoadModuleVar(CompileUnit *cu, const char *name);
+static void stringInterpolation(CompileUnit *cu, bool canAssign UNUSED);
+static void boolean(CompileUnit *cu, bool canAssign UNUSED);
+static void null(CompileUnit *cu, bool canAssign UNUSED);
+static void this(CompileUnit *cu, bool canAssign UNUSED);
+static void super(CompileUnit *cu, bool canAssign);
+static void parentheses(CompileUnit *cu, bool canAssign UNUSED);
+static void listLiteral(CompileUnit *cu, bool canAssign UNUSED);
+static void subscript(CompileUnit *cu, bool canAssign);
+static void subscriptMethodSignature(CompileUnit *cu, Signature *sign);
+static void callEntry(CompileUnit *cu, bool canAssign);
+static void mapLiteral(CompileUnit *cu, bool canAssign UNUSED);
+static uint32_t emitInstrWithPlaceholder(CompileUnit *cu, OpCode opCode);
+static void patchPlaceholder(CompileUnit *cu, uint32_t absIndex);
+static void logicOr(CompileUnit *cu, bool canAssign UNUSED);
+static void logicAnd(CompileUnit *cu, bool canAssign UNUSED);
+static void condition(CompileUnit *cu, bool canAssign UNUSED);
+static void compileDefinition(CompileUnit *cu, bool isStatic);
+static void compileIfStatement(CompileUnit *cu);
+static void compileStatement(CompileUnit *cu);
+static void enterLoopSetting(CompileUnit *cu, Loop *loop);
+static void compileLoopBody(CompileUnit *cu);
+static void leaveLoopPatch(CompileUnit *cu);
+static void compileWhileStatment(CompileUnit *cu);
+static uint32_t discardLocalVar(CompileUnit *cu, int scopeDepth);
+inline static void compileReturn(CompileUnit *cu);
+inline static void compileBreak(CompileUnit *cu);
+inline static void compileContinue(CompileUnit *cu);
+static void enterScope(CompileUnit *cu);
+static void leaveScope(CompileUnit *cu);
+static void compileForStatment(CompileUnit *cu);
+static void emitStoreModuleVar(CompileUnit *cu, int index);
+static int declareMethod(CompileUnit *cu, char *signStr, uint32_t length);
+static void defineMethod(CompileUnit *cu, Variable classVar, bool isStatic, int methodIndex);
+static void emitCreateInstance(CompileUnit *cu, Signature *sign, uint32_t constructorIndex);
+static void compileMethod(CompileUnit *cu, Variable classVar, bool isStatic);
+static void compileClassBody(CompileUnit *cu, Variable classVar);
+static void compileClassDefinition(CompileUnit *cu);
+static void compileFunctionDefinition(CompileUnit *cu);
+static void compileImport(CompileUnit *cu);
+static Variable findVariable(CompileUnit *cu, const char *name, uint32_t length);
+static void defineVariable(CompileUnit *cu, uint32_t index);
+static void compileProgram(CompileUnit *cu);
+
+//不关注左操作符的符号称为前缀符号
+// 用于如字面量、变量名，前缀符合等非运算符
+#define PREFIX_SYMBOL(nud) {NULL, BP_NONE, nud, NULL, NULL}
+
+// 前缀运算符，如！
+#define PREFIX_OPERATOR(id) {id, BP_NONE, unaryOperator, NULL, unaryMethodSignature}
+
+// 关注左操作数的符合称为中缀符合
+// 数组[,函数(
+#define INFIX_SYMBOL(lbp, led) {NULL, lbp, NULL, led, NULL}
+
+// 中缀运算符
+#define INFIX_OPERATOR(id, lbp) {id, lbp, NULL, infixOperator, infixMethodSignature}
+
+// 即可做前缀又可做中缀的运算符，如-
+#define MIX_OPERATOR(id) {id, BP_TERM, unaryOperator, infixOperator, mixMethodSignature}
+
+// 占位用
+#define UNUSED_RULE {NULL, BP_NONE, NULL, NULL, NULL}
+
+SymbolBindRule Rules[] = {
+        /* TOKEN_UNKNOWN */ UNUSED_RULE,
+        /* TOKEN_NUM */ PREFIX_SYMBOL(literal),
+        /* TOKEN_STRING */ PREFIX_SYMBOL(literal),
+        /* TOKEN_ID */ {NULL, BP_NONE, id, NULL, idMethodSignature},
+        /* TOKEN_INTERPOLATION */ PREFIX_SYMBOL(stringInterpolation),
+        /* TOKEN_VAR */ UNUSED_RULE,
+        /* TOKEN_FUN */ UNUSED_RULE,
+        /* TOKEN_IF */ UNUSED_RULE,
+        /* TOKEN_ELSE */ UNUSED_RULE,
+        /* TOKEN_TRUE */ PREFIX_SYMBOL(boolean),
+        /* TOKEN_FALSE */ PREFIX_SYMBOL(boolean),
+        /* TOKEN_WHILE */ UNUSED_RULE,
+        /* TOKEN_FOR */ UNUSED_RULE,
+        /* TOKEN_BREAK */ UNUSED_RULE,
+        /* TOKEN_CONTINUE */ UNUSED_RULE,
+        /* TOKEN_RETURN */ UNUSED_RULE,
+        /* TOKEN_NULL */ PREFIX_SYMBOL(null),
+        /* TOKEN_CLASS */ UNUSED_RULE,
+        /* TOKEN_THIS */ PREFIX_SYMBOL(this),
+        /* TOKEN_STATIC */ UNUSED_RULE,
+        /* TOKEN_IS */ INFIX_OPERATOR("is", BP_IS),
+        /* TOKEN_SUPER */ PREFIX_SYMBOL(super),
+        /* TOKEN_IMPORT */ UNUSED_RULE,
+        /* TOKEN_COMMA */ UNUSED_RULE,
+        /* TOKEN_COLON */ UNUSED_RULE,
+        /* TOKEN_LEFT_PAREN */ PREFIX_SYMBOL(parentheses),
+        /* TOKEN_RIGHT_PAREN */ UNUSED_RULE,
+        /* TOKEN_LEFT_BRACKET */ {NULL, BP_CALL, listLiteral, subscript, subscriptMethodSignature},
+        /* TOKEN_RIGHT_BRACKET */ UNUSED_RULE,
+        /* TOKEN_LEFT_BRACE */ PREFIX_SYMBOL(mapLiteral),
+        /* TOKEN_RIGHT_BRACE */ UNUSED_RULE,
+        /* TOKEN_DOT */ INFIX_SYMBOL(BP_CALL, callEntry),
+        /* TOKEN_DOT_DOT */ INFIX_OPERATOR("..", BP_RANGE),
+        /* TOKEN_ADD */ INFIX_OPERATOR("+", BP_TERM),
+        /* TOKEN_SUB */ MIX_OPERATOR("-"),
+        /* TOKEN_MUL */ INFIX_OPERATOR("*", BP_FACTOR),
+        /* TOKEN_DIV */ INFIX_OPERATOR("/", BP_FACTOR),
+        /* TOKEN_MOD */ INFIX_OPERATOR("%", BP_FACTOR),
+        /* TOKEN_ASSIGN */ UNUSED_RULE,
+        /* TOKEN_BIT_AND */ INFIX_OPERATOR("&", BP_BIT_AND),
+        /* TOKEN_BIT_OR */ INFIX_OPERATOR("|", BP_BIT_OR),
+        /* TOKEN_BIT_NOT */ PREFIX_OPERATOR("~"),
+        /* TOKEN_BIT_SHIFT_RIGHT */ INFIX_OPERATOR(">>", BP_BIT_SHIFT),
+        /* TOKEN_BIT_SHIFT_LEFT */ INFIX_OPERATOR("<<", BP_BIT_SHIFT),
+        /* TOKEN_LOGIC_AND */ INFIX_SYMBOL(BP_LOGIC_AND, logicAnd),
+        /* TOKEN_LOGIC_OR */ INFIX_SYMBOL(BP_LOGIC_OR, logicOr),
+        /* TOKEN_LOGIC_NOT */ PREFIX_OPERATOR("!"),
+        /* TOKEN_EQUAL */ INFIX_OPERATOR("==", BP_EQUAL),
+        /* TOKEN_NOT_EQUAL */ INFIX_OPERATOR("!=", BP_EQUAL),
+        /* TOKEN_GREATE */ INFIX_OPERATOR(">", BP_CMP),
+        /* TOKEN_GREATE_EQUAL */ INFIX_OPERATOR(">=", BP_CMP),
+        /* TOKEN_LESS */ INFIX_OPERATOR("<", BP_CMP),
+        /* TOKEN_LESS_EQUAL */ INFIX_OPERATOR("<=", BP_CMP),
+        /* TOKEN_QUESTION */ INFIX_SYMBOL(BP_ASSIGN, condition),
+        /* TOKEN_EOF */ UNUSED_RULE
+}; // 按TokenType索引的符号绑定规则
+
+
 int defineModuleVar(VM *vm, ObjModule *objModule,
                     const char *name,
                     uint32_t length,
                     Value value) {
     if (length > MAX_ID_LEN) {
-        char id[MAX_ID_LEN] = {'\0'};
-        memcpy(id, name, length);
+        // 只打印前MAX_ID_LEN个字符，不拷贝超长的标识符
         if (vm->curParser != NULL) {
-            COMPILE_ERROR(vm->curParser, "length of identifier \"%s\" should be no more than %d", id, MAX_ID_LEN);
+            COMPILE_ERROR(vm->curParser, "length of identifier \"%.*s\" should be no more than %d",
+                          MAX_ID_LEN, name, MAX_ID_LEN);
         }
         else {
-            MEM_ERROR("length of identifier \"%s\" should be no more than %d", id, MAX_ID_LEN);
+            MEM_ERROR("length of identifier \"%.*s\" should be no more than %d", MAX_ID_LEN, name, MAX_ID_LEN);
         }
     }
 
+    // 只统计编译期间的符号表耗时，loadModule继承核心模块变量时不计入
+    CompileStats *stats = &vm->compileStats;
+    bool timing = stats->enabled && vm->curParser != NULL;
+    uint64_t start = timing ? getNowNs() : 0;
+
     // 从模块变量名中查找变量，若不存在就添加
+    ARENA_REMEMBER(vm, objModule);
     int symbolIndex = getIndexFromSymbolTable(&objModule->moduleVarName, name, length);
     if (symbolIndex == - 1) {
         symbolIndex = addSymbol(vm, &objModule->moduleVarName, name, length);
@@ -71,17 +310,22 @@ int defineModuleVar(VM *vm, ObjModule *objModule,
         symbolIndex = -1; // 已定义则返回01，用于判断重定义
     }
 
+    if (timing) {
+        stats->symbolNs += getNowNs() - start;
+        stats->symbolCallNum ++;
+    }
     return symbolIndex;
 }
 
 /**
- * 初始化CompileUnit
+ * 初始化CompileUnit，指令写入fn
  * @param parser
  * @param cu
  * @param enclosingUnit
  * @param isMethod
+ * @param fn 为NULL时新建
  */
-static void initCompileUint(Parser *parser, CompileUnit *cu, CompileUnit *enclosingUnit, bool isMethod) {
+static void initCompileUnitWithFn(Parser *parser, CompileUnit *cu, CompileUnit *enclosingUnit, bool isMethod, ObjFn *fn) {
     parser->curCompileUnit = cu;
     cu->curParser = parser;
     cu->enclosingUnit = enclosingUnit;
@@ -119,7 +363,18 @@ static void initCompileUint(Parser *parser, CompileUnit *cu, CompileUnit *enclos
     // 局部变量保存在栈中，初始时栈中已使用的slot数量等于局部变量的数量
     cu->stackSlotNum = cu->localVarNum;
 
-    cu->fn = newObjFn(cu->curParser->vm, cu->curParser->curModule, cu->localVarNum);
+    cu->fn = fn != NULL ? fn : newObjFn(cu->curParser->vm, cu->curParser->curModule, cu->localVarNum);
+}
+
+/**
+ * 初始化CompileUnit
+ * @param parser
+ * @param cu
+ * @param enclosingUnit
+ * @param isMethod
+ */
+static void initCompileUint(Parser *parser, CompileUnit *cu, CompileUnit *enclosingUnit, bool isMethod) {
+    initCompileUnitWithFn(parser, cu, enclosingUnit, isMethod, NULL);
 }
 
 /**
@@ -181,7 +436,7 @@ inline static void writeShortOperand(CompileUnit *cu, int operand) {
  * @return
  */
 static int writeOpCodeByteOperand(CompileUnit *cu, OpCode opCode, int operand) {
-    writeByte(cu, opCode);
+    writeOpCode(cu, opCode);
     return writeByteOperand(cu, operand);
 }
 
@@ -193,7 +448,7 @@ static int writeOpCodeByteOperand(CompileUnit *cu, OpCode opCode, int operand) {
  * @return
  */
 static void writeOpCodeShortOperand(CompileUnit *cu, OpCode opCode, int operand) {
-    writeByte(cu, opCode);
+    writeOpCode(cu, opCode);
     writeShortOperand(cu, operand);
 }
 
@@ -205,6 +460,19 @@ static void writeOpCodeShortOperand(CompileUnit *cu, OpCode opCode, int operand)
  * @return
  */
 ObjFn* compileModule(VM *vm, ObjModule *objModule, const char *moduleCore) {
+    CompileStats *stats = &vm->compileStats;
+    uint64_t compileStart = stats->enabled ? getNowNs() : 0;
+    // 编译结果随vm存在，不在分配区域中
+    pauseArena(vm);
+
+    // 延迟编译的函数体在首次调用时才从源码编译，须保留一份源码
+    if (vm->lazyCompile) {
+        uint32_t sourceLen = strlen(moduleCore);
+        objModule->source = ALLOCATE_ARRAY(vm, char, sourceLen + 1);
+        memcpy(objModule->source, moduleCore, sourceLen + 1);
+        moduleCore = objModule->source;
+    }
+
     // 各源码模块文件需要单独的parser
     Parser parser;
     parser.parent = vm->curParser;
@@ -218,6 +486,11 @@ ObjFn* compileModule(VM *vm, ObjModule *objModule, const char *moduleCore) {
         initParser(vm, &parser, (const char *)objModule->name->value.start, moduleCore, objModule);
     }
 
+    if (stats->enabled) {
+        // 单独扫描的耗时不计入编译总耗时
+        compileStart += lexWholeModule(&parser);
+    }
+
     CompileUnit moduleCU;
     initCompileUint(&parser, &moduleCU, NULL, false);
 
@@ -227,42 +500,43 @@ ObjFn* compileModule(VM *vm, ObjModule *objModule, const char *moduleCore) {
     // 初始的parser->curToken.type为TOKEN_UNKNOWN，先使其指向第一个合法的token
     getNextToken(&parser);
 
-    // 此时compilerProgram为桩函数，并不会读进token，因此是死循环
     while (!matchToken(&parser, TOKEN_EOF)) {
         compileProgram(&moduleCU);
     }
 
-    // other
-}
+    // 模块编译完成，生成return null返回，避免执行到endCompileUnit中添加的END
+    writeOpCode(&moduleCU, OPCODE_PUSH_NULL);
+    writeOpCode(&moduleCU, OPCODE_RETURN);
 
-typedef enum {
-    BP_NONE, // 无绑定能力
+    // 检查在函数id中用行号声明的模块变量是否在引用之后有定义
+    uint32_t index = moduleVarNumBdfor;
+    while (index < objModule->moduelVarValue.count) {
+        if (VALUE_IS_NUM(objModule->moduelVarValue.datas[index])) {
+            char *str = objModule->moduleVarName.datas[index].str;
+            uint32_t lineNo = VALUE_TO_NUM(objModule->moduelVarValue.datas[index]);
+            COMPILE_ERROR(&parser, "line:%d, variable '%s' not defined!", lineNo, str);
+        }
+        index ++;
+    }
 
-    // 从上到下，优先级越来越高
-    BP_LOWEST, // 最低绑定能力
-    BP_ASSIGN, // =
-    BP_CONDITION, // ?:
-    BP_LOGIC_OR, // ||
-    BP_LOGIC_AND, // &&
-    BP_EQUAL, // == !=
-    BP_IS, // is
-    BP_CMP, // < >  <= >=
-    BP_BIT_OR, // |
-    BP_BIT_AND, // &
-    BP_BIT_SHIFT, // << >>
-    BP_RANGE, // ..
-    BP_TERM, // + -
-    BP_FACTOR, // * / %
-    BP_UNARY, // - ! ~
-    BP_CALL, // .() []
-    BP_HIGHEST
-} BindPower; // 定义了操作符的绑定权值，即优先级
+    // 编译完成后恢复外层parser
+    vm->curParser->curCompileUnit = NULL;
+    vm->curParser = vm->curParser->parent;
 
-// 指示符函数指针
-typedef void (*DenotationFn) (CompileUnit *CU, bool canAssign);
+#if DEBUG
+    ObjFn *fn = endCompileUnit(&moduleCU, "(script)", 8);
+#else
+    ObjFn *fn = endCompileUnit(&moduleCU);
+#endif
 
-// 签名函数指针
-typedef void (*methodSignatureFn) (CompileUnit *cu, Signature *signature);
+    if (stats->enabled) {
+        stats->totalNs += getNowNs() - compileStart;
+        stats->sourceBytes += strlen(moduleCore);
+        stats->moduleNum ++;
+    }
+    resumeArena(vm);
+    return fn;
+}
 
 /**
  * 添加常量并返回其索引
@@ -271,7 +545,17 @@ typedef void (*methodSignatureFn) (CompileUnit *cu, Signature *signature);
  * @return
  */
 static uint32_t addConstant(CompileUnit *cu, Value constant) {
+    uint32_t oldCapacity = cu->fn->constants.capacity;
     ValueBufferAdd(cu->curParser->vm, &cu->fn->constants, constant);
+
+    CompileStats *stats = &cu->curParser->vm->compileStats;
+    if (stats->enabled) {
+        stats->constantNum ++;
+        if (cu->fn->constants.capacity != oldCapacity) {
+            stats->constantGrowNum ++;
+            stats->constantGrowBytes += (cu->fn->constants.capacity - oldCapacity) * sizeof(Value);
+        }
+    }
     return cu->fn->constants.count - 1;
 }
 
@@ -517,9 +801,7 @@ static int declareLocalVar(CompileUnit *cu, const char *name, uint32_t length) {
         }
 
         if (var->length == length && memcmp(var->name, name, length) == 0) {
-            char id[MAX_ID_LEN] = {'\0'};
-            memcpy(id, name, length);
-            COMPILE_ERROR(cu->curParser, "identifier \"%s\" redefinition!", id);
+            COMPILE_ERROR(cu->curParser, "identifier \"%.*s\" redefinition!", (int) length, name);
         }
         idx --;
     }
@@ -539,11 +821,9 @@ static int declareVariable(CompileUnit *cu, const char *name, uint32_t length) {
     // 若当前是模块作用域就声明为模块变量
     if (cu->scopeDepth == -1) {
         int index = defineModuleVar(cu->curParser->vm,
-                                    cu->curParser->curModule, name, length, VT_TO_VALUE(VT_NUM));
+                                    cu->curParser->curModule, name, length, VT_TO_VALUE(VT_NULL));
         if (index == -1) {
-            char id[MAX_ID_LEN] = {'\0'};
-            memcpy(id, name, length);
-            COMPILE_ERROR(cu->curParser, "identifier \"%s\" redefinition!", id);
+            COMPILE_ERROR(cu->curParser, "identifier \"%.*s\" redefinition!", (int) length, name);
         }
         return index;
     }
@@ -585,7 +865,7 @@ static void infixMethodSignature(CompileUnit *cu, Signature *sign) {
  * @param cu
  * @param sign
  */
-static void mxMethodSignature(CompileUnit *cu, Signature *sign) {
+static void mixMethodSignature(CompileUnit *cu, Signature *sign) {
     // 假设是单运算符方法，因此默认为getter
     sign->type = SIGN_GETTER;
 
@@ -863,7 +1143,7 @@ static void emitLoadVariable(CompileUnit *cu, Variable var) {
             writeOpCodeByteOperand(cu, OPCODE_LOAD_UPVALUE, var.index);
             break;
         case VAR_SCOPE_MODULE:
-            writeOpCodeByteOperand(cu, OPCODE_LOAD_MODULE_VAR, var.index);
+            writeOpCodeShortOperand(cu, OPCODE_LOAD_MODULE_VAR, var.index);
             break;
         default:
             NOT_REACHED();
@@ -884,7 +1164,7 @@ static void emitStoreVariable(CompileUnit *cu, Variable var) {
             writeOpCodeByteOperand(cu, OPCODE_STORE_UPVALUE, var.index);
             break;
         case VAR_SCOPE_MODULE:
-            writeOpCodeByteOperand(cu, OPCODE_STORE_MODULE_VAR, var.index);
+            writeOpCodeShortOperand(cu, OPCODE_STORE_MODULE_VAR, var.index);
             break;
         default:
             NOT_REACHED();
@@ -956,7 +1236,7 @@ static void compileBody(CompileUnit *cu, bool isConstruct) {
  */
 #if DEBUG
 static ObjFn* endCompileUnit(CompileUnit *cu, const char *debugName, uint32_t debugNameLen) {
-        bindDebugFnName(cu->curParser->vm, cu->fn->debug,debugName, debugNameLen);
+        bindDebugFnName(cu->curParser->vm, &cu->fn->debug, debugName, debugNameLen);
 #else
 static ObjFn* endCompileUnit(CompileUnit *cu) {
 #endif
@@ -1163,7 +1443,7 @@ static void id(CompileUnit *cu, bool canAssign) {
 
                 // 如果当前正在编译类方法，则直接在该实例对象中加载field
                 if (cu->enclosingUnit != NULL) {
-                    writeOpCodeByteOperand(cu, isRead ? OPCODE_LOAD_THIS_FIELD : OPCODE_STORE_FIELD, fieldIndex);
+                    writeOpCodeByteOperand(cu, isRead ? OPCODE_LOAD_THIS_FIELD : OPCODE_STORE_THIS_FIELD, fieldIndex);
                 } else {
                     emitLoadThis(cu);
                     writeOpCodeByteOperand(cu, isRead ? OPCODE_LOAD_FIELD : OPCODE_STORE_FIELD, fieldIndex);
@@ -1234,12 +1514,6 @@ static void id(CompileUnit *cu, bool canAssign) {
     }
 }
 
-//SymbolBindRule Rules[] = {
-//        UNUSED_RULE,
-//        PREFIX_SYMBOL(literal),
-//        PREFIX_SYMBOL(literal),
-//        {NULL, BP_NONE, id, NULL, idMethodSignature},
-//};
 
 /***********************************************************************************************
  ********************************* 编译内嵌表达式 ************************************************
@@ -1257,33 +1531,59 @@ static void emitLoadModuleVar(CompileUnit *cu, const char *name) {
     writeOpCodeShortOperand(cu, OPCODE_LOAD_MODULE_VAR, index);
 }
 
+/**
+ * 压入插值中刚读入的字符串片段，空串不压栈
+ * @param cu
+ * @return 压入的片段数
+ */
+static uint32_t emitInterpolationLiteral(CompileUnit *cu) {
+    Value value = cu->curParser->preToken.value;
+    if (VALUE_TO_OBJSTR(value)->value.length == 0) {
+        return 0;
+    }
+    literal(cu, false);
+    return 1;
+}
+
+/**
+ * 生成OPCODE_INTERPOLATE，把栈顶pieceNum个值转为字符串后拼成一个
+ * 只有一个片段时也要生成，由它把表达式的值转为字符串
+ * @param cu
+ * @param pieceNum
+ */
+static void emitInterpolate(CompileUnit *cu, uint32_t pieceNum) {
+    writeOpCode(cu, OPCODE_INTERPOLATE);
+    writeByteOperand(cu, (int)pieceNum);
+    // pieceNum个片段出栈，结果入栈
+    cu->stackSlotNum -= pieceNum - 1;
+}
+
 /**
  * 内嵌表达式.nud()
  * @param cu
  * @param canAssign
  */
 static void stringInterpolation(CompileUnit *cu, bool canAssign UNUSED) {
-
-
-    emitLoadModuleVar(cu, "List");
-    emitCall(cu, 0, "new()", 5);
-
+    // 各片段依次压栈，最后由OPCODE_INTERPOLATE一次拼成结果
+    uint32_t pieceNum = 0;
     do {
-        literal(cu, false);
-        emitCall(cu, 1, "addCore_(_)", 11);
+        pieceNum += emitInterpolationLiteral(cu);
 
+        // 表达式的值由OPCODE_INTERPOLATE转为字符串，数字等不经过toString调用
         expression(cu, BP_LOWEST);
-        // 将结果添加到list
-        emitCall(cu, 1, "addCore_(_)", 11); // 生成addCore_前缀的函数
+        pieceNum ++;
+
+        // 片段过多时先拼接已有的部分，结果作为后续的第一个片段
+        if (pieceNum >= MAX_INTERPOLATE_NUM - 1) {
+            emitInterpolate(cu, pieceNum);
+            pieceNum = 1;
+        }
     } while (matchToken(cu->curParser, TOKEN_INTERPOLATION));
 
     consumeCurToken(cu->curParser, TOKEN_STRING, "expect string at the end of interpolatation!");
 
-    literal(cu, false);
-
-    emitCall(cu, 1, "addCore_(_)", 11);
-
-    emitCall(cu, 0, "join()", 6);
+    pieceNum += emitInterpolationLiteral(cu);
+    emitInterpolate(cu, pieceNum);
 }
 
 /***********************************************************************************************
@@ -1370,10 +1670,13 @@ static void parentheses(CompileUnit *cu, bool canAssign UNUSED) {
 static void listLiteral(CompileUnit *cu, bool canAssign UNUSED) {
     // 进入函数后，curToken是[右边的符号
 
-    // 先创建list对象
-    emitLoadModuleVar(cu, "list");
-    emitCall(cu, 0, "new()", 5);
+    // 先创建list对象，元素个数读完才知道，先用常量0占位，结束后回填，list只分配一次
+    emitLoadModuleVar(cu, "List");
+    uint32_t capacityIndex = addConstant(cu, NUM_TO_VALUE(0));
+    writeOpCodeShortOperand(cu, OPCODE_LOAD_CONSTANT, capacityIndex);
+    emitCall(cu, 1, "new(_)", 6);
 
+    uint32_t elementNum = 0;
     do {
         // 支持字面量形式定义的空列表
         if (PEEK_TOKEN(cu->curParser) == TOKEN_RIGHT_BRACKET) {
@@ -1381,7 +1684,11 @@ static void listLiteral(CompileUnit *cu, bool canAssign UNUSED) {
         }
         expression(cu, BP_LOWEST);
         emitCall(cu, 1, "addCore_(_)", 11);
-    } while (cu->curParser, TOKEN_RIGHT_BRACKET, "expect ')' after list element!");
+        elementNum ++;
+    } while (matchToken(cu->curParser, TOKEN_COMMA));
+
+    consumeCurToken(cu->curParser, TOKEN_RIGHT_BRACKET, "expect ']' after list element!");
+    cu->fn->constants.datas[capacityIndex] = NUM_TO_VALUE(elementNum);
 }
 
 /**
@@ -1456,8 +1763,12 @@ static void mapLiteral(CompileUnit *cu, bool canAssign UNUSED) {
 
     emitLoadModuleVar(cu, "Map");
 
-    emitCall(cu, 0, "new()", 5);
+    // 同list字面量，用回填的键值对个数预留空间，避免逐个添加时反复重建
+    uint32_t capacityIndex = addConstant(cu, NUM_TO_VALUE(0));
+    writeOpCodeShortOperand(cu, OPCODE_LOAD_CONSTANT, capacityIndex);
+    emitCall(cu, 1, "new(_)", 6);
 
+    uint32_t entryNum = 0;
     do {
         if (PEEK_TOKEN(cu->curParser) == TOKEN_RIGHT_BRACE) {
             break;
@@ -1471,9 +1782,11 @@ static void mapLiteral(CompileUnit *cu, bool canAssign UNUSED) {
         expression(cu, BP_LOWEST);
 
         emitCall(cu, 2, "addCore_(_,_)", 13);
+        entryNum ++;
     } while (matchToken(cu->curParser, TOKEN_COMMA));
 
     consumeCurToken(cu->curParser, TOKEN_RIGHT_BRACE, "map literal should end with\')\'!");
+    cu->fn->constants.datas[capacityIndex] = NUM_TO_VALUE(entryNum);
 }
 
 /***********************************************************************************************
@@ -1774,9 +2087,11 @@ uint32_t getBytesOfOperands(Byte *instrStream, Value *constants, int ip) {
         case OPCODE_PUSH_FALSE:
         case OPCODE_PUSH_TRUE:
         case OPCODE_POP:
+        case OPCODE_RETURN:
             return 0;
 
         case OPCODE_CREATE_CLASS:
+        case OPCODE_INTERPOLATE:
         case OPCODE_LOAD_THIS_FIELD:
         case OPCODE_STORE_THIS_FIELD:
         case OPCODE_LOAD_FIELD:
@@ -1833,6 +2148,8 @@ uint32_t getBytesOfOperands(Byte *instrStream, Value *constants, int ip) {
         case OPCODE_SUPER14:
         case OPCODE_SUPER15:
         case OPCODE_SUPER16:
+        case OPCODE_ITERATE:
+        case OPCODE_ITERATOR_VALUE:
             return 4;
 
         case OPCODE_CREATE_CLOSURE: {
@@ -1975,7 +2292,7 @@ inline static void compileContinue(CompileUnit *cu) {
     int loopBackOffset = cu->fn->instrStream.count - cu->curLoop->condStartIndex + 2;
 
     // 生成向回跳转的CODE_ LOOP指令，即使ip -= loopBackOffset
-    writeOpCodeByteOperand(cu, OPCODE_LOOP, loopBackOffset);
+    writeOpCodeShortOperand(cu, OPCODE_LOOP, loopBackOffset);
 }
 
 /**
@@ -1992,18 +2309,41 @@ static void enterScope(CompileUnit *cu) {
  * @param cu
  */
 static void leaveScope(CompileUnit *cu) {
-    // 对于非模块编译单元，丢弃局部变量
-    if (cu->enclosingUnit != NULL) {
-        // 出作用域后丢弃本作用域以内的局部变量
-        uint32_t discardNum = discardLocalVar(cu, cu->scopeDepth);
-        cu->localVarNum -= discardNum;
-        cu->stackSlotNum -= discardNum;
-    }
+    // 出作用域后丢弃本作用域以内的局部变量，模块中的代码块及类体也有局部变量
+    uint32_t discardNum = discardLocalVar(cu, cu->scopeDepth);
+    cu->localVarNum -= discardNum;
+    cu->stackSlotNum -= discardNum;
 
     // 回到上一层作用域
     cu->scopeDepth --;
 }
 
+/**
+ * 生成for循环中调用seq.iterate(iter)或seq.iteratorValue(iter)的指令，
+ * 操作数依次为seq和iter的局部变量槽位及方法索引，效果等同于两条LOAD_LOCAL_VAR加一条CALL1。
+ * seq为range且方法未被改写时解释器直接计数，不派发方法
+ * @param cu
+ * @param opCode OPCODE_ITERATE或OPCODE_ITERATOR_VALUE
+ * @param seqSlot
+ * @param iterSlot
+ * @param name
+ * @param length
+ */
+static void emitIterateCall(CompileUnit *cu, OpCode opCode, uint32_t seqSlot, uint32_t iterSlot,
+                            const char *name, uint32_t length) {
+    int symbolIndex = ensureSymbolExist(cu->curParser->vm,
+                                        &cu->curParser->vm->allMethodNames, name, length);
+    writeOpCode(cu, opCode);
+    writeByteOperand(cu, seqSlot);
+    writeByteOperand(cu, iterSlot);
+    writeShortOperand(cu, symbolIndex);
+
+    // 净压入1个值，但退回普通调用时要先压入seq和iter两个值
+    if (cu->stackSlotNum + 1 > cu->fn->maxStackSlotUsedNum) {
+        cu->fn->maxStackSlotUsedNum = cu->stackSlotNum + 1;
+    }
+}
+
 /**
  * 编译for
  * @param cu
@@ -2037,13 +2377,8 @@ static void compileForStatment(CompileUnit *cu) {
     Loop loop;
     enterLoopSetting(cu, &loop);
 
-    // 为调用seq. iterate (iter)做准备
-    // 先压入序列对象seq,即seq.iterate(iter)中的seq
-    writeOpCodeByteOperand(cu, OPCODE_LOAD_LOCAL_VAR, seqSlot);
-    // 再压入参数iter,即seq. iterate (iter)中的iter
-    writeOpCodeByteOperand(cu, OPCODE_LOAD_LOCAL_VAR, iterSlot);
-    // 调用seq.iterate (iter)
-    emitCall(cu, 1, "iterate(_)", 10);
+    // 调用seq.iterate(iter)，range上的循环由解释器直接计数
+    emitIterateCall(cu, OPCODE_ITERATE, seqSlot, iterSlot, "iterate(_)", 10);
 
     // sea. iterate (iter)把结果(下一个迭代器)存储到
     // args[0] (即栈顶) ,现在将其同步到变量iter
@@ -2053,13 +2388,8 @@ static void compileForStatment(CompileUnit *cu) {
     // 先写入占位符
     loop.exitIndex = emitInstrWithPlaceholder(cu, OPCODE_JUMP_IF_FALSE);
 
-    // 为调用seq. iterate (iter)做准备
-    // 先压入序列对象seq,即seq.iterate(iter)中的seq
-    writeOpCodeByteOperand(cu, OPCODE_LOAD_LOCAL_VAR, seqSlot);
-    // 再压入参数iter,即seq. iterate (iter)中的iter
-    writeOpCodeByteOperand(cu, OPCODE_LOAD_LOCAL_VAR, iterSlot);
-    // 调用seq.iterate (iter)
-    emitCall(cu, 1, "iteratorValue(_)", 16);
+    // 调用seq.iteratorValue(iter)
+    emitIterateCall(cu, OPCODE_ITERATOR_VALUE, seqSlot, iterSlot, "iteratorValue(_)", 16);
 
     // 为循环变量i创建作用域
     enterScope(cu);
@@ -2090,6 +2420,38 @@ static void emitStoreModuleVar(CompileUnit *cu, int index) {
     writeOpCode(cu, OPCODE_POP); // 弹出栈顶数据
 }
 
+/**
+ * 依次从局部变量、upvalue和模块变量中查找变量
+ * @param cu
+ * @param name
+ * @param length
+ * @return
+ */
+static Variable findVariable(CompileUnit *cu, const char *name, uint32_t length) {
+    Variable var = getVarFromLocalOrUpvalue(cu, name, length);
+    if (var.index != -1) {
+        return var;
+    }
+
+    var.index = getIndexFromSymbolTable(&cu->curParser->curModule->moduleVarName, name, length);
+    if (var.index != -1) {
+        var.scopeType = VAR_SCOPE_MODULE;
+    }
+    return var;
+}
+
+/**
+ * 定义变量，为其赋值
+ * 局部变量已在栈中，模块变量不在栈中，须把栈顶的值写回
+ * @param cu
+ * @param index
+ */
+static void defineVariable(CompileUnit *cu, uint32_t index) {
+    if (cu->scopeDepth == -1) {
+        emitStoreModuleVar(cu, index);
+    }
+}
+
 /**
  * 声明方法
  * @param cu
@@ -2162,6 +2524,186 @@ static void emitCreateInstance(CompileUnit *cu, Signature *sign, uint32_t constr
 #endif
 }
 
+/**
+ * 名为name的标识符在cu中是否指代局部变量，含以"Cls类名 静态域名"存储的静态域
+ * @param cu
+ * @param name
+ * @param length
+ * @return
+ */
+static bool capturesEnclosingLocal(CompileUnit *cu, const char *name, uint32_t length) {
+    if (cu->localVarNum == 0) {
+        return false;
+    }
+    if (findLocal(cu, name, length) != -1) {
+        return true;
+    }
+    if (cu->enclosingClassBK == NULL) {
+        return false;
+    }
+    char staticFieldId[MAX_ID_LEN * 2 + 4] = {'\0'};
+    ObjString *className = cu->enclosingClassBK->name;
+    int idLen = snprintf(staticFieldId, sizeof(staticFieldId), "Cls%.*s %.*s",
+                         (int)className->value.length, className->value.start, (int)length, name);
+    return findLocal(cu, staticFieldId, (uint32_t)idLen) != -1;
+}
+
+/**
+ * 返回cu正在编译的类供延迟编译的方法共用的副本，没有时创建
+ * @param cu
+ * @return
+ */
+static ClassBookKeep* ensureLazyClassBK(CompileUnit *cu) {
+    ClassBookKeep *classBK = cu->enclosingClassBK;
+    if (classBK->lazyCopy == NULL) {
+        ClassBookKeep *lazyCopy = ALLOCATE(cu->curParser->vm, ClassBookKeep);
+        lazyCopy->name = classBK->name;
+        StringBufferInit(&lazyCopy->fields);
+        IntBufferInit(&lazyCopy->instantMethods);
+        IntBufferInit(&lazyCopy->staticMethods);
+        lazyCopy->inStatic = false;
+        lazyCopy->signature = NULL;
+        lazyCopy->lazyCopy = NULL;
+        classBK->lazyCopy = lazyCopy;
+    }
+    return classBK->lazyCopy;
+}
+
+/**
+ * 延迟编译模式下跳过函数体，只记录其位置，首次调用时由compileLazyFn编译
+ * 预扫描只为匹配大括号及检查是否引用外层局部变量，引用时须创建upvalue，改为立即编译
+ * 进入本函数之前已经读入了{
+ * @param cu 外层编译单元，即模块
+ * @param bodyCU 函数体的编译单元，形参已声明
+ * @param sign 方法签名，函数为NULL
+ * @param isConstruct
+ * @return 未能延迟时恢复parser并返回false，由调用方立即编译
+ */
+static bool tryDeferBody(CompileUnit *cu, CompileUnit *bodyCU, Signature *sign, bool isConstruct) {
+    Parser *parser = cu->curParser;
+    if (!parser->vm->lazyCompile || cu->enclosingUnit != NULL || parser->curModule->source == NULL) {
+        return false;
+    }
+
+    Parser saved = *parser;
+    int depth = 1;
+    while (depth > 0) {
+        switch (parser->curToken.type) {
+            case TOKEN_LEFT_BRACE:
+                depth ++;
+                break;
+            case TOKEN_RIGHT_BRACE:
+                depth --;
+                break;
+            case TOKEN_ID:
+                if (capturesEnclosingLocal(cu, parser->curToken.start, parser->curToken.length)) {
+                    *parser = saved;
+                    return false;
+                }
+                break;
+            case TOKEN_EOF:
+                // 交给立即编译报告缺少}的错误
+                *parser = saved;
+                return false;
+            default:
+                break;
+        }
+        getNextToken(parser);
+    }
+
+    LazyBody *body = ALLOCATE(parser->vm, LazyBody);
+    body->file = parser->file;
+    body->bodyStart = saved.curToken.start;
+    body->lineNo = saved.curToken.lineNo;
+    memcpy(body->localVars, bodyCU->localVars, sizeof(LocalVar) * bodyCU->localVarNum);
+    body->localVarNum = bodyCU->localVarNum;
+    body->isMethod = sign != NULL;
+    body->isConstruct = isConstruct;
+    body->inStatic = false;
+    body->classBK = NULL;
+    body->class = NULL;
+    if (sign != NULL) {
+        body->signature = *sign;
+        body->inStatic = cu->enclosingClassBK->inStatic;
+        body->classBK = ensureLazyClassBK(cu);
+    }
+    bodyCU->fn->lazyBody = body;
+    return true;
+}
+
+/**
+ * 编译延迟的函数体，在函数首次调用前执行
+ * 此时模块已编译完成，函数体中引用的模块变量均已定义
+ * @param vm
+ * @param objFn
+ */
+void compileLazyFn(VM *vm, ObjFn *objFn) {
+    LazyBody *body = objFn->lazyBody;
+    // 先置空，函数体递归调用自身时不会重复编译
+    objFn->lazyBody = NULL;
+    pauseArena(vm);
+
+    Parser parser;
+    initParser(vm, &parser, body->file, body->bodyStart, objFn->module);
+    parser.curToken.lineNo = body->lineNo;
+    parser.parent = vm->curParser;
+    vm->curParser = &parser;
+
+    // 外层是模块作用域，方法还需所属类的实例域及自己的签名
+    CompileUnit moduleCU;
+    moduleCU.fn = NULL;
+    moduleCU.localVarNum = 0;
+    moduleCU.scopeDepth = -1;
+    moduleCU.stackSlotNum = 0;
+    moduleCU.curLoop = NULL;
+    moduleCU.enclosingClassBK = NULL;
+    moduleCU.enclosingUnit = NULL;
+    moduleCU.curParser = &parser;
+
+    ClassBookKeep classBK;
+    Signature sign = body->signature;
+    if (body->classBK != NULL) {
+        classBK = *body->classBK;
+        classBK.inStatic = body->inStatic;
+        classBK.signature = &sign;
+        moduleCU.enclosingClassBK = &classBK;
+    }
+
+    CompileUnit bodyCU;
+    initCompileUnitWithFn(&parser, &bodyCU, &moduleCU, body->isMethod, objFn);
+    memcpy(bodyCU.localVars, body->localVars, sizeof(LocalVar) * body->localVarNum);
+    bodyCU.localVarNum = body->localVarNum;
+    bodyCU.stackSlotNum = body->localVarNum;
+    objFn->maxStackSlotUsedNum = body->localVarNum;
+
+    // 定义时写入的OPCODE_END作废
+    objFn->instrStream.count = 0;
+#if DEBUG
+    objFn->debug.lineNo.count = 0;
+#endif
+
+    getNextToken(&parser);
+    compileBody(&bodyCU, body->isConstruct);
+    writeOpCode(&bodyCU, OPCODE_END);
+
+    // 方法绑定时还没有指令可修正，此时补上
+    if (body->class != NULL) {
+        patchOperand(body->class, objFn);
+    }
+
+    vm->curParser = parser.parent;
+    resumeArena(vm);
+}
+
+/**
+ * 记下延迟编译的方法所属的类，由绑定方法时的patchOperand调用
+ * @param objFn
+ * @param class
+ */
+void bindLazyClass(ObjFn *objFn, Class *class) {
+    objFn->lazyBody->class = class;
+}
+
 /**
  * 编译定义方法，isStatic表示是否在编译静态方法
  * @param cu
@@ -2203,8 +2745,10 @@ static void compileMethod(CompileUnit *cu, Variable classVar, bool isStatic) {
     // 将方法声明
     uint32_t methodIndex = declareMethod(cu, signatureString, signLen);
 
-    // 编译方法体指令流到方法自己的编译单元methodCU
-    compileBody(&methodCU, sign.type == SIGN_CONSTRUCT);
+    // 编译方法体指令流到方法自己的编译单元methodCU，延迟编译时只记录其位置
+    if (!tryDeferBody(cu, &methodCU, &sign, sign.type == SIGN_CONSTRUCT)) {
+        compileBody(&methodCU, sign.type == SIGN_CONSTRUCT);
+    }
 
 #if DEBUG
     endCompileUnit(&methodCU, signatureString, signLen);
@@ -2216,7 +2760,7 @@ static void compileMethod(CompileUnit *cu, Variable classVar, bool isStatic) {
     defineMethod(cu, classVar, cu->enclosingClassBK->inStatic, methodIndex);
 
     if (sign.type == SIGN_CONSTRUCT) {
-        sign.type == SIGN_METHOD;
+        sign.type = SIGN_METHOD;
         char signatureString[MAX_SIGN_LEN] = {'\0'};
         uint32_t signLen = sign2String(&sign, signatureString);
 
@@ -2237,14 +2781,14 @@ static void compileMethod(CompileUnit *cu, Variable classVar, bool isStatic) {
 static void compileClassBody(CompileUnit *cu, Variable classVar) {
     if (matchToken(cu->curParser, TOKEN_STATIC)) {
         if (matchToken(cu->curParser, TOKEN_VAR)) {
-            compileVarDeinition(cu, true);
+            compileDefinition(cu, true);
         }
         else {
             compileMethod(cu, classVar, true);
         }
     }
     else if (matchToken(cu->curParser, TOKEN_VAR)) {  // 实例域
-        compileVarDeinition(cu, false);
+        compileDefinition(cu, false);
     }
     else {  // 类的方法
         compileMethod(cu, classVar, false);
@@ -2279,7 +2823,7 @@ static void compileClassDefinition(CompileUnit *cu) {
 
     // 创建类需要知道域的个数,目前类未定义完,因此域的个数未知，
     // 因此先临时写为255,待类编译完成后再回填属性数
-    int fieldNumIndex = writeOpCodeByteOperand(cu, OPCODE_CREATE_CLASS, 3); // todo
+    int fieldNumIndex = writeOpCodeByteOperand(cu, OPCODE_CREATE_CLASS, 255);
 
     // 虛拟机执行完OPCODE_ CREATE CLASS 后,栈顶留下了创建好的类，
     // 因此现在可以用该类为之前声明的类名className赋值
@@ -2293,6 +2837,7 @@ static void compileClassDefinition(CompileUnit *cu) {
     StringBufferInit(&classBK.fields);
     IntBufferInit(&classBK.instantMethods);
     IntBufferInit(&classBK.staticMethods);
+    classBK.lazyCopy = NULL;
 
     // 此时cu是模块的编译单元，跟踪当前编译的类
     cu->enclosingClassBK = &classBK;
@@ -2315,7 +2860,13 @@ static void compileClassDefinition(CompileUnit *cu) {
     // classBK. fields的是由compileVarDefinition函数统计的
     cu->fn->instrStream.datas[fieldNumIndex] = classBK.fields.count;
 
-    symbolTableClear(cu->curParser->vm, &classBK.fields);
+    if (classBK.lazyCopy != NULL) {
+        // 实例域移交给延迟编译的方法，编译时按类的完整域列表解析
+        classBK.lazyCopy->fields = classBK.fields;
+    }
+    else {
+        symbolTableClear(cu->curParser->vm, &classBK.fields);
+    }
     IntBufferClear(cu->curParser->vm, &classBK.instantMethods);
     IntBufferClear(cu->curParser->vm, &classBK.staticMethods);
 
@@ -2362,8 +2913,10 @@ static void compileFunctionDefinition(CompileUnit *cu) {
 
     consumeCurToken(cu->curParser, TOKEN_LEFT_BRACE, "expect '{' at the begining of method body.");
 
-    // 编译函数体,将指令流写进该函数自己的指令单元fnCu
-    compileBody(&fnCU, false);
+    // 编译函数体,将指令流写进该函数自己的指令单元fnCu，延迟编译时只记录其位置
+    if (!tryDeferBody(cu, &fnCU, NULL, false)) {
+        compileBody(&fnCU, false);
+    }
 
 #if DEBUG
     endCompileUnit(&fnCU, fnName, strlen(fnName));
@@ -2436,6 +2989,28 @@ static void compileImport(CompileUnit *cu) {
 
         // 此时栈项是system. getModuleVariable ("foo", "barl")的返回值,
         // 即导入的模块变量的值，下面将其同步到相应变量中
-        defineVariebl(cu, varId);
+        defineVariable(cu, varId);
     } while (matchToken(cu->curParser, TOKEN_COMMA));
-}
\ No newline at end of file
+}
+
+/**
+ * 编译程序，即模块或代码块中的一条定义或语句
+ * @param cu
+ */
+static void compileProgram(CompileUnit *cu) {
+    if (matchToken(cu->curParser, TOKEN_CLASS)) {
+        compileClassDefinition(cu);
+    }
+    else if (matchToken(cu->curParser, TOKEN_FUN)) {
+        compileFunctionDefinition(cu);
+    }
+    else if (matchToken(cu->curParser, TOKEN_VAR)) {
+        compileDefinition(cu, false);
+    }
+    else if (matchToken(cu->curParser, TOKEN_IMPORT)) {
+        compileImport(cu);
+    }
+    else {
+        compileStatement(cu);
+    }
+}
@@ -92,6 +92,50 @@ uint32_t getByteNumOfDecodeUtf8(uint8_t byte) {
     return 1;
 }
 
+/**
+ * 解码以bytePtr起始的UTF-8序列，length为bytePtr之后可读的字节数
+ * @param bytePtr
+ * @param length
+ * @return 码点，序列不合法时返回-1
+ */
 int decodeUtf8(const uint8_t *bytePtr, uint32_t length) {
-    return 0;
+    // ASCII只有1个字节
+    if (*bytePtr <= 0x7f) {
+        return *bytePtr;
+    }
+
+    int value;
+    uint32_t remainingBytes;
+    // 先读取高字节中的有效位
+    if ((*bytePtr & 0xe0) == 0xc0) {
+        value = *bytePtr & 0x1f;
+        remainingBytes = 1;
+    }
+    else if ((*bytePtr & 0xf0) == 0xe0) {
+        value = *bytePtr & 0x0f;
+        remainingBytes = 2;
+    }
+    else if ((*bytePtr & 0xf8) == 0xf0) {
+        value = *bytePtr & 0x07;
+        remainingBytes = 3;
+    }
+    else {
+        // 非法的首字节
+        return -1;
+    }
+
+    if (remainingBytes > length - 1) {
+        return -1;
+    }
+
+    // 再读取后续字节的低6位
+    while (remainingBytes > 0) {
+        bytePtr ++;
+        remainingBytes --;
+        if ((*bytePtr & 0xc0) != 0x80) {
+            return -1;
+        }
+        value = value << 6 | (*bytePtr & 0x3f);
+    }
+    return value;
 }
\ No newline at end of file
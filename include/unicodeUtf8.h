@@ -8,6 +8,5 @@ uint32_t getByteNumOfEncodeUtf8(int value);
 uint8_t encodeUtf8(uint8_t *buf, int value);
 uint32_t getByteNumOfDecodeUtf8(uint8_t byte);
 int decodeUtf8(const uint8_t *bytePtr, uint32_t length);
-int decodeUtf8(const uint8_t *bytePtr, uint32_t length);
 
 #endif
\ No newline at end of file
@@ -3,14 +3,17 @@
 //
 #include "utils.h"
 #include "../vm/vm.h"
+#include "../vm/arena.h"
 #include "../parser/parser.h"
 
 #include <stdlib.h>
 #include <stdarg.h>
+#include <time.h>
 
 /**
  * 内存管理3种方法
  *      1 申请内存 2 修改空间大小 3 释放内存
+ * 打开分配区域后新的分配在区域中进行，见arena.c
  * @param vm
  * @param ptr
  * @param oldSize
@@ -20,10 +23,15 @@
 void* memManager(VM *vm, void *ptr, uint32_t oldSize, uint32_t newSize) {
     vm->allocatedBytes += newSize - oldSize;
 
+    if (vm->arena != NULL) {
+        return arenaMemManager(vm, ptr, newSize);
+    }
+
     if (newSize == 0) {
         free(ptr);
         return NULL;
     }
+    vm->allocatedNum ++;
     return realloc(ptr, newSize);
 }
 
@@ -46,6 +54,16 @@ uint32_t ceilToPowerOf2(uint32_t v) {
     return v;
 }
 
+/**
+ * 返回单调时钟的纳秒数，用于统计耗时
+ * @return
+ */
+uint64_t getNowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
 DEFINE_BUFFER_METHOD(String)
 
 DEFINE_BUFFER_METHOD(Int)
@@ -22,6 +22,7 @@ void* memManager(VM *vm, void *ptr, uint32_t oldSize, uint32_t newSize);
     memManager(vmPtr, memPtr, 0, 0)
 
 uint32_t ceilToPowerOf2(uint32_t v);
+uint64_t getNowNs(void);
 
 typedef struct {
     char *str;
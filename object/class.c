@@ -4,6 +4,7 @@
 #include "class.h"
 #include "../include/common.h"
 #include "obj_range.h"
+#include "obj_tuple.h"
 #include "string.h"
 #include "../vm/core.h"
 #include "../vm/vm.h"
@@ -35,16 +36,17 @@ int valueIsEqual(Value a, Value b) {
     }
 
     if (a.objHeader->type == OT_STRING) {
-        ObjString *strA = VALUE_TO_OBJSTR(a);
-        ObjString *strB = VALUE_TO_OBJSTR(b);
-        return (strA->value.length == strB->value.length &&
-        memcmp(strA->value.start, strB->value.start, strA->value.length) == 0);
+        return objStringEquals(VALUE_TO_OBJSTR(a), VALUE_TO_OBJSTR(b));
     }
 
     if (a.objHeader->type == OT_RANGE) {
         ObjRange *rgA = VALUE_TO_OBJRANGE(a);
         ObjRange *rgB = VALUE_TO_OBJRANGE(b);
-        return (rgA->from == rgB->from && rgA->to == rgB->to);
+        return (rgA->from == rgB->from && rgA->to == rgB->to && rgA->step == rgB->step);
+    }
+
+    if (a.objHeader->type == OT_TUPLE) {
+        return tupleEquals(VALUE_TO_OBJTUPLE(a), VALUE_TO_OBJTUPLE(b));
     }
     return false;
 }
@@ -70,13 +72,41 @@ Class* newRawClass(VM *vm, const char *name, uint32_t fieldNum) {
     return class;
 }
 
+/**
+ * 创建类，同时为其创建元类，元类中存放类方法
+ * @param vm
+ * @param className
+ * @param fieldNum 本类自己的字段数，不含基类的
+ * @param superClass
+ * @return
+ */
+Class* newClass(VM *vm, ObjString *className, uint32_t fieldNum, Class *superClass) {
+    // 元类名为"a metaclass of 类名"
+    char newClassName[MAX_METACLASS_LEN] = {'\0'};
+    uint32_t prefixLen = strlen(META_CLASS_PREFIX);
+    memcpy(newClassName, META_CLASS_PREFIX, prefixLen);
+    memcpy(newClassName + prefixLen, className->value.start, className->value.length);
+
+    Class *metaclass = newRawClass(vm, newClassName, 0);
+    metaclass->objHeader.class = vm->classOfClass;
+    // 元类的基类是classOfClass
+    bindSuperClass(vm, metaclass, vm->classOfClass);
+
+    memcpy(newClassName, className->value.start, className->value.length);
+    newClassName[className->value.length] = '\0';
+    Class *class = newRawClass(vm, newClassName, fieldNum);
+    class->objHeader.class = metaclass;
+    bindSuperClass(vm, class, superClass);
+    return class;
+}
+
 /**
  * 数字等value也被视为对象，因此参数为value，获得对象obj所属的类
  * @param vm
  * @param object
  * @return
  */
-inline Class *getClassOfObj(VM *vm, Value object) {
+Class *getClassOfObj(VM *vm, Value object) {
     switch (object.type) {
         case VT_NULL:
             return vm->nullClass;
@@ -86,6 +116,21 @@ inline Class *getClassOfObj(VM *vm, Value object) {
         case VT_NUM:
             return vm->numClass;
         case VT_OBJ:
+            if (VALUE_TO_OBJ(object)->isFrozen) {
+                // 冻结对象被多个vm共享，类取读取方vm自己的核心类
+                switch (VALUE_TO_OBJ(object)->type) {
+                    case OT_STRING:
+                        return vm->stringClass;
+                    case OT_LIST:
+                        return vm->listClass;
+                    case OT_MAP:
+                        return vm->mapClass;
+                    case OT_RANGE:
+                        return vm->rangeClass;
+                    default:
+                        NOT_REACHED();
+                }
+            }
             return VALUE_TO_OBJ(object)->class;
         default:
             NOT_REACHED();
@@ -44,6 +44,11 @@ typedef enum {
 #define VALUE_TO_OBJTHREAD(value) ((ObjThread *)VALUE_TO_OBJ(value))
 #define VALUE_TO_OBJMODULE(value) ((ObjModule *)VALUE_TO_OBJ(value))
 #define VALUE_TO_CLASS(value) ((Class *)VALUE_TO_OBJ(value))
+#define VALUE_TO_OBJTYPEDARRAY(value) ((ObjTypedArray *)VALUE_TO_OBJ(value))
+#define VALUE_TO_OBJSET(value) ((ObjSet *)VALUE_TO_OBJ(value))
+#define VALUE_TO_OBJTUPLE(value) ((ObjTuple *)VALUE_TO_OBJ(value))
+#define VALUE_TO_OBJVECTOR(value) ((ObjVector *)VALUE_TO_OBJ(value))
+#define VALUE_TO_OBJHASHMAP(value) ((ObjHashMap *)VALUE_TO_OBJ(value))
 
 #define VALUE_IS_UNDEFINED(value) ((value).type == VT_UNDEFINED)
 #define VALUE_IS_NULL(value) ((value).type == VT_NULL)
@@ -61,7 +66,7 @@ typedef enum {
 #define VALUE_IS_0(value) (VALUE_IS_NUM(value) && (value).num == 0)
 
 // 原生方法指针
-typedef int (*Primitive)(VM *vm, Value *value);
+typedef bool (*Primitive)(VM *vm, Value *value);
 
 typedef struct {
     MethodType type;
@@ -87,11 +92,15 @@ typedef union {
     double num;
 } Bits64;
 
+#define META_CLASS_PREFIX "a metaclass of "
+#define MAX_METACLASS_LEN 144 // 元类名前缀加上最长的类名
+
 #define CAPACITY_GROW_FACTOR 4
 #define MIN_CAPACITY 64
 
 int valueIsEqual(Value a, Value b);
-inline Class *getClassOfObj(VM *vm, Value object);
+Class *getClassOfObj(VM *vm, Value object);
 Class* newRawClass(VM *vm, const char *name, uint32_t fieldNum);
+Class* newClass(VM *vm, ObjString *className, uint32_t fieldNum, Class *superClass);
 
 #endif //!__OBJECT_CLASS_H__
\ No newline at end of file
@@ -15,7 +15,85 @@ DEFINE_BUFFER_METHOD(Value)
 void initObjHeader(VM *vm, ObjHeader *objHeader, ObjType objType, Class *class) {
     objHeader->type = objType;
     objHeader->isDark = false;
+    objHeader->isFrozen = false;
+    objHeader->isRemembered = false;
     objHeader->class = class;
     objHeader->next = vm->allObjects;
     vm->allObjects = objHeader;
-}
\ No newline at end of file
+}
+
+/**
+ * 初始化空的映射
+ * @param memo
+ */
+void initObjMemo(ObjMemo *memo) {
+    memo->sources = NULL;
+    memo->values = NULL;
+    memo->capacity = memo->count = 0;
+}
+
+/**
+ * 查找source对应的值
+ * @param memo
+ * @param source
+ * @return 没有时返回NULL
+ */
+Value* objMemoFind(ObjMemo *memo, ObjHeader *source) {
+    if (memo->capacity == 0) {
+        return NULL;
+    }
+    uint32_t idx = (uint32_t)(((uintptr_t)source >> 4) * 2654435761u) & (memo->capacity - 1);
+    while (memo->sources[idx] != NULL) {
+        if (memo->sources[idx] == source) {
+            return &memo->values[idx];
+        }
+        idx = (idx + 1) & (memo->capacity - 1);
+    }
+    return NULL;
+}
+
+/**
+ * 记录source对应的值，装载率超过一半时扩容
+ * @param memo
+ * @param source 须不在映射中
+ * @param value
+ */
+void objMemoAdd(ObjMemo *memo, ObjHeader *source, Value value) {
+    if ((memo->count + 1) * 2 > memo->capacity) {
+        ObjMemo grown;
+        grown.capacity = memo->capacity == 0 ? 16 : memo->capacity * 2;
+        grown.count = 0;
+        grown.sources = (ObjHeader **)calloc(grown.capacity, sizeof(ObjHeader *));
+        grown.values = (Value *)malloc(sizeof(Value) * grown.capacity);
+        if (grown.sources == NULL || grown.values == NULL) {
+            MEM_ERROR("allocate object memo failed!");
+        }
+        uint32_t idx = 0;
+        while (idx < memo->capacity) {
+            if (memo->sources[idx] != NULL) {
+                objMemoAdd(&grown, memo->sources[idx], memo->values[idx]);
+            }
+            idx ++;
+        }
+        freeObjMemo(memo);
+        *memo = grown;
+    }
+
+    uint32_t idx = (uint32_t)(((uintptr_t)source >> 4) * 2654435761u) & (memo->capacity - 1);
+    while (memo->sources[idx] != NULL) {
+        idx = (idx + 1) & (memo->capacity - 1);
+    }
+    memo->sources[idx] = source;
+    memo->values[idx] = value;
+    memo->count ++;
+}
+
+/**
+ * 释放映射占用的内存
+ * @param memo
+ */
+void freeObjMemo(ObjMemo *memo) {
+    free(memo->sources);
+    free(memo->values);
+    initObjMemo(memo);
+}
@@ -19,14 +19,23 @@ typedef enum {
     OT_FUNCTION,
     OT_CLOSURE,
     OT_INSTANCE,
-    OT_THREAD
+    OT_THREAD,
+    OT_CHANNEL,
+    OT_STRING_BUILDER,
+    OT_TYPED_ARRAY,
+    OT_SET,
+    OT_TUPLE,
+    OT_VECTOR,
+    OT_HASH_MAP
 } ObjType;  // 对象类型
 
 typedef struct objHeader {
     ObjType type;
     int isDark;
+    bool isFrozen;  // 属于共享堆，只读且不归任何vm回收
+    bool isRemembered;  // 打开区域前的对象，已记入区域的记忆集
     Class *class;  // 对象所属的类
-    struct ObjHeader *next;  // 用于链接所有已分配对象
+    struct objHeader *next;  // 用于链接所有已分配对象
 } ObjHeader; // 对象头，用于记录元信息和垃圾回收
 
 typedef enum {
@@ -48,6 +57,17 @@ typedef struct {
 
 DECLARE_BUFFER_TYPE(Value)
 
+typedef struct {
+    ObjHeader **sources; // 开放定址，以源对象的地址为key
+    Value *values;
+    uint32_t capacity; // 为2的幂
+    uint32_t count;
+} ObjMemo;  // 对象到值的映射，深拷贝时用来保持共享及循环引用
+
 void initObjHeader(VM *vm, ObjHeader *objHeader, ObjType objType, Class *class);
+void initObjMemo(ObjMemo *memo);
+Value* objMemoFind(ObjMemo *memo, ObjHeader *source);
+void objMemoAdd(ObjMemo *memo, ObjHeader *source, Value value);
+void freeObjMemo(ObjMemo *memo);
 
 #endif //SPARROW_HEADER_OBJ_H
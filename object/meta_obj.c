@@ -26,6 +26,7 @@ ObjModule * newObjModule(VM *vm, const char *modName) {
     ValueBufferInit(&objModule->moduelVarValue);
 
     objModule->name = NULL;
+    objModule->source = NULL;
     if (modName != NULL) {
         objModule->name = newObjString(vm, modName, strlen(modName));
     }
@@ -13,6 +13,7 @@ typedef struct {
     SymbolTable moduleVarName; // 模块中的模块变量名
     ValueBuffer  moduelVarValue; // 模块中的模块变量值
     ObjString  *name;
+    char *source; // 延迟编译时保留的源码副本，否则为NULL
 } ObjModule; // 模块对象
 
 typedef struct {
@@ -0,0 +1,28 @@
+//
+// Created by ZiXuan on 2022/7/16.
+//
+#include "obj_channel.h"
+#include "../vm/vm.h"
+
+/**
+ * 新建channel对象，接管调用方持有的一个mailbox引用
+ * @param vm
+ * @param mailbox
+ * @return
+ */
+ObjChannel* newObjChannel(VM *vm, Mailbox *mailbox) {
+    ObjChannel *objChannel = ALLOCATE(vm, ObjChannel);
+    initObjHeader(vm, &objChannel->objHeader, OT_CHANNEL, vm->channelClass);
+    objChannel->mailbox = mailbox;
+    return objChannel;
+}
+
+/**
+ * 释放channel对象，供gc调用
+ * @param vm
+ * @param objChannel
+ */
+void freeObjChannel(VM *vm, ObjChannel *objChannel) {
+    releaseMailbox(objChannel->mailbox);
+    DEALLOCATE(vm, objChannel);
+}
@@ -0,0 +1,19 @@
+//
+// Created by ZiXuan on 2022/7/16.
+//
+
+#ifndef SPARROW_OBJ_CHANNEL_H
+#define SPARROW_OBJ_CHANNEL_H
+
+#include "class.h"
+#include "../vm/mailbox.h"
+
+typedef struct {
+    ObjHeader objHeader;
+    Mailbox *mailbox; // 可被多个vm中的channel对象共享
+} ObjChannel;  // channel对象
+
+ObjChannel* newObjChannel(VM *vm, Mailbox *mailbox);
+void freeObjChannel(VM *vm, ObjChannel *objChannel);
+
+#endif //SPARROW_OBJ_CHANNEL_H
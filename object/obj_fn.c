@@ -62,8 +62,8 @@ ObjFn* newObjFn(VM *vm, ObjModule *objModule, uint32_t maxStackSlotUsedNum) {
     objFn->module = objModule;
     objFn->maxStackSlotUsedNum = maxStackSlotUsedNum;
     objFn->upvalueNum = objFn->argNum = 0;
+    objFn->lazyBody = NULL;
 #ifdef DEBUG
-    objFn->debug = ALLOCATE(vm, FnDebug);
     objFn->debug.fnName = NULL;
     IntBufferInit(&objFn->debug.lineNo);
 #endif
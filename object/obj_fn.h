@@ -19,6 +19,7 @@ typedef struct {
     uint32_t maxStackSlotUsedNum;
     uint32_t upvalueNum; // 本函数所涵盖的upvalue
     uint8_t argNum; // 函数期望的参数个数
+    struct lazyBody *lazyBody; // 延迟编译时函数体在源码中的位置，编译后为NULL
 #if DEBUG
     FnDebug debug;
 #endif
@@ -56,5 +57,8 @@ typedef struct {
 ObjUpvalue* newObjUpvalue(VM *vm, Value *localVarPtr);
 ObjClosure* newObjClosure(VM *vm, ObjFn *objFn);
 ObjFn* newObjFn(VM *vm, ObjModule *objModule, uint32_t maxStackSlotUsedNum);
+// 定义在compiler.c，函数首次调用前由此编译延迟的函数体
+void compileLazyFn(VM *vm, ObjFn *objFn);
+void bindLazyClass(ObjFn *objFn, Class *class);
 
 #endif //SPARROW_OBJ_FN_H
@@ -0,0 +1,507 @@
+//
+// Created by ZiXuan on 2022/7/30.
+//
+#include "obj_hash_map.h"
+#include <string.h>
+#include "class.h"
+#include "../vm/vm.h"
+
+#define HAMT_CHILDREN(node) ((HamtNode **)((node)->entries + (node)->entryNum))
+
+/**
+ * 节点占用的字节数
+ * @param entryNum
+ * @param childNum
+ * @return
+ */
+static uint32_t hamtNodeSize(uint32_t entryNum, uint32_t childNum) {
+    return sizeof(HamtNode) + sizeof(Entry) * entryNum + sizeof(HamtNode *) * childNum;
+}
+
+/**
+ * 新建节点，引用计数为1，entries及子节点由调用方填写
+ * @param vm
+ * @param dataMap
+ * @param nodeMap
+ * @param entryNum
+ * @param childNum
+ * @return
+ */
+static HamtNode* newHamtNode(VM *vm, uint32_t dataMap, uint32_t nodeMap, uint32_t entryNum, uint32_t childNum) {
+    HamtNode *node = (HamtNode *)memManager(vm, NULL, 0, hamtNodeSize(entryNum, childNum));
+    node->refCount = 1;
+    node->dataMap = dataMap;
+    node->nodeMap = nodeMap;
+    node->entryNum = entryNum;
+    node->childNum = childNum;
+    return node;
+}
+
+/**
+ * 只释放节点本身，子节点已转给别的节点
+ * @param vm
+ * @param node
+ */
+static void freeHamtShell(VM *vm, HamtNode *node) {
+    memManager(vm, node, hamtNodeSize(node->entryNum, node->childNum), 0);
+}
+
+/**
+ * 释放对节点的一个引用，计数归0时连同子节点一并释放
+ * @param vm
+ * @param node
+ */
+static void releaseHamtNode(VM *vm, HamtNode *node) {
+    if (node == NULL || -- node->refCount > 0) {
+        return;
+    }
+    HamtNode **children = HAMT_CHILDREN(node);
+    uint32_t idx = 0;
+    while (idx < node->childNum) {
+        releaseHamtNode(vm, children[idx ++]);
+    }
+    freeHamtShell(vm, node);
+}
+
+/**
+ * 为node的全部子节点增加一个引用
+ * @param node
+ */
+static void retainHamtChildren(HamtNode *node) {
+    HamtNode **children = HAMT_CHILDREN(node);
+    uint32_t idx = 0;
+    while (idx < node->childNum) {
+        children[idx ++]->refCount ++;
+    }
+}
+
+/**
+ * 返回可原地修改的同形节点：独占时即是node本身，否则复制一份，node的计数减1
+ * @param vm
+ * @param node
+ * @return
+ */
+static HamtNode* editableHamtNode(VM *vm, HamtNode *node) {
+    if (node->refCount == 1) {
+        return node;
+    }
+    HamtNode *copy = newHamtNode(vm, node->dataMap, node->nodeMap, node->entryNum, node->childNum);
+    memcpy(copy->entries, node->entries,
+           sizeof(Entry) * node->entryNum + sizeof(HamtNode *) * node->childNum);
+    retainHamtChildren(copy);
+    node->refCount --;
+    return copy;
+}
+
+/**
+ * 形状改变后处置旧节点，新节点已拷贝旧节点的全部子节点指针：
+ * 旧节点独占时子节点的引用转给新节点，只释放旧节点本身；否则为子节点增加引用
+ * @param vm
+ * @param old
+ */
+static void disposeReshaped(VM *vm, HamtNode *old) {
+    if (old->refCount == 1) {
+        freeHamtShell(vm, old);
+        return;
+    }
+    retainHamtChildren(old);
+    old->refCount --;
+}
+
+/**
+ * 位图中bit之前置位的个数，即bit对应的数组下标
+ * @param bitmap
+ * @param bit
+ * @return
+ */
+static uint32_t bitIndex(uint32_t bitmap, uint32_t bit) {
+    return (uint32_t)__builtin_popcount(bitmap & (bit - 1));
+}
+
+/**
+ * 返回key对应的value，不存在时返回VT_UNDEFINED
+ * @param vm
+ * @param objHashMap
+ * @param key
+ * @return
+ */
+Value hashMapGet(VM *vm, ObjHashMap *objHashMap, Value key) {
+    HamtNode *node = objHashMap->root;
+    uint32_t hashCode = hashValue(vm, key);
+    uint32_t shift = 0;
+    while (node != NULL) {
+        if (shift > HAMT_MAX_SHIFT) {
+            uint32_t idx = 0;
+            while (idx < node->entryNum) {
+                if (keyIsEqual(vm, node->entries[idx].key, key)) {
+                    return node->entries[idx].value;
+                }
+                idx ++;
+            }
+            break;
+        }
+        uint32_t bit = 1u << ((hashCode >> shift) & HAMT_MASK);
+        if (node->dataMap & bit) {
+            Entry *entry = &node->entries[bitIndex(node->dataMap, bit)];
+            if (keyIsEqual(vm, entry->key, key)) {
+                return entry->value;
+            }
+            break;
+        }
+        if (!(node->nodeMap & bit)) {
+            break;
+        }
+        node = HAMT_CHILDREN(node)[bitIndex(node->nodeMap, bit)];
+        shift += HAMT_BITS;
+    }
+    return VT_TO_VALUE(VT_UNDEFINED);
+}
+
+/**
+ * 两个entry在shift层的哈希片段相同，为它们建子树
+ * @param vm
+ * @param first
+ * @param firstHash
+ * @param second
+ * @param secondHash
+ * @param shift
+ * @return
+ */
+static HamtNode* mergeEntries(VM *vm, Entry first, uint32_t firstHash, Entry second, uint32_t secondHash,
+                              uint32_t shift) {
+    if (shift > HAMT_MAX_SHIFT) {
+        HamtNode *collision = newHamtNode(vm, 0, 0, 2, 0);
+        collision->entries[0] = first;
+        collision->entries[1] = second;
+        return collision;
+    }
+    uint32_t firstFrag = (firstHash >> shift) & HAMT_MASK;
+    uint32_t secondFrag = (secondHash >> shift) & HAMT_MASK;
+    if (firstFrag == secondFrag) {
+        HamtNode *node = newHamtNode(vm, 0, 1u << firstFrag, 0, 1);
+        HAMT_CHILDREN(node)[0] = mergeEntries(vm, first, firstHash, second, secondHash, shift + HAMT_BITS);
+        return node;
+    }
+    HamtNode *node = newHamtNode(vm, (1u << firstFrag) | (1u << secondFrag), 0, 2, 0);
+    node->entries[firstFrag < secondFrag ? 0 : 1] = first;
+    node->entries[firstFrag < secondFrag ? 1 : 0] = second;
+    return node;
+}
+
+/**
+ * 在node为根的子树中设置key，调用方对node的引用转为对结果的引用
+ * @param vm
+ * @param node
+ * @param entry
+ * @param hashCode
+ * @param shift
+ * @param added key原先不存在时置为true
+ * @return
+ */
+static HamtNode* hamtSet(VM *vm, HamtNode *node, Entry entry, uint32_t hashCode, uint32_t shift, bool *added) {
+    HamtNode *fresh;
+    uint32_t idx;
+    if (shift > HAMT_MAX_SHIFT) {
+        idx = 0;
+        while (idx < node->entryNum) {
+            if (keyIsEqual(vm, node->entries[idx].key, entry.key)) {
+                node = editableHamtNode(vm, node);
+                node->entries[idx].value = entry.value;
+                return node;
+            }
+            idx ++;
+        }
+        fresh = newHamtNode(vm, 0, 0, node->entryNum + 1, 0);
+        memcpy(fresh->entries, node->entries, sizeof(Entry) * node->entryNum);
+        fresh->entries[node->entryNum] = entry;
+        disposeReshaped(vm, node);
+        *added = true;
+        return fresh;
+    }
+
+    uint32_t bit = 1u << ((hashCode >> shift) & HAMT_MASK);
+    HamtNode **children = HAMT_CHILDREN(node);
+    if (node->nodeMap & bit) {
+        node = editableHamtNode(vm, node);
+        children = HAMT_CHILDREN(node);
+        idx = bitIndex(node->nodeMap, bit);
+        children[idx] = hamtSet(vm, children[idx], entry, hashCode, shift + HAMT_BITS, added);
+        return node;
+    }
+
+    idx = bitIndex(node->dataMap, bit);
+    if (!(node->dataMap & bit)) {
+        // 空位，插入entry
+        fresh = newHamtNode(vm, node->dataMap | bit, node->nodeMap, node->entryNum + 1, node->childNum);
+        memcpy(fresh->entries, node->entries, sizeof(Entry) * idx);
+        fresh->entries[idx] = entry;
+        memcpy(fresh->entries + idx + 1, node->entries + idx, sizeof(Entry) * (node->entryNum - idx));
+        memcpy(HAMT_CHILDREN(fresh), children, sizeof(HamtNode *) * node->childNum);
+        disposeReshaped(vm, node);
+        *added = true;
+        return fresh;
+    }
+
+    Entry *old = &node->entries[idx];
+    if (keyIsEqual(vm, old->key, entry.key)) {
+        node = editableHamtNode(vm, node);
+        node->entries[idx].value = entry.value;
+        return node;
+    }
+
+    // 片段相同而key不同，两个entry下沉为子节点
+    HamtNode *child = mergeEntries(vm, *old, hashValue(vm, old->key), entry, hashCode, shift + HAMT_BITS);
+    uint32_t childIdx = bitIndex(node->nodeMap, bit);
+    fresh = newHamtNode(vm, node->dataMap ^ bit, node->nodeMap | bit, node->entryNum - 1, node->childNum + 1);
+    memcpy(fresh->entries, node->entries, sizeof(Entry) * idx);
+    memcpy(fresh->entries + idx, node->entries + idx + 1, sizeof(Entry) * (node->entryNum - idx - 1));
+    HamtNode **freshChildren = HAMT_CHILDREN(fresh);
+    memcpy(freshChildren, children, sizeof(HamtNode *) * childIdx);
+    freshChildren[childIdx] = child;
+    memcpy(freshChildren + childIdx + 1, children + childIdx, sizeof(HamtNode *) * (node->childNum - childIdx));
+    disposeReshaped(vm, node);
+    *added = true;
+    return fresh;
+}
+
+/**
+ * 删除entries中下标为idx的entry，bit为其在dataMap中的位，冲突节点为0
+ * @param vm
+ * @param node
+ * @param idx
+ * @param bit
+ * @return 新节点，变空时返回NULL
+ */
+static HamtNode* removeHamtEntry(VM *vm, HamtNode *node, uint32_t idx, uint32_t bit) {
+    if (node->entryNum == 1 && node->childNum == 0) {
+        releaseHamtNode(vm, node);
+        return NULL;
+    }
+    HamtNode *fresh = newHamtNode(vm, node->dataMap ^ bit, node->nodeMap, node->entryNum - 1, node->childNum);
+    memcpy(fresh->entries, node->entries, sizeof(Entry) * idx);
+    memcpy(fresh->entries + idx, node->entries + idx + 1, sizeof(Entry) * (node->entryNum - idx - 1));
+    memcpy(HAMT_CHILDREN(fresh), HAMT_CHILDREN(node), sizeof(HamtNode *) * node->childNum);
+    disposeReshaped(vm, node);
+    return fresh;
+}
+
+/**
+ * 在node为根的子树中删除key，调用方对node的引用转为对结果的引用。
+ * 子节点只剩一个entry时把它收回本层，保持每个子节点至少有两个key
+ * @param vm
+ * @param node
+ * @param key
+ * @param hashCode
+ * @param shift
+ * @param removed key存在时置为true
+ * @return 修改后的node，变空时返回NULL
+ */
+static HamtNode* hamtRemove(VM *vm, HamtNode *node, Value key, uint32_t hashCode, uint32_t shift, bool *removed) {
+    uint32_t idx;
+    if (shift > HAMT_MAX_SHIFT) {
+        idx = 0;
+        while (idx < node->entryNum) {
+            if (keyIsEqual(vm, node->entries[idx].key, key)) {
+                *removed = true;
+                return removeHamtEntry(vm, node, idx, 0);
+            }
+            idx ++;
+        }
+        return node;
+    }
+
+    uint32_t bit = 1u << ((hashCode >> shift) & HAMT_MASK);
+    if (node->dataMap & bit) {
+        idx = bitIndex(node->dataMap, bit);
+        if (!keyIsEqual(vm, node->entries[idx].key, key)) {
+            return node;
+        }
+        *removed = true;
+        return removeHamtEntry(vm, node, idx, bit);
+    }
+    if (!(node->nodeMap & bit)) {
+        return node;
+    }
+
+    node = editableHamtNode(vm, node);
+    HamtNode **children = HAMT_CHILDREN(node);
+    uint32_t childIdx = bitIndex(node->nodeMap, bit);
+    HamtNode *child = hamtRemove(vm, children[childIdx], key, hashCode, shift + HAMT_BITS, removed);
+    children[childIdx] = child;
+    if (child != NULL && (child->entryNum > 1 || child->childNum > 0)) {
+        return node;
+    }
+
+    // 子节点为空或只剩一个entry，去掉子节点，剩下的entry收回本层
+    uint32_t entryNum = node->entryNum + (child != NULL ? 1 : 0);
+    uint32_t dataMap = child != NULL ? node->dataMap | bit : node->dataMap;
+    if (entryNum == 0 && node->childNum == 1) {
+        releaseHamtNode(vm, node);
+        return NULL;
+    }
+    HamtNode *fresh = newHamtNode(vm, dataMap, node->nodeMap ^ bit, entryNum, node->childNum - 1);
+    idx = bitIndex(dataMap, bit);
+    if (child != NULL) {
+        memcpy(fresh->entries, node->entries, sizeof(Entry) * idx);
+        fresh->entries[idx] = child->entries[0];
+        memcpy(fresh->entries + idx + 1, node->entries + idx, sizeof(Entry) * (node->entryNum - idx));
+        releaseHamtNode(vm, child);
+    }
+    else {
+        memcpy(fresh->entries, node->entries, sizeof(Entry) * node->entryNum);
+    }
+    HamtNode **freshChildren = HAMT_CHILDREN(fresh);
+    memcpy(freshChildren, children, sizeof(HamtNode *) * childIdx);
+    memcpy(freshChildren + childIdx, children + childIdx + 1, sizeof(HamtNode *) * (node->childNum - childIdx - 1));
+    // node已独占，其余子节点的引用转给fresh
+    freeHamtShell(vm, node);
+    return fresh;
+}
+
+/**
+ * 新建空表
+ * @param vm
+ * @return
+ */
+ObjHashMap* newObjHashMap(VM *vm) {
+    ObjHashMap *objHashMap = ALLOCATE(vm, ObjHashMap);
+    initObjHeader(vm, &objHashMap->objHeader, OT_HASH_MAP, vm->hashMapClass);
+    objHashMap->count = 0;
+    objHashMap->isTransient = false;
+    objHashMap->root = NULL;
+    return objHashMap;
+}
+
+/**
+ * 新建与objHashMap共享全部节点的表
+ * @param vm
+ * @param objHashMap
+ * @param isTransient
+ * @return
+ */
+static ObjHashMap* shareHashMap(VM *vm, ObjHashMap *objHashMap, bool isTransient) {
+    ObjHashMap *result = newObjHashMap(vm);
+    result->count = objHashMap->count;
+    result->isTransient = isTransient;
+    result->root = objHashMap->root;
+    if (result->root != NULL) {
+        result->root->refCount ++;
+    }
+    return result;
+}
+
+/**
+ * 设置key对应的value
+ * @param vm
+ * @param objHashMap
+ * @param key
+ * @param value
+ * @return 修改后的表，暂态时即objHashMap
+ */
+ObjHashMap* hashMapSet(VM *vm, ObjHashMap *objHashMap, Value key, Value value) {
+    ObjHashMap *result = objHashMap->isTransient ? objHashMap : shareHashMap(vm, objHashMap, false);
+    uint32_t hashCode = hashValue(vm, key);
+    Entry entry = {key, value};
+    if (result->root == NULL) {
+        result->root = newHamtNode(vm, 1u << (hashCode & HAMT_MASK), 0, 1, 0);
+        result->root->entries[0] = entry;
+        result->count = 1;
+        return result;
+    }
+    bool added = false;
+    result->root = hamtSet(vm, result->root, entry, hashCode, 0, &added);
+    if (added) {
+        result->count ++;
+    }
+    return result;
+}
+
+/**
+ * 删除key
+ * @param vm
+ * @param objHashMap
+ * @param key
+ * @return 修改后的表，暂态时即objHashMap
+ */
+ObjHashMap* hashMapRemove(VM *vm, ObjHashMap *objHashMap, Value key) {
+    ObjHashMap *result = objHashMap->isTransient ? objHashMap : shareHashMap(vm, objHashMap, false);
+    if (result->root == NULL) {
+        return result;
+    }
+    bool removed = false;
+    result->root = hamtRemove(vm, result->root, key, hashValue(vm, key), 0, &removed);
+    if (removed) {
+        result->count --;
+    }
+    return result;
+}
+
+/**
+ * 返回与objHashMap共享节点的暂态表，用于批量修改
+ * @param vm
+ * @param objHashMap
+ * @return
+ */
+ObjHashMap* hashMapTransient(VM *vm, ObjHashMap *objHashMap) {
+    return shareHashMap(vm, objHashMap, true);
+}
+
+/**
+ * 返回暂态表当前内容的持久化版本，O(1)
+ * @param vm
+ * @param objHashMap
+ * @return
+ */
+ObjHashMap* hashMapPersistent(VM *vm, ObjHashMap *objHashMap) {
+    return shareHashMap(vm, objHashMap, false);
+}
+
+/**
+ * 深度优先收集子树中的key和value
+ * @param node
+ * @param keys
+ * @param values
+ * @param pos
+ */
+static void collectHamtNode(HamtNode *node, Value *keys, Value *values, uint32_t *pos) {
+    uint32_t idx = 0;
+    while (idx < node->entryNum) {
+        if (keys != NULL) {
+            keys[*pos] = node->entries[idx].key;
+        }
+        if (values != NULL) {
+            values[*pos] = node->entries[idx].value;
+        }
+        (*pos) ++;
+        idx ++;
+    }
+    HamtNode **children = HAMT_CHILDREN(node);
+    idx = 0;
+    while (idx < node->childNum) {
+        collectHamtNode(children[idx ++], keys, values, pos);
+    }
+}
+
+/**
+ * 把全部key和value依次写入keys和values，二者容量须不少于count，为NULL的不写
+ * 顺序由哈希码决定
+ * @param objHashMap
+ * @param keys
+ * @param values
+ */
+void hashMapCollect(ObjHashMap *objHashMap, Value *keys, Value *values) {
+    uint32_t pos = 0;
+    if (objHashMap->root != NULL) {
+        collectHamtNode(objHashMap->root, keys, values, &pos);
+    }
+}
+
+/**
+ * 释放表及只被它引用的节点，供gc调用
+ * @param vm
+ * @param objHashMap
+ */
+void freeObjHashMap(VM *vm, ObjHashMap *objHashMap) {
+    releaseHamtNode(vm, objHashMap->root);
+    DEALLOCATE(vm, objHashMap);
+}
@@ -0,0 +1,46 @@
+//
+// Created by ZiXuan on 2022/7/30.
+//
+
+#ifndef SPARROW_OBJ_HASH_MAP_H
+#define SPARROW_OBJ_HASH_MAP_H
+
+/**
+ * 实现持久化哈希表（HAMT）：每层取哈希码的5位在位图中定位，
+ * 修改时只复制根到目标的一条路径，新旧版本共享其余节点。
+ * 节点的引用计数及暂态模式同持久化向量
+ */
+
+#include "obj_map.h"
+
+#define HAMT_BITS 5
+#define HAMT_MASK ((1u << HAMT_BITS) - 1)
+// 哈希码的32位在此位移所在的层用尽，再往下为冲突节点
+#define HAMT_MAX_SHIFT 30
+
+typedef struct hamtNode {
+    uint32_t refCount;  // 为1时可原地修改
+    uint32_t dataMap;  // 该位的key直接存在entries中
+    uint32_t nodeMap;  // 该位为子节点
+    uint32_t entryNum;
+    uint32_t childNum;
+    Entry entries[0];  // 之后紧跟childNum个子节点指针；冲突节点只有entries，位图为0
+} HamtNode;
+
+typedef struct {
+    ObjHeader objHeader;
+    uint32_t count;
+    bool isTransient;  // 为真时修改操作原地进行并返回本对象
+    HamtNode *root;  // 空表为NULL
+} ObjHashMap;  // 持久化哈希表对象
+
+ObjHashMap* newObjHashMap(VM *vm);
+Value hashMapGet(VM *vm, ObjHashMap *objHashMap, Value key);
+ObjHashMap* hashMapSet(VM *vm, ObjHashMap *objHashMap, Value key, Value value);
+ObjHashMap* hashMapRemove(VM *vm, ObjHashMap *objHashMap, Value key);
+ObjHashMap* hashMapTransient(VM *vm, ObjHashMap *objHashMap);
+ObjHashMap* hashMapPersistent(VM *vm, ObjHashMap *objHashMap);
+void hashMapCollect(ObjHashMap *objHashMap, Value *keys, Value *values);
+void freeObjHashMap(VM *vm, ObjHashMap *objHashMap);
+
+#endif //SPARROW_OBJ_HASH_MAP_H
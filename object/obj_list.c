@@ -1,6 +1,7 @@
 //
 // Created by ZiXuan on 2022/6/11.
 //
+#include <string.h>
 #include "obj_list.h"
 
 /**
@@ -26,30 +27,81 @@ ObjList* newObjList(VM *vm, uint32_t elementNum) {
 }
 
 
+/**
+ * 确保list能再容纳addNum个元素，容量不足时一次扩到位
+ * @param vm
+ * @param objList
+ * @param addNum
+ */
+void reserveList(VM *vm, ObjList *objList, uint32_t addNum) {
+    uint32_t newCount = objList->elements.count + addNum;
+    if (newCount <= objList->elements.capacity) {
+        return;
+    }
+    uint32_t newCapacity = ceilToPowerOf2(newCount);
+    objList->elements.datas = (Value *)memManager(vm, objList->elements.datas,
+                                                  objList->elements.capacity * sizeof(Value),
+                                                  newCapacity * sizeof(Value));
+    objList->elements.capacity = newCapacity;
+}
+
 /**
  * 在objlist中索引为index处插入value，类似于list[index]=value
+ * index等于元素个数时追加到末尾
  * @param vm
  * @param objList
  * @param index
  * @param value
  */
 void insertElement(VM *vm, ObjList *objList, uint32_t index, Value value) {
-    if (index > objList->elements.count - 1) {
+    insertElements(vm, objList, index, &value, 1);
+}
+
+/**
+ * 在index处插入values中的num个元素，后面的元素用memmove整体后移，
+ * 容量只增长一次。values可以来自objList自身
+ * @param vm
+ * @param objList
+ * @param index
+ * @param values
+ * @param num
+ */
+void insertElements(VM *vm, ObjList *objList, uint32_t index, const Value *values, uint32_t num) {
+    if (objList->objHeader.isFrozen) {
+        RUN_ERROR("can't modify a frozen list!");
+    }
+    if (index > objList->elements.count) {
         RUN_ERROR("index out bounded!");
     }
+    if (num == 0) {
+        return;
+    }
+
+    // values可能指向本list，扩容会使其失效，先记下偏移
+    Value *oldDatas = objList->elements.datas;
+    bool fromSelf = oldDatas != NULL && values >= oldDatas && values < oldDatas + objList->elements.count;
+    uint32_t selfOffset = fromSelf ? (uint32_t)(values - oldDatas) : 0;
 
-    // 准备有个Value的空间以容纳新元素产生的空间波动
-    // 即最后一个元素要后移1个空间
-    ValueBufferAdd(vm, &objList->elements, VT_TO_VALUE(VT_NULL));
+    reserveList(vm, objList, num);
+    Value *datas = objList->elements.datas;
+    uint32_t tailNum = objList->elements.count - index;
+    memmove(datas + index + num, datas + index, tailNum * sizeof(Value));
 
-    // 下面使index后面的元素整体后移一位
-    uint32_t idx = objList->elements.count - 1;
-    while (idx > index) {
-        objList->elements.datas[idx] = objList->elements.datas[idx - 1];
-        idx --;
+    if (!fromSelf) {
+        memcpy(datas + index, values, num * sizeof(Value));
+    } else if (selfOffset + num <= index) {
+        // 源区间整体在插入点之前，未被移动
+        memcpy(datas + index, datas + selfOffset, num * sizeof(Value));
+    } else if (selfOffset >= index) {
+        // 源区间整体在插入点之后，已随尾部后移num位
+        memcpy(datas + index, datas + selfOffset + num, num * sizeof(Value));
+    } else {
+        // 源区间跨过插入点，前半段未动，后半段已后移
+        uint32_t headNum = index - selfOffset;
+        memcpy(datas + index, datas + selfOffset, headNum * sizeof(Value));
+        memcpy(datas + index + headNum, datas + index + num, (num - headNum) * sizeof(Value));
     }
-    // 在index处插入数值
-    objList->elements.datas[index] = value;
+    objList->elements.count += num;
 }
 
 /**
@@ -61,7 +113,7 @@ void insertElement(VM *vm, ObjList *objList, uint32_t index, Value value) {
 static void shrinkList(VM *vm, ObjList *objList, uint32_t newCapacity) {
     uint32_t oldSize = objList->elements.capacity * sizeof(Value);
     uint32_t newSize = newCapacity * sizeof(Value);
-    memManager(vm, objList->elements.datas, oldSize, newSize);
+    objList->elements.datas = (Value *)memManager(vm, objList->elements.datas, oldSize, newSize);
     objList->elements.capacity = newCapacity;
 }
 
@@ -73,21 +125,245 @@ static void shrinkList(VM *vm, ObjList *objList, uint32_t newCapacity) {
  * @return
  */
 Value removeElement(VM *vm, ObjList *objList, uint32_t index) {
+    if (index >= objList->elements.count) {
+        RUN_ERROR("index out bounded!");
+    }
     Value valueRemoved = objList->elements.datas[index];
+    removeRange(vm, objList, index, 1);
+    return valueRemoved;
+}
 
-    // 使index后面的元素前移一位，覆盖index处的元素
-    uint32_t idx = index;
-    while (idx < objList->elements.count) {
-        objList->elements.datas[idx] = objList->elements.datas[idx + 1];
-        idx ++;
+/**
+ * 删除从start起的num个元素，后面的元素用memmove整体前移
+ * @param vm
+ * @param objList
+ * @param start
+ * @param num
+ */
+void removeRange(VM *vm, ObjList *objList, uint32_t start, uint32_t num) {
+    if (objList->objHeader.isFrozen) {
+        RUN_ERROR("can't modify a frozen list!");
     }
+    if (start > objList->elements.count || num > objList->elements.count - start) {
+        RUN_ERROR("index out bounded!");
+    }
+    Value *datas = objList->elements.datas;
+    uint32_t tailNum = objList->elements.count - start - num;
+    memmove(datas + start, datas + start + num, tailNum * sizeof(Value));
+    objList->elements.count -= num;
 
     // 若容量利用率过低就减小容量
     uint32_t  _capacity = objList->elements.capacity / CAPACITY_GROW_FACTOR;
     if (_capacity > objList->elements.count) {
         shrinkList(vm, objList, _capacity);
     }
+}
 
-    objList->elements.count --;
-    return valueRemoved;
-}
\ No newline at end of file
+/**
+ * 新建list，内容为objList中从start起的num个元素的拷贝
+ * @param vm
+ * @param objList
+ * @param start
+ * @param num
+ * @return
+ */
+ObjList* newObjListSlice(VM *vm, ObjList *objList, uint32_t start, uint32_t num) {
+    if (start > objList->elements.count || num > objList->elements.count - start) {
+        RUN_ERROR("index out bounded!");
+    }
+    ObjList *slice = newObjList(vm, num);
+    if (num > 0) {
+        memcpy(slice->elements.datas, objList->elements.datas + start, num * sizeof(Value));
+    }
+    return slice;
+}
+
+/**
+ * 数字比较，NaN排在最后以保持严格弱序
+ * @param a
+ * @param b
+ * @return
+ */
+static inline bool numLess(Value a, Value b) {
+    return (a.num < b.num) | ((a.num == a.num) & (b.num != b.num));
+}
+
+/**
+ * 字符串按字节序比较，调用前已展开拼接串
+ * @param a
+ * @param b
+ * @return
+ */
+static inline bool strLess(Value a, Value b) {
+    ObjString *left = VALUE_TO_OBJSTR(a);
+    ObjString *right = VALUE_TO_OBJSTR(b);
+    uint32_t minLength = left->value.length < right->value.length ? left->value.length : right->value.length;
+    int cmp = memcmp(left->value.start, right->value.start, minLength);
+    return cmp < 0 || (cmp == 0 && left->value.length < right->value.length);
+}
+
+/**
+ * 以LESS为比较函数定义内省排序name##Sort：
+ *      已有序或完全逆序时线性返回，16个以内插入排序，
+ *      其余三数取中快排，递归过深改用堆排序，保证O(nlogn)
+ */
+#define DEFINE_LIST_SORT(name, LESS) \
+    static void name##InsertionSort(Value *datas, uint32_t num) { \
+        uint32_t idx = 1; \
+        while (idx < num) { \
+            Value value = datas[idx]; \
+            uint32_t pos = idx; \
+            while (pos > 0 && LESS(value, datas[pos - 1])) { \
+                datas[pos] = datas[pos - 1]; \
+                pos --; \
+            } \
+            datas[pos] = value; \
+            idx ++; \
+        } \
+    } \
+\
+    static void name##SiftDown(Value *datas, uint32_t root, uint32_t num) { \
+        Value value = datas[root]; \
+        uint32_t child = root * 2 + 1; \
+        while (child < num) { \
+            if (child + 1 < num && LESS(datas[child], datas[child + 1])) { \
+                child ++; \
+            } \
+            if (!LESS(value, datas[child])) { \
+                break; \
+            } \
+            datas[root] = datas[child]; \
+            root = child; \
+            child = root * 2 + 1; \
+        } \
+        datas[root] = value; \
+    } \
+\
+    static void name##HeapSort(Value *datas, uint32_t num) { \
+        uint32_t idx = num / 2; \
+        while (idx > 0) { \
+            idx --; \
+            name##SiftDown(datas, idx, num); \
+        } \
+        idx = num; \
+        while (idx > 1) { \
+            idx --; \
+            Value top = datas[0]; \
+            datas[0] = datas[idx]; \
+            datas[idx] = top; \
+            name##SiftDown(datas, 0, idx); \
+        } \
+    } \
+\
+    static void name##IntroSort(Value *datas, uint32_t num, uint32_t depthLimit) { \
+        while (num > 16) { \
+            if (depthLimit == 0) { \
+                name##HeapSort(datas, num); \
+                return; \
+            } \
+            depthLimit --; \
+            /* 三数取中，并把三者排好，首尾作哨兵 */ \
+            uint32_t mid = num / 2, last = num - 1; \
+            Value tmp; \
+            if (LESS(datas[mid], datas[0])) { tmp = datas[mid]; datas[mid] = datas[0]; datas[0] = tmp; } \
+            if (LESS(datas[last], datas[mid])) { tmp = datas[last]; datas[last] = datas[mid]; datas[mid] = tmp; } \
+            if (LESS(datas[mid], datas[0])) { tmp = datas[mid]; datas[mid] = datas[0]; datas[0] = tmp; } \
+            Value pivot = datas[mid]; \
+            uint32_t left = 0, right = last; \
+            while (true) { \
+                do { left ++; } while (LESS(datas[left], pivot)); \
+                do { right --; } while (LESS(pivot, datas[right])); \
+                if (left >= right) { \
+                    break; \
+                } \
+                tmp = datas[left]; datas[left] = datas[right]; datas[right] = tmp; \
+            } \
+            /* 递归处理较小的一半，较大的一半继续循环，栈深度为O(logn) */ \
+            uint32_t leftNum = right + 1; \
+            if (leftNum < num - leftNum) { \
+                name##IntroSort(datas, leftNum, depthLimit); \
+                datas += leftNum; \
+                num -= leftNum; \
+            } else { \
+                name##IntroSort(datas + leftNum, num - leftNum, depthLimit); \
+                num = leftNum; \
+            } \
+        } \
+        name##InsertionSort(datas, num); \
+    } \
+\
+    static void name##Sort(Value *datas, uint32_t num) { \
+        uint32_t ascending = 1, descending = 1; \
+        uint32_t idx = 1; \
+        while (idx < num) { \
+            ascending += !LESS(datas[idx], datas[idx - 1]); \
+            descending += LESS(datas[idx], datas[idx - 1]); \
+            idx ++; \
+        } \
+        if (ascending == num) { \
+            return; \
+        } \
+        if (descending == num) { \
+            uint32_t low = 0, high = num - 1; \
+            while (low < high) { \
+                Value tmp = datas[low]; datas[low] = datas[high]; datas[high] = tmp; \
+                low ++; \
+                high --; \
+            } \
+            return; \
+        } \
+        uint32_t depthLimit = 0; \
+        idx = num; \
+        while (idx > 0) { \
+            depthLimit += 2; \
+            idx >>= 1; \
+        } \
+        name##IntroSort(datas, num, depthLimit); \
+    }
+
+DEFINE_LIST_SORT(num, numLess)
+DEFINE_LIST_SORT(str, strLess)
+
+/**
+ * 元素全为数字或全为字符串时原地升序排序，直接比较ValueBuffer中的值，不经方法调用
+ * 字符串按字节序即码点序比较，拼接串先展开
+ * @param vm
+ * @param objList
+ * @return 含其它类型的元素时返回false，list不变
+ */
+bool sortListNatural(VM *vm, ObjList *objList) {
+    if (objList->objHeader.isFrozen) {
+        RUN_ERROR("can't modify a frozen list!");
+    }
+    Value *datas = objList->elements.datas;
+    uint32_t num = objList->elements.count;
+    if (num < 2) {
+        return true;
+    }
+
+    uint32_t idx = 0;
+    if (VALUE_IS_NUM(datas[0])) {
+        while (idx < num && VALUE_IS_NUM(datas[idx])) {
+            idx ++;
+        }
+        if (idx < num) {
+            return false;
+        }
+        numSort(datas, num);
+        return true;
+    }
+
+    while (idx < num && VALUE_IS_CREATIN_OBJ(datas[idx], OT_STRING)) {
+        idx ++;
+    }
+    if (idx < num) {
+        return false;
+    }
+    idx = 0;
+    while (idx < num) {
+        datas[idx] = OBJ_TO_VALUE(flattenObjString(vm, VALUE_TO_OBJSTR(datas[idx])));
+        idx ++;
+    }
+    strSort(datas, num);
+    return true;
+}
@@ -18,7 +18,12 @@ typedef struct {
 } ObjList;
 
 ObjList* newObjList(VM *vm, uint32_t elementNum);
+void reserveList(VM *vm, ObjList *objList, uint32_t addNum);
 Value removeElement(VM *vm, ObjList *objList, uint32_t index);
 void insertElement(VM *vm, ObjList *objList, uint32_t index, Value value);
+void insertElements(VM *vm, ObjList *objList, uint32_t index, const Value *values, uint32_t num);
+void removeRange(VM *vm, ObjList *objList, uint32_t start, uint32_t num);
+ObjList* newObjListSlice(VM *vm, ObjList *objList, uint32_t start, uint32_t num);
+bool sortListNatural(VM *vm, ObjList *objList);
 
 #endif //SPARROW_OBJ_LIST_H
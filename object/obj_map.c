@@ -2,10 +2,12 @@
 // Created by ZiXuan on 2022/6/11.
 //
 #include "obj_map.h"
+#include <string.h>
 #include "class.h"
 #include "../vm/vm.h"
 #include "obj_string.h"
 #include "obj_range.h"
+#include "obj_tuple.h"
 
 /**
  * 创建新map对象
@@ -15,61 +17,122 @@
 ObjMap* newObjMap(VM *vm) {
     ObjMap *objMap = ALLOCATE(vm, ObjMap);
     initObjHeader(vm, &objMap->objHeader, OT_MAP, vm->mapClass);
-    objMap->capacity = objMap->count = 0;
+    objMap->capacity = objMap->count = objMap->entryNum = 0;
+    objMap->indices = NULL;
     objMap->entries = NULL;
     return objMap;
 }
 
 /**
  * 计算数字的哈希码
+ * 整数的double低位全为0，只乘一个常数时低位仍大多为0，
+ * 先把高位异或到低位再乘法混合，索引表按低位定位
  * @param num
  * @return
  */
 static uint32_t hashNum(double num) {
     Bits64 bits64;
     bits64.num = num;
-    return bits64.bits32[0] ^ bits64.bits32[1];
+    uint64_t bits = bits64.bits64;
+    bits ^= bits >> 33;
+    bits *= 0xff51afd7ed558ccdull;
+    bits ^= bits >> 33;
+    return (uint32_t)bits;
+}
+
+/**
+ * 返回实例的类在脚本中定义的方法，没有或是原生方法时返回NULL
+ * @param objHeader
+ * @param index
+ * @return
+ */
+static Method* scriptMethodOf(ObjHeader *objHeader, int index) {
+    Class *class = objHeader->class;
+    if ((uint32_t)index >= class->methods.count || class->methods.datas[index].type != MT_SCRIPT) {
+        return NULL;
+    }
+    return &class->methods.datas[index];
+}
+
+/**
+ * 实例能否作为key：其类须在脚本中定义hashCode
+ * @param vm
+ * @param value
+ * @return
+ */
+bool instanceIsHashable(VM *vm, Value value) {
+    return VALUE_IS_CREATIN_OBJ(value, OT_INSTANCE) && scriptMethodOf(value.objHeader, vm->hashCodeIndex) != NULL;
+}
+
+/**
+ * 调用实例的hashCode计算其哈希码
+ * @param vm
+ * @param objHeader
+ * @return 出错时返回0，错误已写入当前线程
+ */
+static uint32_t hashInstance(VM *vm, ObjHeader *objHeader) {
+    Method *method = scriptMethodOf(objHeader, vm->hashCodeIndex);
+    if (method == NULL) {
+        RUN_ERROR("instance used as a key must define hashCode!");
+    }
+    Value receiver = OBJ_TO_VALUE(objHeader);
+    Value result;
+    if (!callClosure(vm, method->obj, &receiver, 1, &result)) {
+        return 0;
+    }
+    if (!VALUE_IS_NUM(result)) {
+        setNativeError(vm, "hashCode must return a number!");
+        return 0;
+    }
+    return hashNum(VALUE_TO_NUM(result));
 }
 
 /**
  * 计算对象的哈希码
+ * @param vm
  * @param objHeader
  * @return
  */
-static uint32_t hashObj(ObjHeader *objHeader) {
+static uint32_t hashObj(VM *vm, ObjHeader *objHeader) {
     switch (objHeader->type) {
         case OT_CLASS:
-            return hashString(((Class *)objHeader)->name->value.start,
-                              ((Class *)objHeader)->name->value.length);
+            return objStringHash(((Class *)objHeader)->name);
 //            break;
         case OT_RANGE: {
             ObjRange *objRange = (ObjRange *) objHeader;
-            return hashNum(objRange->from) ^ hashNum(objRange->to);
+            return hashNum(objRange->from) ^ hashNum(objRange->to) ^ hashNum(objRange->step);
 //            break;
         }
         case OT_STRING:
-            return ((ObjString *)objHeader)->hashCode;
+            return objStringHash((ObjString *)objHeader);
+        case OT_TUPLE:
+            return tupleHash(vm, (ObjTuple *)objHeader);
+        case OT_INSTANCE:
+            return hashInstance(vm, objHeader);
         default:
-            RUN_ERROR("the hashable are objstring, objrange and class.");
+            RUN_ERROR("the hashable are objstring, objrange, tuple, class and instance with hashCode.");
     }
     return 0;
 }
 
 /**
- * 根据value的类型调用相应的哈希函数
+ * 根据value的类型调用相应的哈希函数，Set与map共用
+ * @param vm
  * @param value
  * @return
  */
-static uint32_t hashValue(Value value) {
+uint32_t hashValue(VM *vm, Value value) {
     switch (value.type) {
         case VT_FALSE:
             return 0;
         case VT_NULL:
             return 1;
+        case VT_TRUE:
+            return 2;
         case VT_NUM:
             return hashNum(value.num);
         case VT_OBJ:
-            return hashObj(value.objHeader);
+            return hashObj(vm, value.objHeader);
         default:
             RUN_ERROR("unsupport type hashed!");
     }
@@ -77,125 +140,198 @@ static uint32_t hashValue(Value value) {
 }
 
 /**
- * 在entries中添加entry，如果是新的key则返回true
- * @param entries
+ * 判断两个key是否相等，Set与map共用
+ * 两个不同的实例调用其类在脚本中定义的==(_)，没有定义时不相等
+ * @param vm
+ * @param a
+ * @param b
+ * @return 出错时返回false，错误已写入当前线程
+ */
+bool keyIsEqual(VM *vm, Value a, Value b) {
+    if (!VALUE_IS_CREATIN_OBJ(a, OT_INSTANCE) || !VALUE_IS_CREATIN_OBJ(b, OT_INSTANCE) ||
+        a.objHeader == b.objHeader) {
+        return valueIsEqual(a, b);
+    }
+    Method *method = scriptMethodOf(a.objHeader, vm->equalIndex);
+    if (method == NULL) {
+        return false;
+    }
+    Value args[2] = {a, b};
+    Value result;
+    if (!callClosure(vm, method->obj, args, 2, &result)) {
+        return false;
+    }
+    return !VALUE_IS_FALSE(result) && !VALUE_IS_NULL(result);
+}
+
+/**
+ * 索引表有capacity个槽位时entries的容量
  * @param capacity
- * @param key
- * @param value
  * @return
  */
-static int addEntry(Entry *entries, uint32_t capacity, Value key, Value value) {
-    uint32_t index = hashValue(key) % capacity;
+uint32_t mapEntryCapacity(uint32_t capacity) {
+    return (uint32_t)(capacity * MAP_LOAD_PERCENT);
+}
 
-    // 通过开放探测法找可用的slot
+/**
+ * 在索引表中查找key
+ * @param vm
+ * @param objMap
+ * @param key
+ * @param hashCode
+ * @param insertSlot 不为NULL时存入可插入key的槽位，即探测中遇到的首个删除位或空位
+ * @return key所在的槽位，不存在时返回-1
+ */
+static int findSlot(VM *vm, ObjMap *objMap, Value key, uint32_t hashCode, uint32_t *insertSlot) {
+    uint32_t mask = objMap->capacity - 1;
+    uint32_t slot = hashCode & mask;
+    int deletedSlot = -1;
     while (true) {
-        // 找到空闲的slot，说明目前没有此key，直接赋值返回
-        if (entries[index].key.type == VT_UNDEFINED) {
-            entries[index].key = key;
-            entries[index].value = value;
-            return true;
+        uint32_t index = objMap->indices[slot];
+        if (index == MAP_INDEX_EMPTY) {
+            if (insertSlot != NULL) {
+                *insertSlot = deletedSlot >= 0 ? (uint32_t)deletedSlot : slot;
+            }
+            return -1;
+        }
+        if (index == MAP_INDEX_DELETED) {
+            if (deletedSlot < 0) {
+                deletedSlot = (int)slot;
+            }
         }
-        else if (valueIsEqual(entries[index].key, key)) {
-            entries[index].value = value;
-            return false;
+        else if (keyIsEqual(vm, objMap->entries[index - MAP_INDEX_BASE].key, key)) {
+            return (int)slot;
         }
-        index = (index + 1) % capacity;
+        slot = (slot + 1) & mask;
     }
 }
 
 /**
- * 使对象objMap的容量调整到capacity
+ * 重建索引表，槽位数调整为newCapacity，同时去掉entries中已删除的entry，
+ * 保持其余entry的插入顺序
  * @param vm
  * @param objMap
  * @param newCapacity
  */
 static void resizeMap(VM *vm, ObjMap *objMap, uint32_t newCapacity) {
-    Entry *newEntries = ALLOCATE_ARRAY(vm, Entry, newCapacity);
+    uint32_t newEntryCapacity = mapEntryCapacity(newCapacity);
+    uint32_t *newIndices = ALLOCATE_ARRAY(vm, uint32_t, newCapacity);
+    Entry *newEntries = ALLOCATE_ARRAY(vm, Entry, newEntryCapacity);
+    memset(newIndices, 0, sizeof(uint32_t) * newCapacity);
+
+    uint32_t mask = newCapacity - 1;
+    uint32_t newNum = 0;
     uint32_t idx = 0;
-    while (idx < newCapacity) {
-        newEntries[idx].key = VT_TO_VALUE(VT_UNDEFINED);
-        newEntries[idx].value = VT_TO_VALUE(VT_FALSE);
-        idx ++;
-    }
-    // 遍历老的数组，把有值的部分插入到新数组
-    if (objMap->capacity > 0) {
-        Entry *entryArr = objMap->entries;
-        idx = 0;
-        while (idx < objMap->capacity) {
-            if (entryArr[idx].key.type != VT_UNDEFINED) {
-                addEntry(newEntries, newCapacity, entryArr[idx].key, entryArr[idx].value);
+    while (idx < objMap->entryNum) {
+        Entry *entry = &objMap->entries[idx];
+        if (!VALUE_IS_UNDEFINED(entry->key)) {
+            // 新表中没有重复的key也没有删除位，找到空位即可
+            uint32_t slot = hashValue(vm, entry->key) & mask;
+            while (newIndices[slot] != MAP_INDEX_EMPTY) {
+                slot = (slot + 1) & mask;
             }
-            idx ++;
+            newIndices[slot] = newNum + MAP_INDEX_BASE;
+            newEntries[newNum ++] = *entry;
         }
+        idx ++;
     }
-    // 将entry数组空间回收
-    DEALLOCATE_ARRAY(vm, objMap->entries, objMap->count);
+
+    DEALLOCATE_ARRAY(vm, objMap->indices, objMap->capacity);
+    DEALLOCATE_ARRAY(vm, objMap->entries, mapEntryCapacity(objMap->capacity));
+    objMap->indices = newIndices;
     objMap->entries = newEntries;
     objMap->capacity = newCapacity;
+    objMap->entryNum = newNum;
 }
 
 /**
- * 在objmap中查找key对应的entry
+ * 预留空间，使map容纳entryNum个有效entry前不再重建
+ * 用于已知元素个数的批量插入，只分配一次
+ * @param vm
  * @param objMap
- * @param value
- * @return
+ * @param entryNum
  */
-static Entry* findEntry(ObjMap* objMap, Value key) {
-    // objmap为空则返回null
-    if (objMap->capacity == 0) {
-        return NULL;
+void mapReserve(VM *vm, ObjMap *objMap, uint32_t entryNum) {
+    if (objMap->objHeader.isFrozen) {
+        RUN_ERROR("can't modify a frozen map!");
     }
-
-    // 以下用开放定址法
-    // 用哈希值对容量取模计算槽位
-    uint32_t index = hashValue(key) % objMap->capacity;
-    Entry *entry;
-    while (true) {
-        entry = &objMap->entries[index];
-
-        if (valueIsEqual(entry->key, key)) {
-            return entry;
-        }
-        if (VALUE_IS_UNDEFINED(entry->key) && VALUE_IS_FALSE(entry->value)) {
-            return NULL;
-        }
-        index = (index + 1) % objMap->capacity;
+    // 已删除的entry在重建时被压缩，只需为有效entry预留
+    if (entryNum < objMap->count) {
+        entryNum = objMap->count;
+    }
+    if (objMap->entryNum + (entryNum - objMap->count) <= mapEntryCapacity(objMap->capacity)) {
+        return;
+    }
+    uint32_t newCapacity = objMap->capacity < MAP_MIN_CAPACITY ? MAP_MIN_CAPACITY : objMap->capacity;
+    while (mapEntryCapacity(newCapacity) < entryNum) {
+        newCapacity *= 2;
     }
+    resizeMap(vm, objMap, newCapacity);
 }
 
 /**
  * 在objmap中实现key与value的关联 objmap[key]=value
+ * 新key追加到entries末尾，已有的key原位更新，不改变顺序
  * @param vm
  * @param objMap
  * @param key
  * @param value
  */
 void mapSet(VM *vm, ObjMap *objMap, Value key, Value value) {
-    if (objMap->count + 1 > objMap->capacity * MAP_LOAD_PERCENT) {
-        uint32_t newCapacity = objMap->capacity * CAPACITY_GROW_FACTOR;
-        if (newCapacity < MIN_CAPACITY) {
-            newCapacity = MIN_CAPACITY;
+    if (objMap->objHeader.isFrozen) {
+        RUN_ERROR("can't modify a frozen map!");
+    }
+    uint32_t hashCode = hashValue(vm, key);
+    uint32_t insertSlot = 0;
+    if (objMap->capacity > 0) {
+        int slot = findSlot(vm, objMap, key, hashCode, &insertSlot);
+        if (slot >= 0) {
+            objMap->entries[objMap->indices[slot] - MAP_INDEX_BASE].value = value;
+            return;
         }
-        resizeMap(vm, objMap, newCapacity);
     }
 
-    if (addEntry(objMap->entries, objMap->capacity, key, value)) {
-        objMap->count ++;
+    // 删除时不重建，以免打乱进行中的遍历，删除后利用率过低时在插入前缩小
+    if (objMap->capacity > MAP_MIN_CAPACITY && objMap->entryNum > objMap->count &&
+        objMap->count * 8 < mapEntryCapacity(objMap->capacity)) {
+        resizeMap(vm, objMap, objMap->capacity / 2);
+        findSlot(vm, objMap, key, hashCode, &insertSlot);
     }
+
+    // entries已满时重建，有效entry至多占新容量的一半，重建的开销均摊为O(1)；
+    // 已删除的entry较多时只需原地压缩
+    if (objMap->entryNum >= mapEntryCapacity(objMap->capacity)) {
+        uint32_t newCapacity = objMap->capacity < MAP_MIN_CAPACITY ? MAP_MIN_CAPACITY : objMap->capacity;
+        while ((objMap->count + 1) * 2 > mapEntryCapacity(newCapacity)) {
+            newCapacity *= 2;
+        }
+        resizeMap(vm, objMap, newCapacity);
+        findSlot(vm, objMap, key, hashCode, &insertSlot);
+    }
+
+    objMap->indices[insertSlot] = objMap->entryNum + MAP_INDEX_BASE;
+    objMap->entries[objMap->entryNum].key = key;
+    objMap->entries[objMap->entryNum].value = value;
+    objMap->entryNum ++;
+    objMap->count ++;
 }
 
 /**
  * 从map中查找key对应的value
+ * @param vm
  * @param objMap
  * @param key
  * @return
  */
-Value mapGet(ObjMap *objMap, Value key) {
-    Entry *entry = findEntry(objMap, key);
-    if (entry == NULL) {
+Value mapGet(VM *vm, ObjMap *objMap, Value key) {
+    if (objMap->count == 0) {
+        return VT_TO_VALUE(VT_UNDEFINED);
+    }
+    int slot = findSlot(vm, objMap, key, hashValue(vm, key), NULL);
+    if (slot < 0) {
         return VT_TO_VALUE(VT_UNDEFINED);
     }
-    return entry->value;
+    return objMap->entries[objMap->indices[slot] - MAP_INDEX_BASE].value;
 }
 
 /**
@@ -204,9 +340,14 @@ Value mapGet(ObjMap *objMap, Value key) {
  * @param objMap
  */
 void clearMap(VM *vm, ObjMap *objMap) {
-    DEALLOCATE_ARRAY(vm, objMap->entries, objMap->count);
+    if (objMap->objHeader.isFrozen) {
+        RUN_ERROR("can't modify a frozen map!");
+    }
+    DEALLOCATE_ARRAY(vm, objMap->indices, objMap->capacity);
+    DEALLOCATE_ARRAY(vm, objMap->entries, mapEntryCapacity(objMap->capacity));
+    objMap->indices = NULL;
     objMap->entries = NULL;
-    objMap->capacity = objMap->count = 0;
+    objMap->capacity = objMap->count = objMap->entryNum = 0;
 }
 
 /**
@@ -217,27 +358,37 @@ void clearMap(VM *vm, ObjMap *objMap) {
  * @return
  */
 Value removeKey(VM *vm, ObjMap *objMap, Value key) {
-    Entry *entry = findEntry(objMap, key);
-
-    if (entry == NULL) {
+    if (objMap->objHeader.isFrozen) {
+        RUN_ERROR("can't modify a frozen map!");
+    }
+    if (objMap->count == 0) {
+        return VT_TO_VALUE(VT_NULL);
+    }
+    int slot = findSlot(vm, objMap, key, hashValue(vm, key), NULL);
+    if (slot < 0) {
         return VT_TO_VALUE(VT_NULL);
     }
 
+    // 索引表中留下删除位，entries中的entry标记为已删除，下次插入时重建才一并去掉，
+    // 其余entry的下标不变，遍历中删除也不会跳过或重复
+    Entry *entry = &objMap->entries[objMap->indices[slot] - MAP_INDEX_BASE];
     Value value = entry->value;
     entry->key = VT_TO_VALUE(VT_UNDEFINED);
-    entry->value = VT_TO_VALUE(VT_TRUE);
-
+    entry->value = VT_TO_VALUE(VT_NULL);
+    objMap->indices[slot] = MAP_INDEX_DELETED;
     objMap->count --;
-    if (objMap->count == 0) {
-        clearMap(vm, objMap);
-    }
-    else if (objMap->count < objMap->capacity / (CAPACITY_GROW_FACTOR) * MAP_LOAD_PERCENT
-    && objMap->count > MIN_CAPACITY) {
-        uintptr_t newCapacity = objMap->capacity;
-        if (newCapacity < MIN_CAPACITY) {
-            newCapacity = MIN_CAPACITY;
-        }
-        resizeMap(vm, objMap, newCapacity);
-    }
     return value;
-}
\ No newline at end of file
+}
+
+/**
+ * 返回entries中从entryIdx起的首个有效entry的下标，按插入顺序遍历时使用
+ * @param objMap
+ * @param entryIdx
+ * @return 没有时返回objMap->entryNum
+ */
+uint32_t mapNextEntry(ObjMap *objMap, uint32_t entryIdx) {
+    while (entryIdx < objMap->entryNum && VALUE_IS_UNDEFINED(objMap->entries[entryIdx].key)) {
+        entryIdx ++;
+    }
+    return entryIdx;
+}
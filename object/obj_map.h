@@ -8,24 +8,38 @@
 #include "header_obj.h"
 
 #define MAP_LOAD_PERCENT 0.8
+#define MAP_MIN_CAPACITY 8 // 索引表的最小槽位数
+
+// 索引表中槽位的取值，其余为entries下标加MAP_INDEX_BASE
+#define MAP_INDEX_EMPTY 0
+#define MAP_INDEX_DELETED 1
+#define MAP_INDEX_BASE 2
 
 typedef struct {
-    Value key;
+    Value key; // 已删除的entry的key为VT_UNDEFINED
     Value value;
 } Entry;
 
 typedef struct {
     ObjHeader objHeader;
-    uint32_t capacity;
-    uint32_t count;
-    Entry *entries;
-} ObjMap;
+    uint32_t capacity; // 索引表的槽位数，为2的幂
+    uint32_t count; // 有效的entry数
+    uint32_t entryNum; // entries中已用的个数，含已删除的
+    uint32_t *indices; // 开放定址的索引表，存entries的下标
+    Entry *entries; // 按插入顺序紧密排列，容量为capacity * MAP_LOAD_PERCENT
+} ObjMap;  // 紧凑的有序map，遍历entries即按插入顺序访问
 
 ObjMap* newObjMap(VM *vm);
 
+bool instanceIsHashable(VM *vm, Value value);
+uint32_t hashValue(VM *vm, Value value);
+bool keyIsEqual(VM *vm, Value a, Value b);
+uint32_t mapEntryCapacity(uint32_t capacity);
+void mapReserve(VM *vm, ObjMap *objMap, uint32_t entryNum);
 void mapSet(VM *vm, ObjMap *objMap, Value key, Value value);
-Value mapGet(ObjMap *objMap, Value key);
+Value mapGet(VM *vm, ObjMap *objMap, Value key);
 void clearMap(VM *vm, ObjMap *objMap);
 Value removeKey(VM *vm, ObjMap *objMap, Value key);
+uint32_t mapNextEntry(ObjMap *objMap, uint32_t entryIdx);
 
 #endif //SPARROW_OBJ_MAP_H
@@ -11,12 +11,38 @@
  * @param vm
  * @param from
  * @param to
+ * @param step 不能为0
  * @return
  */
-ObjRange* newObjRange(VM *vm, int from, int to) {
+ObjRange* newObjRange(VM *vm, double from, double to, double step) {
+    ASSERT(step != 0, "range step can`t be zero!");
     ObjRange *objRange = ALLOCATE(vm, ObjRange);
     initObjHeader(vm, &objRange->objHeader, OT_RANGE, vm->rangeClass);
     objRange->from = from;
     objRange->to = to;
+    objRange->step = step;
     return objRange;
+}
+
+/**
+ * from..to的默认步长，from大于to时倒序
+ * @param from
+ * @param to
+ * @return
+ */
+double defaultRangeStep(double from, double to) {
+    return from > to ? -1 : 1;
+}
+
+/**
+ * 实现range.iterate(iter)：iter为null时返回from，否则返回iter加上步长，
+ * 越过to时返回false。迭代器就是当前值，不分配内存
+ * @param objRange
+ * @param iter null或数字
+ * @return
+ */
+Value rangeIterate(ObjRange *objRange, Value iter) {
+    double next = VALUE_IS_NULL(iter) ? objRange->from : VALUE_TO_NUM(iter) + objRange->step;
+    bool inRange = objRange->step > 0 ? next <= objRange->to : next >= objRange->to;
+    return inRange ? NUM_TO_VALUE(next) : VT_TO_VALUE(VT_FALSE);
 }
\ No newline at end of file
@@ -9,10 +9,13 @@
 
 typedef struct {
     ObjHeader objHeader;
-    int from;
-    int to;
+    double from;
+    double to; // 含to
+    double step; // 步长，非0，from..to在from大于to时为-1，否则为1
 } ObjRange;  // range对象
 
-ObjRange* newObjRange(VM *vm, int from, int to);
+ObjRange* newObjRange(VM *vm, double from, double to, double step);
+double defaultRangeStep(double from, double to);
+Value rangeIterate(ObjRange *objRange, Value iter);
 
 #endif //SPARROW_OBJ_RANGE_H
@@ -0,0 +1,312 @@
+//
+// Created by ZiXuan on 2022/7/27.
+//
+#include "obj_set.h"
+#include <string.h>
+#include "class.h"
+#include "../vm/vm.h"
+
+/**
+ * 新建空集合
+ * @param vm
+ * @return
+ */
+ObjSet* newObjSet(VM *vm) {
+    ObjSet *objSet = ALLOCATE(vm, ObjSet);
+    initObjHeader(vm, &objSet->objHeader, OT_SET, vm->setClass);
+    objSet->capacity = objSet->count = objSet->keyNum = 0;
+    objSet->indices = NULL;
+    objSet->keys = NULL;
+    return objSet;
+}
+
+/**
+ * 在索引表中查找key，同ObjMap的findSlot
+ * @param vm
+ * @param objSet
+ * @param key
+ * @param hashCode
+ * @param insertSlot 不为NULL时存入可插入key的槽位
+ * @return key所在的槽位，不存在时返回-1
+ */
+static int findSlot(VM *vm, ObjSet *objSet, Value key, uint32_t hashCode, uint32_t *insertSlot) {
+    uint32_t mask = objSet->capacity - 1;
+    uint32_t slot = hashCode & mask;
+    int deletedSlot = -1;
+    while (true) {
+        uint32_t index = objSet->indices[slot];
+        if (index == MAP_INDEX_EMPTY) {
+            if (insertSlot != NULL) {
+                *insertSlot = deletedSlot >= 0 ? (uint32_t)deletedSlot : slot;
+            }
+            return -1;
+        }
+        if (index == MAP_INDEX_DELETED) {
+            if (deletedSlot < 0) {
+                deletedSlot = (int)slot;
+            }
+        }
+        else if (keyIsEqual(vm, objSet->keys[index - MAP_INDEX_BASE], key)) {
+            return (int)slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+/**
+ * 重建索引表，槽位数调整为newCapacity，同时去掉已删除的key
+ * @param vm
+ * @param objSet
+ * @param newCapacity
+ */
+static void resizeSet(VM *vm, ObjSet *objSet, uint32_t newCapacity) {
+    uint32_t *newIndices = ALLOCATE_ARRAY(vm, uint32_t, newCapacity);
+    Value *newKeys = ALLOCATE_ARRAY(vm, Value, mapEntryCapacity(newCapacity));
+    memset(newIndices, 0, sizeof(uint32_t) * newCapacity);
+
+    uint32_t mask = newCapacity - 1;
+    uint32_t newNum = 0;
+    uint32_t idx = 0;
+    while (idx < objSet->keyNum) {
+        Value key = objSet->keys[idx];
+        if (!VALUE_IS_UNDEFINED(key)) {
+            uint32_t slot = hashValue(vm, key) & mask;
+            while (newIndices[slot] != MAP_INDEX_EMPTY) {
+                slot = (slot + 1) & mask;
+            }
+            newIndices[slot] = newNum + MAP_INDEX_BASE;
+            newKeys[newNum ++] = key;
+        }
+        idx ++;
+    }
+
+    DEALLOCATE_ARRAY(vm, objSet->indices, objSet->capacity);
+    DEALLOCATE_ARRAY(vm, objSet->keys, mapEntryCapacity(objSet->capacity));
+    objSet->indices = newIndices;
+    objSet->keys = newKeys;
+    objSet->capacity = newCapacity;
+    objSet->keyNum = newNum;
+}
+
+/**
+ * 确保还能追加addNum个key，容量不足时一次扩到位
+ * @param vm
+ * @param objSet
+ * @param addNum
+ */
+static void reserveSet(VM *vm, ObjSet *objSet, uint32_t addNum) {
+    if (objSet->keyNum + addNum <= mapEntryCapacity(objSet->capacity)) {
+        return;
+    }
+    uint32_t newCapacity = objSet->capacity < MAP_MIN_CAPACITY ? MAP_MIN_CAPACITY : objSet->capacity;
+    while ((objSet->count + addNum) * 2 > mapEntryCapacity(newCapacity)) {
+        newCapacity *= 2;
+    }
+    resizeSet(vm, objSet, newCapacity);
+}
+
+/**
+ * 添加key，已存在时不变
+ * @param vm
+ * @param objSet
+ * @param key
+ * @return 新加入时返回true
+ */
+bool setAdd(VM *vm, ObjSet *objSet, Value key) {
+    if (objSet->objHeader.isFrozen) {
+        RUN_ERROR("can't modify a frozen set!");
+    }
+    uint32_t hashCode = hashValue(vm, key);
+    uint32_t insertSlot = 0;
+    if (objSet->capacity > 0 && findSlot(vm, objSet, key, hashCode, &insertSlot) >= 0) {
+        return false;
+    }
+    if (objSet->capacity > MAP_MIN_CAPACITY && objSet->keyNum > objSet->count &&
+        objSet->count * 8 < mapEntryCapacity(objSet->capacity)) {
+        resizeSet(vm, objSet, objSet->capacity / 2);
+        findSlot(vm, objSet, key, hashCode, &insertSlot);
+    }
+    if (objSet->keyNum >= mapEntryCapacity(objSet->capacity)) {
+        reserveSet(vm, objSet, 1);
+        findSlot(vm, objSet, key, hashCode, &insertSlot);
+    }
+    objSet->indices[insertSlot] = objSet->keyNum + MAP_INDEX_BASE;
+    objSet->keys[objSet->keyNum ++] = key;
+    objSet->count ++;
+    return true;
+}
+
+/**
+ * 集合中是否有key
+ * @param vm
+ * @param objSet
+ * @param key
+ * @return
+ */
+bool setContains(VM *vm, ObjSet *objSet, Value key) {
+    if (objSet->count == 0) {
+        return false;
+    }
+    return findSlot(vm, objSet, key, hashValue(vm, key), NULL) >= 0;
+}
+
+/**
+ * 删除key
+ * @param vm
+ * @param objSet
+ * @param key
+ * @return key存在时返回true
+ */
+bool setRemove(VM *vm, ObjSet *objSet, Value key) {
+    if (objSet->objHeader.isFrozen) {
+        RUN_ERROR("can't modify a frozen set!");
+    }
+    if (objSet->count == 0) {
+        return false;
+    }
+    int slot = findSlot(vm, objSet, key, hashValue(vm, key), NULL);
+    if (slot < 0) {
+        return false;
+    }
+    objSet->keys[objSet->indices[slot] - MAP_INDEX_BASE] = VT_TO_VALUE(VT_UNDEFINED);
+    objSet->indices[slot] = MAP_INDEX_DELETED;
+
+    // 同map，删除时只留下删除位，下次插入时再重建
+    objSet->count --;
+    return true;
+}
+
+/**
+ * 回收空间
+ * @param vm
+ * @param objSet
+ */
+void clearSet(VM *vm, ObjSet *objSet) {
+    if (objSet->objHeader.isFrozen) {
+        RUN_ERROR("can't modify a frozen set!");
+    }
+    DEALLOCATE_ARRAY(vm, objSet->indices, objSet->capacity);
+    DEALLOCATE_ARRAY(vm, objSet->keys, mapEntryCapacity(objSet->capacity));
+    objSet->indices = NULL;
+    objSet->keys = NULL;
+    objSet->capacity = objSet->count = objSet->keyNum = 0;
+}
+
+/**
+ * 返回keys中从keyIdx起的首个有效key的下标
+ * @param objSet
+ * @param keyIdx
+ * @return 没有时返回objSet->keyNum
+ */
+uint32_t setNextKey(ObjSet *objSet, uint32_t keyIdx) {
+    while (keyIdx < objSet->keyNum && VALUE_IS_UNDEFINED(objSet->keys[keyIdx])) {
+        keyIdx ++;
+    }
+    return keyIdx;
+}
+
+/**
+ * 拷贝集合，索引表及keys原样拷贝，不重新计算哈希值
+ * @param vm
+ * @param src
+ * @return
+ */
+static ObjSet* copySet(VM *vm, ObjSet *src) {
+    ObjSet *objSet = newObjSet(vm);
+    if (src->capacity == 0) {
+        return objSet;
+    }
+    objSet->indices = ALLOCATE_ARRAY(vm, uint32_t, src->capacity);
+    objSet->keys = ALLOCATE_ARRAY(vm, Value, mapEntryCapacity(src->capacity));
+    memcpy(objSet->indices, src->indices, sizeof(uint32_t) * src->capacity);
+    memcpy(objSet->keys, src->keys, sizeof(Value) * src->keyNum);
+    objSet->capacity = src->capacity;
+    objSet->count = src->count;
+    objSet->keyNum = src->keyNum;
+    return objSet;
+}
+
+/**
+ * 并集：拷贝较大的集合，再逐个加入较小集合中的key，只探测较小集合的元素个数次
+ * 结果中较大集合的key在前
+ * @param vm
+ * @param a
+ * @param b
+ * @return
+ */
+ObjSet* setUnion(VM *vm, ObjSet *a, ObjSet *b) {
+    ObjSet *larger = a->count >= b->count ? a : b;
+    ObjSet *smaller = larger == a ? b : a;
+    ObjSet *result = copySet(vm, larger);
+    reserveSet(vm, result, smaller->count);
+    uint32_t keyIdx = setNextKey(smaller, 0);
+    while (keyIdx < smaller->keyNum) {
+        setAdd(vm, result, smaller->keys[keyIdx]);
+        keyIdx = setNextKey(smaller, keyIdx + 1);
+    }
+    return result;
+}
+
+/**
+ * 交集：遍历较小的集合，在较大的集合中探测，结果按较小集合的顺序
+ * @param vm
+ * @param a
+ * @param b
+ * @return
+ */
+ObjSet* setIntersect(VM *vm, ObjSet *a, ObjSet *b) {
+    ObjSet *smaller = a->count <= b->count ? a : b;
+    ObjSet *larger = smaller == a ? b : a;
+    ObjSet *result = newObjSet(vm);
+    uint32_t keyIdx = setNextKey(smaller, 0);
+    while (keyIdx < smaller->keyNum) {
+        Value key = smaller->keys[keyIdx];
+        if (setContains(vm, larger, key)) {
+            setAdd(vm, result, key);
+        }
+        keyIdx = setNextKey(smaller, keyIdx + 1);
+    }
+    return result;
+}
+
+/**
+ * 差集a-b：a较小时遍历a并在b中探测，否则拷贝a后删去b中的key，
+ * 两种情况都只探测较小集合的元素个数次，结果按a的顺序
+ * @param vm
+ * @param a
+ * @param b
+ * @return
+ */
+ObjSet* setDifference(VM *vm, ObjSet *a, ObjSet *b) {
+    ObjSet *result;
+    uint32_t keyIdx;
+    if (a->count <= b->count) {
+        result = newObjSet(vm);
+        keyIdx = setNextKey(a, 0);
+        while (keyIdx < a->keyNum) {
+            if (!setContains(vm, b, a->keys[keyIdx])) {
+                setAdd(vm, result, a->keys[keyIdx]);
+            }
+            keyIdx = setNextKey(a, keyIdx + 1);
+        }
+        return result;
+    }
+    result = copySet(vm, a);
+    keyIdx = setNextKey(b, 0);
+    while (keyIdx < b->keyNum && result->count > 0) {
+        setRemove(vm, result, b->keys[keyIdx]);
+        keyIdx = setNextKey(b, keyIdx + 1);
+    }
+    return result;
+}
+
+/**
+ * 释放集合，供gc调用
+ * @param vm
+ * @param objSet
+ */
+void freeObjSet(VM *vm, ObjSet *objSet) {
+    DEALLOCATE_ARRAY(vm, objSet->indices, objSet->capacity);
+    DEALLOCATE_ARRAY(vm, objSet->keys, mapEntryCapacity(objSet->capacity));
+    DEALLOCATE(vm, objSet);
+}
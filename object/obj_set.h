@@ -0,0 +1,34 @@
+//
+// Created by ZiXuan on 2022/7/27.
+//
+
+#ifndef SPARROW_OBJ_SET_H
+#define SPARROW_OBJ_SET_H
+
+/**
+ * 实现Set集合对象，布局同ObjMap，只是entries中只存key
+ */
+
+#include "obj_map.h"
+
+typedef struct {
+    ObjHeader objHeader;
+    uint32_t capacity; // 索引表的槽位数，为2的幂
+    uint32_t count; // 有效的key数
+    uint32_t keyNum; // keys中已用的个数，含已删除的
+    uint32_t *indices; // 开放定址的索引表，取值同ObjMap
+    Value *keys; // 按插入顺序紧密排列，已删除的为VT_UNDEFINED
+} ObjSet;  // 集合对象
+
+ObjSet* newObjSet(VM *vm);
+bool setAdd(VM *vm, ObjSet *objSet, Value key);
+bool setContains(VM *vm, ObjSet *objSet, Value key);
+bool setRemove(VM *vm, ObjSet *objSet, Value key);
+void clearSet(VM *vm, ObjSet *objSet);
+uint32_t setNextKey(ObjSet *objSet, uint32_t keyIdx);
+ObjSet* setUnion(VM *vm, ObjSet *a, ObjSet *b);
+ObjSet* setIntersect(VM *vm, ObjSet *a, ObjSet *b);
+ObjSet* setDifference(VM *vm, ObjSet *a, ObjSet *b);
+void freeObjSet(VM *vm, ObjSet *objSet);
+
+#endif //SPARROW_OBJ_SET_H
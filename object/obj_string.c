@@ -1,25 +1,110 @@
 #include "obj_string.h"
 #include "header_obj.h"
+#include "class.h"
+#include "../include/unicodeUtf8.h"
 #include <string.h>
 #include "../vm/vm.h"
+#include "../vm/arena.h"
 #include "../include/utils.h"
 #include "../include/common.h"
 #include <stdlib.h>
 
+// wyhash的种子及密钥
+#define WYHASH_SEED 0xa0761d6478bd642full
+static const uint64_t wyhashSecret[4] = {
+    0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull
+};
+
+static inline uint64_t wyRead8(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline uint64_t wyRead4(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+// 读取1到3个字节
+static inline uint64_t wyRead3(const uint8_t *p, uint32_t k) {
+    return ((uint64_t)p[0] << 16) | ((uint64_t)p[k >> 1] << 8) | p[k - 1];
+}
+
+// 64位乘法的128位结果的低位及高位分别写回a、b
+static inline void wyMum(uint64_t *a, uint64_t *b) {
+    __uint128_t r = *a;
+    r *= *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+}
+
+static inline uint64_t wyMix(uint64_t a, uint64_t b) {
+    wyMum(&a, &b);
+    return a ^ b;
+}
+
 /**
- * fnv-la算法
+ * wyhash算法，长串每步处理48字节，分三路独立混合
+ * @param p
+ * @param length
+ * @return 64位哈希值
+ */
+static uint64_t wyhash(const uint8_t *p, uint32_t length) {
+    uint64_t seed = WYHASH_SEED ^ wyMix(WYHASH_SEED ^ wyhashSecret[0], wyhashSecret[1]);
+    uint64_t a, b;
+    if (length <= 16) {
+        if (length >= 4) {
+            uint32_t offset = (length >> 3) << 2;
+            a = (wyRead4(p) << 32) | wyRead4(p + offset);
+            b = (wyRead4(p + length - 4) << 32) | wyRead4(p + length - 4 - offset);
+        }
+        else if (length > 0) {
+            a = wyRead3(p, length);
+            b = 0;
+        }
+        else {
+            a = b = 0;
+        }
+    }
+    else {
+        uint32_t left = length;
+        if (left > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = wyMix(wyRead8(p) ^ wyhashSecret[1], wyRead8(p + 8) ^ seed);
+                see1 = wyMix(wyRead8(p + 16) ^ wyhashSecret[2], wyRead8(p + 24) ^ see1);
+                see2 = wyMix(wyRead8(p + 32) ^ wyhashSecret[3], wyRead8(p + 40) ^ see2);
+                p += 48;
+                left -= 48;
+            } while (left > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (left > 16) {
+            seed = wyMix(wyRead8(p) ^ wyhashSecret[1], wyRead8(p + 8) ^ seed);
+            p += 16;
+            left -= 16;
+        }
+        a = wyRead8(p + left - 16);
+        b = wyRead8(p + left - 8);
+    }
+    a ^= wyhashSecret[1];
+    b ^= seed;
+    wyMum(&a, &b);
+    return wyMix(a ^ wyhashSecret[0] ^ length, b ^ wyhashSecret[1]);
+}
+
+/**
+ * 计算字符串的哈希码，取wyhash的低32位
+ * 0留给ObjString表示哈希码尚未计算，结果为0时改为1
  * @param str
  * @param length
  * @return
  */
 uint32_t hashString(char *str, uint32_t length) {
-    uint32_t hashCode = 2166136261, idx = 0;
-    while (idx < length) {
-        hashCode ^= str[idx];
-        hashCode *= 1677619;
-        idx ++;
-    }
-    return hashCode;
+    uint32_t hashCode = (uint32_t)wyhash((const uint8_t *)str, length);
+    return hashCode != 0 ? hashCode : 1;
 }
 
 /**
@@ -30,8 +115,121 @@ void hashObjString(ObjString *objString) {
     objString->hashCode = hashString(objString->value.start, objString->value.length);
 }
 
+/**
+ * 返回objString的哈希码，首次使用时才计算，从不参与哈希的字符串不付出此开销
+ * 未展开的拼接串先拷贝到临时缓冲区，不展开本身，因此不需要vm
+ * @param objString
+ * @return
+ */
+uint32_t objStringHash(ObjString *objString) {
+    if (objString->hashCode != 0) {
+        return objString->hashCode;
+    }
+    if (!OBJSTRING_IS_ROPE(objString)) {
+        hashObjString(objString);
+    }
+    else if (objString->right == NULL) {
+        objString->hashCode = objStringHash(objString->left);
+    }
+    else {
+        uint32_t length = objString->value.length;
+        char *buf = (char *)malloc(length);
+        if (buf == NULL) {
+            MEM_ERROR("allocate string hash buffer failed!");
+        }
+        copyObjStringChars(objString, buf);
+        objString->hashCode = hashString(buf, length);
+        free(buf);
+    }
+    return objString->hashCode;
+}
+
+/**
+ * 初始化短字符串驻留池，首次驻留时才分配
+ * @param pool
+ */
+void initStringPool(StringPool *pool) {
+    pool->slots = NULL;
+    pool->count = pool->capacity = 0;
+}
+
+/**
+ * 释放驻留池的槽位，池中的字符串仍在vm->allObjects中，随之释放
+ * @param vm
+ * @param pool
+ */
+void freeStringPool(VM *vm, StringPool *pool) {
+    DEALLOCATE_ARRAY(vm, pool->slots, pool->capacity);
+    initStringPool(pool);
+}
+
+/**
+ * 在驻留池中查找内容为str的字符串
+ * @param pool
+ * @param str
+ * @param length
+ * @param hashCode
+ * @return 未找到时返回NULL
+ */
+static ObjString* findPooledString(StringPool *pool, const char *str, uint32_t length, uint32_t hashCode) {
+    if (pool->capacity == 0) {
+        return NULL;
+    }
+    uint32_t mask = pool->capacity - 1;
+    uint32_t index = hashCode & mask;
+    while (pool->slots[index] != NULL) {
+        ObjString *objString = pool->slots[index];
+        if (objString->hashCode == hashCode && objString->value.length == length &&
+            memcmp(objString->value.start, str, length) == 0) {
+            return objString;
+        }
+        index = (index + 1) & mask;
+    }
+    return NULL;
+}
+
+/**
+ * 把objString放入驻留池，负载超过3/4时扩容，池满时不驻留
+ * @param vm
+ * @param pool
+ * @param objString
+ */
+static void addPooledString(VM *vm, StringPool *pool, ObjString *objString) {
+    if (pool->count >= SHORT_STRING_POOL_MAX) {
+        return;
+    }
+    if ((pool->count + 1) * 4 > pool->capacity * 3) {
+        uint32_t newCapacity = pool->capacity == 0 ? 64 : pool->capacity * 2;
+        ObjString **newSlots = ALLOCATE_ARRAY(vm, ObjString *, newCapacity);
+        memset(newSlots, 0, sizeof(ObjString *) * newCapacity);
+        uint32_t idx = 0;
+        while (idx < pool->capacity) {
+            ObjString *old = pool->slots[idx ++];
+            if (old != NULL) {
+                uint32_t index = old->hashCode & (newCapacity - 1);
+                while (newSlots[index] != NULL) {
+                    index = (index + 1) & (newCapacity - 1);
+                }
+                newSlots[index] = old;
+            }
+        }
+        DEALLOCATE_ARRAY(vm, pool->slots, pool->capacity);
+        pool->slots = newSlots;
+        pool->capacity = newCapacity;
+    }
+
+    uint32_t mask = pool->capacity - 1;
+    uint32_t index = objString->hashCode & mask;
+    while (pool->slots[index] != NULL) {
+        index = (index + 1) & mask;
+    }
+    pool->slots[index] = objString;
+    pool->count ++;
+}
+
 /**
  * 以str字符串创建objString对象，允许空串""
+ * 不超过SHORT_STRING_MAX_LEN的字符串驻留在vm中，相同内容返回同一对象
  * @param vm
  * @param str
  * @param length
@@ -40,20 +238,413 @@ void hashObjString(ObjString *objString) {
 ObjString* newObjString(VM *vm, const char *str, uint32_t length) {
     ASSERT(length == 0 || str != NULL, "str length don't match str!");
 
+    uint32_t hashCode = 0;
+    if (length <= SHORT_STRING_MAX_LEN) {
+        hashCode = hashString((char *)str, length);
+        ObjString *pooled = findPooledString(&vm->shortStrings, str, length, hashCode);
+        if (pooled != NULL) {
+            return pooled;
+        }
+    }
+
+    // 驻留的字符串随vm存在，不在分配区域中
+    bool pooled = length <= SHORT_STRING_MAX_LEN;
+    if (pooled) {
+        pauseArena(vm);
+    }
     ObjString *objString = ALLOCATE_EXTRA(vm, ObjString, length + 1);
 
     if (objString != NULL) {
         initObjHeader(vm, &objString->objHeader, OT_STRING, vm->stringClass);
+        objString->left = objString->right = NULL;
+        objString->utf8Index = NULL;
         objString->value.length = length;
 
         if (length > 0) {
             memcpy(objString->value.start, str, length);
         }
+        objString->isAscii = isAsciiChars(objString->value.start, length);
         objString->value.start[length] = '\0';
-        hashObjString(objString);
+        // 长串的哈希码在首次使用时才计算
+        objString->hashCode = hashCode;
+        if (pooled) {
+            addPooledString(vm, &vm->shortStrings, objString);
+            resumeArena(vm);
+        }
     }
     else {
         MEM_ERROR("Allocating objString failed!");
     }
     return objString;
-}
\ No newline at end of file
+}
+/**
+ * 拼接left和right，结果较短时直接拷贝，否则建立拼接串，首次读取字符时才展开
+ * 右部总是展开后再拼接，拼接串只沿左部嵌套，s = s + x反复追加时每次只处理x
+ * 哈希码在首次使用时才计算
+ * @param vm
+ * @param left
+ * @param right
+ * @return
+ */
+ObjString* newObjStringConcat(VM *vm, ObjString *left, ObjString *right) {
+    if (right->value.length == 0) {
+        return left;
+    }
+    if (left->value.length == 0) {
+        return right;
+    }
+    right = flattenObjString(vm, right);
+    // 已展开的拼接串直接以展开结果作左部
+    if (OBJSTRING_IS_ROPE(left) && left->right == NULL) {
+        left = left->left;
+    }
+
+    uint32_t length = left->value.length + right->value.length;
+    if (length < left->value.length) {
+        RUN_ERROR("string is too long!");
+    }
+    if (length <= SHORT_STRING_MAX_LEN) {
+        // 短结果取驻留的字符串
+        char chars[SHORT_STRING_MAX_LEN];
+        memcpy(chars, left->value.start, left->value.length);
+        memcpy(chars + left->value.length, right->value.start, right->value.length);
+        return newObjString(vm, chars, length);
+    }
+    if (length < ROPE_MIN_LENGTH) {
+        ObjString *objString = ALLOCATE_EXTRA(vm, ObjString, length + 1);
+        initObjHeader(vm, &objString->objHeader, OT_STRING, vm->stringClass);
+        objString->left = objString->right = NULL;
+        objString->isAscii = left->isAscii && right->isAscii;
+        objString->utf8Index = NULL;
+        objString->value.length = length;
+        memcpy(objString->value.start, left->value.start, left->value.length);
+        memcpy(objString->value.start + left->value.length, right->value.start, right->value.length + 1);
+        objString->hashCode = 0;
+        return objString;
+    }
+
+    ObjString *rope = ALLOCATE(vm, ObjString);
+    initObjHeader(vm, &rope->objHeader, OT_STRING, vm->stringClass);
+    rope->left = left;
+    rope->right = right;
+    rope->isAscii = left->isAscii && right->isAscii;
+    rope->utf8Index = NULL;
+    rope->value.length = length;
+    rope->hashCode = 0;
+    return rope;
+}
+
+/**
+ * 把objString的全部字符写入dest，dest须能容纳value.length个字节
+ * @param objString
+ * @param dest
+ */
+void copyObjStringChars(ObjString *objString, char *dest) {
+    // 右部总是普通字符串，从后往前沿左部写入
+    while (OBJSTRING_IS_ROPE(objString)) {
+        if (objString->right == NULL) {
+            objString = objString->left;
+            break;
+        }
+        ObjString *right = objString->right;
+        memcpy(dest + objString->left->value.length, right->value.start, right->value.length);
+        objString = objString->left;
+    }
+    memcpy(dest, objString->value.start, objString->value.length);
+}
+
+/**
+ * 在vm中新建与objString内容相同的普通字符串，objString可以属于别的vm，不会被修改
+ * @param vm
+ * @param objString
+ * @return
+ */
+ObjString* copyObjString(VM *vm, ObjString *objString) {
+    if (OBJSTRING_IS_ROPE(objString) && objString->right == NULL) {
+        objString = objString->left;
+    }
+    uint32_t length = objString->value.length;
+    if (!OBJSTRING_IS_ROPE(objString)) {
+        return newObjString(vm, objString->value.start, length);
+    }
+
+    // 拼接串不短于ROPE_MIN_LENGTH，不需驻留
+
+    ObjString *copy = ALLOCATE_EXTRA(vm, ObjString, length + 1);
+    initObjHeader(vm, &copy->objHeader, OT_STRING, vm->stringClass);
+    copy->left = copy->right = NULL;
+    copy->isAscii = objString->isAscii;
+    copy->utf8Index = NULL;
+    copy->value.length = length;
+    copyObjStringChars(objString, copy->value.start);
+    copy->value.start[length] = '\0';
+    copy->hashCode = objString->hashCode;
+    return copy;
+}
+
+/**
+ * 返回与objString内容相同的普通字符串，拼接串展开一次后记住结果
+ * @param vm
+ * @param objString
+ * @return
+ */
+ObjString* flattenObjString(VM *vm, ObjString *objString) {
+    if (!OBJSTRING_IS_ROPE(objString)) {
+        return objString;
+    }
+    if (objString->right == NULL) {
+        return objString->left;
+    }
+
+    uint32_t length = objString->value.length;
+    ObjString *flat = ALLOCATE_EXTRA(vm, ObjString, length + 1);
+    initObjHeader(vm, &flat->objHeader, OT_STRING, vm->stringClass);
+    flat->left = flat->right = NULL;
+    flat->isAscii = objString->isAscii;
+    flat->utf8Index = NULL;
+    flat->value.length = length;
+    copyObjStringChars(objString, flat->value.start);
+    flat->value.start[length] = '\0';
+    flat->hashCode = objString->hashCode;
+
+    // 此后不再经由本串引用原来的拼接链
+    ARENA_REMEMBER(vm, objString);
+    objString->left = flat;
+    objString->right = NULL;
+    return flat;
+}
+
+/**
+ * 比较两个字符串的内容，可以是拼接串，不需要vm
+ * @param a
+ * @param b
+ * @return
+ */
+bool objStringEquals(ObjString *a, ObjString *b) {
+    if (a->value.length != b->value.length) {
+        return false;
+    }
+    // 只在两者都已算出哈希码时用它排除
+    if (a->hashCode != 0 && b->hashCode != 0 && a->hashCode != b->hashCode) {
+        return false;
+    }
+    if (OBJSTRING_IS_ROPE(a) && a->right == NULL) {
+        a = a->left;
+    }
+    if (OBJSTRING_IS_ROPE(b) && b->right == NULL) {
+        b = b->left;
+    }
+    if (!OBJSTRING_IS_ROPE(a) && !OBJSTRING_IS_ROPE(b)) {
+        return memcmp(a->value.start, b->value.start, a->value.length) == 0;
+    }
+
+    // 哈希码相同的未展开拼接串，展开到临时缓冲区再比较
+    uint32_t length = a->value.length;
+    char *bufA = OBJSTRING_IS_ROPE(a) ? (char *)malloc(length) : a->value.start;
+    char *bufB = OBJSTRING_IS_ROPE(b) ? (char *)malloc(length) : b->value.start;
+    if (bufA == NULL || bufB == NULL) {
+        MEM_ERROR("allocate string compare buffer failed!");
+    }
+    if (bufA != a->value.start) {
+        copyObjStringChars(a, bufA);
+    }
+    if (bufB != b->value.start) {
+        copyObjStringChars(b, bufB);
+    }
+    bool equal = memcmp(bufA, bufB, length) == 0;
+    if (bufA != a->value.start) {
+        free(bufA);
+    }
+    if (bufB != b->value.start) {
+        free(bufB);
+    }
+    return equal;
+}
+
+/**
+ * 把num个字符串依次拼成一个长度恰好的字符串，供OPCODE_INTERPOLATE使用
+ * 只分配结果本身
+ * @param vm
+ * @param pieces
+ * @param num
+ * @return pieces中有非字符串时返回NULL
+ */
+ObjString* newObjStringFromPieces(VM *vm, Value *pieces, uint32_t num) {
+    uint32_t length = 0;
+    uint32_t idx = 0;
+    while (idx < num) {
+        if (!VALUE_IS_CREATIN_OBJ(pieces[idx], OT_STRING)) {
+            return NULL;
+        }
+        uint32_t pieceLen = VALUE_TO_OBJSTR(pieces[idx])->value.length;
+        if (length + pieceLen < length) {
+            RUN_ERROR("string is too long!");
+        }
+        length += pieceLen;
+        idx ++;
+    }
+
+    if (length <= SHORT_STRING_MAX_LEN) {
+        // 短结果取驻留的字符串
+        char chars[SHORT_STRING_MAX_LEN];
+        uint32_t pos = 0;
+        idx = 0;
+        while (idx < num) {
+            ObjString *piece = VALUE_TO_OBJSTR(pieces[idx ++]);
+            copyObjStringChars(piece, chars + pos);
+            pos += piece->value.length;
+        }
+        return newObjString(vm, chars, length);
+    }
+
+    ObjString *objString = ALLOCATE_EXTRA(vm, ObjString, length + 1);
+    initObjHeader(vm, &objString->objHeader, OT_STRING, vm->stringClass);
+    objString->left = objString->right = NULL;
+    objString->isAscii = true;
+    objString->utf8Index = NULL;
+    objString->value.length = length;
+
+    char *dest = objString->value.start;
+    idx = 0;
+    while (idx < num) {
+        ObjString *piece = VALUE_TO_OBJSTR(pieces[idx]);
+        objString->isAscii = objString->isAscii && piece->isAscii;
+        copyObjStringChars(piece, dest);
+        dest += piece->value.length;
+        idx ++;
+    }
+    *dest = '\0';
+    objString->hashCode = 0;
+    return objString;
+}
+
+/**
+ * str是否只含ASCII字符，每次检查8个字节，编译器可进一步向量化
+ * @param str
+ * @param length
+ * @return
+ */
+bool isAsciiChars(const char *str, uint32_t length) {
+    uint64_t bits = 0;
+    uint32_t idx = 0;
+    while (idx + 8 <= length) {
+        uint64_t word;
+        memcpy(&word, str + idx, 8);
+        bits |= word;
+        idx += 8;
+    }
+    while (idx < length) {
+        bits |= (uint8_t)str[idx ++];
+    }
+    return (bits & 0x8080808080808080ull) == 0;
+}
+
+/**
+ * 从pos处前进一个码点，非法的字节按一个码点计
+ * @param start
+ * @param pos
+ * @param length
+ * @return 下一个码点的字节偏移
+ */
+static inline uint32_t nextCodePoint(const char *start, uint32_t pos, uint32_t length) {
+    uint32_t byteNum = getByteNumOfDecodeUtf8((uint8_t)start[pos]);
+    if (byteNum == 0 || byteNum > length - pos) {
+        byteNum = 1;
+    }
+    return pos + byteNum;
+}
+
+/**
+ * 为length字节的字符串建立码点索引所需的字节数，码点数不超过字节数，按字节数预留
+ * @param length
+ * @return
+ */
+uint32_t utf8IndexBytes(uint32_t length) {
+    return sizeof(Utf8Index) + sizeof(uint32_t) * (length / UTF8_INDEX_STRIDE + 1);
+}
+
+/**
+ * 遍历一次str，把码点索引写入utf8Index，其空间须不小于utf8IndexBytes(length)
+ * @param str
+ * @param length
+ * @param utf8Index
+ */
+void fillUtf8Index(const char *str, uint32_t length, Utf8Index *utf8Index) {
+    uint32_t codePointNum = 0, offsetNum = 0, pos = 0;
+    while (pos < length) {
+        if (codePointNum % UTF8_INDEX_STRIDE == 0) {
+            utf8Index->offsets[offsetNum ++] = pos;
+        }
+        pos = nextCodePoint(str, pos, length);
+        codePointNum ++;
+    }
+    utf8Index->codePointNum = codePointNum;
+    utf8Index->offsetNum = offsetNum;
+    utf8Index->lastIndex = utf8Index->lastOffset = 0;
+}
+
+/**
+ * 返回objString的码点索引，首次调用时建立
+ * 只读字符串的索引在冻结时已建好，这里不会写入
+ * @param vm
+ * @param objString
+ * @return
+ */
+static Utf8Index* ensureUtf8Index(VM *vm, ObjString *objString) {
+    if (objString->utf8Index == NULL) {
+        uint32_t bytes = utf8IndexBytes(objString->value.length);
+        Utf8Index *utf8Index = (Utf8Index *)memManager(vm, NULL, 0, bytes);
+        fillUtf8Index(objString->value.start, objString->value.length, utf8Index);
+        ARENA_REMEMBER(vm, objString);
+        objString->utf8Index = utf8Index;
+    }
+    return objString->utf8Index;
+}
+
+/**
+ * 返回objString的码点数，ASCII串即字节数
+ * @param vm
+ * @param objString 普通字符串，拼接串须先展开
+ * @return
+ */
+uint32_t objStringCodePointCount(VM *vm, ObjString *objString) {
+    ASSERT(!OBJSTRING_IS_ROPE(objString), "flatten rope before indexing!");
+    if (objString->isAscii) {
+        return objString->value.length;
+    }
+    return ensureUtf8Index(vm, objString)->codePointNum;
+}
+
+/**
+ * 返回第index个码点的字节偏移，ASCII串为O(1)，
+ * 其余从最近的索引点或上次访问处起至多前进UTF8_INDEX_STRIDE-1个码点
+ * @param vm
+ * @param objString 普通字符串，拼接串须先展开
+ * @param index 须小于码点数
+ * @return
+ */
+uint32_t objStringCodePointOffset(VM *vm, ObjString *objString, uint32_t index) {
+    ASSERT(!OBJSTRING_IS_ROPE(objString), "flatten rope before indexing!");
+    if (objString->isAscii) {
+        return index;
+    }
+    Utf8Index *utf8Index = ensureUtf8Index(vm, objString);
+    ASSERT(index < utf8Index->codePointNum, "code point index out of bounds!");
+
+    uint32_t pos = utf8Index->offsets[index / UTF8_INDEX_STRIDE];
+    uint32_t steps = index % UTF8_INDEX_STRIDE;
+    if (utf8Index->lastIndex <= index && index - utf8Index->lastIndex < steps) {
+        pos = utf8Index->lastOffset;
+        steps = index - utf8Index->lastIndex;
+    }
+    while (steps > 0) {
+        pos = nextCodePoint(objString->value.start, pos, objString->value.length);
+        steps --;
+    }
+    // 只读字符串可被多个os线程同时读取，不记录
+    if (!objString->objHeader.isFrozen) {
+        utf8Index->lastIndex = index;
+        utf8Index->lastOffset = pos;
+    }
+    return pos;
+}
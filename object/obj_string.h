@@ -3,14 +3,60 @@
 
 #include "header_obj.h"
 
-typedef struct {
+// 拼接结果短于此长度时直接拷贝，不建拼接串
+#define ROPE_MIN_LENGTH 64
+// 不超过此长度的字符串在vm内驻留，相同内容只分配一次
+#define SHORT_STRING_MAX_LEN 15
+// 驻留池最多容纳的字符串个数，满后短字符串按普通字符串分配
+#define SHORT_STRING_POOL_MAX (1u << 20)
+// 非ASCII字符串的码点索引每隔此数个码点记录一次字节偏移
+#define UTF8_INDEX_STRIDE 32
+
+typedef struct utf8Index {
+    uint32_t codePointNum;
+    uint32_t lastIndex;  // 上次访问的码点及其字节偏移，按下标顺序遍历时每次只前进一个码点
+    uint32_t lastOffset;
+    uint32_t offsetNum;
+    uint32_t offsets[0]; // 第k项为第k*UTF8_INDEX_STRIDE个码点的字节偏移
+} Utf8Index;  // 非ASCII字符串的稀疏码点索引
+
+typedef struct objString {
     ObjHeader objHeader;
-    uint32_t  hashCode;
-    CharValue value;
+    uint32_t  hashCode;  // 为0时尚未计算，须经objStringHash读取
+    // 拼接串的左部，普通字符串为NULL；左部可以仍是拼接串
+    struct objString *left;
+    // 拼接串的右部，总是普通字符串；展开后为NULL，此时left指向展开的结果
+    struct objString *right;
+    bool isAscii;  // 创建时算出，为真时码点即字节，下标可直接定位
+    Utf8Index *utf8Index;  // 非ASCII字符串首次按码点访问时建立，否则为NULL
+    CharValue value;  // 拼接串只有length有效
 } ObjString;
 
+typedef struct {
+    ObjString **slots; // 开放定址，空位为NULL
+    uint32_t count;
+    uint32_t capacity; // 2的幂，为0时尚未分配
+} StringPool;  // 短字符串驻留池，池中的字符串不可变，随vm存在
+
+// 是否为拼接串，拼接串的value.start不可直接读取，须先flattenObjString
+#define OBJSTRING_IS_ROPE(objString) ((objString)->left != NULL)
+
+void initStringPool(StringPool *pool);
+void freeStringPool(VM *vm, StringPool *pool);
 uint32_t hashString(char *str, uint32_t length);
 void hashObjString(ObjString *objString);
+uint32_t objStringHash(ObjString *objString);
 ObjString* newObjString(VM *vm, const char *str, uint32_t length);
+ObjString* newObjStringConcat(VM *vm, ObjString *left, ObjString *right);
+ObjString* flattenObjString(VM *vm, ObjString *objString);
+void copyObjStringChars(ObjString *objString, char *dest);
+ObjString* copyObjString(VM *vm, ObjString *objString);
+bool objStringEquals(ObjString *a, ObjString *b);
+ObjString* newObjStringFromPieces(VM *vm, Value *pieces, uint32_t num);
+bool isAsciiChars(const char *str, uint32_t length);
+uint32_t utf8IndexBytes(uint32_t length);
+void fillUtf8Index(const char *str, uint32_t length, Utf8Index *utf8Index);
+uint32_t objStringCodePointCount(VM *vm, ObjString *objString);
+uint32_t objStringCodePointOffset(VM *vm, ObjString *objString, uint32_t index);
 
-#endif //SPARROW_OBJ_STRING_H
\ No newline at end of file
+#endif //SPARROW_OBJ_STRING_H
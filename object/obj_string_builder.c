@@ -0,0 +1,61 @@
+//
+// Created by ZiXuan on 2022/7/20.
+//
+#include "obj_string_builder.h"
+#include "../vm/vm.h"
+
+#include <string.h>
+
+/**
+ * 新建空的StringBuilder对象
+ * @param vm
+ * @return
+ */
+ObjStringBuilder* newObjStringBuilder(VM *vm) {
+    ObjStringBuilder *builder = ALLOCATE(vm, ObjStringBuilder);
+    initObjHeader(vm, &builder->objHeader, OT_STRING_BUILDER, vm->stringBuilderClass);
+    ByteBufferInit(&builder->buffer);
+    return builder;
+}
+
+/**
+ * 把objString的内容追加到builder，拼接串无须先展开
+ * @param vm
+ * @param builder
+ * @param objString
+ */
+void stringBuilderAppend(VM *vm, ObjStringBuilder *builder, ObjString *objString) {
+    ByteBuffer *buffer = &builder->buffer;
+    uint32_t length = objString->value.length;
+    uint32_t newCount = buffer->count + length;
+    if (newCount < buffer->count) {
+        RUN_ERROR("string builder is too long!");
+    }
+    if (newCount > buffer->capacity) {
+        uint32_t newCapacity = ceilToPowerOf2(newCount);
+        buffer->datas = (Byte *)memManager(vm, buffer->datas, buffer->capacity, newCapacity);
+        buffer->capacity = newCapacity;
+    }
+    copyObjStringChars(objString, (char *)buffer->datas + buffer->count);
+    buffer->count = newCount;
+}
+
+/**
+ * 以builder当前的内容新建字符串，builder不变
+ * @param vm
+ * @param builder
+ * @return
+ */
+ObjString* stringBuilderToString(VM *vm, ObjStringBuilder *builder) {
+    return newObjString(vm, (const char *)builder->buffer.datas, builder->buffer.count);
+}
+
+/**
+ * 释放StringBuilder对象，供gc调用
+ * @param vm
+ * @param builder
+ */
+void freeObjStringBuilder(VM *vm, ObjStringBuilder *builder) {
+    ByteBufferClear(vm, &builder->buffer);
+    DEALLOCATE(vm, builder);
+}
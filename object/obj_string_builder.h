@@ -0,0 +1,21 @@
+//
+// Created by ZiXuan on 2022/7/20.
+//
+
+#ifndef SPARROW_OBJ_STRING_BUILDER_H
+#define SPARROW_OBJ_STRING_BUILDER_H
+
+#include "obj_string.h"
+#include "../include/utils.h"
+
+typedef struct {
+    ObjHeader objHeader;
+    ByteBuffer buffer; // 容量按2的幂增长，追加的总开销与结果长度成正比
+} ObjStringBuilder;  // StringBuilder对象
+
+ObjStringBuilder* newObjStringBuilder(VM *vm);
+void stringBuilderAppend(VM *vm, ObjStringBuilder *builder, ObjString *objString);
+ObjString* stringBuilderToString(VM *vm, ObjStringBuilder *builder);
+void freeObjStringBuilder(VM *vm, ObjStringBuilder *builder);
+
+#endif //SPARROW_OBJ_STRING_BUILDER_H
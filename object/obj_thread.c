@@ -3,7 +3,16 @@
 //
 #include "obj_thread.h"
 #include "../vm/vm.h"
+#include "../vm/arena.h"
 #include "class.h"
+#include <string.h>
+
+#ifdef THREAD_STACK_GUARD
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 /**
  * 为运行准备栈帧
@@ -13,7 +22,7 @@
  */
 void prepareFrame(ObjThread *objThread, ObjClosure *objClosure, Value *stackStart) {
     ASSERT(objThread->frameCapacity > objThread->usedFrameNum, "frame not enough!");
-    Frame *frame = &(objThread->frames[objThread->usedFrameNum + 1]);
+    Frame *frame = &(objThread->frames[objThread->usedFrameNum ++]);
 
     frame->stackStart = stackStart;
     frame->closure = objClosure;
@@ -21,32 +30,479 @@ void prepareFrame(ObjThread *objThread, ObjClosure *objClosure, Value *stackStar
 }
 
 /**
- * 新建线程
+ * 返回容量capacity在线程池中的级别，capacity须为base乘以2的幂
+ * 超出池的最大级别时返回-1
+ * @param capacity
+ * @param base
+ * @return
+ */
+static int poolClassOf(uint32_t capacity, uint32_t base) {
+    int cls = 0;
+    while (base < capacity) {
+        base <<= 1;
+        cls ++;
+    }
+    return cls < THREAD_POOL_CLASS_NUM ? cls : -1;
+}
+
+#ifdef THREAD_STACK_GUARD
+/**
+ * 栈所占的数据页字节数，按页大小向上取整
+ * @param capacity
+ * @return
+ */
+static size_t stackDataBytes(uint32_t capacity) {
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    size_t bytes = sizeof(Value) * capacity;
+    return (bytes + pageSize - 1) & ~(pageSize - 1);
+}
+
+// 信号处理函数只能调用异步信号安全的函数，消息预先写好，地址逐位转成十六进制
+#define GUARD_PAGE_MSG "thread stack overflow: access guard page at 0x"
+
+static pthread_once_t guardHandlerOnce = PTHREAD_ONCE_INIT;
+// 线程退出时释放其备用栈
+static pthread_key_t altStackKey;
+// 每个os线程各自的备用栈是否已设置
+static __thread bool altStackReady = false;
+
+/**
+ * 访问到保护页时触发，报告栈溢出后退出
+ * 保护页已映射而不可访问，si_code为SEGV_ACCERR；其他段错误恢复默认处理，返回后重新触发
+ * @param signo
+ * @param info
+ * @param context
+ */
+static void guardPageHandler(int signo, siginfo_t *info, void *context UNUSED) {
+    if (info->si_code != SEGV_ACCERR) {
+        signal(signo, SIG_DFL);
+        return;
+    }
+
+    char addr[2 * sizeof(uintptr_t) + 2];
+    uintptr_t value = (uintptr_t)info->si_addr;
+    int idx = (int)sizeof(addr) - 1;
+    addr[idx --] = '\n';
+    do {
+        addr[idx --] = "0123456789abcdef"[value & 0xf];
+        value >>= 4;
+    } while (value != 0);
+    idx ++;
+
+    ssize_t ignored UNUSED = write(STDERR_FILENO, GUARD_PAGE_MSG, sizeof(GUARD_PAGE_MSG) - 1);
+    ignored = write(STDERR_FILENO, addr + idx, sizeof(addr) - idx);
+    _exit(EXIT_FAILURE);
+}
+
+/**
+ * os线程退出时撤下并释放其备用栈
+ * @param stackMemory
+ */
+static void freeAltStack(void *stackMemory) {
+    stack_t disable;
+    memset(&disable, 0, sizeof(disable));
+    disable.ss_flags = SS_DISABLE;
+    sigaltstack(&disable, NULL);
+    free(stackMemory);
+}
+
+/**
+ * 进程内只安装一次SIGSEGV处理函数
+ */
+static void installGuardHandler(void) {
+    pthread_key_create(&altStackKey, freeAltStack);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = guardPageHandler;
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigaction(SIGSEGV, &action, NULL);
+}
+
+/**
+ * 确保处理函数已安装且当前os线程有备用栈
+ * 栈溢出时原栈不可用，信号处理函数须运行在备用栈上，而备用栈是每个os线程各自的
+ */
+static void ensureGuardHandler(void) {
+    pthread_once(&guardHandlerOnce, installGuardHandler);
+    if (altStackReady) {
+        return;
+    }
+
+    stack_t altStack;
+    altStack.ss_sp = malloc(SIGSTKSZ);
+    if (altStack.ss_sp == NULL) {
+        MEM_ERROR("allocate signal stack failed!");
+    }
+    altStack.ss_size = SIGSTKSZ;
+    altStack.ss_flags = 0;
+    sigaltstack(&altStack, NULL);
+    pthread_setspecific(altStackKey, altStack.ss_sp);
+    altStackReady = true;
+}
+
+/**
+ * 以mmap分配栈，栈尾紧邻一个不可访问的保护页，越界写入时由硬件检测
+ * @param vm
+ * @param capacity
+ * @return
+ */
+static Value* newStackMemory(VM *vm, uint32_t capacity) {
+    ensureGuardHandler();
+
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    size_t dataBytes = stackDataBytes(capacity);
+    char *base = mmap(NULL, dataBytes + pageSize, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        MEM_ERROR("mmap thread stack failed!");
+    }
+    mprotect(base + dataBytes, pageSize, PROT_NONE);
+
+    vm->allocatedBytes += sizeof(Value) * capacity;
+    vm->allocatedNum ++;
+    // 栈的最后一个slot紧挨保护页
+    return (Value *)(base + dataBytes - sizeof(Value) * capacity);
+}
+
+/**
+ * 释放newStackMemory分配的栈
+ * @param vm
+ * @param stack
+ * @param capacity
+ */
+static void freeStackMemory(VM *vm, Value *stack, uint32_t capacity) {
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    size_t dataBytes = stackDataBytes(capacity);
+    char *base = (char *)(stack + capacity) - dataBytes;
+    munmap(base, dataBytes + pageSize);
+    vm->allocatedBytes -= sizeof(Value) * capacity;
+}
+#else
+/**
+ * 分配容量为capacity的栈
+ * @param vm
+ * @param capacity
+ * @return
+ */
+static Value* newStackMemory(VM *vm, uint32_t capacity) {
+    return ALLOCATE_ARRAY(vm, Value, capacity);
+}
+
+/**
+ * 释放容量为capacity的栈
+ * @param vm
+ * @param stack
+ * @param capacity
+ */
+static void freeStackMemory(VM *vm, Value *stack, uint32_t capacity) {
+    DEALLOCATE_ARRAY(vm, stack, capacity);
+}
+#endif
+
+/**
+ * 该级别的缓存是否已满
+ * 大容量的栈只保留少量，使加深过的线程回收后其内存能缩回
+ * @param num 该级别已缓存的个数
+ * @param slots 该级别每个缓存的容量
+ * @return
+ */
+static bool poolClassFull(uint32_t num, uint32_t slots) {
+    return num >= THREAD_POOL_MAX_PER_CLASS || (uint64_t)(num + 1) * slots > THREAD_POOL_MAX_SLOTS_PER_CLASS;
+}
+
+/**
+ * 从线程池中获取容量为capacity的栈，池中没有时才分配
+ * @param vm
+ * @param capacity
+ * @return
+ */
+static Value* allocStack(VM *vm, uint32_t capacity) {
+    int cls = poolClassOf(capacity, 1);
+    ThreadPool *pool = &vm->threadPool;
+    if (cls != -1 && pool->freeStacks[cls] != NULL) {
+        Value *stack = pool->freeStacks[cls];
+        pool->freeStacks[cls] = *(Value **)stack;
+        pool->freeStackNum[cls] --;
+        return stack;
+    }
+    // 栈会进入线程池，不在分配区域中
+    pauseArena(vm);
+    Value *stack = newStackMemory(vm, capacity);
+    resumeArena(vm);
+    return stack;
+}
+
+/**
+ * 把栈归还到线程池，池满时释放
+ * @param vm
+ * @param stack
+ * @param capacity
+ */
+static void releaseStack(VM *vm, Value *stack, uint32_t capacity) {
+    int cls = poolClassOf(capacity, 1);
+    ThreadPool *pool = &vm->threadPool;
+    if (cls == -1 || poolClassFull(pool->freeStackNum[cls], capacity)) {
+        freeStackMemory(vm, stack, capacity);
+        return;
+    }
+    *(Value **)stack = pool->freeStacks[cls];
+    pool->freeStacks[cls] = stack;
+    pool->freeStackNum[cls] ++;
+}
+
+/**
+ * 从线程池中获取容量为capacity的frame数组
+ * @param vm
+ * @param capacity
+ * @return
+ */
+static Frame* allocFrames(VM *vm, uint32_t capacity) {
+    int cls = poolClassOf(capacity, INITIAL_FRAME_NUM);
+    ThreadPool *pool = &vm->threadPool;
+    if (cls != -1 && pool->freeFrames[cls] != NULL) {
+        Frame *frames = pool->freeFrames[cls];
+        pool->freeFrames[cls] = *(Frame **)frames;
+        pool->freeFrameNum[cls] --;
+        return frames;
+    }
+    pauseArena(vm);
+    Frame *frames = ALLOCATE_ARRAY(vm, Frame, capacity);
+    resumeArena(vm);
+    return frames;
+}
+
+/**
+ * 把frame数组归还到线程池
+ * @param vm
+ * @param frames
+ * @param capacity
+ */
+static void releaseFrames(VM *vm, Frame *frames, uint32_t capacity) {
+    int cls = poolClassOf(capacity, INITIAL_FRAME_NUM);
+    ThreadPool *pool = &vm->threadPool;
+    if (cls == -1 || poolClassFull(pool->freeFrameNum[cls], capacity)) {
+        DEALLOCATE_ARRAY(vm, frames, capacity);
+        return;
+    }
+    *(Frame **)frames = pool->freeFrames[cls];
+    pool->freeFrames[cls] = frames;
+    pool->freeFrameNum[cls] ++;
+}
+
+/**
+ * 确保线程的栈至少有neededSlots个slot
+ * 容量不足时按2倍扩容，并修正frame、esp及open upvalue中指向旧栈的指针
+ * @param vm
+ * @param objThread
+ * @param neededSlots
+ */
+void ensureStack(VM *vm, ObjThread *objThread, uint32_t neededSlots) {
+    if (objThread->stackCapacity >= neededSlots) {
+        return;
+    }
+
+    uint32_t newCapacity = ceilToPowerOf2(neededSlots);
+    if (newCapacity < objThread->stackCapacity * 2) {
+        newCapacity = objThread->stackCapacity * 2;
+    }
+
+    Value *oldStack = objThread->stack;
+    uint32_t usedSlots = (uint32_t)(objThread->esp - oldStack);
+    Value *newStack = allocStack(vm, newCapacity);
+    memcpy(newStack, oldStack, sizeof(Value) * usedSlots);
+
+    // 各指针按在旧栈中的偏移量搬到新栈
+    uint32_t idx = 0;
+    while (idx < objThread->usedFrameNum) {
+        Frame *frame = &objThread->frames[idx];
+        frame->stackStart = newStack + (frame->stackStart - oldStack);
+        idx ++;
+    }
+
+    ObjUpvalue *upvalue = objThread->openUpvalues;
+    while (upvalue != NULL) {
+        upvalue->localVarPtr = newStack + (upvalue->localVarPtr - oldStack);
+        upvalue = upvalue->next;
+    }
+
+    objThread->esp = newStack + usedSlots;
+    releaseStack(vm, oldStack, objThread->stackCapacity);
+    objThread->stack = newStack;
+    objThread->stackCapacity = newCapacity;
+}
+
+/**
+ * 确保线程还能再压入一个frame，不足时按2倍扩容
+ * frame中只有指向栈的指针，搬移frame数组时无须修正
+ * @param vm
+ * @param objThread
+ */
+void ensureFrame(VM *vm, ObjThread *objThread) {
+    if (objThread->usedFrameNum < objThread->frameCapacity) {
+        return;
+    }
+
+    uint32_t newCapacity = objThread->frameCapacity * 2;
+    Frame *newFrames = allocFrames(vm, newCapacity);
+    memcpy(newFrames, objThread->frames, sizeof(Frame) * objThread->usedFrameNum);
+    releaseFrames(vm, objThread->frames, objThread->frameCapacity);
+    objThread->frames = newFrames;
+    objThread->frameCapacity = newCapacity;
+}
+
+/**
+ * 为调用objClosure创建frame，接收者及参数共argNum个已压入栈顶
+ * 扩容后旧的栈和frame数组失效，调用方须重新加载esp和当前frame
+ * @param vm
+ * @param objThread
+ * @param objClosure
+ * @param argNum
+ */
+void createFrame(VM *vm, ObjThread *objThread, ObjClosure *objClosure, uint32_t argNum) {
+    // 延迟编译的函数须先编译，才知道所需的栈大小
+    if (objClosure->fn->lazyBody != NULL) {
+        compileLazyFn(vm, objClosure->fn);
+    }
+    ensureFrame(vm, objThread);
+
+    uint32_t stackSlots = (uint32_t)(objThread->esp - objThread->stack);
+    ensureStack(vm, objThread, stackSlots + objClosure->fn->maxStackSlotUsedNum);
+
+    prepareFrame(objThread, objClosure, objThread->esp - argNum);
+}
+
+/**
+ * 初始化线程池
+ * @param pool
+ */
+void initThreadPool(ThreadPool *pool) {
+    uint32_t idx = 0;
+    while (idx < THREAD_POOL_CLASS_NUM) {
+        pool->freeStacks[idx] = NULL;
+        pool->freeStackNum[idx] = 0;
+        pool->freeFrames[idx] = NULL;
+        pool->freeFrameNum[idx] = 0;
+        idx ++;
+    }
+    pool->freeThreads = NULL;
+    pool->freeThreadNum = 0;
+}
+
+/**
+ * 新建线程，栈、frame数组及线程对象优先从线程池中获取
  * @param vm
  * @param objClosure
  * @return
  */
 ObjThread* newObjThread(VM *vm, ObjClosure *objClosure) {
     ASSERT(objClosure != NULL, "objClosure is NULL!");
+    if (objClosure->fn->lazyBody != NULL) {
+        compileLazyFn(vm, objClosure->fn);
+    }
 
-    Frame *frames = ALLOCATE_ARRAY(vm, Frame, INITIAL_FRAME_NUM);
+    Frame *frames = allocFrames(vm, INITIAL_FRAME_NUM);
 
     uint32_t stackCapacity = ceilToPowerOf2(objClosure->fn->maxStackSlotUsedNum + 1);
 
-    Value *newStack = ALLOCATE_ARRAY(vm, Value, stackCapacity);
+    Value *newStack = allocStack(vm, stackCapacity);
 
-    ObjThread *objThread = ALLOCATE(vm, ObjThread);
+    // 区域打开时线程对象建在区域中，关闭时不可达的线程随区域回收并归还栈；池中的线程只在区域外复用
+    ThreadPool *pool = &vm->threadPool;
+    ObjThread *objThread = NULL;
+    if (vm->arena == NULL && pool->freeThreads != NULL) {
+        objThread = pool->freeThreads;
+        pool->freeThreads = objThread->nextReady;
+        pool->freeThreadNum --;
+    }
+    else {
+        objThread = ALLOCATE(vm, ObjThread);
+    }
     initObjHeader(vm, &objThread->objHeader, OT_THREAD, vm->threadClass);
 
     objThread->frames = frames;
     objThread->frameCapacity = INITIAL_FRAME_NUM;
     objThread->stack = newStack;
     objThread->stackCapacity = stackCapacity;
+    objThread->nextReady = NULL;
+    objThread->prevReady = NULL;
+    objThread->isReady = false;
+    objThread->isParked = false;
+    objThread->isSync = false;
 
     resetThread(objThread, objClosure);
     return objThread;
 }
 
+/**
+ * 线程运行结束后把栈和frame数组归还线程池
+ * 运行结束的线程usedFrameNum为0，不会再用到二者
+ * @param vm
+ * @param objThread
+ */
+void recycleThreadStack(VM *vm, ObjThread *objThread) {
+    ASSERT(objThread->usedFrameNum == 0, "only finished thread can be recycled!");
+    if (objThread->stack != NULL) {
+        releaseStack(vm, objThread->stack, objThread->stackCapacity);
+        objThread->stack = objThread->esp = NULL;
+        objThread->stackCapacity = 0;
+    }
+    if (objThread->frames != NULL) {
+        releaseFrames(vm, objThread->frames, objThread->frameCapacity);
+        objThread->frames = NULL;
+        objThread->frameCapacity = 0;
+    }
+}
+
+/**
+ * 释放线程对象，供gc回收不可达的线程时调用
+ * 线程对象本身也进入线程池，下次newObjThread时复用
+ * @param vm
+ * @param objThread
+ */
+void freeObjThread(VM *vm, ObjThread *objThread) {
+    objThread->usedFrameNum = 0;
+    recycleThreadStack(vm, objThread);
+
+    // 区域打开时线程对象可能在区域中，不可进入线程池
+    ThreadPool *pool = &vm->threadPool;
+    if (vm->arena != NULL || pool->freeThreadNum >= THREAD_POOL_MAX_PER_CLASS) {
+        DEALLOCATE(vm, objThread);
+        return;
+    }
+    objThread->nextReady = pool->freeThreads;
+    pool->freeThreads = objThread;
+    pool->freeThreadNum ++;
+}
+
+/**
+ * 释放线程池中缓存的全部内存
+ * @param vm
+ * @param pool
+ */
+void clearThreadPool(VM *vm, ThreadPool *pool) {
+    uint32_t cls = 0;
+    while (cls < THREAD_POOL_CLASS_NUM) {
+        while (pool->freeStacks[cls] != NULL) {
+            Value *stack = pool->freeStacks[cls];
+            pool->freeStacks[cls] = *(Value **)stack;
+            freeStackMemory(vm, stack, 1u << cls);
+        }
+        while (pool->freeFrames[cls] != NULL) {
+            Frame *frames = pool->freeFrames[cls];
+            pool->freeFrames[cls] = *(Frame **)frames;
+            DEALLOCATE_ARRAY(vm, frames, INITIAL_FRAME_NUM << cls);
+        }
+        cls ++;
+    }
+    while (pool->freeThreads != NULL) {
+        ObjThread *objThread = pool->freeThreads;
+        pool->freeThreads = objThread->nextReady;
+        DEALLOCATE(vm, objThread);
+    }
+    initThreadPool(pool);
+}
+
 /**
  * 重置thread
  * @param objThread
@@ -23,10 +23,48 @@ typedef struct objThread {
     struct objThread *caller;
     // 导致运行时错误的对象会放在此处，否则为空
     Value errorObj;
+
+    // 就绪队列中的前后线程，双向链接使队列中任意线程可O(1)移出
+    struct objThread *nextReady;
+    struct objThread *prevReady;
+    // 是否已在就绪队列中，避免重复入队
+    bool isReady;
+    // 是否挂起在io或定时器上，此时只能由事件循环唤醒
+    bool isParked;
+    // 是否由callClosure从原生代码同步运行，最后一个frame返回时回到原生代码
+    bool isSync;
 } ObjThread;  // 线程对象
 
+// 线程池按容量的2次幂分级，超过最大级别的栈直接释放
+#define THREAD_POOL_CLASS_NUM 16
+// 每级最多缓存的个数，避免峰值过后长期占用内存
+#define THREAD_POOL_MAX_PER_CLASS 1024
+// 每级缓存的总slot数上限，递归加深过的大栈回收后大多直接释放
+#define THREAD_POOL_MAX_SLOTS_PER_CLASS (64 * 1024)
+
+typedef struct {
+    // 空闲的运行时栈，链表指针就存放在栈的首个slot中
+    Value *freeStacks[THREAD_POOL_CLASS_NUM];
+    uint32_t freeStackNum[THREAD_POOL_CLASS_NUM];
+
+    // 空闲的frame数组，容量为INITIAL_FRAME_NUM乘以2的幂
+    Frame *freeFrames[THREAD_POOL_CLASS_NUM];
+    uint32_t freeFrameNum[THREAD_POOL_CLASS_NUM];
+
+    // 已被回收的线程对象，通过nextReady链接
+    ObjThread *freeThreads;
+    uint32_t freeThreadNum;
+} ThreadPool;  // 每个vm一个，使创建和切换线程无须分配内存
+
 void prepareFrame(ObjThread *objThread, ObjClosure *objClosure, Value *stackStart);
 ObjThread* newObjThread(VM *vm, ObjClosure *objClosure);
 void resetThread(ObjThread *objThread, ObjClosure *objClosure);
+void ensureStack(VM *vm, ObjThread *objThread, uint32_t neededSlots);
+void ensureFrame(VM *vm, ObjThread *objThread);
+void createFrame(VM *vm, ObjThread *objThread, ObjClosure *objClosure, uint32_t argNum);
+void initThreadPool(ThreadPool *pool);
+void recycleThreadStack(VM *vm, ObjThread *objThread);
+void freeObjThread(VM *vm, ObjThread *objThread);
+void clearThreadPool(VM *vm, ThreadPool *pool);
 
 #endif //SPARROW_OBJ_THREAD_H
@@ -0,0 +1,87 @@
+//
+// Created by ZiXuan on 2022/7/28.
+//
+#include "obj_tuple.h"
+#include <string.h>
+#include "class.h"
+#include "../vm/vm.h"
+
+/**
+ * 新建元组，拷贝elements中的length个值
+ * @param vm
+ * @param elements 为NULL时元素都置为null，由调用方随后填入
+ * @param length
+ * @return
+ */
+ObjTuple* newObjTuple(VM *vm, const Value *elements, uint32_t length) {
+    ObjTuple *objTuple = ALLOCATE_EXTRA(vm, ObjTuple, sizeof(Value) * length);
+    initObjHeader(vm, &objTuple->objHeader, OT_TUPLE, vm->tupleClass);
+    objTuple->hashCode = 0;
+    objTuple->length = length;
+    if (elements != NULL) {
+        memcpy(objTuple->elements, elements, sizeof(Value) * length);
+        return objTuple;
+    }
+    uint32_t idx = 0;
+    while (idx < length) {
+        objTuple->elements[idx ++] = VT_TO_VALUE(VT_NULL);
+    }
+    return objTuple;
+}
+
+/**
+ * 元组的哈希码，由各元素的哈希码依次混合而成，首次计算后缓存
+ * 元素不可哈希时由hashValue报错
+ * @param vm
+ * @param objTuple
+ * @return
+ */
+uint32_t tupleHash(VM *vm, ObjTuple *objTuple) {
+    if (objTuple->hashCode != 0) {
+        return objTuple->hashCode;
+    }
+    uint32_t hashCode = 0x345678u ^ objTuple->length;
+    uint32_t idx = 0;
+    while (idx < objTuple->length) {
+        hashCode = (hashCode ^ hashValue(vm, objTuple->elements[idx])) * 1000003u;
+        idx ++;
+    }
+    // 0表示未计算
+    if (hashCode == 0) {
+        hashCode = 1;
+    }
+    objTuple->hashCode = hashCode;
+    return hashCode;
+}
+
+/**
+ * 两个元组的元素是否逐个相等，哈希码都已算出且不同时直接返回false
+ * @param a
+ * @param b
+ * @return
+ */
+bool tupleEquals(ObjTuple *a, ObjTuple *b) {
+    if (a->length != b->length) {
+        return false;
+    }
+    if (a->hashCode != 0 && b->hashCode != 0 && a->hashCode != b->hashCode) {
+        return false;
+    }
+    uint32_t idx = 0;
+    while (idx < a->length) {
+        if (!valueIsEqual(a->elements[idx], b->elements[idx])) {
+            return false;
+        }
+        idx ++;
+    }
+    return true;
+}
+
+/**
+ * 释放元组，供gc调用
+ * @param vm
+ * @param objTuple
+ */
+void freeObjTuple(VM *vm, ObjTuple *objTuple) {
+    DEALLOCATE(vm, objTuple);
+}
@@ -0,0 +1,26 @@
+//
+// Created by ZiXuan on 2022/7/28.
+//
+
+#ifndef SPARROW_OBJ_TUPLE_H
+#define SPARROW_OBJ_TUPLE_H
+
+/**
+ * 实现不可变的元组，可作为map的key或Set的元素
+ */
+
+#include "header_obj.h"
+
+typedef struct {
+    ObjHeader objHeader;
+    uint32_t hashCode;  // 为0时尚未计算，须经tupleHash读取
+    uint32_t length;
+    Value elements[0];
+} ObjTuple;  // 元组对象，创建后元素不再改变
+
+ObjTuple* newObjTuple(VM *vm, const Value *elements, uint32_t length);
+uint32_t tupleHash(VM *vm, ObjTuple *objTuple);
+bool tupleEquals(ObjTuple *a, ObjTuple *b);
+void freeObjTuple(VM *vm, ObjTuple *objTuple);
+
+#endif //SPARROW_OBJ_TUPLE_H
@@ -0,0 +1,434 @@
+//
+// Created by ZiXuan on 2022/7/24.
+//
+#include "obj_typed_array.h"
+#include "../vm/vm.h"
+
+#include <string.h>
+
+/**
+ * 把double转换为int32，超出范围的数按二进制补码截断，NaN及无穷为0
+ * @param value
+ * @return
+ */
+static inline int32_t toInt32(double value) {
+    if (!(value > -9.2e18 && value < 9.2e18)) {
+        return 0;
+    }
+    return (int32_t)(uint32_t)(int64_t)value;
+}
+
+/**
+ * 把double转换为字节，规则同toInt32
+ * @param value
+ * @return
+ */
+static inline uint8_t toByte(double value) {
+    return (uint8_t)toInt32(value);
+}
+
+/**
+ * 返回元素所占的字节数
+ * @param kind
+ * @return
+ */
+uint32_t typedArrayElementSize(TypedArrayKind kind) {
+    switch (kind) {
+        case TA_FLOAT64:
+            return sizeof(double);
+        case TA_INT32:
+            return sizeof(int32_t);
+        default:
+            return sizeof(uint8_t);
+    }
+}
+
+/**
+ * 返回kind对应的类
+ * @param vm
+ * @param kind
+ * @return
+ */
+static Class* typedArrayClass(VM *vm, TypedArrayKind kind) {
+    switch (kind) {
+        case TA_FLOAT64:
+            return vm->float64ArrayClass;
+        case TA_INT32:
+            return vm->int32ArrayClass;
+        default:
+            return vm->byteArrayClass;
+    }
+}
+
+/**
+ * 新建length个元素的数值数组，元素初值为0
+ * @param vm
+ * @param kind
+ * @param length
+ * @return
+ */
+ObjTypedArray* newObjTypedArray(VM *vm, TypedArrayKind kind, uint32_t length) {
+    uint64_t bytes = (uint64_t)length * typedArrayElementSize(kind);
+    if (bytes > UINT32_MAX) {
+        RUN_ERROR("typed array is too large!");
+    }
+    // 先分配内存，后调用initObjHeader，避免gc无谓的遍历
+    uint8_t *data = NULL;
+    if (length > 0) {
+        data = ALLOCATE_ARRAY(vm, uint8_t, bytes);
+        memset(data, 0, bytes);
+    }
+    ObjTypedArray *array = ALLOCATE(vm, ObjTypedArray);
+    array->kind = kind;
+    array->length = length;
+    array->base = NULL;
+    array->data = data;
+    initObjHeader(vm, &array->objHeader, OT_TYPED_ARRAY, typedArrayClass(vm, kind));
+    return array;
+}
+
+/**
+ * 新建array中从start起length个元素的切片，与array共享数据，修改彼此可见
+ * @param vm
+ * @param array
+ * @param start
+ * @param length
+ * @return
+ */
+ObjTypedArray* newTypedArraySlice(VM *vm, ObjTypedArray *array, uint32_t start, uint32_t length) {
+    if (start > array->length || length > array->length - start) {
+        RUN_ERROR("index out bounded!");
+    }
+    ObjTypedArray *slice = ALLOCATE(vm, ObjTypedArray);
+    slice->kind = array->kind;
+    slice->length = length;
+    slice->base = array->base != NULL ? array->base : array;
+    slice->data = array->data + (size_t)start * typedArrayElementSize(array->kind);
+    initObjHeader(vm, &slice->objHeader, OT_TYPED_ARRAY, array->objHeader.class);
+    return slice;
+}
+
+/**
+ * 返回第index个元素
+ * @param array
+ * @param index
+ * @return
+ */
+double typedArrayGet(ObjTypedArray *array, uint32_t index) {
+    switch (array->kind) {
+        case TA_FLOAT64:
+            return ((double *)array->data)[index];
+        case TA_INT32:
+            return ((int32_t *)array->data)[index];
+        default:
+            return array->data[index];
+    }
+}
+
+/**
+ * 设置第index个元素，整数数组按toInt32的规则转换
+ * @param array
+ * @param index
+ * @param value
+ */
+void typedArraySet(ObjTypedArray *array, uint32_t index, double value) {
+    switch (array->kind) {
+        case TA_FLOAT64:
+            ((double *)array->data)[index] = value;
+            break;
+        case TA_INT32:
+            ((int32_t *)array->data)[index] = toInt32(value);
+            break;
+        default:
+            array->data[index] = toByte(value);
+    }
+}
+
+/**
+ * 为元素类型type定义name##Sum等批量运算
+ * 循环体无分支、无别名，浮点累加分4路以免受限于加法的顺序依赖，
+ * 编译器在-O2以上可将其向量化，不依赖特定的SIMD指令集
+ */
+#define DEFINE_TYPED_ARRAY_KERNELS(name, type, ACC, WRAP) \
+    static double name##Sum(const type *restrict datas, uint32_t num) { \
+        ACC acc0 = 0, acc1 = 0, acc2 = 0, acc3 = 0; \
+        uint32_t idx = 0; \
+        while (idx + 4 <= num) { \
+            acc0 += datas[idx]; \
+            acc1 += datas[idx + 1]; \
+            acc2 += datas[idx + 2]; \
+            acc3 += datas[idx + 3]; \
+            idx += 4; \
+        } \
+        while (idx < num) { \
+            acc0 += datas[idx]; \
+            idx ++; \
+        } \
+        return (double)((acc0 + acc1) + (acc2 + acc3)); \
+    } \
+\
+    static double name##Min(const type *restrict datas, uint32_t num) { \
+        type result = datas[0]; \
+        uint32_t idx = 1; \
+        while (idx < num) { \
+            result = datas[idx] < result ? datas[idx] : result; \
+            idx ++; \
+        } \
+        return result; \
+    } \
+\
+    static double name##Max(const type *restrict datas, uint32_t num) { \
+        type result = datas[0]; \
+        uint32_t idx = 1; \
+        while (idx < num) { \
+            result = datas[idx] > result ? datas[idx] : result; \
+            idx ++; \
+        } \
+        return result; \
+    } \
+\
+    static double name##Dot(const type *restrict a, const type *restrict b, uint32_t num) { \
+        double acc0 = 0, acc1 = 0, acc2 = 0, acc3 = 0; \
+        uint32_t idx = 0; \
+        while (idx + 4 <= num) { \
+            acc0 += (double)a[idx] * b[idx]; \
+            acc1 += (double)a[idx + 1] * b[idx + 1]; \
+            acc2 += (double)a[idx + 2] * b[idx + 2]; \
+            acc3 += (double)a[idx + 3] * b[idx + 3]; \
+            idx += 4; \
+        } \
+        while (idx < num) { \
+            acc0 += (double)a[idx] * b[idx]; \
+            idx ++; \
+        } \
+        return (acc0 + acc1) + (acc2 + acc3); \
+    } \
+\
+    static void name##Scale(type *restrict datas, uint32_t num, double factor) { \
+        uint32_t idx = 0; \
+        while (idx < num) { \
+            datas[idx] = WRAP(datas[idx] * factor); \
+            idx ++; \
+        } \
+    }
+
+// byte数组直接用memset填充，只为float64和int32生成fill
+#define DEFINE_TYPED_ARRAY_FILL(name, type) \
+    static void name##Fill(type *restrict datas, uint32_t num, type value) { \
+        uint32_t idx = 0; \
+        while (idx < num) { \
+            datas[idx] = value; \
+            idx ++; \
+        } \
+    }
+
+#define WRAP_FLOAT64(value) (value)
+#define WRAP_INT32(value) toInt32(value)
+#define WRAP_BYTE(value) toByte(value)
+
+DEFINE_TYPED_ARRAY_KERNELS(float64, double, double, WRAP_FLOAT64)
+DEFINE_TYPED_ARRAY_KERNELS(int32, int32_t, int64_t, WRAP_INT32)
+DEFINE_TYPED_ARRAY_KERNELS(byte, uint8_t, uint64_t, WRAP_BYTE)
+DEFINE_TYPED_ARRAY_FILL(float64, double)
+DEFINE_TYPED_ARRAY_FILL(int32, int32_t)
+
+/**
+ * 把所有元素置为value
+ * @param array
+ * @param value
+ */
+void typedArrayFill(ObjTypedArray *array, double value) {
+    switch (array->kind) {
+        case TA_FLOAT64:
+            float64Fill((double *)array->data, array->length, value);
+            break;
+        case TA_INT32:
+            int32Fill((int32_t *)array->data, array->length, toInt32(value));
+            break;
+        default:
+            memset(array->data, toByte(value), array->length);
+    }
+}
+
+/**
+ * 返回元素之和，整数数组用64位整数累加，不溢出
+ * @param array
+ * @return
+ */
+double typedArraySum(ObjTypedArray *array) {
+    switch (array->kind) {
+        case TA_FLOAT64:
+            return float64Sum((double *)array->data, array->length);
+        case TA_INT32:
+            return int32Sum((int32_t *)array->data, array->length);
+        default:
+            return byteSum(array->data, array->length);
+    }
+}
+
+/**
+ * 返回最小元素，调用者保证数组非空
+ * @param array
+ * @return
+ */
+double typedArrayMin(ObjTypedArray *array) {
+    switch (array->kind) {
+        case TA_FLOAT64:
+            return float64Min((double *)array->data, array->length);
+        case TA_INT32:
+            return int32Min((int32_t *)array->data, array->length);
+        default:
+            return byteMin(array->data, array->length);
+    }
+}
+
+/**
+ * 返回最大元素，调用者保证数组非空
+ * @param array
+ * @return
+ */
+double typedArrayMax(ObjTypedArray *array) {
+    switch (array->kind) {
+        case TA_FLOAT64:
+            return float64Max((double *)array->data, array->length);
+        case TA_INT32:
+            return int32Max((int32_t *)array->data, array->length);
+        default:
+            return byteMax(array->data, array->length);
+    }
+}
+
+/**
+ * 返回两个同类型同长度数组的点积
+ * @param a
+ * @param b
+ * @return
+ */
+double typedArrayDot(ObjTypedArray *a, ObjTypedArray *b) {
+    if (a->kind != b->kind || a->length != b->length) {
+        RUN_ERROR("typed arrays must have the same kind and length!");
+    }
+    switch (a->kind) {
+        case TA_FLOAT64:
+            return float64Dot((double *)a->data, (double *)b->data, a->length);
+        case TA_INT32:
+            return int32Dot((int32_t *)a->data, (int32_t *)b->data, a->length);
+        default:
+            return byteDot(a->data, b->data, a->length);
+    }
+}
+
+/**
+ * 每个元素乘以factor
+ * @param array
+ * @param factor
+ */
+void typedArrayScale(ObjTypedArray *array, double factor) {
+    switch (array->kind) {
+        case TA_FLOAT64:
+            float64Scale((double *)array->data, array->length, factor);
+            break;
+        case TA_INT32:
+            int32Scale((int32_t *)array->data, array->length, factor);
+            break;
+        default:
+            byteScale(array->data, array->length, factor);
+    }
+}
+
+/**
+ * dst[i] += src[i]，两者须同类型同长度，整数按位宽回绕
+ * @param dst
+ * @param src
+ */
+void typedArrayAdd(ObjTypedArray *dst, ObjTypedArray *src) {
+    if (dst->kind != src->kind || dst->length != src->length) {
+        RUN_ERROR("typed arrays must have the same kind and length!");
+    }
+    uint32_t num = dst->length;
+    uint32_t idx = 0;
+    switch (dst->kind) {
+        case TA_FLOAT64: {
+            double *d = (double *)dst->data;
+            const double *s = (const double *)src->data;
+            while (idx < num) {
+                d[idx] += s[idx];
+                idx ++;
+            }
+            break;
+        }
+        case TA_INT32: {
+            // 以无符号数相加，回绕有定义
+            uint32_t *d = (uint32_t *)dst->data;
+            const uint32_t *s = (const uint32_t *)src->data;
+            while (idx < num) {
+                d[idx] += s[idx];
+                idx ++;
+            }
+            break;
+        }
+        default: {
+            uint8_t *d = dst->data;
+            const uint8_t *s = src->data;
+            while (idx < num) {
+                d[idx] += s[idx];
+                idx ++;
+            }
+        }
+    }
+}
+
+/**
+ * 把src的全部元素拷贝到dst中dstStart起的位置，两者可以是同一数组的重叠切片
+ * @param dst
+ * @param dstStart
+ * @param src
+ */
+void typedArrayCopy(ObjTypedArray *dst, uint32_t dstStart, ObjTypedArray *src) {
+    if (dst->kind != src->kind) {
+        RUN_ERROR("typed arrays must have the same kind!");
+    }
+    if (dstStart > dst->length || src->length > dst->length - dstStart) {
+        RUN_ERROR("index out bounded!");
+    }
+    uint32_t elementSize = typedArrayElementSize(dst->kind);
+    memmove(dst->data + (size_t)dstStart * elementSize, src->data, (size_t)src->length * elementSize);
+}
+
+/**
+ * 两数组类型、长度及各元素均相同时返回true，Float64Array按数值比较
+ * @param a
+ * @param b
+ * @return
+ */
+bool typedArrayEquals(ObjTypedArray *a, ObjTypedArray *b) {
+    if (a->kind != b->kind || a->length != b->length) {
+        return false;
+    }
+    if (a->kind != TA_FLOAT64) {
+        return memcmp(a->data, b->data, (size_t)a->length * typedArrayElementSize(a->kind)) == 0;
+    }
+    // 0.0与-0.0相等而NaN不等，不能按字节比较
+    const double *left = (const double *)a->data;
+    const double *right = (const double *)b->data;
+    uint32_t idx = 0;
+    while (idx < a->length) {
+        if (left[idx] != right[idx]) {
+            return false;
+        }
+        idx ++;
+    }
+    return true;
+}
+
+/**
+ * 释放数值数组，切片不释放所引用的数据，供gc调用
+ * @param vm
+ * @param array
+ */
+void freeObjTypedArray(VM *vm, ObjTypedArray *array) {
+    if (array->base == NULL && array->data != NULL) {
+        DEALLOCATE_ARRAY(vm, array->data, (size_t)array->length * typedArrayElementSize(array->kind));
+    }
+    DEALLOCATE(vm, array);
+}
@@ -0,0 +1,46 @@
+//
+// Created by ZiXuan on 2022/7/24.
+//
+
+#ifndef SPARROW_OBJ_TYPED_ARRAY_H
+#define SPARROW_OBJ_TYPED_ARRAY_H
+
+/**
+ * 实现定长的数值数组Float64Array、Int32Array及ByteArray，
+ * 元素不装箱，连续存放，便于编译器向量化批量运算
+ */
+
+#include "header_obj.h"
+#include "../include/utils.h"
+
+typedef enum {
+    TA_FLOAT64,
+    TA_INT32,
+    TA_BYTE
+} TypedArrayKind;  // 元素类型
+
+typedef struct objTypedArray {
+    ObjHeader objHeader;
+    TypedArrayKind kind;
+    uint32_t length; // 元素个数
+    struct objTypedArray *base; // 切片所引用的数组，不拷贝数据，gc标记切片时须一并标记base；自己持有数据时为NULL
+    uint8_t *data; // 首个元素的地址，切片指向base中的数据
+} ObjTypedArray;  // 数值数组对象
+
+uint32_t typedArrayElementSize(TypedArrayKind kind);
+ObjTypedArray* newObjTypedArray(VM *vm, TypedArrayKind kind, uint32_t length);
+ObjTypedArray* newTypedArraySlice(VM *vm, ObjTypedArray *array, uint32_t start, uint32_t length);
+double typedArrayGet(ObjTypedArray *array, uint32_t index);
+void typedArraySet(ObjTypedArray *array, uint32_t index, double value);
+void typedArrayFill(ObjTypedArray *array, double value);
+double typedArraySum(ObjTypedArray *array);
+double typedArrayMin(ObjTypedArray *array);
+double typedArrayMax(ObjTypedArray *array);
+double typedArrayDot(ObjTypedArray *a, ObjTypedArray *b);
+void typedArrayScale(ObjTypedArray *array, double factor);
+void typedArrayAdd(ObjTypedArray *dst, ObjTypedArray *src);
+void typedArrayCopy(ObjTypedArray *dst, uint32_t dstStart, ObjTypedArray *src);
+bool typedArrayEquals(ObjTypedArray *a, ObjTypedArray *b);
+void freeObjTypedArray(VM *vm, ObjTypedArray *array);
+
+#endif //SPARROW_OBJ_TYPED_ARRAY_H
@@ -0,0 +1,371 @@
+//
+// Created by ZiXuan on 2022/7/30.
+//
+#include "obj_vector.h"
+#include <stddef.h>
+#include <string.h>
+#include "../vm/vm.h"
+
+/**
+ * 节点占用的字节数，分支节点只分配子节点指针的空间
+ * @param isLeaf
+ * @return
+ */
+static uint32_t vectorNodeSize(bool isLeaf) {
+    return (uint32_t)(offsetof(VectorNode, values) +
+                      (isLeaf ? sizeof(Value) : sizeof(VectorNode *)) * VECTOR_WIDTH);
+}
+
+/**
+ * 新建空节点，引用计数为1
+ * @param vm
+ * @param isLeaf
+ * @return
+ */
+static VectorNode* newVectorNode(VM *vm, bool isLeaf) {
+    uint32_t size = vectorNodeSize(isLeaf);
+    VectorNode *node = (VectorNode *)memManager(vm, NULL, 0, size);
+    memset(node, 0, size);
+    node->refCount = 1;
+    return node;
+}
+
+/**
+ * 释放对节点的一个引用，计数归0时连同子节点一并释放
+ * @param vm
+ * @param node
+ * @param level 节点所在层的位移，叶子为0
+ */
+static void releaseVectorNode(VM *vm, VectorNode *node, uint32_t level) {
+    if (node == NULL || -- node->refCount > 0) {
+        return;
+    }
+    if (level > 0) {
+        uint32_t idx = 0;
+        while (idx < VECTOR_WIDTH) {
+            releaseVectorNode(vm, node->children[idx], level - VECTOR_BITS);
+            idx ++;
+        }
+    }
+    memManager(vm, node, vectorNodeSize(level == 0), 0);
+}
+
+/**
+ * 返回可原地修改的节点：独占时即是node本身，否则复制一份，
+ * 副本引用node的全部子节点，node的计数减1。调用方对node的引用转为对结果的引用
+ * @param vm
+ * @param node
+ * @param isLeaf
+ * @return
+ */
+static VectorNode* editableVectorNode(VM *vm, VectorNode *node, bool isLeaf) {
+    if (node->refCount == 1) {
+        return node;
+    }
+    VectorNode *copy = newVectorNode(vm, isLeaf);
+    memcpy(copy, node, vectorNodeSize(isLeaf));
+    copy->refCount = 1;
+    if (!isLeaf) {
+        uint32_t idx = 0;
+        while (idx < VECTOR_WIDTH) {
+            if (copy->children[idx] != NULL) {
+                copy->children[idx]->refCount ++;
+            }
+            idx ++;
+        }
+    }
+    node->refCount --;
+    return copy;
+}
+
+/**
+ * 尾部首个元素的下标，尾部总从VECTOR_WIDTH的整数倍开始
+ * @param objVector
+ * @return
+ */
+static uint32_t tailOffset(ObjVector *objVector) {
+    if (objVector->count < VECTOR_WIDTH) {
+        return 0;
+    }
+    return ((objVector->count - 1) >> VECTOR_BITS) << VECTOR_BITS;
+}
+
+/**
+ * 新建空向量
+ * @param vm
+ * @return
+ */
+ObjVector* newObjVector(VM *vm) {
+    ObjVector *objVector = ALLOCATE(vm, ObjVector);
+    initObjHeader(vm, &objVector->objHeader, OT_VECTOR, vm->vectorClass);
+    objVector->count = 0;
+    objVector->shift = VECTOR_BITS;
+    objVector->isTransient = false;
+    objVector->root = NULL;
+    objVector->tail = NULL;
+    return objVector;
+}
+
+/**
+ * 新建与objVector共享全部节点的向量
+ * @param vm
+ * @param objVector
+ * @param isTransient
+ * @return
+ */
+static ObjVector* shareVector(VM *vm, ObjVector *objVector, bool isTransient) {
+    ObjVector *result = newObjVector(vm);
+    result->count = objVector->count;
+    result->shift = objVector->shift;
+    result->isTransient = isTransient;
+    result->root = objVector->root;
+    result->tail = objVector->tail;
+    if (result->root != NULL) {
+        result->root->refCount ++;
+    }
+    if (result->tail != NULL) {
+        result->tail->refCount ++;
+    }
+    return result;
+}
+
+/**
+ * 修改操作的对象：暂态向量原地修改，否则修改共享节点的新版本
+ * @param vm
+ * @param objVector
+ * @return
+ */
+static ObjVector* vectorForUpdate(VM *vm, ObjVector *objVector) {
+    return objVector->isTransient ? objVector : shareVector(vm, objVector, false);
+}
+
+/**
+ * 返回下标为index的元素，调用方保证index小于count
+ * @param objVector
+ * @param index
+ * @return
+ */
+Value vectorGet(ObjVector *objVector, uint32_t index) {
+    if (index >= tailOffset(objVector)) {
+        return objVector->tail->values[index & VECTOR_MASK];
+    }
+    VectorNode *node = objVector->root;
+    uint32_t level = objVector->shift;
+    while (level > 0) {
+        node = node->children[(index >> level) & VECTOR_MASK];
+        level -= VECTOR_BITS;
+    }
+    return node->values[index & VECTOR_MASK];
+}
+
+/**
+ * 把下标为index的元素改为value，只复制从根到该叶子路径上的共享节点
+ * @param vm
+ * @param objVector
+ * @param index 小于count
+ * @param value
+ * @return 修改后的向量，暂态时即objVector
+ */
+ObjVector* vectorSet(VM *vm, ObjVector *objVector, uint32_t index, Value value) {
+    ObjVector *result = vectorForUpdate(vm, objVector);
+    if (index >= tailOffset(result)) {
+        result->tail = editableVectorNode(vm, result->tail, true);
+        result->tail->values[index & VECTOR_MASK] = value;
+        return result;
+    }
+
+    result->root = editableVectorNode(vm, result->root, false);
+    VectorNode *node = result->root;
+    uint32_t level = result->shift;
+    while (level > 0) {
+        uint32_t slot = (index >> level) & VECTOR_MASK;
+        node->children[slot] = editableVectorNode(vm, node->children[slot], level == VECTOR_BITS);
+        node = node->children[slot];
+        level -= VECTOR_BITS;
+    }
+    node->values[index & VECTOR_MASK] = value;
+    return result;
+}
+
+/**
+ * 建一条从level层到叶子node的单链路径
+ * @param vm
+ * @param level
+ * @param node
+ * @return
+ */
+static VectorNode* newVectorPath(VM *vm, uint32_t level, VectorNode *node) {
+    if (level == 0) {
+        return node;
+    }
+    VectorNode *branch = newVectorNode(vm, false);
+    branch->children[0] = newVectorPath(vm, level - VECTOR_BITS, node);
+    return branch;
+}
+
+/**
+ * 把已满的尾部挂到树的最右侧
+ * @param vm
+ * @param objVector 尾部尚未移出，count含尾部
+ * @param level parent所在层的位移
+ * @param parent 可以为NULL
+ * @param tailNode
+ * @return 修改后的parent
+ */
+static VectorNode* pushTail(VM *vm, ObjVector *objVector, uint32_t level, VectorNode *parent, VectorNode *tailNode) {
+    parent = parent == NULL ? newVectorNode(vm, false) : editableVectorNode(vm, parent, false);
+    uint32_t slot = ((objVector->count - 1) >> level) & VECTOR_MASK;
+    if (level == VECTOR_BITS) {
+        parent->children[slot] = tailNode;
+    }
+    else if (parent->children[slot] != NULL) {
+        parent->children[slot] = pushTail(vm, objVector, level - VECTOR_BITS, parent->children[slot], tailNode);
+    }
+    else {
+        parent->children[slot] = newVectorPath(vm, level - VECTOR_BITS, tailNode);
+    }
+    return parent;
+}
+
+/**
+ * 在末尾追加value，尾部满了才整块挂入树中
+ * @param vm
+ * @param objVector
+ * @param value
+ * @return 修改后的向量，暂态时即objVector
+ */
+ObjVector* vectorAdd(VM *vm, ObjVector *objVector, Value value) {
+    ObjVector *result = vectorForUpdate(vm, objVector);
+    if (result->tail == NULL) {
+        result->tail = newVectorNode(vm, true);
+    }
+    else if (result->count - tailOffset(result) < VECTOR_WIDTH) {
+        result->tail = editableVectorNode(vm, result->tail, true);
+    }
+    else {
+        // 尾部移入树中，向量对它的引用转给树
+        if ((result->count >> VECTOR_BITS) > (1u << result->shift)) {
+            VectorNode *newRoot = newVectorNode(vm, false);
+            newRoot->children[0] = result->root;
+            newRoot->children[1] = newVectorPath(vm, result->shift, result->tail);
+            result->root = newRoot;
+            result->shift += VECTOR_BITS;
+        }
+        else {
+            result->root = pushTail(vm, result, result->shift, result->root, result->tail);
+        }
+        result->tail = newVectorNode(vm, true);
+    }
+    result->tail->values[result->count & VECTOR_MASK] = value;
+    result->count ++;
+    return result;
+}
+
+/**
+ * 摘下树最右侧的叶子
+ * @param vm
+ * @param objVector count含尾部
+ * @param level node所在层的位移
+ * @param node
+ * @return 修改后的node，变空时返回NULL
+ */
+static VectorNode* popTail(VM *vm, ObjVector *objVector, uint32_t level, VectorNode *node) {
+    node = editableVectorNode(vm, node, false);
+    uint32_t slot = ((objVector->count - 2) >> level) & VECTOR_MASK;
+    if (level > VECTOR_BITS) {
+        VectorNode *child = popTail(vm, objVector, level - VECTOR_BITS, node->children[slot]);
+        node->children[slot] = child;
+        if (child == NULL && slot == 0) {
+            releaseVectorNode(vm, node, level);
+            return NULL;
+        }
+        return node;
+    }
+    releaseVectorNode(vm, node->children[slot], 0);
+    node->children[slot] = NULL;
+    if (slot == 0) {
+        releaseVectorNode(vm, node, level);
+        return NULL;
+    }
+    return node;
+}
+
+/**
+ * 删除最后一个元素
+ * @param vm
+ * @param objVector count大于0
+ * @return 修改后的向量，暂态时即objVector
+ */
+ObjVector* vectorRemoveLast(VM *vm, ObjVector *objVector) {
+    ObjVector *result = vectorForUpdate(vm, objVector);
+    if (result->count == 1) {
+        releaseVectorNode(vm, result->tail, 0);
+        result->tail = NULL;
+        result->count = 0;
+        return result;
+    }
+    if (result->count - tailOffset(result) > 1) {
+        result->tail = editableVectorNode(vm, result->tail, true);
+        result->count --;
+        return result;
+    }
+
+    // 尾部只剩一个元素，树最右侧的叶子成为新尾部
+    uint32_t level = result->shift;
+    VectorNode *newTail = result->root;
+    while (level > 0) {
+        newTail = newTail->children[((result->count - 2) >> level) & VECTOR_MASK];
+        level -= VECTOR_BITS;
+    }
+    newTail->refCount ++;
+
+    VectorNode *newRoot = popTail(vm, result, result->shift, result->root);
+    if (newRoot != NULL && result->shift > VECTOR_BITS && newRoot->children[1] == NULL) {
+        // 根只剩一个子节点，降低一层
+        VectorNode *child = newRoot->children[0];
+        newRoot->children[0] = NULL;
+        releaseVectorNode(vm, newRoot, result->shift);
+        newRoot = child;
+        result->shift -= VECTOR_BITS;
+    }
+    if (newRoot == NULL) {
+        result->shift = VECTOR_BITS;
+    }
+    result->root = newRoot;
+    releaseVectorNode(vm, result->tail, 0);
+    result->tail = newTail;
+    result->count --;
+    return result;
+}
+
+/**
+ * 返回与objVector共享节点的暂态向量，用于批量修改
+ * @param vm
+ * @param objVector
+ * @return
+ */
+ObjVector* vectorTransient(VM *vm, ObjVector *objVector) {
+    return shareVector(vm, objVector, true);
+}
+
+/**
+ * 返回暂态向量当前内容的持久化版本，O(1)。
+ * 之后再修改暂态向量时，共享的节点按引用计数自动复制，不影响返回的版本
+ * @param vm
+ * @param objVector
+ * @return
+ */
+ObjVector* vectorPersistent(VM *vm, ObjVector *objVector) {
+    return shareVector(vm, objVector, false);
+}
+
+/**
+ * 释放向量及只被它引用的节点，供gc调用
+ * @param vm
+ * @param objVector
+ */
+void freeObjVector(VM *vm, ObjVector *objVector) {
+    releaseVectorNode(vm, objVector->root, objVector->shift);
+    releaseVectorNode(vm, objVector->tail, 0);
+    DEALLOCATE(vm, objVector);
+}
@@ -0,0 +1,46 @@
+//
+// Created by ZiXuan on 2022/7/30.
+//
+
+#ifndef SPARROW_OBJ_VECTOR_H
+#define SPARROW_OBJ_VECTOR_H
+
+/**
+ * 实现持久化向量：32叉前缀树加尾部缓冲，修改时只复制根到叶子的一条路径，
+ * 新旧版本共享其余节点。节点带引用计数，只被一个版本引用的节点可原地修改，
+ * 暂态（transient）向量借此在批量修改时不再逐次复制
+ */
+
+#include "class.h"
+
+#define VECTOR_BITS 5
+#define VECTOR_WIDTH (1u << VECTOR_BITS)
+#define VECTOR_MASK (VECTOR_WIDTH - 1)
+
+typedef struct vectorNode {
+    uint32_t refCount;  // 引用此节点的父节点及向量个数，为1时可原地修改
+    union {
+        struct vectorNode *children[VECTOR_WIDTH];  // 分支节点，按实际大小分配
+        Value values[VECTOR_WIDTH];  // 叶子节点
+    };
+} VectorNode;
+
+typedef struct {
+    ObjHeader objHeader;
+    uint32_t count;
+    uint32_t shift;  // 根节点所在层的位移，最小为VECTOR_BITS，即根的子节点为叶子
+    bool isTransient;  // 为真时修改操作原地进行并返回本向量
+    VectorNode *root;  // 尾部之前的元素，没有时为NULL
+    VectorNode *tail;  // 最后1到VECTOR_WIDTH个元素，count为0时为NULL
+} ObjVector;  // 持久化向量对象
+
+ObjVector* newObjVector(VM *vm);
+Value vectorGet(ObjVector *objVector, uint32_t index);
+ObjVector* vectorSet(VM *vm, ObjVector *objVector, uint32_t index, Value value);
+ObjVector* vectorAdd(VM *vm, ObjVector *objVector, Value value);
+ObjVector* vectorRemoveLast(VM *vm, ObjVector *objVector);
+ObjVector* vectorTransient(VM *vm, ObjVector *objVector);
+ObjVector* vectorPersistent(VM *vm, ObjVector *objVector);
+void freeObjVector(VM *vm, ObjVector *objVector);
+
+#endif //SPARROW_OBJ_VECTOR_H
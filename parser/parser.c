@@ -116,7 +116,7 @@ static void skipBlanks(Parser *parser) {
  */
 static void skipAline(Parser *parser) {
     getNextChar(parser);
-    while (parser->curChar == '\0') {
+    while (parser->curChar != '\0') {
         if (parser->curChar == '\n') {
             parser->curToken.lineNo ++;
             getNextChar(parser);
@@ -132,27 +132,23 @@ static void skipAline(Parser *parser) {
  * @param parser
  */
 static void skipComment(Parser *parser) {
-    char nextChar = lookAheadChar(parser);
     if (parser->curChar == '/') { // 行注释
         skipAline(parser);
     }
-    else { // 区块注释
-        while (nextChar != '*' && nextChar != '\0') {
-            getNextChar(parser);
+    else { // 区块注释，先跳过开头的*
+        getNextChar(parser);
+        while (parser->curChar != '*' || lookAheadChar(parser) != '/') {
+            if (parser->curChar == '\0') {
+                LEX_ERROR(parser, "expect '*/' before file end!");
+            }
             if (parser->curChar == '\n') {
                 parser->curToken.lineNo ++;
-            }
-            nextChar = lookAheadChar(parser);
-        }
-        if (matchNextChar(parser, '*')) {
-            if (!matchNextChar(parser, '/')) {
-
             }
             getNextChar(parser);
         }
-        else {
-
-        }
+        // 跳过结尾的*/
+        getNextChar(parser);
+        getNextChar(parser);
     }
     skipBlanks(parser);
 }
@@ -228,7 +224,7 @@ static void parseString(Parser *parser) {
     while (true) {
         getNextChar(parser);
         if (parser->curChar == '\0') {  // 处理字符串的不完整
-
+            LEX_ERROR(parser, "unterminated string!");
         }
 
         if (parser->curChar == '"') {  // 处理字符串的结束
@@ -236,8 +232,17 @@ static void parseString(Parser *parser) {
             break;
         }
 
-        if (parser->curChar == '%') {
-
+        if (parser->curChar == '%') {  // 处理内嵌表达式%(...)
+            if (!matchNextChar(parser, '(')) {
+                LEX_ERROR(parser, "'%%' should followed by '('!");
+            }
+            if (parser->interpolationExpectRightParenNum > 0) {
+                LEX_ERROR(parser, "sorry, nested interpolate expression is not supported!");
+            }
+            // 此后遇到与之配对的)时再继续解析字符串的剩余部分
+            parser->interpolationExpectRightParenNum = 1;
+            parser->curToken.type = TOKEN_INTERPOLATION;
+            break;
         }
 
         if (parser->curChar == '\\') {  // 处理转义字符
@@ -304,11 +309,11 @@ static void parseString(Parser *parser) {
 // }
 
 /**
- * @brief Get the Next Token object 获取下一个token
+ * @brief 识别下一个token
  *
  * @param parser
  */
-void getNextToken(Parser *parser) {
+static void lexNextToken(Parser *parser) {
     parser->preToken = parser->curToken;
     skipBlanks(parser);
     parser->curToken.type = TOKEN_EOF;
@@ -377,7 +382,7 @@ void getNextToken(Parser *parser) {
                 parser->curToken.type = TOKEN_MUL;
                 break;
             case '/':
-                if (matchNextChar(parser, '/') || matchNextChar(parser, '/')) {
+                if (matchNextChar(parser, '/') || matchNextChar(parser, '*')) {
                     skipComment(parser);
 
                     // reset下一个token起始地址
@@ -400,7 +405,7 @@ void getNextToken(Parser *parser) {
                 }
                 break;
             case '|':
-                if (matchNextChar(parser, '&')) {
+                if (matchNextChar(parser, '|')) {
                     parser->curToken.type = TOKEN_LOGIC_OR;
                 }
                 else {
@@ -428,7 +433,7 @@ void getNextToken(Parser *parser) {
                 if (matchNextChar(parser, '=')) {
                     parser->curToken.type = TOKEN_LESS_EQUAL;
                 }
-                else if (matchNextChar(parser, '>')) {
+                else if (matchNextChar(parser, '<')) {
                     parser->curToken.type = TOKEN_BIT_SHIFT_LEFT;
                 }
                 else {
@@ -475,6 +480,39 @@ void getNextToken(Parser *parser) {
     }
 }
 
+/**
+ * @brief Get the Next Token object 获取下一个token
+ *
+ * @param parser
+ */
+void getNextToken(Parser *parser) {
+    lexNextToken(parser);
+}
+
+/**
+ * 从parser当前位置把剩余源码单独扫描一遍，整体计时词法分析阶段并统计token数
+ * 逐个token读时钟的开销与词法分析本身相当，会使统计失真
+ * 在parser的副本上进行，不改变parser的状态
+ * @param parser
+ * @return 扫描耗时的纳秒数
+ */
+uint64_t lexWholeModule(Parser *parser) {
+    CompileStats *stats = &parser->vm->compileStats;
+    Parser lexer = *parser;
+    uint64_t tokenNum = 0;
+
+    uint64_t start = getNowNs();
+    do {
+        lexNextToken(&lexer);
+        tokenNum ++;
+    } while (lexer.curToken.type != TOKEN_EOF);
+    uint64_t elapsed = getNowNs() - start;
+
+    stats->lexNs += elapsed;
+    stats->tokenNum += tokenNum;
+    return elapsed;
+}
+
 /**
  * @brief 若当前token为expected则读入下一个token并返回为TRUE
  * 否则不读入token且返回false
@@ -111,6 +111,8 @@ struct parser {  // 词法分析器结构
     struct vm* vm;  // parser隶属于哪一个vm，在词法分析过程中需要指定vm
 };
 
+// 当前token的类型，不读入新token
+#define PEEK_TOKEN(parserPtr) (parserPtr)->curToken.type
 
 int matchToken(Parser *parser, TokenType expected);
 static TokenType idOrkeyword(const char *start, uint32_t length);
@@ -122,8 +124,10 @@ static void skipComment(Parser *parser);
 static void parseId(Parser *parser, TokenType type);
 static void parseUnicodeCodePoint(Parser *parser, ByteBuffer *buf);
 static void parseString(Parser *parser);
+static void lexNextToken(Parser *parser);
 char lookAheadChar(Parser *parser);
 void getNextToken(Parser *parser);
+uint64_t lexWholeModule(Parser *parser);
 // void getNextToken(Parser *parser);
 void consumeCurToken(Parser *parser, TokenType expected, const char *errMsg);
 void consumeNextCurToken(Parser *parser, TokenType expected, const char *errMsg);
@@ -0,0 +1,1630 @@
+//
+// Created by ZiXuan on 2022/8/20.
+//
+
+/**
+ * spr-unit-test: 运行时各部分的单元测试
+ * 不带参数时运行全部用例，带参数时只运行名字相同的用例，供ctest逐项登记
+ * 每个用例使用独立的虚拟机，失败时输出所在行及原因，进程以非0状态退出
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sched.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "../include/utils.h"
+#include "../include/unicodeUtf8.h"
+#include "../vm/vm.h"
+#include "../vm/core.h"
+#include "../object/class.h"
+#include "../object/obj_list.h"
+#include "../object/obj_range.h"
+#include "../object/obj_string_builder.h"
+#include "../object/obj_typed_array.h"
+#include "../object/obj_set.h"
+#include "../object/obj_tuple.h"
+#include "../object/obj_vector.h"
+#include "../object/obj_hash_map.h"
+#include "../object/obj_channel.h"
+#include "../vm/message.h"
+#include "../vm/worker.h"
+#include "../vm/mailbox.h"
+#include "../vm/shared_heap.h"
+#include "../vm/arena.h"
+#include "../vm/event_loop.h"
+#include "../compiler/compiler.h"
+
+#define CHECK(condition, ...) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__); \
+            fputc('\n', stderr); \
+            return false; \
+        } \
+    } while (0)
+
+typedef bool (*TestFn)(VM *vm);
+
+typedef struct {
+    const char *name;
+    TestFn fn;
+} TestCase;
+
+/**
+ * 每次查找前重新构造的短key取自驻留池，不应有分配
+ * @param vm
+ * @return
+ */
+static bool testMapPooledKeys(VM *vm) {
+    ObjMap *objMap = newObjMap(vm);
+    char buf[32];
+    uint32_t idx = 0;
+    while (idx < 1000) {
+        int len = snprintf(buf, sizeof(buf), "key_%u", idx);
+        mapSet(vm, objMap, OBJ_TO_VALUE(newObjString(vm, buf, len)), NUM_TO_VALUE(idx));
+        idx ++;
+    }
+
+    uint64_t allocatedNum = vm->allocatedNum;
+    idx = 0;
+    while (idx < 1000) {
+        int len = snprintf(buf, sizeof(buf), "key_%u", idx);
+        Value value = mapGet(vm, objMap, OBJ_TO_VALUE(newObjString(vm, buf, len)));
+        CHECK(!VALUE_IS_UNDEFINED(value) && value.num == idx, "key_%u is missing", idx);
+        idx ++;
+    }
+    CHECK(vm->allocatedNum == allocatedNum, "short keys were allocated again");
+    return true;
+}
+
+/**
+ * 删除三分之一的key再插入新key后，遍历顺序仍为插入顺序
+ * @param vm
+ * @return
+ */
+static bool testMapInsertionOrder(VM *vm) {
+    uint32_t n = 3000, total = n + n / 3;
+    ObjMap *objMap = newObjMap(vm);
+    // expected按插入顺序记录有效的key，删除的置为-1
+    double *expected = (double *)malloc(sizeof(double) * total);
+    uint32_t idx = 0;
+    while (idx < n) {
+        // 乱序的key，检验顺序与哈希值无关
+        double key = (double)(((uint64_t)idx * 2654435761u) % 1000003u);
+        mapSet(vm, objMap, NUM_TO_VALUE(key), NUM_TO_VALUE(idx));
+        expected[idx ++] = key;
+    }
+    idx = 0;
+    while (idx < n) {
+        removeKey(vm, objMap, NUM_TO_VALUE(expected[idx]));
+        expected[idx] = -1;
+        idx += 3;
+    }
+    idx = n;
+    while (idx < total) {
+        mapSet(vm, objMap, NUM_TO_VALUE(1000003.0 + idx), NUM_TO_VALUE(idx));
+        expected[idx] = 1000003.0 + idx;
+        idx ++;
+    }
+
+    uint32_t visited = 0, expectedIdx = 0;
+    uint32_t entryIdx = mapNextEntry(objMap, 0);
+    while (entryIdx < objMap->entryNum) {
+        while (expected[expectedIdx] < 0) {
+            expectedIdx ++;
+        }
+        Entry *entry = &objMap->entries[entryIdx];
+        bool inOrder = entry->key.num == expected[expectedIdx] && entry->value.num == expectedIdx;
+        if (!inOrder) {
+            free(expected);
+        }
+        CHECK(inOrder, "entry %u is out of insertion order", visited);
+        expectedIdx ++;
+        visited ++;
+        entryIdx = mapNextEntry(objMap, entryIdx + 1);
+    }
+    free(expected);
+    CHECK(visited == objMap->count, "visited %u of %u entries", visited, objMap->count);
+    return true;
+}
+
+/**
+ * 预留空间后装载不再重建索引表
+ * @param vm
+ * @return
+ */
+static bool testMapReserve(VM *vm) {
+    uint32_t n = 5000;
+    ObjMap *objMap = newObjMap(vm);
+    mapReserve(vm, objMap, n);
+    uint32_t *reservedIndices = objMap->indices;
+    uint32_t idx = 0;
+    while (idx < n) {
+        mapSet(vm, objMap, NUM_TO_VALUE(idx), NUM_TO_VALUE(idx * 2));
+        idx ++;
+    }
+    CHECK(objMap->indices == reservedIndices, "reserved map was resized");
+    idx = 0;
+    while (idx < n) {
+        Value value = mapGet(vm, objMap, NUM_TO_VALUE(idx));
+        CHECK(!VALUE_IS_UNDEFINED(value) && value.num == idx * 2, "entry %u is lost", idx);
+        idx ++;
+    }
+    return true;
+}
+
+/**
+ * 遍历中删除当前及其后的key，其余key各访问一次，之后插入时再压缩
+ * @param vm
+ * @return
+ */
+static bool testMapRemoveIterate(VM *vm) {
+    uint32_t n = 1000;
+    ObjMap *objMap = newObjMap(vm);
+    ObjSet *objSet = newObjSet(vm);
+    uint32_t idx = 0;
+    while (idx < n) {
+        mapSet(vm, objMap, NUM_TO_VALUE(idx), NUM_TO_VALUE(idx));
+        setAdd(vm, objSet, NUM_TO_VALUE(idx));
+        idx ++;
+    }
+
+    // 删除访问到的key，偶数时还删除其后一个，只应访问到偶数
+    uint32_t visited = 0;
+    uint32_t entryIdx = mapNextEntry(objMap, 0);
+    while (entryIdx < objMap->entryNum) {
+        uint32_t key = (uint32_t)objMap->entries[entryIdx].key.num;
+        CHECK(key == visited * 2, "map visited %u, expected %u", key, visited * 2);
+        removeKey(vm, objMap, NUM_TO_VALUE(key));
+        removeKey(vm, objMap, NUM_TO_VALUE(key + 1));
+        visited ++;
+        entryIdx = mapNextEntry(objMap, entryIdx + 1);
+    }
+    CHECK(visited == n / 2 && objMap->count == 0, "map visited %u keys", visited);
+
+    visited = 0;
+    uint32_t keyIdx = setNextKey(objSet, 0);
+    while (keyIdx < objSet->keyNum) {
+        uint32_t key = (uint32_t)objSet->keys[keyIdx].num;
+        CHECK(key == visited * 2, "set visited %u, expected %u", key, visited * 2);
+        setRemove(vm, objSet, NUM_TO_VALUE(key));
+        setRemove(vm, objSet, NUM_TO_VALUE(key + 1));
+        visited ++;
+        keyIdx = setNextKey(objSet, keyIdx + 1);
+    }
+    CHECK(visited == n / 2 && objSet->count == 0, "set visited %u keys", visited);
+
+    uint32_t capacity = objMap->capacity;
+    mapSet(vm, objMap, NUM_TO_VALUE(-1), NUM_TO_VALUE(-1));
+    CHECK(objMap->capacity < capacity && objMap->entryNum == 1, "map not compacted on insert");
+    CHECK(mapGet(vm, objMap, NUM_TO_VALUE(-1)).num == -1, "inserted key is lost");
+    return true;
+}
+
+/**
+ * 以元组作key分组与以插值得到的字符串作key分组，组数及各组计数一致
+ * @param vm
+ * @return
+ */
+static bool testMapTupleKeys(VM *vm) {
+    uint32_t n = 5000, cityNum = 20;
+    ObjMap *byString = newObjMap(vm);
+    ObjMap *byTuple = newObjMap(vm);
+    Value cities[20];
+    char buf[32];
+    uint32_t idx = 0;
+    while (idx < cityNum) {
+        int len = snprintf(buf, sizeof(buf), "city-of-the-plain-%u", idx);
+        cities[idx ++] = OBJ_TO_VALUE(newObjString(vm, buf, len));
+    }
+    Value separator = OBJ_TO_VALUE(newObjString(vm, "|", 1));
+
+    idx = 0;
+    while (idx < n) {
+        int len = snprintf(buf, sizeof(buf), "%u", idx % 37);
+        Value pieces[3] = {cities[idx % cityNum], separator, OBJ_TO_VALUE(newObjString(vm, buf, len))};
+        Value key = OBJ_TO_VALUE(newObjStringFromPieces(vm, pieces, 3));
+        Value count = mapGet(vm, byString, key);
+        mapSet(vm, byString, key, NUM_TO_VALUE(VALUE_IS_UNDEFINED(count) ? 1 : count.num + 1));
+
+        Value columns[2] = {cities[idx % cityNum], NUM_TO_VALUE(idx % 37)};
+        key = OBJ_TO_VALUE(newObjTuple(vm, columns, 2));
+        count = mapGet(vm, byTuple, key);
+        mapSet(vm, byTuple, key, NUM_TO_VALUE(VALUE_IS_UNDEFINED(count) ? 1 : count.num + 1));
+        idx ++;
+    }
+
+    CHECK(byString->count == byTuple->count, "%u string groups, %u tuple groups",
+          byString->count, byTuple->count);
+    uint32_t entryIdx = mapNextEntry(byTuple, 0);
+    while (entryIdx < byTuple->entryNum) {
+        ObjTuple *objTuple = VALUE_TO_OBJTUPLE(byTuple->entries[entryIdx].key);
+        int len = snprintf(buf, sizeof(buf), "%u", (uint32_t)objTuple->elements[1].num);
+        Value pieces[3] = {objTuple->elements[0], separator, OBJ_TO_VALUE(newObjString(vm, buf, len))};
+        Value count = mapGet(vm, byString, OBJ_TO_VALUE(newObjStringFromPieces(vm, pieces, 3)));
+        CHECK(!VALUE_IS_UNDEFINED(count) && count.num == byTuple->entries[entryIdx].value.num,
+              "group sizes differ");
+        entryIdx = mapNextEntry(byTuple, entryIdx + 1);
+    }
+    return true;
+}
+
+/**
+ * 集合的并、交、差
+ * @param vm
+ * @return
+ */
+static bool testSetOperations(VM *vm) {
+    uint32_t n = 1000, m = 100;
+    ObjSet *large = newObjSet(vm);
+    uint32_t idx = 0;
+    while (idx < n) {
+        setAdd(vm, large, NUM_TO_VALUE(idx ++));
+    }
+    CHECK(!setAdd(vm, large, NUM_TO_VALUE(0)), "duplicate key was added");
+
+    // small的前一半在large中
+    ObjSet *small = newObjSet(vm);
+    idx = 0;
+    while (idx < m) {
+        setAdd(vm, small, NUM_TO_VALUE(n - m / 2 + idx));
+        idx ++;
+    }
+
+    ObjSet *common = setIntersect(vm, large, small);
+    ObjSet *unionSet = setUnion(vm, small, large);
+    ObjSet *diffLarge = setDifference(vm, large, small);
+    ObjSet *diffSmall = setDifference(vm, small, large);
+    CHECK(common->count == m / 2, "intersect has %u keys", common->count);
+    CHECK(unionSet->count == n + m - m / 2, "union has %u keys", unionSet->count);
+    CHECK(diffLarge->count == n - m / 2 && !setContains(vm, diffLarge, NUM_TO_VALUE(n - 1)),
+          "large - small is wrong");
+    CHECK(diffSmall->count == m - m / 2 && setContains(vm, diffSmall, NUM_TO_VALUE(n)),
+          "small - large is wrong");
+    CHECK(setRemove(vm, large, NUM_TO_VALUE(5)) && !setContains(vm, large, NUM_TO_VALUE(5)), "remove failed");
+    return true;
+}
+
+/**
+ * 整体拷贝、拼接串及StringBuilder三种方式拼出的字符串相同
+ * @param vm
+ * @return
+ */
+static bool testStringConcat(VM *vm) {
+    uint32_t n = 500;
+    ObjString *piece = newObjString(vm, "0123456789", 10);
+    char *expected = (char *)malloc(n * 10);
+    ObjString *rope = newObjString(vm, "", 0);
+    ObjStringBuilder *builder = newObjStringBuilder(vm);
+    uint32_t idx = 0;
+    while (idx < n) {
+        memcpy(expected + idx * 10, piece->value.start, 10);
+        rope = newObjStringConcat(vm, rope, piece);
+        stringBuilderAppend(vm, builder, piece);
+        idx ++;
+    }
+    ObjString *copied = newObjString(vm, expected, n * 10);
+    free(expected);
+
+    CHECK(objStringEquals(copied, flattenObjString(vm, rope)), "rope differs from copy");
+    CHECK(objStringEquals(copied, stringBuilderToString(vm, builder)), "builder differs from copy");
+    return true;
+}
+
+/**
+ * OPCODE_INTERPOLATE所用的一次拼接与逐段拼接的结果相同
+ * @param vm
+ * @return
+ */
+static bool testStringInterpolate(VM *vm) {
+    Value pieces[5] = {
+        OBJ_TO_VALUE(newObjString(vm, "id=", 3)),
+        OBJ_TO_VALUE(newObjString(vm, "12345", 5)),
+        OBJ_TO_VALUE(newObjString(vm, " name=", 6)),
+        OBJ_TO_VALUE(newObjString(vm, "sparrow", 7)),
+        OBJ_TO_VALUE(newObjString(vm, " done", 5))
+    };
+    ObjString *expected = newObjString(vm, "id=12345 name=sparrow done", 26);
+    CHECK(objStringEquals(expected, newObjStringFromPieces(vm, pieces, 5)), "interpolation is wrong");
+    return true;
+}
+
+/**
+ * 几类常见key按低位放入桶中，冲突数不应明显多于随机分布
+ * @param vm
+ * @return
+ */
+static bool testHashDistribution(VM *vm UNUSED) {
+    static const char *corpora[] = {"key_%u", "%u", "user.%u.name", "/usr/lib/sparrow/module_%u.sp"};
+    uint32_t n = 20000;
+    uint32_t bucketNum = ceilToPowerOf2(n * 2);
+    uint8_t *used = (uint8_t *)malloc(bucketNum);
+    char buf[64];
+
+    // 随机分布下期望占用的桶数为m(1-(1-1/m)^n)
+    double expected = n - bucketNum * (1.0 - pow(1.0 - 1.0 / bucketNum, n));
+    uint32_t corpus = 0;
+    while (corpus < sizeof(corpora) / sizeof(corpora[0])) {
+        memset(used, 0, bucketNum);
+        uint32_t collisions = 0;
+        uint32_t idx = 0;
+        while (idx < n) {
+            int len = snprintf(buf, sizeof(buf), corpora[corpus], idx);
+            uint32_t bucket = hashString(buf, len) & (bucketNum - 1);
+            collisions += used[bucket];
+            used[bucket] = 1;
+            idx ++;
+        }
+        if (collisions > expected * 1.1) {
+            free(used);
+        }
+        CHECK(collisions <= expected * 1.1, "poor distribution on \"%s\": %u collisions, %.0f expected",
+              corpora[corpus], collisions, expected);
+        corpus ++;
+    }
+    free(used);
+    return true;
+}
+
+/**
+ * 按下标取中英混排字符串的码点，与顺序解码的结果一致
+ * @param vm
+ * @return
+ */
+static bool testStringCodePointIndex(VM *vm) {
+    const char *sample = "麻雀sparrow编程语言 ";
+    uint32_t sampleLen = strlen(sample), repeat = 300;
+    char *text = (char *)malloc(sampleLen * repeat);
+    uint32_t idx = 0;
+    while (idx < repeat) {
+        memcpy(text + idx * sampleLen, sample, sampleLen);
+        idx ++;
+    }
+    ObjString *objString = newObjString(vm, text, sampleLen * repeat);
+    free(text);
+
+    uint32_t length = objString->value.length;
+    uint32_t count = objStringCodePointCount(vm, objString);
+    uint32_t pos = 0;
+    idx = 0;
+    while (pos < length) {
+        const uint8_t *bytes = (const uint8_t *)objString->value.start + pos;
+        uint32_t offset = objStringCodePointOffset(vm, objString, idx);
+        CHECK(offset == pos, "code point %u is at byte %u, expected %u", idx, offset, pos);
+        pos += getByteNumOfDecodeUtf8(*bytes);
+        idx ++;
+    }
+    CHECK(count == idx, "counted %u code points, expected %u", count, idx);
+    return true;
+}
+
+/**
+ * insertElements/removeRange与逐个插入删除结果相同，整体插入自身时源区间随之移动
+ * @param vm
+ * @return
+ */
+static bool testListSplice(VM *vm) {
+    uint32_t listNum = 200, chunkNum = 10, at = listNum / 2;
+    ObjList *objList = newObjList(vm, listNum);
+    ObjList *expected = newObjList(vm, listNum);
+    Value chunk[10];
+    uint32_t idx = 0;
+    while (idx < listNum) {
+        objList->elements.datas[idx] = expected->elements.datas[idx] = NUM_TO_VALUE(idx);
+        idx ++;
+    }
+    idx = 0;
+    while (idx < chunkNum) {
+        chunk[idx] = NUM_TO_VALUE(-1.0 - idx);
+        insertElement(vm, expected, at + idx, chunk[idx]);
+        idx ++;
+    }
+    insertElements(vm, objList, at, chunk, chunkNum);
+    CHECK(objList->elements.count == expected->elements.count, "insert count is wrong");
+    idx = 0;
+    while (idx < objList->elements.count) {
+        CHECK(valueIsEqual(objList->elements.datas[idx], expected->elements.datas[idx]),
+              "element %u differs after insert", idx);
+        idx ++;
+    }
+    removeRange(vm, objList, at, chunkNum);
+    CHECK(objList->elements.count == listNum, "remove count is wrong");
+    idx = 0;
+    while (idx < listNum) {
+        CHECK(objList->elements.datas[idx].num == idx, "element %u differs after remove", idx);
+        idx ++;
+    }
+
+    // list.insertAll(k, list)：各插入点都要得到[0,k) 0..4 [k,5)
+    uint32_t insertAt = 0;
+    while (insertAt <= 5) {
+        ObjList *self = newObjList(vm, 5);
+        idx = 0;
+        while (idx < 5) {
+            self->elements.datas[idx] = NUM_TO_VALUE(idx);
+            idx ++;
+        }
+        insertElements(vm, self, insertAt, self->elements.datas, 5);
+        idx = 0;
+        while (idx < 10) {
+            double want = idx < insertAt ? idx : (idx < insertAt + 5 ? idx - insertAt : idx - 5);
+            CHECK(self->elements.datas[idx].num == want, "self insert at %u is wrong", insertAt);
+            idx ++;
+        }
+        insertAt ++;
+    }
+    return true;
+}
+
+/**
+ * 同类型的list原生排序后有序，混合类型的list不排序也不改动
+ * @param vm
+ * @return
+ */
+static bool testListSortNatural(VM *vm) {
+    uint32_t n = 2000;
+    uint32_t kind = 0;
+    while (kind < 2) {
+        ObjList *objList = newObjList(vm, n);
+        uint32_t seed = 42;
+        uint32_t idx = 0;
+        while (idx < n) {
+            seed = seed * 1103515245 + 12345;
+            if (kind == 0) {
+                objList->elements.datas[idx] = NUM_TO_VALUE((seed >> 8) % 100);
+            }
+            else {
+                char key[24];
+                int len = snprintf(key, sizeof(key), "user-%u", seed >> 8);
+                objList->elements.datas[idx] = OBJ_TO_VALUE(newObjString(vm, key, len));
+            }
+            idx ++;
+        }
+        CHECK(sortListNatural(vm, objList), "homogeneous list was not sorted natively");
+        idx = 1;
+        while (idx < n) {
+            Value prev = objList->elements.datas[idx - 1];
+            Value cur = objList->elements.datas[idx];
+            if (kind == 0) {
+                CHECK(prev.num <= cur.num, "numbers out of order at %u", idx);
+            }
+            else {
+                ObjString *a = VALUE_TO_OBJSTR(prev), *b = VALUE_TO_OBJSTR(cur);
+                uint32_t minLength = a->value.length < b->value.length ? a->value.length : b->value.length;
+                int cmp = memcmp(a->value.start, b->value.start, minLength);
+                CHECK(cmp < 0 || (cmp == 0 && a->value.length <= b->value.length), "strings out of order at %u", idx);
+            }
+            idx ++;
+        }
+        kind ++;
+    }
+
+    ObjList *mixed = newObjList(vm, 2);
+    mixed->elements.datas[0] = NUM_TO_VALUE(2);
+    mixed->elements.datas[1] = OBJ_TO_VALUE(newObjString(vm, "1", 1));
+    CHECK(!sortListNatural(vm, mixed) && mixed->elements.datas[0].num == 2, "mixed list must fall back");
+    return true;
+}
+
+/**
+ * 数值数组的批量运算、切片共享数据及Int32Array的回绕
+ * @param vm
+ * @return
+ */
+static bool testTypedArray(VM *vm) {
+    uint32_t n = 1000;
+    ObjTypedArray *array = newObjTypedArray(vm, TA_FLOAT64, n);
+    double sum = 0, dot = 0;
+    uint32_t idx = 0;
+    while (idx < n) {
+        double value = (idx % 100) * 0.5;
+        typedArraySet(array, idx, value);
+        sum += value;
+        dot += value * value;
+        idx ++;
+    }
+    CHECK(fabs(typedArraySum(array) - sum) <= 1e-9 * sum, "sum is wrong");
+    CHECK(fabs(typedArrayDot(array, array) - dot) <= 1e-9 * dot, "dot is wrong");
+
+    ObjTypedArray *ints = newObjTypedArray(vm, TA_INT32, 8);
+    typedArrayFill(ints, 2147483647);
+    ObjTypedArray *slice = newTypedArraySlice(vm, ints, 2, 4);
+    typedArrayAdd(slice, slice);
+    CHECK(typedArrayGet(ints, 2) == -2 && typedArrayGet(ints, 1) == 2147483647, "slice does not share data");
+    CHECK(typedArrayMin(ints) == -2 && typedArraySum(slice) == -8, "int32 does not wrap");
+    return true;
+}
+
+/**
+ * range的快速路径与按方法索引派发的结果一致，iterate(_)被改写后不再走快速路径
+ * @param vm
+ * @return
+ */
+static bool testRangeIterate(VM *vm) {
+    uint32_t iterateIdx = getIndexFromSymbolTable(&vm->allMethodNames, "iterate(_)", 10);
+    uint32_t valueIdx = getIndexFromSymbolTable(&vm->allMethodNames, "iteratorValue(_)", 16);
+    ObjRange *ranges[3] = {newObjRange(vm, 0, 99, 1), newObjRange(vm, 10, 1, defaultRangeStep(10, 1)),
+                           newObjRange(vm, 0, 9, 4)};
+    double sums[3] = {4950, 55, 12};
+
+    uint32_t idx = 0;
+    while (idx < 3) {
+        Value seq = OBJ_TO_VALUE(ranges[idx]);
+        Class *class = vm->rangeClass;
+        Value iter = VT_TO_VALUE(VT_NULL), fastIter = iter;
+        double sum = 0, fastSum = 0;
+        Value args[2];
+        while (true) {
+            args[0] = seq;
+            args[1] = iter;
+            class->methods.datas[iterateIdx].primFn(vm, args);
+            iter = args[0];
+            if (VALUE_IS_FALSE(iter)) {
+                break;
+            }
+            args[0] = seq;
+            args[1] = iter;
+            class->methods.datas[valueIdx].primFn(vm, args);
+            sum += VALUE_TO_NUM(args[0]);
+        }
+        Value value;
+        while (rangeIterateFast(seq, fastIter, iterateIdx, &fastIter) && !VALUE_IS_FALSE(fastIter)) {
+            rangeIteratorValueFast(seq, fastIter, valueIdx, &value);
+            fastSum += VALUE_TO_NUM(value);
+        }
+        CHECK(sum == sums[idx] && fastSum == sums[idx], "range %u sums to %g and %g, expected %g",
+              idx, sum, fastSum, sums[idx]);
+        idx ++;
+    }
+
+    Value result;
+    vm->rangeClass->methods.datas[iterateIdx].type = MT_SCRIPT;
+    CHECK(!rangeIterateFast(OBJ_TO_VALUE(ranges[0]), VT_TO_VALUE(VT_NULL), iterateIdx, &result),
+          "fast path ignores modified iterate(_)");
+    return true;
+}
+
+/**
+ * Vector及HashMap连续保存多个版本，后来的修改不影响之前的版本
+ * @param vm
+ * @return
+ */
+static bool testPersistentSnapshots(VM *vm) {
+    uint32_t n = 2000, snapshotNum = 50;
+    ObjVector *vectors[51];
+    ObjHashMap *hashMaps[51];
+    ObjVector *objVector = vectorTransient(vm, newObjVector(vm));
+    ObjHashMap *objHashMap = hashMapTransient(vm, newObjHashMap(vm));
+    uint32_t idx = 0;
+    while (idx < n) {
+        vectorAdd(vm, objVector, NUM_TO_VALUE(idx));
+        hashMapSet(vm, objHashMap, NUM_TO_VALUE(idx), NUM_TO_VALUE(idx));
+        idx ++;
+    }
+    vectors[0] = vectorPersistent(vm, objVector);
+    hashMaps[0] = hashMapPersistent(vm, objHashMap);
+
+    // 第s个版本把下标s * 37 % n的元素改为-s
+    uint32_t snapshot = 1;
+    while (snapshot <= snapshotNum) {
+        uint32_t target = snapshot * 37 % n;
+        vectors[snapshot] = vectorSet(vm, vectors[snapshot - 1], target, NUM_TO_VALUE(-(double)snapshot));
+        hashMaps[snapshot] = hashMapSet(vm, hashMaps[snapshot - 1], NUM_TO_VALUE(target),
+                                        NUM_TO_VALUE(-(double)snapshot));
+        snapshot ++;
+    }
+
+    snapshot = 0;
+    while (snapshot <= snapshotNum) {
+        idx = 0;
+        while (idx < n) {
+            double expected = idx;
+            uint32_t s = snapshot;
+            while (s > 0) {
+                if (s * 37 % n == idx) {
+                    expected = -(double)s;
+                    break;
+                }
+                s --;
+            }
+            CHECK(vectorGet(vectors[snapshot], idx).num == expected, "vector snapshot %u was modified", snapshot);
+            CHECK(hashMapGet(vm, hashMaps[snapshot], NUM_TO_VALUE(idx)).num == expected,
+                  "hashMap snapshot %u was modified", snapshot);
+            idx ++;
+        }
+        snapshot ++;
+    }
+    return true;
+}
+
+/**
+ * 区域关闭时逃逸到区域外的对象被迁出，内容不变
+ * @param vm
+ * @return
+ */
+static bool testArenaEvacuate(VM *vm) {
+    ObjList *kept = newObjList(vm, 0);
+    char buf[64];
+    uint32_t request = 0;
+    while (request < 64) {
+        openArena(vm);
+        ObjMap *response = newObjMap(vm);
+        ObjString *summary = newObjString(vm, "", 0);
+        uint32_t field = 0;
+        while (field < 4) {
+            int len = snprintf(buf, sizeof(buf), "request-%u-field-%u-with-a-long-name", request, field);
+            ObjString *key = newObjString(vm, buf, len);
+            mapSet(vm, response, OBJ_TO_VALUE(key), NUM_TO_VALUE(field));
+            summary = newObjStringConcat(vm, summary, key);
+            field ++;
+        }
+        if (request % 4 == 0) {
+            ARENA_REMEMBER(vm, kept);
+            ValueBufferAdd(vm, &kept->elements, OBJ_TO_VALUE(summary));
+        }
+        closeArena(vm);
+        request ++;
+    }
+
+    // 第k个摘要以第4k个请求的最后一个字段名结尾
+    uint32_t idx = 0;
+    while (idx < kept->elements.count) {
+        ObjString *summary = flattenObjString(vm, VALUE_TO_OBJSTR(kept->elements.datas[idx]));
+        int len = snprintf(buf, sizeof(buf), "request-%u-field-3-with-a-long-name", idx * 4);
+        CHECK(summary->value.length >= (uint32_t)len &&
+              memcmp(summary->value.start + summary->value.length - len, buf, len) == 0,
+              "summary %u is broken", idx);
+        idx ++;
+    }
+    return true;
+}
+
+/**
+ * 闭包、upvalue、类、vector及hashMap逃逸时同样迁出，共享的节点迁出后仍共享
+ * 只有记忆集中的旧对象被扫描，打开前以暂态原地修改的节点也能修正
+ * @param vm
+ * @return
+ */
+static bool testArenaEvacuateAll(VM *vm) {
+    ObjList *kept = newObjList(vm, 0);
+    ObjModule *objModule = newObjModule(vm, "arena");
+    ObjFn *objFn = newObjFn(vm, objModule, 1);
+    objFn->upvalueNum = 1;
+    ObjVector *oldTransient = vectorTransient(vm, newObjVector(vm));
+    uint32_t idx = 0;
+    while (idx < 100) {
+        vectorAdd(vm, oldTransient, NUM_TO_VALUE(idx ++));
+    }
+
+    openArena(vm);
+    ObjString *word = newObjString(vm, "escaped-value", 13);
+    Class *class = newClass(vm, newObjString(vm, "Box", 3), 2, vm->objectClass);
+    defineModuleVar(vm, objModule, "Box", 3, OBJ_TO_VALUE(class));
+
+    ObjClosure *objClosure = newObjClosure(vm, objFn);
+    ObjUpvalue *upvalue = newObjUpvalue(vm, NULL);
+    upvalue->closedUpvalue = OBJ_TO_VALUE(word);
+    upvalue->localVarPtr = &upvalue->closedUpvalue;
+    objClosure->upvalues[0] = upvalue;
+
+    ObjVector *v1 = newObjVector(vm);
+    ObjHashMap *h1 = newObjHashMap(vm);
+    idx = 0;
+    while (idx < 100) {
+        v1 = vectorAdd(vm, v1, OBJ_TO_VALUE(word));
+        h1 = hashMapSet(vm, h1, NUM_TO_VALUE(idx), OBJ_TO_VALUE(word));
+        idx ++;
+    }
+    ObjVector *v2 = vectorSet(vm, v1, 99, NUM_TO_VALUE(-1));
+    ObjHashMap *h2 = hashMapSet(vm, h1, NUM_TO_VALUE(0), NUM_TO_VALUE(-1));
+    // 打开前的暂态向量原地修改堆上的节点
+    ARENA_REMEMBER(vm, oldTransient);
+    vectorSet(vm, oldTransient, 5, OBJ_TO_VALUE(word));
+
+    Value escaped[] = {OBJ_TO_VALUE(objClosure), OBJ_TO_VALUE(v1), OBJ_TO_VALUE(v2),
+                       OBJ_TO_VALUE(h1), OBJ_TO_VALUE(h2)};
+    ARENA_REMEMBER(vm, kept);
+    idx = 0;
+    while (idx < sizeof(escaped) / sizeof(escaped[0])) {
+        ValueBufferAdd(vm, &kept->elements, escaped[idx ++]);
+    }
+    uint32_t rememberedNum = vm->arena->remembered.count;
+    closeArena(vm);
+    CHECK(rememberedNum == 3, "%u objects remembered, expected kept, module and the transient vector",
+          rememberedNum);
+
+    Value *got = kept->elements.datas;
+    Value boxValue = objModule->moduelVarValue.datas[objModule->moduelVarValue.count - 1];
+    CHECK(VALUE_IS_CLASS(boxValue) && VALUE_TO_CLASS(boxValue)->fieldNum == 2 &&
+          objStringEquals(VALUE_TO_CLASS(boxValue)->name, newObjString(vm, "Box", 3)), "class not evacuated");
+
+    ObjString *expected = newObjString(vm, "escaped-value", 13);
+    ObjUpvalue *gotUpvalue = VALUE_TO_OBJCLOSURE(got[0])->upvalues[0];
+    CHECK(gotUpvalue->localVarPtr == &gotUpvalue->closedUpvalue &&
+          objStringEquals(VALUE_TO_OBJSTR(gotUpvalue->closedUpvalue), expected), "closed upvalue broken");
+
+    ObjVector *gotV1 = (ObjVector *)got[1].objHeader, *gotV2 = (ObjVector *)got[2].objHeader;
+    CHECK(gotV1->root == gotV2->root || gotV1->root->children[0] == gotV2->root->children[0],
+          "vector versions no longer share nodes");
+    CHECK(objStringEquals(VALUE_TO_OBJSTR(vectorGet(gotV1, 99)), expected) && vectorGet(gotV2, 99).num == -1 &&
+          objStringEquals(VALUE_TO_OBJSTR(vectorGet(gotV2, 0)), expected), "vector contents broken");
+    ObjHashMap *gotH1 = (ObjHashMap *)got[3].objHeader, *gotH2 = (ObjHashMap *)got[4].objHeader;
+    CHECK(objStringEquals(VALUE_TO_OBJSTR(hashMapGet(vm, gotH1, NUM_TO_VALUE(0))), expected) &&
+          hashMapGet(vm, gotH2, NUM_TO_VALUE(0)).num == -1 &&
+          objStringEquals(VALUE_TO_OBJSTR(hashMapGet(vm, gotH2, NUM_TO_VALUE(50))), expected), "hashMap contents broken");
+    CHECK(objStringEquals(VALUE_TO_OBJSTR(vectorGet(oldTransient, 5)), expected), "old transient node not fixed");
+    return true;
+}
+
+/**
+ * 经序列化把list与map传到另一vm
+ * @param vm
+ * @return
+ */
+static bool testMessageRoundTrip(VM *vm) {
+    VM *dst = newVM();
+    ObjMap *objMap = newObjMap(vm);
+    ObjList *objList = newObjList(vm, 64);
+    uint32_t idx = 0;
+    while (idx < 64) {
+        char key[16];
+        int len = snprintf(key, sizeof(key), "key%u", idx);
+        Value keyValue = OBJ_TO_VALUE(newObjString(vm, key, len));
+        objList->elements.datas[idx] = keyValue;
+        mapSet(vm, objMap, keyValue, NUM_TO_VALUE(idx));
+        idx ++;
+    }
+
+    // 每条消息只有一个value
+    Message *listMsg = newMessage();
+    Message *mapMsg = newMessage();
+    serializeValue(vm, OBJ_TO_VALUE(objList), listMsg);
+    serializeValue(vm, OBJ_TO_VALUE(objMap), mapMsg);
+    Value gotList = deserializeValue(dst, listMsg);
+    Value gotMap = deserializeValue(dst, mapMsg);
+    freeMessage(listMsg);
+    freeMessage(mapMsg);
+
+    bool ok = VALUE_IS_CREATIN_OBJ(gotList, OT_LIST) && VALUE_TO_OBJLIST(gotList)->elements.count == 64 &&
+              VALUE_IS_CREATIN_OBJ(gotMap, OT_MAP) && VALUE_TO_OBJMAP(gotMap)->count == 64;
+    idx = 0;
+    while (ok && idx < 64) {
+        Value key = VALUE_TO_OBJLIST(gotList)->elements.datas[idx];
+        Value value = mapGet(dst, VALUE_TO_OBJMAP(gotMap), key);
+        ok = VALUE_TO_OBJ(key)->class == dst->stringClass && !VALUE_IS_UNDEFINED(value) && value.num == idx;
+        idx ++;
+    }
+    freeVM(dst);
+    CHECK(ok, "deserialized list or map is wrong");
+    return true;
+}
+
+/**
+ * 线程池中缓存的栈的总数
+ * @param vm
+ * @return
+ */
+static uint32_t pooledStackNum(VM *vm) {
+    uint32_t num = 0;
+    uint32_t cls = 0;
+    while (cls < THREAD_POOL_CLASS_NUM) {
+        num += vm->threadPool.freeStackNum[cls ++];
+    }
+    return num;
+}
+
+/**
+ * 区域中未逃逸的channel归还mailbox的引用，未逃逸的线程把栈归还线程池，逃逸的二者迁出后仍可用
+ * @param vm
+ * @return
+ */
+static bool testArenaThreadChannel(VM *vm) {
+    ObjList *kept = newObjList(vm, 0);
+    ObjFn *objFn = newObjFn(vm, newObjModule(vm, "arena"), 1);
+    Mailbox *target = newMailbox(4);
+    uint32_t baseRef = target->refCount;
+
+    openArena(vm);
+    ObjThread *dropped = newObjThread(vm, newObjClosure(vm, objFn));
+    ObjThread *escaped = newObjThread(vm, newObjClosure(vm, objFn));
+    retainMailbox(target);
+    newObjChannel(vm, target);
+    retainMailbox(target);
+    ObjChannel *channel = newObjChannel(vm, target);
+    Value *escapedStack = escaped->stack;
+    CHECK(dropped->stack != NULL, "thread has no stack");
+    uint32_t pooled = pooledStackNum(vm);
+
+    ARENA_REMEMBER(vm, kept);
+    ValueBufferAdd(vm, &kept->elements, OBJ_TO_VALUE(escaped));
+    ValueBufferAdd(vm, &kept->elements, OBJ_TO_VALUE(channel));
+    closeArena(vm);
+
+    CHECK(target->refCount == baseRef + 1, "dropped channel kept its mailbox ref");
+    CHECK(pooledStackNum(vm) == pooled + 1, "dropped thread did not return its stack");
+    ObjThread *gotThread = VALUE_TO_OBJTHREAD(kept->elements.datas[0]);
+    ObjChannel *gotChannel = (ObjChannel *)kept->elements.datas[1].objHeader;
+    CHECK(gotThread->objHeader.type == OT_THREAD && gotThread->stack == escapedStack, "escaped thread broken");
+    CHECK(gotChannel->objHeader.type == OT_CHANNEL && gotChannel->mailbox == target, "escaped channel broken");
+    releaseMailbox(target);
+    return true;
+}
+
+/**
+ * 多个worker实例化同一镜像，子类方法的字段索引各自只按基类修正一次
+ * @param vm
+ * @return
+ */
+static bool testWorkerSubclassFields(VM *vm) {
+    CompiledImage *image = newCompiledImage("worker",
+            "class A {\n"
+            "    var a\n"
+            "    new() { a = 1 }\n"
+            "}\n"
+            "class B < A {\n"
+            "    var b\n"
+            "    new() {\n"
+            "        super()\n"
+            "        b = 2\n"
+            "    }\n"
+            "    getB { return b }\n"
+            "}\n"
+            "Worker.send(B.new().getB)\n");
+    uint32_t workerNum = 4;
+    WorkerPool *pool = newWorkerPool(image, workerNum);
+
+    bool ok = true;
+    uint32_t idx = 0;
+    while (idx < workerNum) {
+        Message *msg = workerPoolReceive(pool);
+        Value value = deserializeValue(vm, msg);
+        freeMessage(msg);
+        ok = ok && VALUE_IS_NUM(value) && VALUE_TO_NUM(value) == 2;
+        idx ++;
+    }
+    workerPoolJoin(pool);
+    freeVM(image->vm);
+    free(image);
+    CHECK(ok, "subclass field read wrong value in a worker");
+    return true;
+}
+
+/**
+ * 冻结的查找表经消息只传指针，另一vm中可直接查表
+ * @param vm
+ * @return
+ */
+static bool testSharedFrozenTable(VM *vm) {
+    VM *dst = newVM();
+    ObjMap *table = newObjMap(vm);
+    Value keys[64];
+    uint32_t idx = 0;
+    while (idx < 64) {
+        char key[16];
+        int len = snprintf(key, sizeof(key), "key%u", idx);
+        keys[idx] = OBJ_TO_VALUE(newObjString(vm, key, len));
+        mapSet(vm, table, keys[idx], NUM_TO_VALUE(idx));
+        idx ++;
+    }
+    Value frozen = freezeValue(vm, OBJ_TO_VALUE(table));
+    bool shared = frozen.type != VT_UNDEFINED && valueIsFrozen(frozen) &&
+                  copyValue(dst, frozen).objHeader == frozen.objHeader;
+
+    bool found = shared;
+    idx = 0;
+    while (found && idx < 64) {
+        Message *msg = newMessage();
+        serializeValue(vm, frozen, msg);
+        Value got = deserializeValue(dst, msg);
+        freeMessage(msg);
+        Value value = mapGet(dst, VALUE_TO_OBJMAP(got), keys[idx]);
+        found = got.objHeader == frozen.objHeader && value.type == VT_NUM && value.num == idx;
+        idx ++;
+    }
+    freeVM(dst);
+    CHECK(shared, "frozen table must be shared, not copied");
+    CHECK(found, "lookup in shared table failed");
+    return true;
+}
+
+/**
+ * 冻结时共享及循环引用只拷贝一次，失败时本次新建的对象全部释放，共享堆字节数不变
+ * @param vm
+ * @return
+ */
+static bool testFreezeRollback(VM *vm) {
+    ObjString *shared = newObjString(vm, "shared", 6);
+    ObjList *objList = newObjList(vm, 3);
+    objList->elements.datas[0] = OBJ_TO_VALUE(shared);
+    objList->elements.datas[1] = OBJ_TO_VALUE(shared);
+    objList->elements.datas[2] = OBJ_TO_VALUE(objList);
+    Value frozen = freezeValue(vm, OBJ_TO_VALUE(objList));
+    CHECK(valueIsFrozen(frozen) && frozen.type == VT_OBJ, "cyclic list not frozen");
+    Value *elements = VALUE_TO_OBJLIST(frozen)->elements.datas;
+    CHECK(elements[0].objHeader == elements[1].objHeader && valueIsFrozen(elements[0]),
+          "shared string frozen twice");
+    CHECK(elements[2].objHeader == frozen.objHeader, "cycle not preserved");
+
+    uint64_t bytes = sharedHeapBytes();
+    ObjMap *objMap = newObjMap(vm);
+    mapSet(vm, objMap, OBJ_TO_VALUE(newObjString(vm, "a", 1)), OBJ_TO_VALUE(newObjList(vm, 0)));
+    mapSet(vm, objMap, OBJ_TO_VALUE(newObjString(vm, "b", 1)), OBJ_TO_VALUE(newObjModule(vm, "test")));
+    ObjList *outer = newObjList(vm, 2);
+    outer->elements.datas[0] = OBJ_TO_VALUE(newObjString(vm, "\xe4\xbd\xa0", 3));
+    outer->elements.datas[1] = OBJ_TO_VALUE(objMap);
+    CHECK(VALUE_IS_UNDEFINED(freezeValue(vm, OBJ_TO_VALUE(outer))), "module frozen");
+    CHECK(sharedHeapBytes() == bytes, "failed freeze leaked %llu bytes",
+          (unsigned long long)(sharedHeapBytes() - bytes));
+    return true;
+}
+
+/**
+ * 在vm的核心模块中定义有两个字段的类Point
+ * @param vm
+ * @return
+ */
+static Class* definePointClass(VM *vm) {
+    Class *class = newClass(vm, newObjString(vm, "Point", 5), 2, vm->objectClass);
+    ObjModule *coreModule = VALUE_TO_OBJMODULE(mapGet(vm, vm->allModules, VT_TO_VALUE(VT_NULL)));
+    defineModuleVar(vm, coreModule, "Point", 5, OBJ_TO_VALUE(class));
+    return class;
+}
+
+/**
+ * 建立包含各类可拷贝对象的列表，列表、实例与字符串之间有循环及共享引用
+ * @param vm
+ * @param point vm中的Point类
+ * @param shared 存入被共享的字符串
+ * @return
+ */
+static ObjList* newCopyGraph(VM *vm, Class *point, ObjString **shared) {
+    *shared = newObjString(vm, "shared", 6);
+    ObjList *objList = newObjList(vm, 0);
+    ObjInstance *objInstance = newObjInstance(vm, point);
+    objInstance->fields[0] = OBJ_TO_VALUE(*shared);
+    objInstance->fields[1] = OBJ_TO_VALUE(objList); // 实例与列表互相引用
+
+    Value tupleElements[2] = {OBJ_TO_VALUE(*shared), NUM_TO_VALUE(7)};
+    ObjTuple *objTuple = newObjTuple(vm, tupleElements, 2);
+    ObjSet *objSet = newObjSet(vm);
+    setAdd(vm, objSet, OBJ_TO_VALUE(*shared));
+    ObjTypedArray *array = newObjTypedArray(vm, TA_INT32, 8);
+    ((int32_t *)array->data)[5] = 55;
+    ObjTypedArray *slice = newTypedArraySlice(vm, array, 4, 2);
+    ObjVector *objVector = vectorAdd(vm, newObjVector(vm), OBJ_TO_VALUE(*shared));
+    ObjHashMap *objHashMap = hashMapSet(vm, newObjHashMap(vm), OBJ_TO_VALUE(*shared), NUM_TO_VALUE(1));
+    ObjStringBuilder *builder = newObjStringBuilder(vm);
+    ByteBufferFillWrite(vm, &builder->buffer, 'x', 3);
+
+    Value members[] = {OBJ_TO_VALUE(objList), OBJ_TO_VALUE(objInstance), OBJ_TO_VALUE(objTuple),
+                       OBJ_TO_VALUE(objSet), OBJ_TO_VALUE(array), OBJ_TO_VALUE(slice),
+                       OBJ_TO_VALUE(objVector), OBJ_TO_VALUE(objHashMap), OBJ_TO_VALUE(builder)};
+    uint32_t idx = 0;
+    while (idx < sizeof(members) / sizeof(members[0])) {
+        insertElement(vm, objList, objList->elements.count, members[idx ++]);
+    }
+    return objList;
+}
+
+/**
+ * 检查dst中由newCopyGraph所建列表得到的副本
+ * @param dst
+ * @param copy
+ * @param dstPoint dst中的Point类
+ * @param shared 源vm中被共享的字符串
+ * @return
+ */
+static bool checkCopyGraph(VM *dst, Value copy, Class *dstPoint, ObjString *shared) {
+    bool ok = VALUE_IS_CREATIN_OBJ(copy, OT_LIST) && VALUE_TO_OBJ(copy)->class == dst->listClass;
+    Value *got = ok ? VALUE_TO_OBJLIST(copy)->elements.datas : NULL;
+    ok = ok && got[0].objHeader == copy.objHeader;
+    ObjInstance *gotPoint = ok ? VALUE_TO_OBJINSTANCE(got[1]) : NULL;
+    ok = ok && gotPoint->objHeader.class == dstPoint && gotPoint->fields[1].objHeader == copy.objHeader;
+    Value gotShared = ok ? gotPoint->fields[0] : VT_TO_VALUE(VT_NULL);
+    ok = ok && gotShared.objHeader != OBJ_TO_VALUE(shared).objHeader &&
+         VALUE_TO_OBJ(gotShared)->class == dst->stringClass;
+    CHECK(ok, "list cycle, instance or shared string not preserved");
+
+    ObjTuple *gotTuple = (ObjTuple *)got[2].objHeader;
+    ObjTypedArray *gotArray = (ObjTypedArray *)got[4].objHeader;
+    ObjTypedArray *gotSlice = (ObjTypedArray *)got[5].objHeader;
+    ObjVector *gotVector = (ObjVector *)got[6].objHeader;
+    ObjHashMap *gotHashMap = (ObjHashMap *)got[7].objHeader;
+    ObjStringBuilder *gotBuilder = (ObjStringBuilder *)got[8].objHeader;
+    CHECK(gotTuple->elements[0].objHeader == gotShared.objHeader && gotTuple->elements[1].num == 7,
+          "tuple not copied");
+    CHECK(setContains(dst, (ObjSet *)got[3].objHeader, gotShared), "set not copied");
+    CHECK(((int32_t *)gotArray->data)[5] == 55, "typed array not copied");
+    CHECK(gotSlice->base == gotArray && ((int32_t *)gotSlice->data)[1] == 55, "slice must share the copied base");
+    CHECK(vectorGet(gotVector, 0).objHeader == gotShared.objHeader, "vector not copied");
+    CHECK(hashMapGet(dst, gotHashMap, gotShared).num == 1, "hash map not copied");
+    CHECK(gotBuilder->buffer.count == 3 && gotBuilder->buffer.datas[2] == 'x', "string builder not copied");
+    return true;
+}
+
+/**
+ * 深拷贝各类对象：循环及共享引用在副本中保持，不可拷贝的对象返回undefined
+ * @param vm
+ * @return
+ */
+static bool testCopyValue(VM *vm) {
+    VM *dst = newVM();
+    Class *srcPoint = definePointClass(vm);
+    Class *dstPoint = definePointClass(dst);
+    ObjString *shared;
+    ObjList *objList = newCopyGraph(vm, srcPoint, &shared);
+    if (!checkCopyGraph(dst, copyValue(dst, OBJ_TO_VALUE(objList)), dstPoint, shared)) {
+        return false;
+    }
+
+    // 拼接串读出字符拷贝，源串保持未展开
+    ObjString *rope = newObjString(vm, "", 0);
+    uint32_t idx = 0;
+    while (idx < 100) {
+        rope = newObjStringConcat(vm, rope, shared);
+        idx ++;
+    }
+    Value gotRope = copyValue(dst, OBJ_TO_VALUE(rope));
+    CHECK(VALUE_TO_OBJ(gotRope)->class == dst->stringClass && !OBJSTRING_IS_ROPE(VALUE_TO_OBJSTR(gotRope)) &&
+          objStringEquals(VALUE_TO_OBJSTR(gotRope), rope), "rope not copied");
+    CHECK(OBJSTRING_IS_ROPE(rope) && rope->right != NULL, "copy flattened the source rope");
+
+    // 函数引用源vm的模块，无法拷贝
+    ObjModule *coreModule = VALUE_TO_OBJMODULE(mapGet(vm, vm->allModules, VT_TO_VALUE(VT_NULL)));
+    insertElement(vm, objList, objList->elements.count, OBJ_TO_VALUE(newObjFn(vm, coreModule, 0)));
+    bool rejected = VALUE_IS_UNDEFINED(copyValue(dst, OBJ_TO_VALUE(objList)));
+    freeVM(dst);
+    CHECK(rejected, "function copied to another vm");
+    return true;
+}
+
+/**
+ * 序列化支持的类型与copyValue相同，循环及共享引用在接收方保持
+ * @param vm
+ * @return
+ */
+static bool testMessageGraph(VM *vm) {
+    VM *dst = newVM();
+    Class *srcPoint = definePointClass(vm);
+    Class *dstPoint = definePointClass(dst);
+    ObjString *shared;
+    ObjList *objList = newCopyGraph(vm, srcPoint, &shared);
+    Message *msg = newMessage();
+    bool serialized = serializeValue(vm, OBJ_TO_VALUE(objList), msg);
+    bool ok = serialized && checkCopyGraph(dst, deserializeValue(dst, msg), dstPoint, shared);
+    freeMessage(msg);
+    freeVM(dst);
+    CHECK(serialized, "graph not serialized");
+    return ok;
+}
+
+typedef struct {
+    Mailbox *mailbox;
+    uint32_t num;
+    VM *vm;
+} ChannelProducer;
+
+/**
+ * 生产者线程：以16个为一批发送num个数字
+ * @param arg
+ * @return
+ */
+static void* channelProducerMain(void *arg) {
+    ChannelProducer *producer = (ChannelProducer *)arg;
+    Value batch[16];
+    uint32_t sent = 0;
+    while (sent < producer->num) {
+        uint32_t num = producer->num - sent < 16 ? producer->num - sent : 16;
+        uint32_t idx = 0;
+        while (idx < num) {
+            batch[idx] = NUM_TO_VALUE(sent + idx);
+            idx ++;
+        }
+        bool unsupported;
+        uint32_t batchSent = mailboxSend(producer->vm, producer->mailbox, batch, num, &unsupported);
+        if (batchSent == 0) {
+            sched_yield();
+        }
+        sent += batchSent;
+    }
+    return NULL;
+}
+
+/**
+ * 多个os线程向同一邮箱发送，单个消费者收到的数字之和与发送的一致
+ * @param vm
+ * @return
+ */
+static bool testMailboxMpsc(VM *vm) {
+    uint32_t producerNum = 4, perProducer = 10000;
+    Mailbox *mailbox = newMailbox(256);
+    pthread_t tids[4];
+    ChannelProducer producers[4];
+    uint32_t idx = 0;
+    while (idx < producerNum) {
+        // 只发送数字，不会用到生产者vm的分配器
+        producers[idx].mailbox = mailbox;
+        producers[idx].num = perProducer;
+        producers[idx].vm = vm;
+        pthread_create(&tids[idx], NULL, channelProducerMain, &producers[idx]);
+        idx ++;
+    }
+
+    uint64_t total = (uint64_t)producerNum * perProducer, received = 0;
+    double sum = 0;
+    Value batch[64];
+    while (received < total) {
+        uint32_t num = mailboxReceive(vm, mailbox, batch, 64);
+        if (num == 0 && mailboxPrepareWait(mailbox)) {
+            struct pollfd pfd = {mailbox->eventFd, POLLIN, 0};
+            poll(&pfd, 1, -1);
+            mailboxDrainEvent(mailbox);
+        }
+        uint32_t i = 0;
+        while (i < num) {
+            sum += batch[i ++].num;
+        }
+        received += num;
+    }
+    idx = 0;
+    while (idx < producerNum) {
+        pthread_join(tids[idx ++], NULL);
+    }
+    releaseMailbox(mailbox);
+    CHECK(sum == (double)producerNum * perProducer * (perProducer - 1) / 2, "sum mismatch");
+    return true;
+}
+
+typedef struct {
+    Mailbox *mailbox;
+    uint64_t *remaining; // 尚未被任何消费者取走的个数
+    double sum;
+} ChannelConsumer;
+
+/**
+ * 消费者线程：与其它消费者竞争取值，直到全部取完
+ * @param arg
+ * @return
+ */
+static void* channelConsumerMain(void *arg) {
+    ChannelConsumer *consumer = (ChannelConsumer *)arg;
+    Value batch[16];
+    while (__atomic_load_n(consumer->remaining, __ATOMIC_ACQUIRE) > 0) {
+        // 只收数字，不会用到vm
+        uint32_t num = mailboxReceive(NULL, consumer->mailbox, batch, 16);
+        if (num == 0) {
+            sched_yield();
+            continue;
+        }
+        uint32_t idx = 0;
+        while (idx < num) {
+            consumer->sum += batch[idx ++].num;
+        }
+        __atomic_sub_fetch(consumer->remaining, num, __ATOMIC_ACQ_REL);
+    }
+    return NULL;
+}
+
+/**
+ * 多个os线程同时收发同一邮箱，每个值恰好被取走一次
+ * @param vm
+ * @return
+ */
+static bool testMailboxMpmc(VM *vm) {
+    uint32_t perProducer = 10000;
+    Mailbox *mailbox = newMailbox(8);
+    uint64_t remaining = 4 * perProducer;
+    pthread_t producerTids[4], consumerTids[4];
+    ChannelProducer producers[4];
+    ChannelConsumer consumers[4];
+    uint32_t idx = 0;
+    while (idx < 4) {
+        producers[idx] = (ChannelProducer){mailbox, perProducer, vm};
+        consumers[idx] = (ChannelConsumer){mailbox, &remaining, 0};
+        pthread_create(&producerTids[idx], NULL, channelProducerMain, &producers[idx]);
+        pthread_create(&consumerTids[idx], NULL, channelConsumerMain, &consumers[idx]);
+        idx ++;
+    }
+    double sum = 0;
+    idx = 0;
+    while (idx < 4) {
+        pthread_join(producerTids[idx], NULL);
+        pthread_join(consumerTids[idx], NULL);
+        sum += consumers[idx ++].sum;
+    }
+    uint32_t left = mailboxCount(mailbox);
+    releaseMailbox(mailbox);
+    CHECK(left == 0, "%u values left in mailbox", left);
+    CHECK(sum == 4.0 * perProducer * (perProducer - 1) / 2, "sum mismatch");
+    return true;
+}
+
+/**
+ * 消息中的channel持有邮箱引用：放不下被丢弃、随邮箱释放或被接收后，引用数都应回到原值
+ * @param vm
+ * @return
+ */
+static bool testChannelRefRelease(VM *vm) {
+    Mailbox *target = newMailbox(4);
+    Value channel = OBJ_TO_VALUE(newObjChannel(vm, target));
+    retainMailbox(target); // channel对象已接管初始引用，此处另持一个供检查
+    // 同一个channel对象在消息中只序列化一次，另建一个共享邮箱的channel
+    retainMailbox(target);
+    Value other = OBJ_TO_VALUE(newObjChannel(vm, target));
+    uint32_t baseRef = target->refCount;
+
+    Mailbox *carrier = newMailbox(1);
+    ObjList *objList = newObjList(vm, 2);
+    objList->elements.datas[0] = channel;
+    objList->elements.datas[1] = other;
+    Value listValue = OBJ_TO_VALUE(objList);
+    bool unsupported;
+    CHECK(mailboxSend(vm, carrier, &listValue, 1, &unsupported) == 1, "send failed");
+    CHECK(target->refCount == baseRef + 2, "message must hold two refs");
+    // carrier已满，第二条被丢弃
+    CHECK(mailboxSend(vm, carrier, &channel, 1, &unsupported) == 0, "full mailbox accepted a value");
+    CHECK(target->refCount == baseRef + 2, "dropped message leaked a ref");
+
+    Value got;
+    CHECK(mailboxReceive(vm, carrier, &got, 1) == 1, "receive failed");
+    CHECK(target->refCount == baseRef + 2, "received channels must hold one ref each");
+    CHECK(mailboxSend(vm, carrier, &channel, 1, &unsupported) == 1, "send failed");
+    releaseMailbox(carrier);
+    CHECK(target->refCount == baseRef + 2, "undelivered message leaked a ref on release");
+
+    // 序列化中途失败的消息也归还已持有的引用
+    objList->elements.datas[1] = OBJ_TO_VALUE(newObjFn(vm, newObjModule(vm, "test"), 0));
+    Message *msg = newMessage();
+    CHECK(!serializeValue(vm, listValue, msg), "function serialized");
+    freeMessage(msg);
+    CHECK(target->refCount == baseRef + 2, "failed message leaked a ref");
+    releaseMailbox(target);
+    return true;
+}
+
+/**
+ * call自身或成环的调用链是脚本中的运行时错误，不会使进程退出
+ * @param vm
+ * @return
+ */
+static bool testThreadCallCycle(VM *vm) {
+    const char *sources[] = {
+        "Thread.current.call()\n",
+        "var b\n"
+        "var a = Thread.new(Fn.new { b.call() })\n"
+        "b = Thread.new(Fn.new { a.call() })\n"
+        "a.call()\n",
+    };
+    uint32_t idx = 0;
+    while (idx < sizeof(sources) / sizeof(sources[0])) {
+        char name[16];
+        int len = snprintf(name, sizeof(name), "cycle%u", idx);
+        VMResult result = executeModule(vm, OBJ_TO_VALUE(newObjString(vm, name, len)), sources[idx]);
+        CHECK(result == VM_RESULT_ERROR, "script %u should fail with a runtime error", idx);
+        idx ++;
+    }
+    return true;
+}
+
+/**
+ * 新建一个可挂起在io上的线程，esp[-1]为存放结果的slot
+ * @param vm
+ * @return
+ */
+static ObjThread* newIoThread(VM *vm) {
+    ObjModule *objModule = newObjModule(vm, "test");
+    ObjThread *objThread = newObjThread(vm, newObjClosure(vm, newObjFn(vm, objModule, 16)));
+    objThread->esp ++;
+    return objThread;
+}
+
+/**
+ * 建立一对相连的非阻塞fd：kind为0时是管道，1时是unix socket对，2时是回环tcp连接
+ * @param kind
+ * @param fds fds[0]为读端，fds[1]为写端
+ * @return
+ */
+static bool openFdPair(uint32_t kind, int fds[2]) {
+    if (kind == 0) {
+        if (pipe(fds) == -1) {
+            return false;
+        }
+    }
+    else if (kind == 1) {
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+            return false;
+        }
+    }
+    else {
+        struct sockaddr_in addr;
+        socklen_t len = sizeof(addr);
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        if (listenFd == -1 || bind(listenFd, (struct sockaddr *)&addr, len) == -1 ||
+            listen(listenFd, 1) == -1 || getsockname(listenFd, (struct sockaddr *)&addr, &len) == -1) {
+            return false;
+        }
+        fds[1] = socket(AF_INET, SOCK_STREAM, 0);
+        if (fds[1] == -1 || connect(fds[1], (struct sockaddr *)&addr, len) == -1) {
+            return false;
+        }
+        fds[0] = accept(listenFd, NULL, NULL);
+        close(listenFd);
+        if (fds[0] == -1) {
+            return false;
+        }
+    }
+    setNonBlocking(fds[0]);
+    setNonBlocking(fds[1]);
+    return true;
+}
+
+/**
+ * 管道、unix socket对及回环tcp连接上，挂起在读端的线程在写入后被唤醒并取得所写的数据
+ * @param vm
+ * @return
+ */
+static bool testIoRoundTrip(VM *vm) {
+    static const char *kinds[] = {"pipe", "socketpair", "loopback"};
+    ObjThread *objThread = newIoThread(vm);
+    ObjString *msg = newObjString(vm, "ping from sparrow", 17);
+
+    uint32_t kind = 0;
+    while (kind < 3) {
+        int fds[2];
+        CHECK(openFdPair(kind, fds), "%s: open failed", kinds[kind]);
+
+        Value result;
+        CHECK(ioTryRead(vm, fds[0], 64, &result) == IO_AGAIN, "%s: empty fd must not be readable", kinds[kind]);
+        IoOp op = {IO_OP_READ, objThread, 64, NULL, 0, NULL, NULL};
+        CHECK(ioWait(vm, fds[0], op), "%s: ioWait failed", kinds[kind]);
+        CHECK(!ioWait(vm, fds[0], op), "%s: second reader on one fd accepted", kinds[kind]);
+        CHECK(objThread->isParked && !runEventLoopOnce(vm, false), "%s: woken before write", kinds[kind]);
+
+        uint32_t written = 0;
+        CHECK(ioTryWrite(vm, fds[1], msg, &written, &result) == IO_DONE && result.num == 17,
+              "%s: write failed", kinds[kind]);
+        CHECK(nextRunnableThread(vm) == objThread && !objThread->isParked, "%s: thread not woken", kinds[kind]);
+        ObjString *got = VALUE_TO_OBJSTR(objThread->esp[-1]);
+        CHECK(got->value.length == 17 && memcmp(got->value.start, msg->value.start, 17) == 0,
+              "%s: data mismatch", kinds[kind]);
+        CHECK(vm->eventLoop.pendingNum == 0, "%s: op still pending", kinds[kind]);
+
+        close(fds[0]);
+        close(fds[1]);
+        kind ++;
+    }
+    return true;
+}
+
+/**
+ * 写满管道后写线程挂起，读端逐步取走数据时由事件循环续写，写完才唤醒
+ * @param vm
+ * @return
+ */
+static bool testIoEagainParking(VM *vm) {
+    int fds[2];
+    CHECK(openFdPair(0, fds), "pipe failed");
+    // 远大于管道缓冲区，一次写不完
+    uint32_t length = 1024 * 1024;
+    char *payload = (char *)malloc(length);
+    uint32_t idx = 0;
+    while (idx < length) {
+        payload[idx] = (char)(idx % 251);
+        idx ++;
+    }
+    ObjString *data = newObjString(vm, payload, length);
+
+    ObjThread *writer = newIoThread(vm);
+    uint32_t written = 0;
+    Value result;
+    CHECK(ioTryWrite(vm, fds[1], data, &written, &result) == IO_AGAIN && written < length,
+          "full pipe must return IO_AGAIN");
+    IoOp op = {IO_OP_WRITE, writer, 0, data, written, NULL, NULL};
+    CHECK(ioWait(vm, fds[1], op), "ioWait failed");
+
+    char *received = (char *)malloc(length);
+    uint32_t receivedNum = 0;
+    while (!writer->isReady) {
+        ssize_t n = read(fds[0], received + receivedNum, length - receivedNum);
+        if (n > 0) {
+            receivedNum += (uint32_t)n;
+        }
+        runEventLoopOnce(vm, false);
+    }
+    while (receivedNum < length) {
+        ssize_t n = read(fds[0], received + receivedNum, length - receivedNum);
+        CHECK(n > 0, "data lost after writer finished");
+        receivedNum += (uint32_t)n;
+    }
+    CHECK(nextRunnableThread(vm) == writer && writer->esp[-1].num == length, "writer result wrong");
+    CHECK(memcmp(received, payload, length) == 0, "data corrupted across partial writes");
+
+    free(payload);
+    free(received);
+    close(fds[0]);
+    close(fds[1]);
+    return true;
+}
+
+/**
+ * 定时器按到期先后唤醒线程，与加入顺序无关
+ * @param vm
+ * @return
+ */
+static bool testIoTimerOrder(VM *vm) {
+    static const uint32_t delays[] = {30, 10, 0, 20};
+    ObjThread *threads[4];
+    uint64_t start = getNowNs();
+    uint32_t idx = 0;
+    while (idx < 4) {
+        threads[idx] = newIoThread(vm);
+        ioSleep(vm, threads[idx], (uint64_t)delays[idx] * 1000000);
+        idx ++;
+    }
+
+    static const uint32_t expected[] = {2, 1, 3, 0};
+    idx = 0;
+    while (idx < 4) {
+        ObjThread *woken = nextRunnableThread(vm);
+        CHECK(woken == threads[expected[idx]], "timer %u woke out of order", idx);
+        CHECK(getNowNs() - start >= (uint64_t)delays[expected[idx]] * 1000000, "timer %u woke early", idx);
+        idx ++;
+    }
+    CHECK(nextRunnableThread(vm) == NULL, "no thread should remain");
+    return true;
+}
+
+/**
+ * 关闭fd前ioCancel以错误唤醒挂起在其上的读写线程，之后fd可重新挂起
+ * @param vm
+ * @return
+ */
+static bool testIoCancel(VM *vm) {
+    int fds[2];
+    CHECK(openFdPair(1, fds), "socketpair failed");
+    ObjThread *reader = newIoThread(vm);
+    IoOp op = {IO_OP_READ, reader, 64, NULL, 0, NULL, NULL};
+    CHECK(ioWait(vm, fds[0], op), "ioWait failed");
+
+    ioCancel(vm, fds[0]);
+    CHECK(reader->isReady && !reader->isParked, "reader not woken by ioCancel");
+    CHECK(VALUE_IS_CREATIN_OBJ(reader->errorObj, OT_STRING), "reader must be woken with an error");
+    CHECK(vm->eventLoop.pendingNum == 0, "cancelled op still pending");
+    CHECK(nextRunnableThread(vm) == reader, "reader not runnable");
+
+    // 取消后同一fd可再次挂起
+    reader->errorObj = VT_TO_VALUE(VT_NULL);
+    CHECK(ioWait(vm, fds[0], op), "fd slot not released by ioCancel");
+    ioCancel(vm, fds[0]);
+    // 没有挂起操作的fd及超出范围的fd被忽略
+    ioCancel(vm, fds[1]);
+    ioCancel(vm, 100000);
+    close(fds[0]);
+    close(fds[1]);
+    return true;
+}
+
+/**
+ * 调用线程类的原生方法，如call()、schedule()
+ * @param vm
+ * @param objThread 接收者
+ * @param signature
+ * @return 原生方法的返回值
+ */
+static bool callThreadPrim(VM *vm, ObjThread *objThread, const char *signature) {
+    int index = getIndexFromSymbolTable(&vm->allMethodNames, signature, strlen(signature));
+    Value args[1] = {OBJ_TO_VALUE(objThread)};
+    return vm->threadClass->methods.datas[index].primFn(vm, args);
+}
+
+/**
+ * 就绪队列按入队顺序出队，队首、队中及队尾的线程都可直接移出；
+ * 挂起在定时器上的线程不能被call或schedule
+ * @param vm
+ * @return
+ */
+static bool testThreadReadyQueue(VM *vm) {
+    ObjModule *objModule = newObjModule(vm, "test");
+    ObjClosure *objClosure = newObjClosure(vm, newObjFn(vm, objModule, 16));
+    ObjThread *threads[5];
+    uint32_t idx = 0;
+    while (idx < 5) {
+        threads[idx] = newObjThread(vm, objClosure);
+        scheduleThread(vm, threads[idx]);
+        idx ++;
+    }
+    // 重复入队被忽略
+    scheduleThread(vm, threads[2]);
+
+    unscheduleThread(vm, threads[0]);
+    unscheduleThread(vm, threads[2]);
+    unscheduleThread(vm, threads[4]);
+    CHECK(!threads[2]->isReady && threads[2]->nextReady == NULL && threads[2]->prevReady == NULL,
+          "removed thread still linked");
+    CHECK(nextReadyThread(vm) == threads[1], "expected thread 1 first");
+    scheduleThread(vm, threads[4]);
+    CHECK(nextReadyThread(vm) == threads[3], "expected thread 3 second");
+    CHECK(nextReadyThread(vm) == threads[4], "expected re-queued thread 4 last");
+    CHECK(nextReadyThread(vm) == NULL && vm->readyHead == NULL && vm->readyTail == NULL, "queue not empty");
+
+    vm->curThread = threads[0];
+    ioSleep(vm, threads[1], 1000000000);
+    CHECK(threads[1]->isParked, "sleeping thread not parked");
+    CHECK(!callThreadPrim(vm, threads[1], "call()") && !VALUE_IS_NULL(threads[0]->errorObj),
+          "switched to a thread parked on a timer");
+    CHECK(vm->curThread == threads[0], "current thread changed");
+    threads[0]->errorObj = VT_TO_VALUE(VT_NULL);
+    CHECK(!callThreadPrim(vm, threads[1], "schedule()") && !threads[1]->isReady,
+          "scheduled a thread parked on a timer");
+    return true;
+}
+
+static const TestCase testCases[] = {
+    {"map_pooled_keys", testMapPooledKeys},
+    {"map_insertion_order", testMapInsertionOrder},
+    {"map_reserve", testMapReserve},
+    {"map_remove_iterate", testMapRemoveIterate},
+    {"map_tuple_keys", testMapTupleKeys},
+    {"set_operations", testSetOperations},
+    {"string_concat", testStringConcat},
+    {"string_interpolate", testStringInterpolate},
+    {"string_hash_distribution", testHashDistribution},
+    {"string_code_point_index", testStringCodePointIndex},
+    {"list_splice", testListSplice},
+    {"list_sort_natural", testListSortNatural},
+    {"typed_array", testTypedArray},
+    {"range_iterate", testRangeIterate},
+    {"persistent_snapshots", testPersistentSnapshots},
+    {"arena_evacuate", testArenaEvacuate},
+    {"arena_evacuate_all", testArenaEvacuateAll},
+    {"arena_thread_channel", testArenaThreadChannel},
+    {"message_round_trip", testMessageRoundTrip},
+    {"worker_subclass_fields", testWorkerSubclassFields},
+    {"shared_frozen_table", testSharedFrozenTable},
+    {"freeze_rollback", testFreezeRollback},
+    {"copy_value", testCopyValue},
+    {"message_graph", testMessageGraph},
+    {"mailbox_mpsc", testMailboxMpsc},
+    {"mailbox_mpmc", testMailboxMpmc},
+    {"channel_ref_release", testChannelRefRelease},
+    {"thread_ready_queue", testThreadReadyQueue},
+    {"thread_call_cycle", testThreadCallCycle},
+    {"io_round_trip", testIoRoundTrip},
+    {"io_eagain_parking", testIoEagainParking},
+    {"io_timer_order", testIoTimerOrder},
+    {"io_cancel", testIoCancel},
+};
+
+int main(int argc, const char **argv) {
+    uint32_t caseNum = sizeof(testCases) / sizeof(testCases[0]);
+    uint32_t ran = 0, failed = 0;
+    uint32_t idx = 0;
+    while (idx < caseNum) {
+        const TestCase *testCase = &testCases[idx ++];
+        if (argc > 1 && strcmp(argv[1], testCase->name) != 0) {
+            continue;
+        }
+        VM *vm = newVM();
+        bool ok = testCase->fn(vm);
+        freeVM(vm);
+        printf("%s %s\n", ok ? "PASS" : "FAIL", testCase->name);
+        ran ++;
+        failed += !ok;
+    }
+    if (ran == 0) {
+        fprintf(stderr, "no test case named \"%s\"\n", argc > 1 ? argv[1] : "");
+        return 1;
+    }
+    return failed == 0 ? 0 : 1;
+}
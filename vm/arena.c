@@ -0,0 +1,813 @@
+//
+// Created by ZiXuan on 2022/7/31.
+//
+
+#include "arena.h"
+#include "vm.h"
+#include "../object/class.h"
+#include "../object/obj_list.h"
+#include "../object/obj_map.h"
+#include "../object/obj_string_builder.h"
+#include "../object/obj_typed_array.h"
+#include "../object/obj_set.h"
+#include "../object/obj_tuple.h"
+#include "../object/obj_vector.h"
+#include "../object/obj_hash_map.h"
+#include "../object/obj_thread.h"
+#include "../object/obj_channel.h"
+
+#include <string.h>
+
+// 关闭区域时对象头isDark的取值：可从区域外到达，及已迁出、next指向堆上的副本
+#define ARENA_MARKED 2
+#define ARENA_FORWARDED 3
+
+typedef enum {
+    TRACE_MARK, // 找出从区域外可到达的区域对象，检查能否迁出
+    TRACE_EVACUATE // 把它们拷贝到堆上并修正引用
+} TraceMode;
+
+typedef struct {
+    VM *vm;
+    Arena *arena;
+    TraceMode mode;
+    uint32_t escapeNum; // 从区域外可到达的区域对象及缓冲区个数，为0时无须迁出
+    ValueBuffer work; // 待扫描的对象
+    ObjMemo nodes; // 已处理的vector及hashMap节点，标记时映射到自身，迁出时映射到堆上的副本
+} Tracer;  // 关闭区域时扫描引用关系
+
+/**
+ * 新建可容纳size字节的区域块
+ * @param vm
+ * @param size
+ * @return
+ */
+static ArenaChunk* newArenaChunk(VM *vm, uint32_t size) {
+    vm->allocatedNum ++;
+    ArenaChunk *chunk = (ArenaChunk *)malloc(sizeof(ArenaChunk) + size);
+    if (chunk == NULL) {
+        MEM_ERROR("allocate arena chunk failed!");
+    }
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
+
+/**
+ * 在chunks中找出ptr所在的区域块
+ * @param chunks
+ * @param ptr
+ * @return 不在其中时返回NULL
+ */
+static ArenaChunk* findChunk(ArenaChunk *chunks, const void *ptr) {
+    while (chunks != NULL) {
+        const char *start = (const char *)chunks->data;
+        if ((const char *)ptr >= start && (const char *)ptr < start + chunks->size) {
+            return chunks;
+        }
+        chunks = chunks->next;
+    }
+    return NULL;
+}
+
+/**
+ * ptr是否在区域中
+ * @param arena
+ * @param ptr
+ * @return
+ */
+static bool inArena(Arena *arena, const void *ptr) {
+    if ((const char *)ptr < arena->low || (const char *)ptr >= arena->high) {
+        return false;
+    }
+    return findChunk(arena->chunks, ptr) != NULL;
+}
+
+/**
+ * 区域中块的大小，即分配时请求的字节数
+ * @param block
+ * @return
+ */
+static uint32_t blockSize(const void *block) {
+    return (uint32_t)((const uint64_t *)block)[-1];
+}
+
+/**
+ * 块头及按8字节对齐后的块共占用的字节数
+ * @param size
+ * @return
+ */
+static uint64_t blockSpan(uint32_t size) {
+    return (((uint64_t)size + 7) & ~(uint64_t)7) + ARENA_BLOCK_HEADER;
+}
+
+/**
+ * 把区域块加入区域，asCurrent为真时作为之后顺序分配的块
+ * @param arena
+ * @param chunk
+ * @param asCurrent
+ */
+static void addChunk(Arena *arena, ArenaChunk *chunk, bool asCurrent) {
+    if (asCurrent || arena->chunks == NULL) {
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+    }
+    else {
+        chunk->next = arena->chunks->next;
+        arena->chunks->next = chunk;
+    }
+    char *start = (char *)chunk->data;
+    if (arena->low == NULL || start < arena->low) {
+        arena->low = start;
+    }
+    if (start + chunk->size > arena->high) {
+        arena->high = start + chunk->size;
+    }
+}
+
+/**
+ * 在区域中分配size字节
+ * @param vm
+ * @param arena
+ * @param size
+ * @return
+ */
+static void* arenaAlloc(VM *vm, Arena *arena, uint32_t size) {
+    uint64_t span = blockSpan(size);
+    if (span > UINT32_MAX) {
+        MEM_ERROR("arena block is too large!");
+    }
+    ArenaChunk *chunk = arena->chunks;
+    if (span > ARENA_LARGE_BLOCK_SIZE) {
+        chunk = newArenaChunk(vm, (uint32_t)span);
+        addChunk(arena, chunk, false);
+    }
+    else if (chunk == NULL || chunk->size - chunk->used < span) {
+        chunk = newArenaChunk(vm, arena->nextChunkSize);
+        if (arena->nextChunkSize < ARENA_MAX_CHUNK_SIZE) {
+            arena->nextChunkSize *= 2;
+        }
+        addChunk(arena, chunk, true);
+    }
+
+    uint64_t *header = (uint64_t *)((char *)chunk->data + chunk->used);
+    *header = size;
+    chunk->used += (uint32_t)span;
+    void *block = header + 1;
+    if (chunk == arena->chunks) {
+        arena->lastBlock = block;
+    }
+    return block;
+}
+
+/**
+ * 最后分配的块在当前块中原地伸缩
+ * @param arena
+ * @param block
+ * @param newSize
+ * @return 空间不足或不是最后分配的块时返回false
+ */
+static bool arenaResizeInPlace(Arena *arena, void *block, uint32_t newSize) {
+    if (block != arena->lastBlock) {
+        return false;
+    }
+    ArenaChunk *chunk = arena->chunks;
+    uint64_t end = (uint64_t)((char *)block - (char *)chunk->data) - ARENA_BLOCK_HEADER + blockSpan(newSize);
+    if (end > chunk->size) {
+        return false;
+    }
+    chunk->used = (uint32_t)end;
+    ((uint64_t *)block)[-1] = newSize;
+    return true;
+}
+
+/**
+ * 释放区域中的块，只有最后分配的块能回退，其余的随区域一并释放
+ * @param arena
+ * @param block
+ */
+static void arenaFree(Arena *arena, void *block) {
+    if (block != arena->lastBlock) {
+        return;
+    }
+    ArenaChunk *chunk = arena->chunks;
+    chunk->used = (uint32_t)((char *)block - (char *)chunk->data) - ARENA_BLOCK_HEADER;
+    arena->lastBlock = NULL;
+}
+
+/**
+ * 打开区域时memManager的分配、伸缩及释放
+ * 打开前分配的缓冲区仍在堆上伸缩，新的分配在区域中顺序分配
+ * 区域中的块伸缩时拷贝到新块，最后分配的块可原地伸缩
+ * @param vm
+ * @param ptr
+ * @param newSize 为0时释放
+ * @return
+ */
+void* arenaMemManager(VM *vm, void *ptr, uint32_t newSize) {
+    Arena *arena = vm->arena;
+    bool bumping = arena->pauseDepth == 0;
+    bool inCurrent = ptr != NULL && inArena(arena, ptr);
+
+    if (!inCurrent) {
+        if (newSize == 0) {
+            free(ptr);
+            return NULL;
+        }
+        if (ptr == NULL && bumping) {
+            return arenaAlloc(vm, arena, newSize);
+        }
+        vm->allocatedNum ++;
+        return realloc(ptr, newSize);
+    }
+
+    if (newSize == 0) {
+        arenaFree(arena, ptr);
+        return NULL;
+    }
+    if (bumping && arenaResizeInPlace(arena, ptr, newSize)) {
+        return ptr;
+    }
+    void *newBlock = NULL;
+    if (bumping) {
+        newBlock = arenaAlloc(vm, arena, newSize);
+    }
+    else {
+        vm->allocatedNum ++;
+        newBlock = malloc(newSize);
+        if (newBlock == NULL) {
+            return NULL;
+        }
+    }
+    uint32_t oldSize = blockSize(ptr);
+    memcpy(newBlock, ptr, oldSize < newSize ? oldSize : newSize);
+    return newBlock;
+}
+
+/**
+ * 打开区域，之后memManager的新分配都在区域中，closeArena时整体释放
+ * 用于单次请求的脚本执行：请求结束后其临时对象无须逐个回收
+ * @param vm
+ */
+void openArena(VM *vm) {
+    if (vm->arena != NULL) {
+        RUN_ERROR("arena is already open!");
+    }
+    Arena *arena = (Arena *)malloc(sizeof(Arena));
+    if (arena == NULL) {
+        MEM_ERROR("allocate arena failed!");
+    }
+    arena->chunks = NULL;
+    arena->nextChunkSize = ARENA_FIRST_CHUNK_SIZE;
+    arena->pauseDepth = 0;
+    arena->lastBlock = NULL;
+    arena->low = arena->high = NULL;
+    arena->firstOld = vm->allObjects;
+    ValueBufferInit(&arena->remembered);
+    vm->arena = arena;
+}
+
+/**
+ * 暂停区域，其间的分配走堆，用于符号表、驻留字符串、线程池及编译结果等随vm长期存在的数据
+ * 可以嵌套，未打开区域时无作用
+ * @param vm
+ */
+void pauseArena(VM *vm) {
+    if (vm->arena != NULL) {
+        vm->arena->pauseDepth ++;
+    }
+}
+
+/**
+ * 恢复被pauseArena暂停的区域
+ * @param vm
+ */
+void resumeArena(VM *vm) {
+    if (vm->arena != NULL) {
+        vm->arena->pauseDepth --;
+    }
+}
+
+/**
+ * 把打开区域前的对象记入记忆集，由ARENA_REMEMBER调用
+ * 区域中的对象在关闭时从根出发总会扫描到，共享堆中的对象不可修改，均无须记录
+ * @param vm
+ * @param objHeader
+ */
+void arenaRemember(VM *vm, ObjHeader *objHeader) {
+    Arena *arena = vm->arena;
+    if (objHeader->isFrozen || inArena(arena, objHeader)) {
+        return;
+    }
+    objHeader->isRemembered = true;
+    // 记忆集随区域关闭而释放，不占区域的空间
+    arena->pauseDepth ++;
+    ValueBufferAdd(vm, &arena->remembered, OBJ_TO_VALUE(objHeader));
+    arena->pauseDepth --;
+}
+
+/**
+ * 区域中的块不能在关闭区域后继续使用，迁出时在堆上拷贝一份
+ * @param tracer
+ * @param block
+ * @return 迁出时为堆上的副本，否则为block
+ */
+static void* relocateBlock(Tracer *tracer, void *block) {
+    if (block == NULL || !inArena(tracer->arena, block)) {
+        return block;
+    }
+    if (tracer->mode == TRACE_MARK) {
+        tracer->escapeNum ++;
+        return block;
+    }
+    uint32_t size = blockSize(block);
+    void *copy = malloc(size);
+    if (copy == NULL) {
+        MEM_ERROR("evacuate arena block failed!");
+    }
+    tracer->vm->allocatedNum ++;
+    memcpy(copy, block, size);
+    return copy;
+}
+
+/**
+ * 把区域中的对象拷贝到堆上，原对象记下副本的地址
+ * 数组自己持有的数据及函数的指令流随对象一起迁出，使切片及frame中的ip能按偏移修正
+ * @param tracer
+ * @param objHeader
+ * @return 堆上的副本
+ */
+static ObjHeader* evacuateObj(Tracer *tracer, ObjHeader *objHeader) {
+    VM *vm = tracer->vm;
+    ObjHeader *copy = (ObjHeader *)relocateBlock(tracer, objHeader);
+    copy->isDark = false;
+    copy->next = vm->allObjects;
+    vm->allObjects = copy;
+    switch (copy->type) {
+        case OT_TYPED_ARRAY: {
+            ObjTypedArray *array = (ObjTypedArray *)copy;
+            if (array->base == NULL) {
+                array->data = (uint8_t *)relocateBlock(tracer, array->data);
+            }
+            break;
+        }
+        case OT_FUNCTION: {
+            ObjFn *objFn = (ObjFn *)copy;
+            objFn->instrStream.datas = (Byte *)relocateBlock(tracer, objFn->instrStream.datas);
+            break;
+        }
+        case OT_UPVALUE: {
+            // 已关闭的upvalue指向自己的closedUpvalue
+            ObjUpvalue *objUpvalue = (ObjUpvalue *)copy;
+            if (objUpvalue->localVarPtr == &((ObjUpvalue *)objHeader)->closedUpvalue) {
+                objUpvalue->localVarPtr = &objUpvalue->closedUpvalue;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+
+    objHeader->isDark = ARENA_FORWARDED;
+    objHeader->next = copy;
+    ValueBufferAdd(vm, &tracer->work, OBJ_TO_VALUE(copy));
+    return copy;
+}
+
+/**
+ * 处理对区域中对象的引用：标记时记下可到达的对象，迁出时返回堆上的副本
+ * @param tracer
+ * @param objHeader
+ * @return 修正后的引用
+ */
+static ObjHeader* traceObj(Tracer *tracer, ObjHeader *objHeader) {
+    if (objHeader == NULL || !inArena(tracer->arena, objHeader)) {
+        return objHeader;
+    }
+    if (tracer->mode == TRACE_MARK) {
+        if (objHeader->isDark != ARENA_MARKED) {
+            objHeader->isDark = ARENA_MARKED;
+            tracer->escapeNum ++;
+            ValueBufferAdd(tracer->vm, &tracer->work, OBJ_TO_VALUE(objHeader));
+        }
+        return objHeader;
+    }
+    if (objHeader->isDark == ARENA_FORWARDED) {
+        return objHeader->next;
+    }
+    return evacuateObj(tracer, objHeader);
+}
+
+/**
+ * 处理num个value
+ * @param tracer
+ * @param values
+ * @param num
+ */
+static void traceValues(Tracer *tracer, Value *values, uint32_t num) {
+    uint32_t idx = 0;
+    while (idx < num) {
+        if (VALUE_IS_OBJ(values[idx])) {
+            values[idx].objHeader = traceObj(tracer, values[idx].objHeader);
+        }
+        idx ++;
+    }
+}
+
+/**
+ * 处理区域中的vector或hashMap节点，节点可被多个版本共享，只处理一次
+ * @param tracer
+ * @param node
+ * @param isNew 首次处理时置为真，调用方须继续处理节点中的引用
+ * @return 修正后的节点地址
+ */
+static void* traceNode(Tracer *tracer, void *node, bool *isNew) {
+    Value *traced = objMemoFind(&tracer->nodes, (ObjHeader *)node);
+    if (traced != NULL) {
+        *isNew = false;
+        return traced->objHeader;
+    }
+    Value copy;
+    copy.type = VT_OBJ;
+    copy.objHeader = (ObjHeader *)relocateBlock(tracer, node);
+    objMemoAdd(&tracer->nodes, (ObjHeader *)node, copy);
+    *isNew = true;
+    return copy.objHeader;
+}
+
+/**
+ * 处理vector的节点及其子节点中的引用
+ * @param tracer
+ * @param node
+ * @param level 节点所在层的位移，叶子为0
+ * @param walkHeap 为假时不进入堆上的节点
+ * @return 修正后的节点地址
+ */
+static VectorNode* traceVectorNode(Tracer *tracer, VectorNode *node, uint32_t level, bool walkHeap) {
+    if (node == NULL) {
+        return NULL;
+    }
+    if (inArena(tracer->arena, node)) {
+        bool isNew;
+        node = (VectorNode *)traceNode(tracer, node, &isNew);
+        if (!isNew) {
+            return node;
+        }
+    }
+    else if (!walkHeap) {
+        return node;
+    }
+
+    if (level == 0) {
+        traceValues(tracer, node->values, VECTOR_WIDTH);
+        return node;
+    }
+    uint32_t idx = 0;
+    while (idx < VECTOR_WIDTH) {
+        node->children[idx] = traceVectorNode(tracer, node->children[idx], level - VECTOR_BITS, walkHeap);
+        idx ++;
+    }
+    return node;
+}
+
+/**
+ * 处理hashMap的节点及其子节点中的引用
+ * @param tracer
+ * @param node
+ * @param walkHeap 为假时不进入堆上的节点
+ * @return 修正后的节点地址
+ */
+static HamtNode* traceHamtNode(Tracer *tracer, HamtNode *node, bool walkHeap) {
+    if (node == NULL) {
+        return NULL;
+    }
+    if (inArena(tracer->arena, node)) {
+        bool isNew;
+        node = (HamtNode *)traceNode(tracer, node, &isNew);
+        if (!isNew) {
+            return node;
+        }
+    }
+    else if (!walkHeap) {
+        return node;
+    }
+
+    traceValues(tracer, (Value *)node->entries, node->entryNum * 2);
+    HamtNode **children = (HamtNode **)(node->entries + node->entryNum);
+    uint32_t idx = 0;
+    while (idx < node->childNum) {
+        children[idx] = traceHamtNode(tracer, children[idx], walkHeap);
+        idx ++;
+    }
+    return node;
+}
+
+/**
+ * 处理对象中的引用及缓冲区
+ * @param tracer
+ * @param objHeader
+ */
+static void traceObject(Tracer *tracer, ObjHeader *objHeader) {
+    objHeader->class = (Class *)traceObj(tracer, (ObjHeader *)objHeader->class);
+    switch (objHeader->type) {
+        case OT_CLASS: {
+            Class *class = (Class *)objHeader;
+            class->superClass = (Class *)traceObj(tracer, (ObjHeader *)class->superClass);
+            class->name = (ObjString *)traceObj(tracer, (ObjHeader *)class->name);
+            class->methods.datas = (Method *)relocateBlock(tracer, class->methods.datas);
+            uint32_t idx = 0;
+            while (idx < class->methods.count) {
+                Method *method = &class->methods.datas[idx ++];
+                if (method->type == MT_SCRIPT) {
+                    method->obj = (ObjClosure *)traceObj(tracer, (ObjHeader *)method->obj);
+                }
+            }
+            break;
+        }
+        case OT_LIST: {
+            ObjList *objList = (ObjList *)objHeader;
+            objList->elements.datas = (Value *)relocateBlock(tracer, objList->elements.datas);
+            traceValues(tracer, objList->elements.datas, objList->elements.count);
+            break;
+        }
+        case OT_MAP: {
+            ObjMap *objMap = (ObjMap *)objHeader;
+            objMap->indices = (uint32_t *)relocateBlock(tracer, objMap->indices);
+            objMap->entries = (Entry *)relocateBlock(tracer, objMap->entries);
+            traceValues(tracer, (Value *)objMap->entries, objMap->entryNum * 2);
+            break;
+        }
+        case OT_MODULE: {
+            ObjModule *objModule = (ObjModule *)objHeader;
+            objModule->moduleVarName.datas = (String *)relocateBlock(tracer, objModule->moduleVarName.datas);
+            uint32_t idx = 0;
+            while (idx < objModule->moduleVarName.count) {
+                String *name = &objModule->moduleVarName.datas[idx ++];
+                name->str = (char *)relocateBlock(tracer, name->str);
+            }
+            objModule->moduelVarValue.datas = (Value *)relocateBlock(tracer, objModule->moduelVarValue.datas);
+            traceValues(tracer, objModule->moduelVarValue.datas, objModule->moduelVarValue.count);
+            objModule->name = (ObjString *)traceObj(tracer, (ObjHeader *)objModule->name);
+            objModule->source = (char *)relocateBlock(tracer, objModule->source);
+            break;
+        }
+        case OT_STRING: {
+            ObjString *objString = (ObjString *)objHeader;
+            objString->left = (ObjString *)traceObj(tracer, (ObjHeader *)objString->left);
+            objString->right = (ObjString *)traceObj(tracer, (ObjHeader *)objString->right);
+            objString->utf8Index = (Utf8Index *)relocateBlock(tracer, objString->utf8Index);
+            break;
+        }
+        case OT_UPVALUE: {
+            ObjUpvalue *objUpvalue = (ObjUpvalue *)objHeader;
+            traceValues(tracer, &objUpvalue->closedUpvalue, 1);
+            objUpvalue->next = (ObjUpvalue *)traceObj(tracer, (ObjHeader *)objUpvalue->next);
+            break;
+        }
+        case OT_FUNCTION: {
+            // 编译时暂停了区域，指令流等通常在堆上
+            ObjFn *objFn = (ObjFn *)objHeader;
+            objFn->instrStream.datas = (Byte *)relocateBlock(tracer, objFn->instrStream.datas);
+#if DEBUG
+            objFn->debug.fnName = (char *)relocateBlock(tracer, objFn->debug.fnName);
+            objFn->debug.lineNo.datas = (Int *)relocateBlock(tracer, objFn->debug.lineNo.datas);
+#endif
+            objFn->constants.datas = (Value *)relocateBlock(tracer, objFn->constants.datas);
+            traceValues(tracer, objFn->constants.datas, objFn->constants.count);
+            objFn->module = (ObjModule *)traceObj(tracer, (ObjHeader *)objFn->module);
+            break;
+        }
+        case OT_CLOSURE: {
+            ObjClosure *objClosure = (ObjClosure *)objHeader;
+            objClosure->fn = (ObjFn *)traceObj(tracer, (ObjHeader *)objClosure->fn);
+            uint32_t idx = 0;
+            while (idx < objClosure->fn->upvalueNum) {
+                objClosure->upvalues[idx] = (ObjUpvalue *)traceObj(tracer, (ObjHeader *)objClosure->upvalues[idx]);
+                idx ++;
+            }
+            break;
+        }
+        case OT_INSTANCE: {
+            ObjInstance *objInstance = (ObjInstance *)objHeader;
+            traceValues(tracer, objInstance->fields, objHeader->class->fieldNum);
+            break;
+        }
+        case OT_THREAD: {
+            // 栈及frame数组取自线程池，不在区域中
+            ObjThread *objThread = (ObjThread *)objHeader;
+            if (objThread->stack != NULL) {
+                traceValues(tracer, objThread->stack, (uint32_t)(objThread->esp - objThread->stack));
+            }
+            uint32_t idx = 0;
+            while (idx < objThread->usedFrameNum) {
+                // 函数迁出后指令流换了位置，ip按在指令流中的偏移修正
+                Frame *frame = &objThread->frames[idx ++];
+                uint8_t *oldCode = frame->closure->fn->instrStream.datas;
+                frame->closure = (ObjClosure *)traceObj(tracer, (ObjHeader *)frame->closure);
+                ObjFn *objFn = (ObjFn *)traceObj(tracer, (ObjHeader *)frame->closure->fn);
+                frame->ip = objFn->instrStream.datas + (frame->ip - oldCode);
+            }
+            objThread->openUpvalues = (ObjUpvalue *)traceObj(tracer, (ObjHeader *)objThread->openUpvalues);
+            objThread->caller = (ObjThread *)traceObj(tracer, (ObjHeader *)objThread->caller);
+            objThread->nextReady = (ObjThread *)traceObj(tracer, (ObjHeader *)objThread->nextReady);
+            objThread->prevReady = (ObjThread *)traceObj(tracer, (ObjHeader *)objThread->prevReady);
+            traceValues(tracer, &objThread->errorObj, 1);
+            break;
+        }
+        case OT_STRING_BUILDER: {
+            ObjStringBuilder *builder = (ObjStringBuilder *)objHeader;
+            builder->buffer.datas = (Byte *)relocateBlock(tracer, builder->buffer.datas);
+            break;
+        }
+        case OT_TYPED_ARRAY: {
+            // 切片按原来在base中的偏移指向迁出后的数据
+            ObjTypedArray *array = (ObjTypedArray *)objHeader;
+            if (array->base == NULL) {
+                array->data = (uint8_t *)relocateBlock(tracer, array->data);
+                break;
+            }
+            ObjTypedArray *oldBase = array->base;
+            array->base = (ObjTypedArray *)traceObj(tracer, (ObjHeader *)oldBase);
+            array->data = array->base->data + (array->data - oldBase->data);
+            break;
+        }
+        case OT_SET: {
+            ObjSet *objSet = (ObjSet *)objHeader;
+            objSet->indices = (uint32_t *)relocateBlock(tracer, objSet->indices);
+            objSet->keys = (Value *)relocateBlock(tracer, objSet->keys);
+            traceValues(tracer, objSet->keys, objSet->keyNum);
+            break;
+        }
+        case OT_TUPLE: {
+            ObjTuple *objTuple = (ObjTuple *)objHeader;
+            traceValues(tracer, objTuple->elements, objTuple->length);
+            break;
+        }
+        case OT_VECTOR: {
+            // 打开前的向量可能以暂态原地修改过堆上的节点，须逐个检查；
+            // 区域中的向量只会共享而不会修改堆上的节点，处理到区域中的节点为止
+            ObjVector *objVector = (ObjVector *)objHeader;
+            bool walkHeap = objHeader->isRemembered;
+            objVector->root = traceVectorNode(tracer, objVector->root, objVector->shift, walkHeap);
+            objVector->tail = traceVectorNode(tracer, objVector->tail, 0, walkHeap);
+            break;
+        }
+        case OT_HASH_MAP: {
+            ObjHashMap *objHashMap = (ObjHashMap *)objHeader;
+            objHashMap->root = traceHamtNode(tracer, objHashMap->root, objHeader->isRemembered);
+            break;
+        }
+        case OT_RANGE:
+        case OT_CHANNEL:
+            break;
+        default:
+            RUN_ERROR("unknown object type %d in arena!", objHeader->type);
+    }
+}
+
+/**
+ * 处理记忆集中的对象及vm中的根
+ * 打开前的其余对象在区域打开期间没有被修改，不会引用区域中的对象
+ * @param tracer
+ */
+static void traceRoots(Tracer *tracer) {
+    VM *vm = tracer->vm;
+    ValueBuffer *remembered = &tracer->arena->remembered;
+    uint32_t idx = 0;
+    while (idx < remembered->count) {
+        traceObject(tracer, remembered->datas[idx ++].objHeader);
+    }
+
+    vm->allModules = (ObjMap *)traceObj(tracer, (ObjHeader *)vm->allModules);
+    vm->preloadedFns = (ObjMap *)traceObj(tracer, (ObjHeader *)vm->preloadedFns);
+    vm->curThread = (ObjThread *)traceObj(tracer, (ObjHeader *)vm->curThread);
+    vm->readyHead = (ObjThread *)traceObj(tracer, (ObjHeader *)vm->readyHead);
+    vm->readyTail = (ObjThread *)traceObj(tracer, (ObjHeader *)vm->readyTail);
+
+    // 挂起在io及定时器上的线程和待写的字符串
+    EventLoop *loop = &vm->eventLoop;
+    loop->waiters.datas = (FdWaiter *)relocateBlock(tracer, loop->waiters.datas);
+    loop->timers.datas = (IoTimer *)relocateBlock(tracer, loop->timers.datas);
+    idx = 0;
+    while (idx < loop->waiters.count) {
+        FdWaiter *waiter = &loop->waiters.datas[idx ++];
+        waiter->readOp.thread = (ObjThread *)traceObj(tracer, (ObjHeader *)waiter->readOp.thread);
+        waiter->writeOp.thread = (ObjThread *)traceObj(tracer, (ObjHeader *)waiter->writeOp.thread);
+        waiter->writeOp.data = (ObjString *)traceObj(tracer, (ObjHeader *)waiter->writeOp.data);
+    }
+    idx = 0;
+    while (idx < loop->timers.count) {
+        IoTimer *timer = &loop->timers.datas[idx ++];
+        timer->thread = (ObjThread *)traceObj(tracer, (ObjHeader *)timer->thread);
+    }
+
+    // 处理新到达的对象，直到没有新的
+    while (tracer->work.count > 0) {
+        Value value = tracer->work.datas[-- tracer->work.count];
+        traceObject(tracer, value.objHeader);
+    }
+}
+
+/**
+ * 释放区域中的全部块
+ * @param chunks
+ */
+static void freeChunks(ArenaChunk *chunks) {
+    while (chunks != NULL) {
+        ArenaChunk *next = chunks->next;
+        free(chunks);
+        chunks = next;
+    }
+}
+
+/**
+ * 关闭区域
+ * 先扫描记忆集、模块变量及运行中的线程，找出逃逸到区域外的区域对象，
+ * 把它们拷贝到堆上并修正引用后整体释放区域。vector及hashMap的节点按共享关系迁出，引用计数不变
+ * 只被c代码持有的区域对象在关闭后失效
+ * @param vm
+ */
+void closeArena(VM *vm) {
+    Arena *arena = vm->arena;
+    if (arena == NULL) {
+        RUN_ERROR("no arena is open!");
+    }
+    // 收尾时的分配都走堆
+    arena->pauseDepth ++;
+
+    // 打开后新建的对象中，区域暂停时建在堆上的并入打开前的对象并记入记忆集，其余摘到young链表
+    ObjHeader *young = NULL;
+    ObjHeader *oldObjects = arena->firstOld;
+    ObjHeader *objHeader = vm->allObjects;
+    while (objHeader != arena->firstOld) {
+        ObjHeader *next = objHeader->next;
+        if (inArena(arena, objHeader)) {
+            objHeader->next = young;
+            young = objHeader;
+        }
+        else {
+            objHeader->next = oldObjects;
+            oldObjects = objHeader;
+            ARENA_REMEMBER(vm, objHeader);
+        }
+        objHeader = next;
+    }
+    vm->allObjects = oldObjects;
+
+    Tracer tracer;
+    tracer.vm = vm;
+    tracer.arena = arena;
+    tracer.mode = TRACE_MARK;
+    tracer.escapeNum = 0;
+    ValueBufferInit(&tracer.work);
+    initObjMemo(&tracer.nodes);
+    traceRoots(&tracer);
+
+    // 未逃逸的对象中，vector及hashMap可能与区域外的版本共享节点，须归还其引用；
+    // channel持有mailbox的引用，线程的栈及frame数组取自线程池，也须归还
+    objHeader = young;
+    while (objHeader != NULL) {
+        ObjHeader *next = objHeader->next;
+        if (objHeader->isDark != ARENA_MARKED) {
+            switch (objHeader->type) {
+                case OT_VECTOR:
+                    freeObjVector(vm, (ObjVector *)objHeader);
+                    break;
+                case OT_HASH_MAP:
+                    freeObjHashMap(vm, (ObjHashMap *)objHeader);
+                    break;
+                case OT_CHANNEL:
+                    releaseMailbox(((ObjChannel *)objHeader)->mailbox);
+                    break;
+                case OT_THREAD:
+                    ((ObjThread *)objHeader)->usedFrameNum = 0;
+                    recycleThreadStack(vm, (ObjThread *)objHeader);
+                    break;
+                default:
+                    break;
+            }
+        }
+        objHeader = next;
+    }
+
+    // 多数请求没有对象逃逸，不必再扫描一遍
+    if (tracer.escapeNum > 0) {
+        tracer.mode = TRACE_EVACUATE;
+        freeObjMemo(&tracer.nodes);
+        traceRoots(&tracer);
+    }
+    freeChunks(arena->chunks);
+    arena->chunks = NULL;
+    arena->low = arena->high = NULL;
+
+    uint32_t idx = 0;
+    while (idx < arena->remembered.count) {
+        arena->remembered.datas[idx ++].objHeader->isRemembered = false;
+    }
+    ValueBufferClear(vm, &arena->remembered);
+    ValueBufferClear(vm, &tracer.work);
+    freeObjMemo(&tracer.nodes);
+    vm->arena = NULL;
+    free(arena);
+}
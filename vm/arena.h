@@ -0,0 +1,51 @@
+//
+// Created by ZiXuan on 2022/7/31.
+//
+
+#ifndef SPARROW_ARENA_H
+#define SPARROW_ARENA_H
+
+#include "../object/header_obj.h"
+
+// 首个区域块的字节数，之后的块按2倍增长
+#define ARENA_FIRST_CHUNK_SIZE (64 * 1024)
+#define ARENA_MAX_CHUNK_SIZE (4 * 1024 * 1024)
+// 超过此大小的分配独占一个区域块，不打断当前块的顺序分配
+#define ARENA_LARGE_BLOCK_SIZE (16 * 1024)
+// 每个块前记录块大小，迁出时据此拷贝，无须知道块的类型
+#define ARENA_BLOCK_HEADER 8
+
+typedef struct arenaChunk {
+    struct arenaChunk *next;
+    uint32_t size; // data的字节数
+    uint32_t used; // 已分配的字节数，含块头
+    uint64_t data[0];
+} ArenaChunk;  // 区域块，块内按地址顺序分配
+
+typedef struct arena {
+    ArenaChunk *chunks; // 表头为当前顺序分配的块
+    uint32_t nextChunkSize;
+    uint32_t pauseDepth; // 大于0时新的分配走堆，用于随vm长期存在的数据
+    void *lastBlock; // 当前块中最后分配的块，可原地伸缩或回退
+    char *low; // 所有区域块覆盖的地址范围，多数堆上的指针据此直接排除
+    char *high;
+    ObjHeader *firstOld; // 打开区域时vm->allObjects的表头，其后均为打开前的对象
+    ValueBuffer remembered; // 记忆集：打开期间可能被写入区域对象引用的旧对象，在堆上分配
+} Arena;  // 单次请求的分配区域，关闭时整体释放
+
+// 写屏障：区域打开期间修改打开前的对象前调用，关闭区域时只扫描记下的对象
+#define ARENA_REMEMBER(vm, obj) \
+    do { \
+        if ((vm)->arena != NULL && !((ObjHeader *)(obj))->isRemembered) { \
+            arenaRemember((vm), (ObjHeader *)(obj)); \
+        } \
+    } while (0)
+
+void openArena(VM *vm);
+void closeArena(VM *vm);
+void arenaRemember(VM *vm, ObjHeader *objHeader);
+void pauseArena(VM *vm);
+void resumeArena(VM *vm);
+void* arenaMemManager(VM *vm, void *ptr, uint32_t newSize);
+
+#endif //SPARROW_ARENA_H
@@ -1,14 +1,37 @@
 #include "core.h"
 
 #include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
 
 #include "../include/utils.h"
+#include "../include/unicodeUtf8.h"
 #include "../object/class.h"
 #include "vm.h"
 #include "../compiler/compiler.h"
+#include "../object/obj_list.h"
+#include "event_loop.h"
+#include "worker.h"
+#include "mailbox.h"
+#include "../object/obj_channel.h"
+#include "../object/obj_string_builder.h"
+#include "../object/obj_typed_array.h"
+#include "../object/obj_set.h"
+#include "../object/obj_tuple.h"
+#include "../object/obj_vector.h"
+#include "../object/obj_hash_map.h"
+#include "shared_heap.h"
+#include "preload.h"
+#include "arena.h"
+#include "core.script.inc"
 
 #define CORE_MODULE VT_TO_VALUE(VT_NULL)
+// List.new(_)、Map.new(_)及reserve(_)最多预留的元素个数
+#define MAX_RESERVE_NUM (1u << 30)
 
 char *rootDir = NULL; // 根目录
 
@@ -105,7 +128,7 @@ static bool primObjectNot(VM *vm UNUSED, Value *args) {
  * @param args
  * @return
  */
-static bool primObjectEqual(VM *vm, Value *args) {
+static bool primObjectEqual(VM *vm UNUSED, Value *args) {
     Value boolValue = BOOL_TO_VALUE(valueIsEqual(args[0], args[1]));
     RET_VALUE(boolValue);
 }
@@ -129,18 +152,18 @@ static bool primObjectNotEqual(VM *vm UNUSED, Value *args) {
  */
 static bool primObjectIs(VM *vm, Value *args) {
     if (!VALUE_IS_CLASS(args[1])) {
-        RUN_ERROR("argument must be class!");
+        SET_ERROR_FALSE(vm, "argument must be class!");
     }
 
     Class *thisClass = getClassOfObj(vm, args[0]);
     Class *baseClass = (Class *)(args[1].objHeader);
 
-    // 有可能是多级集成，因此自下而上遍历基类链
-    while (baseClass != NULL) {
+    // 有可能是多级继承，因此自下而上遍历本类的基类链
+    while (thisClass != NULL) {
         if (thisClass == baseClass) {
             RET_VALUE(VT_TO_VALUE(VT_TRUE));
         }
-        baseClass = baseClass->superClass;
+        thisClass = thisClass->superClass;
     }
 
     RET_VALUE(VT_TO_VALUE(VT_FALSE));
@@ -152,8 +175,8 @@ static bool primObjectIs(VM *vm, Value *args) {
  * @param args
  * @return
  */
-static bool primObjectToString(VM *vm UNUSED, Value *args) {
-    Class *class =args[0].objHeader->class;
+static bool primObjectToString(VM *vm, Value *args) {
+    Class *class = getClassOfObj(vm, args[0]);
     Value namevalue = OBJ_TO_VALUE(class->name);
     RET_VALUE(namevalue);
 }
@@ -214,6 +237,49 @@ static bool primObjectmetaSame(VM *vm UNUSED, Value *args) {
     RET_VALUE(boolValue);
 }
 
+/**
+ * !null 结果为true
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primNullNot(VM *vm UNUSED, Value *args) {
+    RET_TRUE;
+}
+
+/**
+ * null.toString
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primNullToString(VM *vm, Value *args) {
+    RET_OBJ(newObjString(vm, "null", 4));
+}
+
+/**
+ * !bool 取反
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primBoolNot(VM *vm UNUSED, Value *args) {
+    RET_BOOL(!VALUE_TO_BOOL(args[0]));
+}
+
+/**
+ * bool.toString
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primBoolToString(VM *vm, Value *args) {
+    if (VALUE_TO_BOOL(args[0])) {
+        RET_OBJ(newObjString(vm, "true", 4));
+    }
+    RET_OBJ(newObjString(vm, "false", 5));
+}
+
 /**
  * table中查找符号symbol，找到后返回索引
  * @param table
@@ -245,12 +311,15 @@ int getIndexFromSymbolTable(SymbolTable *table, const char *symbol, uint32_t len
 int addSymbol(VM *vm, SymbolTable *table, const char *symbol, uint32_t length) {
     ASSERT(length != 0, "length of symbol is 0！");
 
+    // 符号表随vm存在，不在分配区域中
+    pauseArena(vm);
     String string;
     string.str = ALLOCATE_ARRAY(vm, char, length + 1);
     memcpy(string.str, symbol, length);
     string.str[length] = '\0';
     string.length = length;
     StringBufferAdd(vm, table, string);
+    resumeArena(vm);
     return (int)table->count - 1;
 }
 
@@ -293,139 +362,3451 @@ void bindMethod(VM *vm, Class *class, uint32_t index, Method method) {
 void bindSuperClass(VM *vm, Class *subClass, Class *superClass) {
     subClass->superClass = superClass;
 
-    subClass->fieldNum += subClass->fieldNum;
+    // 子类字段排在基类字段之后
+    subClass->fieldNum += superClass->fieldNum;
 
     // 绑定基类方法
     uint32_t idx = 0;
-    while (idx < subClass->methods.count) {
+    while (idx < superClass->methods.count) {
         bindMethod(vm, subClass, idx, superClass->methods.datas[idx]);
         idx ++;
     }
 }
 
 /**
- * @brief 编译核心模块
- *
+ * 校验arg是否为函数(闭包)
  * @param vm
+ * @param arg
+ * @return
  */
-void buildCore(VM *vm) {
-    // 创建核心模块 录入到vm->allModules
-    ObjModule *coreModule = newObjModule(vm, NULL);
+static bool validateFn(VM *vm, Value arg) {
+    if (VALUE_IS_CREATIN_OBJ(arg, OT_CLOSURE)) {
+        return true;
+    }
+    vm->curThread->errorObj = OBJ_TO_VALUE(newObjString(vm, "argument must be a function!", 28));
+    return false;
+}
 
-    // 创建核心模块
-    mapSet(vm, vm->allModules, CORE_MODULE, OBJ_TO_VALUE(coreModule));
+/**
+ * Thread.new(func) 以函数创建线程，线程对象优先从线程池复用
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primThreadNew(VM *vm, Value *args) {
+    if (!validateFn(vm, args[1])) {
+        return false;
+    }
+    if (VALUE_TO_OBJCLOSURE(args[1])->fn->argNum > 1) {
+        SET_ERROR_FALSE(vm, "thread function takes at most one argument!");
+    }
 
-    // 创建object类并绑定方法
-    vm->objectClass = defineClass(vm, coreModule, "object");
-    PRIM_METHOD_BIND(vm->objectClass, "!", primObjectNot);
-    PRIM_METHOD_BIND(vm->objectClass, "==(_)", primObjectEqual);
-    PRIM_METHOD_BIND(vm->objectClass, "!=(_)", primObjectNotEqual);
-    PRIM_METHOD_BIND(vm->objectClass, "is(_)", primObjectIs);
-    PRIM_METHOD_BIND(vm->objectClass, "toString", primObjectToString);
-    PRIM_METHOD_BIND(vm->objectClass, "type", primObjectType);
+    ObjThread *objThread = newObjThread(vm, VALUE_TO_OBJCLOSURE(args[1]));
 
-    // 定义classOfClass类
-    vm->classOfClass = defineClass(vm, coreModule, "class");
+    // 使stack[0]为接收者，保持栈平衡
+    objThread->stack[0] = VT_TO_VALUE(VT_NULL);
+    objThread->esp ++;
+    // 函数有形参时再留出形参的slot，首次call(arg)的arg写入其中
+    if (objThread->frames[0].closure->fn->argNum == 1) {
+        objThread->stack[1] = VT_TO_VALUE(VT_NULL);
+        objThread->esp ++;
+    }
+    RET_OBJ(objThread);
+}
 
-    // objectClass是任何类的基类
-    bindSuperClass(vm, vm->classOfClass, vm->objectClass);
-    PRIM_METHOD_BIND(vm->classOfClass, "name", primClassName);
-    PRIM_METHOD_BIND(vm->classOfClass, "supertype", primClassSupertype);
-    PRIM_METHOD_BIND(vm->classOfClass, "toString", primClassToString);
+/**
+ * Thread.abort(err) 以err为错误终止当前线程，err为null时不终止
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primThreadAbort(VM *vm, Value *args) {
+    vm->curThread->errorObj = args[1];
+    return VALUE_IS_NULL(args[1]);
+}
 
-    // 定义object类的元信息类，他无需挂在到vm
-    Class *objectMetaclass = defineClass(vm, coreModule, "objectMeta");
-    bindSuperClass(vm, objectMetaclass, vm->classOfClass);
+/**
+ * Thread.current 返回当前线程
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primThreadCurrent(VM *vm, Value *args) {
+    RET_OBJ(vm->curThread);
+}
 
-    // 类型比较
-    PRIM_METHOD_BIND(objectMetaclass, "same(_,_)", primObjectmetaSame);
+/**
+ * 当前线程让出cpu：有调用者时回到调用者并把arg传给它，
+ * 否则排到就绪队列末尾，运行队首的线程
+ * @param vm
+ * @param args
+ * @param argNum 参数个数，不含接收者
+ * @param arg
+ * @return
+ */
+static bool yieldThread(VM *vm, Value *args, uint32_t argNum, Value arg) {
+    ObjThread *curThread = vm->curThread;
+    ObjThread *caller = curThread->caller;
 
-    // 绑定各自的meta类
-    vm->objectClass->objHeader.class = objectMetaclass;
-    objectMetaclass->objHeader.class = vm->classOfClass;
-    vm->classOfClass->objHeader.class = vm->classOfClass;
+    // 丢掉参数，只保留args[0]用于存放恢复运行时的返回值
+    curThread->esp -= argNum;
+
+    if (caller != NULL) {
+        curThread->caller = NULL;
+        vm->curThread = caller;
+        // 把arg作为caller中call的返回值
+        caller->esp[-1] = arg;
+        return false;
+    }
+
+    // 由调度器运行的线程恢复时yield返回null
+    args[0] = VT_TO_VALUE(VT_NULL);
+    scheduleThread(vm, curThread);
+    // 有线程在等待io时顺便不阻塞地轮询一次，避免它们被频繁yield的线程饿死
+    if (vm->eventLoop.pendingNum > 0) {
+        runEventLoopOnce(vm, false);
+    }
+    // 就绪队列中只有自己时取回的仍是当前线程，相当于继续运行
+    vm->curThread = nextReadyThread(vm);
+    return false;
 }
 
 /**
- * 从modules中获取名为moduleName的模块
+ * Thread.suspend() 挂起当前线程，运行下一个可运行的线程
+ * 被挂起的线程须经schedule()或call才能再次运行
  * @param vm
- * @param moduleName
+ * @param args
  * @return
  */
-static ObjModule* getModule(VM *vm, Value moduleName) {
-    Value value = mapGet(vm->allModules, moduleName);
-    if (value.type == VT_UNDEFINED) {
-        return NULL;
+static bool primThreadSuspend(VM *vm, Value *args UNUSED) {
+    vm->curThread = nextRunnableThread(vm);
+    return false;
+}
+
+/**
+ * Thread.yield(arg) 带参数让出cpu
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primThreadYieldWithArg(VM *vm, Value *args) {
+    return yieldThread(vm, args, 1, args[1]);
+}
+
+/**
+ * Thread.yield() 无参数让出cpu
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primThreadYieldWithoutArg(VM *vm, Value *args) {
+    return yieldThread(vm, args, 0, VT_TO_VALUE(VT_NULL));
+}
+
+/**
+ * 切换到下一个线程nextThread
+ * withCaller为真时nextThread结束或yield后回到当前线程(call)，
+ * 否则当前线程不再被记录(transfer)，只能由他人再次调度
+ * @param vm
+ * @param nextThread
+ * @param args
+ * @param withArg
+ * @param withCaller
+ * @return
+ */
+static bool switchThread(VM *vm, ObjThread *nextThread, Value *args, bool withArg, bool withCaller) {
+    // 在下一线程nextThread执行之前，其caller必须为NULL，否则调用链成环
+    if (nextThread->caller != NULL) {
+        SET_ERROR_FALSE(vm, "thread has been called!");
     }
 
-    return VALUE_TO_OBJMODULE(value);
+    if (withCaller && nextThread == vm->curThread) {
+        SET_ERROR_FALSE(vm, "a thread can`t call itself!");
+    }
+
+    if (nextThread->usedFrameNum == 0) {
+        SET_ERROR_FALSE(vm, "a finished thread can`t be switched to!");
+    }
+
+    if (!VALUE_IS_NULL(nextThread->errorObj)) {
+        SET_ERROR_FALSE(vm, "an aborted thread can`t be switched to!");
+    }
+
+    // 挂起在io或定时器上的线程由事件循环唤醒，切换过去会使其结果slot被覆盖
+    if (nextThread->isParked) {
+        SET_ERROR_FALSE(vm, "a thread waiting for io or timer can`t be switched to!");
+    }
+
+    // 如果call有参数，回收参数的空间，只保留次栈顶用于存储nextThread返回后的结果
+    if (withArg) {
+        vm->curThread->esp --;
+    }
+
+    ASSERT(nextThread->esp > nextThread->stack, "esp should be greater than stack!");
+    // nextThread.call(arg)中的arg做为nextThread.yield的返回值，存储到nextThread的栈顶
+    nextThread->esp[-1] = withArg ? args[1] : VT_TO_VALUE(VT_NULL);
+
+    // 被切换到的线程若在就绪队列中，先从队列中移走
+    unscheduleThread(vm, nextThread);
+
+    if (withCaller) {
+        nextThread->caller = vm->curThread;
+    }
+
+    vm->curThread = nextThread;
+
+    // 返回false以进入vm中的切换线程流程
+    return false;
 }
 
 /**
- * 载入模块moduleName并编译
+ * objThread.call()
  * @param vm
- * @param moduleName
- * @param moduleCode
+ * @param args
  * @return
  */
-static ObjThread* loadModule(VM *vm, Value moduleName, const char *moduleCode) {
-    // 确保模块已经在到vm->allModules
-    // 先查看是否已经导入了该模块，避免重新载入
-    ObjModule* module = getModule(vm, moduleName);
+static bool primThreadCallWithoutArg(VM *vm, Value *args) {
+    return switchThread(vm, VALUE_TO_OBJTHREAD(args[0]), args, false, true);
+}
 
-    // 若该模块未加载将其载入，并继承核心模块中的变量
-    if (module == NULL ){
-        // 创建模块并添加到vm->allModules
-        ObjString* modName= VALUE_TO_OBJSTR(moduleName);
-        ASSERT(modName->value.start[modName->value.length] == '\0', "string.value.start is not termionated!");
+/**
+ * objThread.call(arg)
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primThreadCallWithArg(VM *vm, Value *args) {
+    return switchThread(vm, VALUE_TO_OBJTHREAD(args[0]), args, true, true);
+}
 
-        module = newObjModule(vm, modName->value.start);
-        mapSet(vm, vm->allModules, moduleName, OBJ_TO_VALUE(module));
+/**
+ * objThread.transfer() 直接切换到objThread，不返回当前线程
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primThreadTransferWithoutArg(VM *vm, Value *args) {
+    return switchThread(vm, VALUE_TO_OBJTHREAD(args[0]), args, false, false);
+}
 
-        // 继承核心模块中的变量
-        ObjModule *coreModule = getModule(vm, CORE_MODULE);
-        uint32_t idx = 0;
-        while (idx < coreModule->moduleVarName.count) {
-            defineModuleVar(vm, module, coreModule->moduleVarName.datas[idx].str,
-                            strlen(coreModule->moduleVarName.datas[idx].str),
-                            coreModule->moduelVarValue.datas[idx]);
-            idx ++;
-        }
+/**
+ * objThread.transfer(arg)
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primThreadTransferWithArg(VM *vm, Value *args) {
+    return switchThread(vm, VALUE_TO_OBJTHREAD(args[0]), args, true, false);
+}
 
+/**
+ * objThread.schedule() 把objThread加入就绪队列，由调度器择机运行
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primThreadSchedule(VM *vm, Value *args) {
+    ObjThread *objThread = VALUE_TO_OBJTHREAD(args[0]);
+    if (objThread->caller != NULL) {
+        SET_ERROR_FALSE(vm, "a called thread can`t be scheduled!");
+    }
+    if (objThread->isParked) {
+        SET_ERROR_FALSE(vm, "a thread waiting for io or timer can`t be scheduled!");
     }
+    scheduleThread(vm, objThread);
+    RET_NULL;
+}
 
-    ObjFn *fn = compileModule(vm, module, moduleCode);
-    ObjClosure *objClosure = newObjClosure(vm, fn);
-    ObjThread *moduleThread = newObjThread(vm, objClosure);
+/**
+ * objThread.isDone 返回线程是否运行完成
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primThreadIsDone(VM *vm UNUSED, Value *args) {
+    ObjThread *objThread = VALUE_TO_OBJTHREAD(args[0]);
+    RET_BOOL(objThread->usedFrameNum == 0 || !VALUE_IS_NULL(objThread->errorObj));
+}
 
-    return moduleThread;
+/**
+ * Fn.new(func) 返回函数本身，用于以块参数的形式创建函数
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primFnNew(VM *vm, Value *args) {
+    if (!validateFn(vm, args[1])) {
+        return false;
+    }
+    RET_VALUE(args[1]);
 }
 
 /**
- * 执行模块，目前为空，桩函数
+ * 把函数的call重载方法绑定为MT_FN_CALL，由解释器直接调用闭包
  * @param vm
- * @param moduleName
- * @param moduleCode
+ * @param sign
+ */
+static void bindFnOverloadCall(VM *vm, const char *sign) {
+    uint32_t index = ensureSymbolExist(vm, &vm->allMethodNames, sign, strlen(sign));
+    Method method = {MT_FN_CALL, {0}};
+    bindMethod(vm, vm->fnClass, index, method);
+}
+
+/**
+ * 校验arg是否为数字
+ * @param vm
+ * @param arg
  * @return
  */
-VMResult executeModule(VM *vm, Value moduleName, const char *moduleCode) {
-    ObjThread *objThread = loadModule(vm, moduleName, moduleCode);
-    return VM_RESULT_ERROR;
+static bool validateNum(VM *vm, Value arg) {
+    if (VALUE_IS_NUM(arg)) {
+        return true;
+    }
+    SET_ERROR_FALSE(vm, "argument must be number!");
 }
 
 /**
- * 确保符号已添加到符号表
+ * 校验arg是否为整数
  * @param vm
- * @param table
- * @param symbol
+ * @param arg
+ * @return
+ */
+static bool validateInt(VM *vm, Value arg) {
+    if (!validateNum(vm, arg)) {
+        return false;
+    }
+    if (trunc(VALUE_TO_NUM(arg)) != VALUE_TO_NUM(arg)) {
+        SET_ERROR_FALSE(vm, "argument must be integer!");
+    }
+    return true;
+}
+
+/**
+ * 校验arg是否为字符串
+ * @param vm
+ * @param arg
+ * @return
+ */
+static bool validateString(VM *vm, Value arg) {
+    if (VALUE_IS_CREATIN_OBJ(arg, OT_STRING)) {
+        return true;
+    }
+    SET_ERROR_FALSE(vm, "argument must be string!");
+}
+
+/**
+ * 校验arg是否为合法的fd
+ * @param vm
+ * @param arg
+ * @return
+ */
+static bool validateFd(VM *vm, Value arg) {
+    if (!validateInt(vm, arg)) {
+        return false;
+    }
+    if (VALUE_TO_NUM(arg) < 0) {
+        SET_ERROR_FALSE(vm, "fd must not be negative!");
+    }
+    return true;
+}
+
+/**
+ * 校验index是否为[-length, length)内的整数，负数从末尾倒数
+ * @param vm
+ * @param index
  * @param length
+ * @param result 转换后的非负下标
  * @return
  */
-int ensureSymbolExist(VM *vm, SymbolTable *table, const char *symbol, uint32_t length) {
+static bool validateIndex(VM *vm, Value index, uint32_t length, uint32_t *result) {
+    if (!validateInt(vm, index)) {
+        return false;
+    }
+    double num = VALUE_TO_NUM(index);
+    if (num < 0) {
+        num += length;
+    }
+    if (num < 0 || num >= length) {
+        SET_ERROR_FALSE(vm, "index out of bounds!");
+    }
+    *result = (uint32_t)num;
+    return true;
+}
 
-    int symbolIndex = getIndexFromSymbolTable(table, symbol, length);
-    if (symbolIndex == -1) {
-        return addSymbol(vm, table, symbol, length);
+/**
+ * 以errno设置线程报错
+ * @param vm
+ * @return
+ */
+static bool setErrnoError(VM *vm) {
+    const char *msg = strerror(errno);
+    vm->curThread->errorObj = OBJ_TO_VALUE(newObjString(vm, msg, strlen(msg)));
+    return false;
+}
+
+/**
+ * 按io操作的结果返回：完成时返回结果，无法完成时把当前线程挂起在fd上，
+ * 切换到下一个可运行的线程，操作完成后由事件循环把结果写入args[0]并唤醒线程
+ * @param vm
+ * @param args
+ * @param argNum 参数个数，不含接收者
+ * @param status
+ * @param result
+ * @param fd
+ * @param op
+ * @return
+ */
+static bool finishOrPark(VM *vm, Value *args, uint32_t argNum,
+                         IoStatus status, Value result, int fd, IoOp op) {
+    if (status == IO_DONE) {
+        RET_VALUE(result);
+    }
+    if (status == IO_FAILED) {
+        vm->curThread->errorObj = result;
+        return false;
+    }
+
+    op.thread = vm->curThread;
+    if (!ioWait(vm, fd, op)) {
+        SET_ERROR_FALSE(vm, "another thread is already waiting on this fd!");
+    }
+    vm->curThread->esp -= argNum;
+    vm->curThread = nextRunnableThread(vm);
+    return false;
+}
+
+/**
+ * IO.pipe() 创建非阻塞管道，返回[读端fd, 写端fd]
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primIoPipe(VM *vm, Value *args) {
+    int fds[2];
+    if (pipe(fds) == -1) {
+        return setErrnoError(vm);
+    }
+    setNonBlocking(fds[0]);
+    setNonBlocking(fds[1]);
+    ObjList *objList = newObjList(vm, 2);
+    objList->elements.datas[0] = NUM_TO_VALUE(fds[0]);
+    objList->elements.datas[1] = NUM_TO_VALUE(fds[1]);
+    RET_OBJ(objList);
+}
+
+/**
+ * IO.socketPair() 创建一对相连的非阻塞unix域socket，返回[fd, fd]
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primIoSocketPair(VM *vm, Value *args) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) == -1) {
+        return setErrnoError(vm);
+    }
+    ObjList *objList = newObjList(vm, 2);
+    objList->elements.datas[0] = NUM_TO_VALUE(fds[0]);
+    objList->elements.datas[1] = NUM_TO_VALUE(fds[1]);
+    RET_OBJ(objList);
+}
+
+/**
+ * IO.listen(port) 在127.0.0.1:port上监听，port为0时由系统分配
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primIoListen(VM *vm, Value *args) {
+    if (!validateInt(vm, args[1])) {
+        return false;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return setErrnoError(vm);
+    }
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)VALUE_TO_NUM(args[1]));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(fd, SOMAXCONN) == -1) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return setErrnoError(vm);
+    }
+    RET_NUM(fd);
+}
+
+/**
+ * IO.port(fd) 返回socket绑定的本地端口
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primIoPort(VM *vm, Value *args) {
+    if (!validateFd(vm, args[1])) {
+        return false;
+    }
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if (getsockname((int)VALUE_TO_NUM(args[1]), (struct sockaddr *)&addr, &len) == -1) {
+        return setErrnoError(vm);
+    }
+    RET_NUM(ntohs(addr.sin_port));
+}
+
+/**
+ * IO.connect(port) 连接127.0.0.1:port，连接建立前挂起当前线程
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primIoConnect(VM *vm, Value *args) {
+    if (!validateInt(vm, args[1])) {
+        return false;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return setErrnoError(vm);
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)VALUE_TO_NUM(args[1]));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        RET_NUM(fd);
+    }
+    if (errno != EINPROGRESS) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return setErrnoError(vm);
+    }
+
+    IoOp op = {IO_OP_CONNECT, NULL, 0, NULL, 0, NULL, NULL};
+    return finishOrPark(vm, args, 1, IO_AGAIN, VT_TO_VALUE(VT_NULL), fd, op);
+}
+
+/**
+ * IO.accept(fd) 接受新连接，没有连接时挂起当前线程
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primIoAccept(VM *vm, Value *args) {
+    if (!validateFd(vm, args[1])) {
+        return false;
+    }
+    int fd = (int)VALUE_TO_NUM(args[1]);
+    Value result = VT_TO_VALUE(VT_NULL);
+    IoStatus status = ioTryAccept(vm, fd, &result);
+
+    IoOp op = {IO_OP_ACCEPT, NULL, 0, NULL, 0, NULL, NULL};
+    return finishOrPark(vm, args, 1, status, result, fd, op);
+}
+
+/**
+ * IO.read(fd, size) 读取至多size个字节，fd不可读时挂起当前线程
+ * 对端关闭时返回空串
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primIoRead(VM *vm, Value *args) {
+    if (!validateFd(vm, args[1]) || !validateInt(vm, args[2])) {
+        return false;
+    }
+    if (VALUE_TO_NUM(args[2]) <= 0) {
+        SET_ERROR_FALSE(vm, "size must be positive!");
+    }
+    int fd = (int)VALUE_TO_NUM(args[1]);
+    uint32_t size = (uint32_t)VALUE_TO_NUM(args[2]);
+    Value result = VT_TO_VALUE(VT_NULL);
+    IoStatus status = ioTryRead(vm, fd, size, &result);
+
+    IoOp op = {IO_OP_READ, NULL, size, NULL, 0, NULL, NULL};
+    return finishOrPark(vm, args, 2, status, result, fd, op);
+}
+
+/**
+ * IO.write(fd, str) 写入整个str，fd不可写时挂起当前线程，返回写入的字节数
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primIoWrite(VM *vm, Value *args) {
+    if (!validateFd(vm, args[1]) || !validateString(vm, args[2])) {
+        return false;
+    }
+    int fd = (int)VALUE_TO_NUM(args[1]);
+    // 写入可能分多次完成，拼接串先展开
+    ObjString *data = flattenObjString(vm, VALUE_TO_OBJSTR(args[2]));
+    uint32_t written = 0;
+    Value result = VT_TO_VALUE(VT_NULL);
+    IoStatus status = ioTryWrite(vm, fd, data, &written, &result);
+
+    IoOp op = {IO_OP_WRITE, NULL, 0, data, written, NULL, NULL};
+    return finishOrPark(vm, args, 2, status, result, fd, op);
+}
+
+/**
+ * IO.sleep(ms) 挂起当前线程ms毫秒
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primIoSleep(VM *vm, Value *args) {
+    if (!validateNum(vm, args[1])) {
+        return false;
+    }
+    double ms = VALUE_TO_NUM(args[1]);
+    ioSleep(vm, vm->curThread, ms > 0 ? (uint64_t)(ms * 1000000) : 0);
+    vm->curThread->esp --;
+    vm->curThread = nextRunnableThread(vm);
+    return false;
+}
+
+/**
+ * IO.close(fd) 关闭fd，挂起在其上的线程以错误唤醒
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primIoClose(VM *vm, Value *args) {
+    if (!validateFd(vm, args[1])) {
+        return false;
+    }
+    int fd = (int)VALUE_TO_NUM(args[1]);
+    ioCancel(vm, fd);
+    if (close(fd) == -1) {
+        return setErrnoError(vm);
+    }
+    RET_NULL;
+}
+
+/**
+ * 校验当前vm是否运行在worker中
+ * @param vm
+ * @return
+ */
+static bool validateWorker(VM *vm) {
+    if (vm->worker != NULL) {
+        return true;
+    }
+    SET_ERROR_FALSE(vm, "not running in a worker!");
+}
+
+/**
+ * 序列化value并发往channel
+ * @param vm
+ * @param channel
+ * @param value
+ * @return
+ */
+static bool sendToChannel(VM *vm, VmChannel *channel, Value value) {
+    Message *msg = newMessage();
+    msg->sender = vm->worker->id;
+    if (!serializeValue(vm, value, msg)) {
+        freeMessage(msg);
+        SET_ERROR_FALSE(vm, "functions, threads, classes and modules can`t be sent!");
+    }
+    if (!vmChannelSend(channel, msg)) {
+        freeMessage(msg);
+        SET_ERROR_FALSE(vm, "channel has been closed!");
+    }
+    return true;
+}
+
+/**
+ * Worker.id 返回当前worker的编号
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primWorkerId(VM *vm, Value *args) {
+    if (!validateWorker(vm)) {
+        return false;
+    }
+    RET_NUM(vm->worker->id);
+}
+
+/**
+ * Worker.count 返回worker池中worker的个数
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primWorkerCount(VM *vm, Value *args) {
+    if (!validateWorker(vm)) {
+        return false;
+    }
+    RET_NUM(vm->worker->pool->workerNum);
+}
+
+/**
+ * Worker.send(value) 把value的副本发给宿主
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primWorkerSend(VM *vm, Value *args) {
+    if (!validateWorker(vm) || !sendToChannel(vm, &vm->worker->pool->outbox, args[1])) {
+        return false;
+    }
+    RET_NULL;
+}
+
+/**
+ * Worker.sendTo(id, value) 把value的副本发给编号为id的worker
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primWorkerSendTo(VM *vm, Value *args) {
+    if (!validateWorker(vm) || !validateInt(vm, args[1])) {
+        return false;
+    }
+    double id = VALUE_TO_NUM(args[1]);
+    WorkerPool *pool = vm->worker->pool;
+    if (id < 0 || id >= pool->workerNum) {
+        SET_ERROR_FALSE(vm, "worker id out of bounds!");
+    }
+    if (!sendToChannel(vm, &pool->workers[(uint32_t)id].inbox, args[2])) {
+        return false;
+    }
+    RET_NULL;
+}
+
+/**
+ * Worker.receive() 接收发给当前worker的值，没有消息时阻塞所在的os线程
+ * worker池关闭后返回null
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primWorkerReceive(VM *vm, Value *args) {
+    if (!validateWorker(vm)) {
+        return false;
+    }
+    Message *msg = vmChannelReceive(&vm->worker->inbox);
+    if (msg == NULL) {
+        RET_NULL;
+    }
+    Value value = deserializeValue(vm, msg);
+    freeMessage(msg);
+    RET_VALUE(value);
+}
+
+/**
+ * 从邮箱取值：size为0时取一个值直接返回，否则取至多size个值组成list
+ * @param vm
+ * @param mailbox
+ * @param size
+ * @return 邮箱为空时返回undefined
+ */
+static Value takeFromMailbox(VM *vm, Mailbox *mailbox, uint32_t size) {
+    if (mailboxCount(mailbox) == 0) {
+        return VT_TO_VALUE(VT_UNDEFINED);
+    }
+    if (size == 0) {
+        Value value;
+        if (mailboxReceive(vm, mailbox, &value, 1) == 0) {
+            return VT_TO_VALUE(VT_UNDEFINED);
+        }
+        return value;
+    }
+
+    uint32_t count = mailboxCount(mailbox);
+    ObjList *objList = newObjList(vm, count < size ? count : size);
+    objList->elements.count = mailboxReceive(vm, mailbox, objList->elements.datas, objList->elements.capacity);
+    if (objList->elements.count == 0) {
+        return VT_TO_VALUE(VT_UNDEFINED);
+    }
+    return OBJ_TO_VALUE(objList);
+}
+
+/**
+ * channel的eventfd可读后由事件循环调用，取值作为挂起的receive的结果
+ * 唤醒可能是虚假的，此时重新登记等待
+ * @param vm
+ * @param fd
+ * @param op
+ * @param result
+ * @return
+ */
+static IoStatus completeChannelReceive(VM *vm, int fd UNUSED, IoOp *op, Value *result) {
+    Mailbox *mailbox = (Mailbox *)op->arg;
+    mailboxDrainEvent(mailbox);
+
+    Value value = takeFromMailbox(vm, mailbox, op->size);
+    if (value.type == VT_UNDEFINED) {
+        if (mailboxPrepareWait(mailbox)) {
+            return IO_AGAIN;
+        }
+        value = takeFromMailbox(vm, mailbox, op->size);
+    }
+    *result = value;
+    return IO_DONE;
+}
+
+/**
+ * 从channel取值，channel为空时把当前线程挂起在其eventfd上
+ * @param vm
+ * @param args
+ * @param argNum 参数个数，不含接收者
+ * @param size 为0时取一个值，否则取至多size个值组成list
+ * @return
+ */
+static bool receiveFromChannel(VM *vm, Value *args, uint32_t argNum, uint32_t size) {
+    Mailbox *mailbox = ((ObjChannel *)VALUE_TO_OBJ(args[0]))->mailbox;
+    while (true) {
+        Value value = takeFromMailbox(vm, mailbox, size);
+        if (value.type != VT_UNDEFINED) {
+            RET_VALUE(value);
+        }
+        if (mailboxPrepareWait(mailbox)) {
+            break;
+        }
+    }
+
+    IoOp op = {IO_OP_CUSTOM, NULL, size, NULL, 0, completeChannelReceive, mailbox};
+    return finishOrPark(vm, args, argNum, IO_AGAIN, VT_TO_VALUE(VT_NULL), mailbox->eventFd, op);
+}
+
+/**
+ * Channel.new(capacity) 新建容量为capacity的channel，容量向上取整到2的幂
+ * channel可经Worker.send传给其它vm，各vm都可从中接收，每个值只被取走一次
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primChannelNew(VM *vm, Value *args) {
+    if (!validateInt(vm, args[1])) {
+        return false;
+    }
+    if (VALUE_TO_NUM(args[1]) < 1 || VALUE_TO_NUM(args[1]) > (1u << 30)) {
+        SET_ERROR_FALSE(vm, "capacity must be between 1 and 2^30!");
+    }
+    RET_OBJ(newObjChannel(vm, newMailbox((uint32_t)VALUE_TO_NUM(args[1]))));
+}
+
+/**
+ * channel.send(value) 发送value的副本，channel已满时返回false
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primChannelSend(VM *vm, Value *args) {
+    Mailbox *mailbox = ((ObjChannel *)VALUE_TO_OBJ(args[0]))->mailbox;
+    bool unsupported;
+    uint32_t sent = mailboxSend(vm, mailbox, &args[1], 1, &unsupported);
+    if (unsupported) {
+        SET_ERROR_FALSE(vm, "functions, threads, classes and modules can`t be sent!");
+    }
+    RET_BOOL(sent == 1);
+}
+
+/**
+ * channel.sendAll(list) 整批发送list中的元素，只做一次同步
+ * channel放不下时只发送前面的部分，返回实际发送的个数
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primChannelSendAll(VM *vm, Value *args) {
+    if (!VALUE_IS_CREATIN_OBJ(args[1], OT_LIST)) {
+        SET_ERROR_FALSE(vm, "argument must be list!");
+    }
+    Mailbox *mailbox = ((ObjChannel *)VALUE_TO_OBJ(args[0]))->mailbox;
+    ObjList *objList = VALUE_TO_OBJLIST(args[1]);
+    bool unsupported;
+    uint32_t sent = mailboxSend(vm, mailbox, objList->elements.datas, objList->elements.count, &unsupported);
+    if (unsupported) {
+        SET_ERROR_FALSE(vm, "functions, threads, classes and modules can`t be sent!");
+    }
+    RET_NUM(sent);
+}
+
+/**
+ * channel.receive() 接收一个值，channel为空时挂起当前线程
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primChannelReceive(VM *vm, Value *args) {
+    return receiveFromChannel(vm, args, 0, 0);
+}
+
+/**
+ * channel.receiveUpTo(n) 一次取走至多n个值组成list，channel为空时挂起当前线程
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primChannelReceiveUpTo(VM *vm, Value *args) {
+    if (!validateInt(vm, args[1])) {
+        return false;
+    }
+    if (VALUE_TO_NUM(args[1]) < 1) {
+        SET_ERROR_FALSE(vm, "n must be positive!");
+    }
+    double n = VALUE_TO_NUM(args[1]);
+    return receiveFromChannel(vm, args, 1, n > UINT32_MAX ? UINT32_MAX : (uint32_t)n);
+}
+
+/**
+ * channel.count 返回channel中的值的个数，仅供参考
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primChannelCount(VM *vm UNUSED, Value *args) {
+    RET_NUM(mailboxCount(((ObjChannel *)VALUE_TO_OBJ(args[0]))->mailbox));
+}
+
+/**
+ * channel.capacity 返回channel的容量
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primChannelCapacity(VM *vm UNUSED, Value *args) {
+    RET_NUM(((ObjChannel *)VALUE_TO_OBJ(args[0]))->mailbox->capacity);
+}
+
+/**
+ * string + other 拼接两个字符串，较长的结果是拼接串，首次读取字符时才展开，
+ * 循环中反复追加时总开销与结果长度成正比
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primStringPlus(VM *vm, Value *args) {
+    if (!validateString(vm, args[1])) {
+        return false;
+    }
+    RET_OBJ(newObjStringConcat(vm, VALUE_TO_OBJSTR(args[0]), VALUE_TO_OBJSTR(args[1])));
+}
+
+/**
+ * string.byteCount 返回字符串的字节数
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primStringByteCount(VM *vm UNUSED, Value *args) {
+    RET_NUM(VALUE_TO_OBJSTR(args[0])->value.length);
+}
+
+/**
+ * string.count 返回码点数，ASCII串为O(1)，其余首次调用时建立码点索引
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primStringCount(VM *vm, Value *args) {
+    ObjString *objString = flattenObjString(vm, VALUE_TO_OBJSTR(args[0]));
+    RET_NUM(objStringCodePointCount(vm, objString));
+}
+
+/**
+ * string[index] 返回第index个码点组成的字符串，负数从末尾倒数
+ * 单个码点的字符串取自驻留池，不分配
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primStringSubscript(VM *vm, Value *args) {
+    ObjString *objString = flattenObjString(vm, VALUE_TO_OBJSTR(args[0]));
+    uint32_t index;
+    if (!validateIndex(vm, args[1], objStringCodePointCount(vm, objString), &index)) {
+        return false;
+    }
+    uint32_t offset = objStringCodePointOffset(vm, objString, index);
+    uint32_t byteNum = getByteNumOfDecodeUtf8((uint8_t)objString->value.start[offset]);
+    if (byteNum == 0 || byteNum > objString->value.length - offset) {
+        byteNum = 1;
+    }
+    RET_OBJ(newObjString(vm, objString->value.start + offset, byteNum));
+}
+
+/**
+ * string.codePointAt(index) 返回第index个码点的值，不合法的UTF-8序列返回-1
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primStringCodePointAt(VM *vm, Value *args) {
+    ObjString *objString = flattenObjString(vm, VALUE_TO_OBJSTR(args[0]));
+    uint32_t index;
+    if (!validateIndex(vm, args[1], objStringCodePointCount(vm, objString), &index)) {
+        return false;
+    }
+    uint32_t offset = objStringCodePointOffset(vm, objString, index);
+    RET_NUM(decodeUtf8((const uint8_t *)objString->value.start + offset, objString->value.length - offset));
+}
+
+/**
+ * string.toString 返回自身
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primStringToString(VM *vm UNUSED, Value *args) {
+    RET_VALUE(args[0]);
+}
+
+/**
+ * StringBuilder.new() 新建空的StringBuilder
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primStringBuilderNew(VM *vm, Value *args) {
+    RET_OBJ(newObjStringBuilder(vm));
+}
+
+/**
+ * builder.append(str) 把str追加到末尾，返回builder以便连续追加
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primStringBuilderAppend(VM *vm, Value *args) {
+    if (!validateString(vm, args[1])) {
+        return false;
+    }
+    stringBuilderAppend(vm, (ObjStringBuilder *)VALUE_TO_OBJ(args[0]), VALUE_TO_OBJSTR(args[1]));
+    RET_VALUE(args[0]);
+}
+
+/**
+ * builder.count 返回已追加的字节数
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primStringBuilderCount(VM *vm UNUSED, Value *args) {
+    RET_NUM(((ObjStringBuilder *)VALUE_TO_OBJ(args[0]))->buffer.count);
+}
+
+/**
+ * builder.clear() 清空内容但保留容量，返回builder
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primStringBuilderClear(VM *vm UNUSED, Value *args) {
+    ((ObjStringBuilder *)VALUE_TO_OBJ(args[0]))->buffer.count = 0;
+    RET_VALUE(args[0]);
+}
+
+/**
+ * builder.toString 以当前内容新建字符串
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primStringBuilderToString(VM *vm, Value *args) {
+    RET_OBJ(stringBuilderToString(vm, (ObjStringBuilder *)VALUE_TO_OBJ(args[0])));
+}
+
+/**
+ * 校验arg是否为list
+ * @param vm
+ * @param arg
+ * @return
+ */
+static bool validateList(VM *vm, Value arg) {
+    if (VALUE_IS_CREATIN_OBJ(arg, OT_LIST)) {
+        return true;
+    }
+    SET_ERROR_FALSE(vm, "argument must be list!");
+}
+
+/**
+ * 校验list未被冻结
+ * @param vm
+ * @param objList
+ * @return
+ */
+static bool validateMutableList(VM *vm, ObjList *objList) {
+    if (!objList->objHeader.isFrozen) {
+        return true;
+    }
+    SET_ERROR_FALSE(vm, "can't modify a frozen list!");
+}
+
+/**
+ * 校验[start, start+num)是否在[0, length]内，start为负数时从末尾倒数
+ * @param vm
+ * @param startArg
+ * @param numArg
+ * @param length
+ * @param start
+ * @param num
+ * @return
+ */
+static bool validateRange(VM *vm, Value startArg, Value numArg, uint32_t length,
+                          uint32_t *start, uint32_t *num) {
+    if (!validateInt(vm, startArg) || !validateInt(vm, numArg)) {
+        return false;
+    }
+    double from = VALUE_TO_NUM(startArg);
+    double cnt = VALUE_TO_NUM(numArg);
+    if (from < 0) {
+        from += length;
+    }
+    if (from < 0 || cnt < 0 || from + cnt > length) {
+        SET_ERROR_FALSE(vm, "range out of bounds!");
+    }
+    *start = (uint32_t)from;
+    *num = (uint32_t)cnt;
+    return true;
+}
+
+/**
+ * List.new() 新建空list
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primListNew(VM *vm, Value *args UNUSED) {
+    RET_OBJ(newObjList(vm, 0));
+}
+
+/**
+ * 校验预留的元素个数，须为不超过MAX_RESERVE_NUM的非负整数
+ * @param vm
+ * @param arg
+ * @param result
+ * @return
+ */
+static bool validateCapacity(VM *vm, Value arg, uint32_t *result) {
+    if (!validateInt(vm, arg)) {
+        return false;
+    }
+    if (VALUE_TO_NUM(arg) < 0 || VALUE_TO_NUM(arg) > MAX_RESERVE_NUM) {
+        SET_ERROR_FALSE(vm, "capacity out of bounds!");
+    }
+    *result = (uint32_t)VALUE_TO_NUM(arg);
+    return true;
+}
+
+/**
+ * List.new(capacity) 新建空list并预留capacity个元素的空间
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primListNewWithCapacity(VM *vm, Value *args) {
+    uint32_t capacity;
+    if (!validateCapacity(vm, args[1], &capacity)) {
+        return false;
+    }
+    ObjList *objList = newObjList(vm, 0);
+    reserveList(vm, objList, capacity);
+    RET_OBJ(objList);
+}
+
+/**
+ * list.reserve(num) 预留空间，使list容纳num个元素前不再扩容，返回list本身
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primListReserve(VM *vm, Value *args) {
+    ObjList *objList = VALUE_TO_OBJLIST(args[0]);
+    uint32_t num;
+    if (!validateMutableList(vm, objList) || !validateCapacity(vm, args[1], &num)) {
+        return false;
+    }
+    if (num > objList->elements.count) {
+        reserveList(vm, objList, num - objList->elements.count);
+    }
+    RET_VALUE(args[0]);
+}
+
+/**
+ * list.count 返回元素个数
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primListCount(VM *vm UNUSED, Value *args) {
+    RET_NUM(VALUE_TO_OBJLIST(args[0])->elements.count);
+}
+
+/**
+ * list.iterate(iter) 迭代器为元素下标，没有下一个元素时返回false
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primListIterate(VM *vm, Value *args) {
+    ObjList *objList = VALUE_TO_OBJLIST(args[0]);
+    if (VALUE_IS_NULL(args[1])) {
+        if (objList->elements.count == 0) {
+            RET_FALSE;
+        }
+        RET_NUM(0);
+    }
+    if (!validateInt(vm, args[1])) {
+        return false;
+    }
+    double iter = VALUE_TO_NUM(args[1]);
+    if (iter < 0 || iter >= objList->elements.count - 1.0) {
+        RET_FALSE;
+    }
+    RET_NUM(iter + 1);
+}
+
+/**
+ * list.iteratorValue(iter) 返回迭代器所指的元素
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primListIteratorValue(VM *vm, Value *args) {
+    ObjList *objList = VALUE_TO_OBJLIST(args[0]);
+    uint32_t index;
+    if (!validateIndex(vm, args[1], objList->elements.count, &index)) {
+        return false;
+    }
+    RET_VALUE(objList->elements.datas[index]);
+}
+
+/**
+ * list[index] 返回第index个元素，负数从末尾倒数
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primListSubscript(VM *vm, Value *args) {
+    ObjList *objList = VALUE_TO_OBJLIST(args[0]);
+    uint32_t index;
+    if (!validateIndex(vm, args[1], objList->elements.count, &index)) {
+        return false;
+    }
+    RET_VALUE(objList->elements.datas[index]);
+}
+
+/**
+ * list[index] = value 设置第index个元素，负数从末尾倒数，返回value
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primListSubscriptSetter(VM *vm, Value *args) {
+    ObjList *objList = VALUE_TO_OBJLIST(args[0]);
+    uint32_t index;
+    if (!validateMutableList(vm, objList) ||
+        !validateIndex(vm, args[1], objList->elements.count, &index)) {
+        return false;
+    }
+    objList->elements.datas[index] = args[2];
+    RET_VALUE(args[2]);
+}
+
+/**
+ * list.add(value) 追加value，返回value
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primListAdd(VM *vm, Value *args) {
+    ObjList *objList = VALUE_TO_OBJLIST(args[0]);
+    if (!validateMutableList(vm, objList)) {
+        return false;
+    }
+    insertElement(vm, objList, objList->elements.count, args[1]);
+    RET_VALUE(args[1]);
+}
+
+/**
+ * list.addCore_(value) 供编译list字面量使用，追加value后返回list本身以便继续追加
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primListAddCore(VM *vm, Value *args) {
+    ObjList *objList = VALUE_TO_OBJLIST(args[0]);
+    if (!validateMutableList(vm, objList)) {
+        return false;
+    }
+    insertElement(vm, objList, objList->elements.count, args[1]);
+    RET_VALUE(args[0]);
+}
+
+/**
+ * list.insert(index, value) 在index处插入value，index可以等于count，负数从末尾倒数
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primListInsert(VM *vm, Value *args) {
+    ObjList *objList = VALUE_TO_OBJLIST(args[0]);
+    uint32_t index;
+    if (!validateMutableList(vm, objList) ||
+        !validateIndex(vm, args[1], objList->elements.count + 1, &index)) {
+        return false;
+    }
+    insertElement(vm, objList, index, args[2]);
+    RET_VALUE(args[2]);
+}
+
+/**
+ * list.removeAt(index) 删除并返回第index个元素
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primListRemoveAt(VM *vm, Value *args) {
+    ObjList *objList = VALUE_TO_OBJLIST(args[0]);
+    uint32_t index;
+    if (!validateMutableList(vm, objList) ||
+        !validateIndex(vm, args[1], objList->elements.count, &index)) {
+        return false;
+    }
+    RET_VALUE(removeElement(vm, objList, index));
+}
+
+/**
+ * list.addAll(other) 把other的元素整体追加到末尾，返回list
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primListAddAll(VM *vm, Value *args) {
+    ObjList *objList = VALUE_TO_OBJLIST(args[0]);
+    if (!validateMutableList(vm, objList) || !validateList(vm, args[1])) {
+        return false;
+    }
+    ObjList *other = VALUE_TO_OBJLIST(args[1]);
+    insertElements(vm, objList, objList->elements.count, other->elements.datas, other->elements.count);
+    RET_VALUE(args[0]);
+}
+
+/**
+ * list.insertAll(index, other) 在index处整体插入other的元素，返回list
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primListInsertAll(VM *vm, Value *args) {
+    ObjList *objList = VALUE_TO_OBJLIST(args[0]);
+    uint32_t index;
+    if (!validateMutableList(vm, objList) || !validateList(vm, args[2]) ||
+        !validateIndex(vm, args[1], objList->elements.count + 1, &index)) {
+        return false;
+    }
+    ObjList *other = VALUE_TO_OBJLIST(args[2]);
+    insertElements(vm, objList, index, other->elements.datas, other->elements.count);
+    RET_VALUE(args[0]);
+}
+
+/**
+ * list.removeRange(start, count) 删除从start起的count个元素，返回list
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primListRemoveRange(VM *vm, Value *args) {
+    ObjList *objList = VALUE_TO_OBJLIST(args[0]);
+    uint32_t start, num;
+    if (!validateMutableList(vm, objList) ||
+        !validateRange(vm, args[1], args[2], objList->elements.count, &start, &num)) {
+        return false;
+    }
+    removeRange(vm, objList, start, num);
+    RET_VALUE(args[0]);
+}
+
+/**
+ * list.slice(start, count) 返回从start起的count个元素组成的新list
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primListSlice(VM *vm, Value *args) {
+    ObjList *objList = VALUE_TO_OBJLIST(args[0]);
+    uint32_t start, num;
+    if (!validateRange(vm, args[1], args[2], objList->elements.count, &start, &num)) {
+        return false;
+    }
+    RET_OBJ(newObjListSlice(vm, objList, start, num));
+}
+
+/**
+ * list.sortNatural_() 元素全为数字或全为字符串时原地排序并返回true，否则返回false，
+ * 由脚本中的sort()回退到逐次调用比较函数的归并排序
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primListSortNatural(VM *vm, Value *args) {
+    ObjList *objList = VALUE_TO_OBJLIST(args[0]);
+    if (!validateMutableList(vm, objList)) {
+        return false;
+    }
+    RET_BOOL(sortListNatural(vm, objList));
+}
+
+/**
+ * list + other 返回两者拼接成的新list，只分配一次
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primListPlus(VM *vm, Value *args) {
+    if (!validateList(vm, args[1])) {
+        return false;
+    }
+    ObjList *left = VALUE_TO_OBJLIST(args[0]);
+    ObjList *right = VALUE_TO_OBJLIST(args[1]);
+    uint32_t leftNum = left->elements.count;
+    ObjList *objList = newObjList(vm, leftNum + right->elements.count);
+    if (leftNum > 0) {
+        memcpy(objList->elements.datas, left->elements.datas, leftNum * sizeof(Value));
+    }
+    if (right->elements.count > 0) {
+        memcpy(objList->elements.datas + leftNum, right->elements.datas, right->elements.count * sizeof(Value));
+    }
+    RET_OBJ(objList);
+}
+
+/**
+ * value是否可哈希，元组须每个元素都可哈希
+ * @param value
+ * @return
+ */
+static bool valueIsHashable(Value value) {
+    if (VALUE_IS_NULL(value) || VALUE_IS_FALSE(value) || VALUE_IS_TRUE(value) || VALUE_IS_NUM(value) ||
+        VALUE_IS_CREATIN_OBJ(value, OT_STRING) || VALUE_IS_CREATIN_OBJ(value, OT_RANGE) ||
+        VALUE_IS_CREATIN_OBJ(value, OT_CLASS)) {
+        return true;
+    }
+    if (!VALUE_IS_CREATIN_OBJ(value, OT_TUPLE)) {
+        return false;
+    }
+    ObjTuple *objTuple = VALUE_TO_OBJTUPLE(value);
+    // 已算出哈希码的元组必然可哈希
+    if (objTuple->hashCode != 0) {
+        return true;
+    }
+    uint32_t idx = 0;
+    while (idx < objTuple->length) {
+        if (!valueIsHashable(objTuple->elements[idx])) {
+            return false;
+        }
+        idx ++;
+    }
+    return true;
+}
+
+/**
+ * 校验arg是否可作为map的key
+ * @param vm
+ * @param arg
+ * @return
+ */
+static bool validateKey(VM *vm, Value arg) {
+    if (valueIsHashable(arg) || instanceIsHashable(vm, arg)) {
+        return true;
+    }
+    SET_ERROR_FALSE(vm, "key must be value type, tuple of value types or instance defining hashCode!");
+}
+
+/**
+ * 以实例为key时在脚本中运行其hashCode及==(_)，其中的错误已写入当前线程
+ * @param vm
+ * @return 出错时返回true
+ */
+static bool keyCallFailed(VM *vm) {
+    return !VALUE_IS_NULL(vm->curThread->errorObj);
+}
+
+/**
+ * 校验map未被冻结
+ * @param vm
+ * @param objMap
+ * @return
+ */
+static bool validateMutableMap(VM *vm, ObjMap *objMap) {
+    if (!objMap->objHeader.isFrozen) {
+        return true;
+    }
+    SET_ERROR_FALSE(vm, "can't modify a frozen map!");
+}
+
+/**
+ * Map.new() 新建空map
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primMapNew(VM *vm, Value *args UNUSED) {
+    RET_OBJ(newObjMap(vm));
+}
+
+/**
+ * Map.new(capacity) 新建空map并预留capacity个键值对的空间
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primMapNewWithCapacity(VM *vm, Value *args) {
+    uint32_t capacity;
+    if (!validateCapacity(vm, args[1], &capacity)) {
+        return false;
+    }
+    ObjMap *objMap = newObjMap(vm);
+    mapReserve(vm, objMap, capacity);
+    RET_OBJ(objMap);
+}
+
+/**
+ * map.reserve(num) 预留空间，使map容纳num个键值对前不再重建，返回map本身
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primMapReserve(VM *vm, Value *args) {
+    ObjMap *objMap = VALUE_TO_OBJMAP(args[0]);
+    uint32_t num;
+    if (!validateMutableMap(vm, objMap) || !validateCapacity(vm, args[1], &num)) {
+        return false;
+    }
+    mapReserve(vm, objMap, num);
+    if (keyCallFailed(vm)) {
+        return false;
+    }
+    RET_VALUE(args[0]);
+}
+
+/**
+ * map[key] 返回key对应的value，不存在时返回null
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primMapSubscript(VM *vm, Value *args) {
+    if (!validateKey(vm, args[1])) {
+        return false;
+    }
+    Value value = mapGet(vm, VALUE_TO_OBJMAP(args[0]), args[1]);
+    if (keyCallFailed(vm)) {
+        return false;
+    }
+    if (VALUE_IS_UNDEFINED(value)) {
+        RET_NULL;
+    }
+    RET_VALUE(value);
+}
+
+/**
+ * map[key] = value 新key排在最后，已有的key保持原来的位置
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primMapSubscriptSetter(VM *vm, Value *args) {
+    ObjMap *objMap = VALUE_TO_OBJMAP(args[0]);
+    if (!validateMutableMap(vm, objMap) || !validateKey(vm, args[1])) {
+        return false;
+    }
+    mapSet(vm, objMap, args[1], args[2]);
+    if (keyCallFailed(vm)) {
+        return false;
+    }
+    RET_VALUE(args[2]);
+}
+
+/**
+ * map.addCore_(key, value) 供编译map字面量使用，返回map本身以便继续添加
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primMapAddCore(VM *vm, Value *args) {
+    ObjMap *objMap = VALUE_TO_OBJMAP(args[0]);
+    if (!validateMutableMap(vm, objMap) || !validateKey(vm, args[1])) {
+        return false;
+    }
+    mapSet(vm, objMap, args[1], args[2]);
+    if (keyCallFailed(vm)) {
+        return false;
+    }
+    RET_VALUE(args[0]);
+}
+
+/**
+ * map.count 返回键值对个数
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primMapCount(VM *vm UNUSED, Value *args) {
+    RET_NUM(VALUE_TO_OBJMAP(args[0])->count);
+}
+
+/**
+ * map.containsKey(key)
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primMapContainsKey(VM *vm, Value *args) {
+    if (!validateKey(vm, args[1])) {
+        return false;
+    }
+    Value value = mapGet(vm, VALUE_TO_OBJMAP(args[0]), args[1]);
+    if (keyCallFailed(vm)) {
+        return false;
+    }
+    RET_BOOL(!VALUE_IS_UNDEFINED(value));
+}
+
+/**
+ * map.remove(key) 删除key并返回其value，不存在时返回null
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primMapRemove(VM *vm, Value *args) {
+    ObjMap *objMap = VALUE_TO_OBJMAP(args[0]);
+    if (!validateMutableMap(vm, objMap) || !validateKey(vm, args[1])) {
+        return false;
+    }
+    Value value = removeKey(vm, objMap, args[1]);
+    if (keyCallFailed(vm)) {
+        return false;
+    }
+    RET_VALUE(value);
+}
+
+/**
+ * map.clear() 删除全部键值对
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primMapClear(VM *vm, Value *args) {
+    ObjMap *objMap = VALUE_TO_OBJMAP(args[0]);
+    if (!validateMutableMap(vm, objMap)) {
+        return false;
+    }
+    clearMap(vm, objMap);
+    RET_NULL;
+}
+
+/**
+ * map.iterate(iter) 按插入顺序迭代，迭代器为entries的下标，只经过有效的entry
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primMapIterate(VM *vm, Value *args) {
+    ObjMap *objMap = VALUE_TO_OBJMAP(args[0]);
+    uint32_t entryIdx = 0;
+    if (!VALUE_IS_NULL(args[1])) {
+        if (!validateInt(vm, args[1])) {
+            return false;
+        }
+        if (VALUE_TO_NUM(args[1]) < 0) {
+            RET_FALSE;
+        }
+        entryIdx = (uint32_t)VALUE_TO_NUM(args[1]) + 1;
+    }
+    entryIdx = mapNextEntry(objMap, entryIdx);
+    if (entryIdx >= objMap->entryNum) {
+        RET_FALSE;
+    }
+    RET_NUM(entryIdx);
+}
+
+/**
+ * map.iteratorValue(iter) 返回迭代器所指的key
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primMapIteratorValue(VM *vm, Value *args) {
+    ObjMap *objMap = VALUE_TO_OBJMAP(args[0]);
+    uint32_t entryIdx;
+    if (!validateIndex(vm, args[1], objMap->entryNum, &entryIdx)) {
+        return false;
+    }
+    RET_VALUE(objMap->entries[entryIdx].key);
+}
+
+/**
+ * 按插入顺序收集map的key或value组成list
+ * @param vm
+ * @param objMap
+ * @param isKey
+ * @return
+ */
+static ObjList* collectMapEntries(VM *vm, ObjMap *objMap, bool isKey) {
+    ObjList *objList = newObjList(vm, objMap->count);
+    uint32_t entryIdx = mapNextEntry(objMap, 0);
+    uint32_t idx = 0;
+    while (entryIdx < objMap->entryNum) {
+        Entry *entry = &objMap->entries[entryIdx];
+        objList->elements.datas[idx ++] = isKey ? entry->key : entry->value;
+        entryIdx = mapNextEntry(objMap, entryIdx + 1);
+    }
+    return objList;
+}
+
+/**
+ * map.keys 按插入顺序返回全部key组成的list
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primMapKeys(VM *vm, Value *args) {
+    RET_OBJ(collectMapEntries(vm, VALUE_TO_OBJMAP(args[0]), true));
+}
+
+/**
+ * map.values 按插入顺序返回全部value组成的list
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primMapValues(VM *vm, Value *args) {
+    RET_OBJ(collectMapEntries(vm, VALUE_TO_OBJMAP(args[0]), false));
+}
+
+/**
+ * 校验arg是否为Set
+ * @param vm
+ * @param arg
+ * @return
+ */
+static bool validateSet(VM *vm, Value arg) {
+    if (VALUE_IS_CREATIN_OBJ(arg, OT_SET)) {
+        return true;
+    }
+    SET_ERROR_FALSE(vm, "argument must be set!");
+}
+
+/**
+ * Set.new() 新建空集合
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primSetNew(VM *vm, Value *args UNUSED) {
+    RET_OBJ(newObjSet(vm));
+}
+
+/**
+ * set.add(key) 加入key，返回是否为新加入
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primSetAdd(VM *vm, Value *args) {
+    if (!validateKey(vm, args[1])) {
+        return false;
+    }
+    bool result = setAdd(vm, VALUE_TO_OBJSET(args[0]), args[1]);
+    if (keyCallFailed(vm)) {
+        return false;
+    }
+    RET_BOOL(result);
+}
+
+/**
+ * set.contains(key)
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primSetContains(VM *vm, Value *args) {
+    if (!validateKey(vm, args[1])) {
+        return false;
+    }
+    bool result = setContains(vm, VALUE_TO_OBJSET(args[0]), args[1]);
+    if (keyCallFailed(vm)) {
+        return false;
+    }
+    RET_BOOL(result);
+}
+
+/**
+ * set.remove(key) 删除key，返回key是否存在
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primSetRemove(VM *vm, Value *args) {
+    if (!validateKey(vm, args[1])) {
+        return false;
+    }
+    bool result = setRemove(vm, VALUE_TO_OBJSET(args[0]), args[1]);
+    if (keyCallFailed(vm)) {
+        return false;
+    }
+    RET_BOOL(result);
+}
+
+/**
+ * set.count 返回元素个数
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primSetCount(VM *vm UNUSED, Value *args) {
+    RET_NUM(VALUE_TO_OBJSET(args[0])->count);
+}
+
+/**
+ * set.clear() 删除全部元素
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primSetClear(VM *vm, Value *args) {
+    clearSet(vm, VALUE_TO_OBJSET(args[0]));
+    RET_NULL;
+}
+
+/**
+ * set.union(other) 返回并集
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primSetUnion(VM *vm, Value *args) {
+    if (!validateSet(vm, args[1])) {
+        return false;
+    }
+    ObjSet *result = setUnion(vm, VALUE_TO_OBJSET(args[0]), VALUE_TO_OBJSET(args[1]));
+    if (keyCallFailed(vm)) {
+        return false;
+    }
+    RET_OBJ(result);
+}
+
+/**
+ * set.intersect(other) 返回交集
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primSetIntersect(VM *vm, Value *args) {
+    if (!validateSet(vm, args[1])) {
+        return false;
+    }
+    ObjSet *result = setIntersect(vm, VALUE_TO_OBJSET(args[0]), VALUE_TO_OBJSET(args[1]));
+    if (keyCallFailed(vm)) {
+        return false;
+    }
+    RET_OBJ(result);
+}
+
+/**
+ * set.difference(other) 返回差集，即在set中而不在other中的元素
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primSetDifference(VM *vm, Value *args) {
+    if (!validateSet(vm, args[1])) {
+        return false;
+    }
+    ObjSet *result = setDifference(vm, VALUE_TO_OBJSET(args[0]), VALUE_TO_OBJSET(args[1]));
+    if (keyCallFailed(vm)) {
+        return false;
+    }
+    RET_OBJ(result);
+}
+
+/**
+ * set.iterate(iter) 按插入顺序迭代，迭代器为keys的下标
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primSetIterate(VM *vm, Value *args) {
+    ObjSet *objSet = VALUE_TO_OBJSET(args[0]);
+    uint32_t keyIdx = 0;
+    if (!VALUE_IS_NULL(args[1])) {
+        if (!validateInt(vm, args[1])) {
+            return false;
+        }
+        if (VALUE_TO_NUM(args[1]) < 0) {
+            RET_FALSE;
+        }
+        keyIdx = (uint32_t)VALUE_TO_NUM(args[1]) + 1;
+    }
+    keyIdx = setNextKey(objSet, keyIdx);
+    if (keyIdx >= objSet->keyNum) {
+        RET_FALSE;
+    }
+    RET_NUM(keyIdx);
+}
+
+/**
+ * set.iteratorValue(iter) 返回迭代器所指的key
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primSetIteratorValue(VM *vm, Value *args) {
+    ObjSet *objSet = VALUE_TO_OBJSET(args[0]);
+    uint32_t keyIdx;
+    if (!validateIndex(vm, args[1], objSet->keyNum, &keyIdx)) {
+        return false;
+    }
+    RET_VALUE(objSet->keys[keyIdx]);
+}
+
+/**
+ * set.toList 按插入顺序返回全部元素组成的list
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primSetToList(VM *vm, Value *args) {
+    ObjSet *objSet = VALUE_TO_OBJSET(args[0]);
+    ObjList *objList = newObjList(vm, objSet->count);
+    uint32_t keyIdx = setNextKey(objSet, 0);
+    uint32_t idx = 0;
+    while (keyIdx < objSet->keyNum) {
+        objList->elements.datas[idx ++] = objSet->keys[keyIdx];
+        keyIdx = setNextKey(objSet, keyIdx + 1);
+    }
+    RET_OBJ(objList);
+}
+
+/**
+ * Tuple.fromList(list) 以list的元素新建元组
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primTupleFromList(VM *vm, Value *args) {
+    if (!validateList(vm, args[1])) {
+        return false;
+    }
+    ObjList *objList = VALUE_TO_OBJLIST(args[1]);
+    RET_OBJ(newObjTuple(vm, objList->elements.datas, objList->elements.count));
+}
+
+/**
+ * Tuple.new(a, b) 二元组
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primTupleNew2(VM *vm, Value *args) {
+    RET_OBJ(newObjTuple(vm, args + 1, 2));
+}
+
+/**
+ * Tuple.new(a, b, c) 三元组
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primTupleNew3(VM *vm, Value *args) {
+    RET_OBJ(newObjTuple(vm, args + 1, 3));
+}
+
+/**
+ * Tuple.new(a, b, c, d) 四元组
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primTupleNew4(VM *vm, Value *args) {
+    RET_OBJ(newObjTuple(vm, args + 1, 4));
+}
+
+/**
+ * tuple.count 返回元素个数
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primTupleCount(VM *vm UNUSED, Value *args) {
+    RET_NUM(VALUE_TO_OBJTUPLE(args[0])->length);
+}
+
+/**
+ * tuple[index] 负数从末尾算起
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primTupleSubscript(VM *vm, Value *args) {
+    ObjTuple *objTuple = VALUE_TO_OBJTUPLE(args[0]);
+    uint32_t index;
+    if (!validateIndex(vm, args[1], objTuple->length, &index)) {
+        return false;
+    }
+    RET_VALUE(objTuple->elements[index]);
+}
+
+/**
+ * tuple.hashCode 元素都可哈希时返回缓存的哈希码
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primTupleHashCode(VM *vm, Value *args) {
+    if (!validateKey(vm, args[0])) {
+        return false;
+    }
+    RET_NUM(tupleHash(vm, VALUE_TO_OBJTUPLE(args[0])));
+}
+
+/**
+ * tuple.toList 返回含同样元素的新list
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primTupleToList(VM *vm, Value *args) {
+    ObjTuple *objTuple = VALUE_TO_OBJTUPLE(args[0]);
+    ObjList *objList = newObjList(vm, objTuple->length);
+    if (objTuple->length > 0) {
+        memcpy(objList->elements.datas, objTuple->elements, sizeof(Value) * objTuple->length);
+    }
+    RET_OBJ(objList);
+}
+
+/**
+ * Vector.new() 新建空的持久化向量
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primVectorNew(VM *vm, Value *args UNUSED) {
+    RET_OBJ(newObjVector(vm));
+}
+
+/**
+ * Vector.fromList(list) 以暂态方式逐个追加list的元素
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primVectorFromList(VM *vm, Value *args) {
+    if (!validateList(vm, args[1])) {
+        return false;
+    }
+    ObjList *objList = VALUE_TO_OBJLIST(args[1]);
+    ObjVector *objVector = newObjVector(vm);
+    objVector->isTransient = true;
+    uint32_t idx = 0;
+    while (idx < objList->elements.count) {
+        vectorAdd(vm, objVector, objList->elements.datas[idx ++]);
+    }
+    objVector->isTransient = false;
+    RET_OBJ(objVector);
+}
+
+/**
+ * vector.count 返回元素个数
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primVectorCount(VM *vm UNUSED, Value *args) {
+    RET_NUM(VALUE_TO_OBJVECTOR(args[0])->count);
+}
+
+/**
+ * vector[index] 负数从末尾算起
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primVectorSubscript(VM *vm, Value *args) {
+    ObjVector *objVector = VALUE_TO_OBJVECTOR(args[0]);
+    uint32_t index;
+    if (!validateIndex(vm, args[1], objVector->count, &index)) {
+        return false;
+    }
+    RET_VALUE(vectorGet(objVector, index));
+}
+
+/**
+ * vector.set(index, value) 返回index处改为value的向量，原向量不变；暂态向量原地修改并返回自身
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primVectorSet(VM *vm, Value *args) {
+    ObjVector *objVector = VALUE_TO_OBJVECTOR(args[0]);
+    uint32_t index;
+    if (!validateIndex(vm, args[1], objVector->count, &index)) {
+        return false;
+    }
+    RET_OBJ(vectorSet(vm, objVector, index, args[2]));
+}
+
+/**
+ * vector.add(value) 返回末尾追加value的向量，暂态向量同set(_,_)
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primVectorAdd(VM *vm, Value *args) {
+    RET_OBJ(vectorAdd(vm, VALUE_TO_OBJVECTOR(args[0]), args[1]));
+}
+
+/**
+ * vector.removeLast 返回去掉最后一个元素的向量，暂态向量同set(_,_)
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primVectorRemoveLast(VM *vm, Value *args) {
+    ObjVector *objVector = VALUE_TO_OBJVECTOR(args[0]);
+    if (objVector->count == 0) {
+        SET_ERROR_FALSE(vm, "can't remove from an empty vector!");
+    }
+    RET_OBJ(vectorRemoveLast(vm, objVector));
+}
+
+/**
+ * vector.toTransient 返回共享节点的暂态向量，用于批量修改
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primVectorToTransient(VM *vm, Value *args) {
+    RET_OBJ(vectorTransient(vm, VALUE_TO_OBJVECTOR(args[0])));
+}
+
+/**
+ * vector.toPersistent 返回当前内容的持久化版本
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primVectorToPersistent(VM *vm, Value *args) {
+    RET_OBJ(vectorPersistent(vm, VALUE_TO_OBJVECTOR(args[0])));
+}
+
+/**
+ * vector.isTransient
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primVectorIsTransient(VM *vm UNUSED, Value *args) {
+    RET_BOOL(VALUE_TO_OBJVECTOR(args[0])->isTransient);
+}
+
+/**
+ * vector.toList 返回含同样元素的新list
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primVectorToList(VM *vm, Value *args) {
+    ObjVector *objVector = VALUE_TO_OBJVECTOR(args[0]);
+    ObjList *objList = newObjList(vm, objVector->count);
+    uint32_t idx = 0;
+    while (idx < objVector->count) {
+        objList->elements.datas[idx] = vectorGet(objVector, idx);
+        idx ++;
+    }
+    RET_OBJ(objList);
+}
+
+/**
+ * vector.iterate(iter) 迭代器为元素下标
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primVectorIterate(VM *vm, Value *args) {
+    ObjVector *objVector = VALUE_TO_OBJVECTOR(args[0]);
+    if (VALUE_IS_NULL(args[1])) {
+        if (objVector->count == 0) {
+            RET_FALSE;
+        }
+        RET_NUM(0);
+    }
+    if (!validateInt(vm, args[1])) {
+        return false;
+    }
+    double iter = VALUE_TO_NUM(args[1]);
+    if (iter < 0 || iter + 1 >= objVector->count) {
+        RET_FALSE;
+    }
+    RET_NUM(iter + 1);
+}
+
+/**
+ * vector.iteratorValue(iter) 返回迭代器所指的元素
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primVectorIteratorValue(VM *vm, Value *args) {
+    return primVectorSubscript(vm, args);
+}
+
+/**
+ * HashMap.new() 新建空的持久化哈希表
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primHashMapNew(VM *vm, Value *args UNUSED) {
+    RET_OBJ(newObjHashMap(vm));
+}
+
+/**
+ * hashMap.count 返回键值对个数
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primHashMapCount(VM *vm UNUSED, Value *args) {
+    RET_NUM(VALUE_TO_OBJHASHMAP(args[0])->count);
+}
+
+/**
+ * hashMap[key] 返回key对应的value，不存在时返回null
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primHashMapSubscript(VM *vm, Value *args) {
+    if (!validateKey(vm, args[1])) {
+        return false;
+    }
+    Value value = hashMapGet(vm, VALUE_TO_OBJHASHMAP(args[0]), args[1]);
+    if (keyCallFailed(vm)) {
+        return false;
+    }
+    if (VALUE_IS_UNDEFINED(value)) {
+        RET_NULL;
+    }
+    RET_VALUE(value);
+}
+
+/**
+ * hashMap.containsKey(key)
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primHashMapContainsKey(VM *vm, Value *args) {
+    if (!validateKey(vm, args[1])) {
+        return false;
+    }
+    Value value = hashMapGet(vm, VALUE_TO_OBJHASHMAP(args[0]), args[1]);
+    if (keyCallFailed(vm)) {
+        return false;
+    }
+    RET_BOOL(!VALUE_IS_UNDEFINED(value));
+}
+
+/**
+ * hashMap.set(key, value) 返回设置后的表，原表不变；暂态表原地修改并返回自身
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primHashMapSet(VM *vm, Value *args) {
+    if (!validateKey(vm, args[1])) {
+        return false;
+    }
+    ObjHashMap *result = hashMapSet(vm, VALUE_TO_OBJHASHMAP(args[0]), args[1], args[2]);
+    if (keyCallFailed(vm)) {
+        return false;
+    }
+    RET_OBJ(result);
+}
+
+/**
+ * hashMap.remove(key) 返回删除key后的表，暂态表同set(_,_)
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primHashMapRemove(VM *vm, Value *args) {
+    if (!validateKey(vm, args[1])) {
+        return false;
+    }
+    ObjHashMap *result = hashMapRemove(vm, VALUE_TO_OBJHASHMAP(args[0]), args[1]);
+    if (keyCallFailed(vm)) {
+        return false;
+    }
+    RET_OBJ(result);
+}
+
+/**
+ * hashMap.toTransient 返回共享节点的暂态表，用于批量修改
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primHashMapToTransient(VM *vm, Value *args) {
+    RET_OBJ(hashMapTransient(vm, VALUE_TO_OBJHASHMAP(args[0])));
+}
+
+/**
+ * hashMap.toPersistent 返回当前内容的持久化版本
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primHashMapToPersistent(VM *vm, Value *args) {
+    RET_OBJ(hashMapPersistent(vm, VALUE_TO_OBJHASHMAP(args[0])));
+}
+
+/**
+ * hashMap.isTransient
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primHashMapIsTransient(VM *vm UNUSED, Value *args) {
+    RET_BOOL(VALUE_TO_OBJHASHMAP(args[0])->isTransient);
+}
+
+/**
+ * hashMap.keys 返回全部key组成的list，顺序由哈希码决定
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primHashMapKeys(VM *vm, Value *args) {
+    ObjHashMap *objHashMap = VALUE_TO_OBJHASHMAP(args[0]);
+    ObjList *objList = newObjList(vm, objHashMap->count);
+    hashMapCollect(objHashMap, objList->elements.datas, NULL);
+    RET_OBJ(objList);
+}
+
+/**
+ * hashMap.values 返回全部value组成的list，与keys的顺序一致
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primHashMapValues(VM *vm, Value *args) {
+    ObjHashMap *objHashMap = VALUE_TO_OBJHASHMAP(args[0]);
+    ObjList *objList = newObjList(vm, objHashMap->count);
+    hashMapCollect(objHashMap, NULL, objList->elements.datas);
+    RET_OBJ(objList);
+}
+
+// 二元算术及比较运算，右操作数须为数字
+#define PRIM_NUM_INFIX(name, operator, type) \
+static bool name(VM *vm, Value *args) { \
+    if (!validateNum(vm, args[1])) { \
+        return false; \
+    } \
+    RET_##type(VALUE_TO_NUM(args[0]) operator VALUE_TO_NUM(args[1])); \
+}
+
+PRIM_NUM_INFIX(primNumPlus, +, NUM)
+PRIM_NUM_INFIX(primNumMinus, -, NUM)
+PRIM_NUM_INFIX(primNumMul, *, NUM)
+PRIM_NUM_INFIX(primNumDiv, /, NUM)
+PRIM_NUM_INFIX(primNumGt, >, BOOL)
+PRIM_NUM_INFIX(primNumGe, >=, BOOL)
+PRIM_NUM_INFIX(primNumLt, <, BOOL)
+PRIM_NUM_INFIX(primNumLe, <=, BOOL)
+#undef PRIM_NUM_INFIX
+
+// 位运算，操作数按32位无符号整数处理
+#define PRIM_NUM_BIT(name, operator) \
+static bool name(VM *vm, Value *args) { \
+    if (!validateNum(vm, args[1])) { \
+        return false; \
+    } \
+    uint32_t leftOperand = (uint32_t)VALUE_TO_NUM(args[0]); \
+    uint32_t rightOperand = (uint32_t)VALUE_TO_NUM(args[1]); \
+    RET_NUM(leftOperand operator rightOperand); \
+}
+
+PRIM_NUM_BIT(primNumBitAnd, &)
+PRIM_NUM_BIT(primNumBitOr, |)
+PRIM_NUM_BIT(primNumBitShiftRight, >>)
+PRIM_NUM_BIT(primNumBitShiftLeft, <<)
+#undef PRIM_NUM_BIT
+
+// 以数学函数mathFn计算数字本身
+#define PRIM_NUM_MATH_FN(name, mathFn) \
+static bool name(VM *vm UNUSED, Value *args) { \
+    RET_NUM(mathFn(VALUE_TO_NUM(args[0]))); \
+}
+
+PRIM_NUM_MATH_FN(primNumAbs, fabs)
+PRIM_NUM_MATH_FN(primNumCeil, ceil)
+PRIM_NUM_MATH_FN(primNumFloor, floor)
+PRIM_NUM_MATH_FN(primNumSqrt, sqrt)
+PRIM_NUM_MATH_FN(primNumTruncate, trunc)
+PRIM_NUM_MATH_FN(primNumNegate, -)
+#undef PRIM_NUM_MATH_FN
+
+/**
+ * num % other 取模，结果与被除数同号
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primNumMod(VM *vm, Value *args) {
+    if (!validateNum(vm, args[1])) {
+        return false;
+    }
+    RET_NUM(fmod(VALUE_TO_NUM(args[0]), VALUE_TO_NUM(args[1])));
+}
+
+/**
+ * ~num 按位取反
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primNumBitNot(VM *vm UNUSED, Value *args) {
+    RET_NUM(~((uint32_t)VALUE_TO_NUM(args[0])));
+}
+
+/**
+ * num.isInteger
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primNumIsInteger(VM *vm UNUSED, Value *args) {
+    double num = VALUE_TO_NUM(args[0]);
+    if (isnan(num) || isinf(num)) {
+        RET_FALSE;
+    }
+    RET_BOOL(trunc(num) == num);
+}
+
+/**
+ * 把数字转为字符串，整数不带小数部分
+ * @param vm
+ * @param num
+ * @return
+ */
+ObjString* num2str(VM *vm, double num) {
+    if (isnan(num)) {
+        return newObjString(vm, "nan", 3);
+    }
+    if (isinf(num)) {
+        return num > 0 ? newObjString(vm, "infinity", 8) : newObjString(vm, "-infinity", 9);
+    }
+
+    // %.14g最多14位有效数字，加上符号、小数点及指数部分不超过24个字符
+    char buf[24] = {'\0'};
+    int len = snprintf(buf, sizeof(buf), "%.14g", num);
+    return newObjString(vm, buf, len);
+}
+
+/**
+ * num.toString
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primNumToString(VM *vm, Value *args) {
+    RET_OBJ(num2str(vm, VALUE_TO_NUM(args[0])));
+}
+
+/**
+ * num..to 返回从num到to的range，含to，num大于to时倒序
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primNumRange(VM *vm, Value *args) {
+    if (!validateNum(vm, args[1])) {
+        return false;
+    }
+    double from = VALUE_TO_NUM(args[0]);
+    double to = VALUE_TO_NUM(args[1]);
+    RET_OBJ(newObjRange(vm, from, to, defaultRangeStep(from, to)));
+}
+
+/**
+ * range.from
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primRangeFrom(VM *vm UNUSED, Value *args) {
+    RET_NUM(VALUE_TO_OBJRANGE(args[0])->from);
+}
+
+/**
+ * range.to
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primRangeTo(VM *vm UNUSED, Value *args) {
+    RET_NUM(VALUE_TO_OBJRANGE(args[0])->to);
+}
+
+/**
+ * range.step
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primRangeStep(VM *vm UNUSED, Value *args) {
+    RET_NUM(VALUE_TO_OBJRANGE(args[0])->step);
+}
+
+/**
+ * range.by(step) 返回起止相同、步长为step的新range，如(0..10).by(2)
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primRangeBy(VM *vm, Value *args) {
+    if (!validateNum(vm, args[1])) {
+        return false;
+    }
+    if (VALUE_TO_NUM(args[1]) == 0) {
+        SET_ERROR_FALSE(vm, "range step can`t be zero!");
+    }
+    ObjRange *objRange = VALUE_TO_OBJRANGE(args[0]);
+    RET_OBJ(newObjRange(vm, objRange->from, objRange->to, VALUE_TO_NUM(args[1])));
+}
+
+/**
+ * range.iterate(iter) 返回下一个值，迭代结束时返回false
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primRangeIterate(VM *vm, Value *args) {
+    if (!VALUE_IS_NULL(args[1]) && !validateNum(vm, args[1])) {
+        return false;
+    }
+    RET_VALUE(rangeIterate(VALUE_TO_OBJRANGE(args[0]), args[1]));
+}
+
+/**
+ * range.iteratorValue(iter) range的迭代器就是当前值
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primRangeIteratorValue(VM *vm UNUSED, Value *args) {
+    RET_VALUE(args[1]);
+}
+
+/**
+ * seq的类中索引为methodIndex的方法是否仍为原生方法primFn，即未被脚本改写
+ * @param seq
+ * @param methodIndex
+ * @param primFn
+ * @return
+ */
+static bool isUnmodifiedRangeMethod(Value seq, uint32_t methodIndex, Primitive primFn) {
+    if (!VALUE_IS_CREATIN_OBJ(seq, OT_RANGE)) {
+        return false;
+    }
+    Class *class = VALUE_TO_OBJ(seq)->class;
+    return methodIndex < class->methods.count &&
+           class->methods.datas[methodIndex].type == MT_PRIMITIVE &&
+           class->methods.datas[methodIndex].primFn == primFn;
+}
+
+/**
+ * OPCODE_ITERATE的快速路径：seq为range且iterate(_)未被改写时直接计算下一个值，
+ * 不压栈、不派发方法，也不分配
+ * @param seq
+ * @param iter
+ * @param methodIndex iterate(_)的方法索引
+ * @param result 下一个值或false
+ * @return 不适用快速路径时返回false，解释器退回到普通的方法调用
+ */
+bool rangeIterateFast(Value seq, Value iter, uint32_t methodIndex, Value *result) {
+    if (!isUnmodifiedRangeMethod(seq, methodIndex, (Primitive)primRangeIterate) ||
+        !(VALUE_IS_NULL(iter) || VALUE_IS_NUM(iter))) {
+        return false;
+    }
+    *result = rangeIterate(VALUE_TO_OBJRANGE(seq), iter);
+    return true;
+}
+
+/**
+ * OPCODE_ITERATOR_VALUE的快速路径，range的值就是迭代器
+ * @param seq
+ * @param iter
+ * @param methodIndex iteratorValue(_)的方法索引
+ * @param result
+ * @return 不适用快速路径时返回false
+ */
+bool rangeIteratorValueFast(Value seq, Value iter, uint32_t methodIndex, Value *result) {
+    if (!isUnmodifiedRangeMethod(seq, methodIndex, (Primitive)primRangeIteratorValue)) {
+        return false;
+    }
+    *result = iter;
+    return true;
+}
+
+/**
+ * 返回数值数组类对应的元素类型
+ * @param vm
+ * @param class
+ * @return
+ */
+static TypedArrayKind typedArrayKindOf(VM *vm, Class *class) {
+    if (class == vm->float64ArrayClass) {
+        return TA_FLOAT64;
+    }
+    return class == vm->int32ArrayClass ? TA_INT32 : TA_BYTE;
+}
+
+/**
+ * 校验arg是否为与array同类型的数值数组
+ * @param vm
+ * @param array
+ * @param arg
+ * @return
+ */
+static bool validateSameTypedArray(VM *vm, ObjTypedArray *array, Value arg) {
+    if (VALUE_IS_CREATIN_OBJ(arg, OT_TYPED_ARRAY) && VALUE_TO_OBJTYPEDARRAY(arg)->kind == array->kind) {
+        return true;
+    }
+    SET_ERROR_FALSE(vm, "argument must be typed array of the same kind!");
+}
+
+/**
+ * Float64Array.new(length) 新建length个元素的数组，元素为0，Int32Array及ByteArray同
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primTypedArrayNew(VM *vm, Value *args) {
+    if (!validateInt(vm, args[1])) {
+        return false;
+    }
+    if (VALUE_TO_NUM(args[1]) < 0 || VALUE_TO_NUM(args[1]) > UINT32_MAX) {
+        SET_ERROR_FALSE(vm, "length out of bounds!");
+    }
+    TypedArrayKind kind = typedArrayKindOf(vm, VALUE_TO_CLASS(args[0]));
+    RET_OBJ(newObjTypedArray(vm, kind, (uint32_t)VALUE_TO_NUM(args[1])));
+}
+
+/**
+ * Float64Array.fromList(list) 以list中的数字新建数组
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primTypedArrayFromList(VM *vm, Value *args) {
+    if (!validateList(vm, args[1])) {
+        return false;
+    }
+    ObjList *objList = VALUE_TO_OBJLIST(args[1]);
+    uint32_t idx = 0;
+    while (idx < objList->elements.count) {
+        if (!validateNum(vm, objList->elements.datas[idx])) {
+            return false;
+        }
+        idx ++;
+    }
+    TypedArrayKind kind = typedArrayKindOf(vm, VALUE_TO_CLASS(args[0]));
+    ObjTypedArray *array = newObjTypedArray(vm, kind, objList->elements.count);
+    idx = 0;
+    while (idx < objList->elements.count) {
+        typedArraySet(array, idx, VALUE_TO_NUM(objList->elements.datas[idx]));
+        idx ++;
+    }
+    RET_OBJ(array);
+}
+
+/**
+ * array.count 返回元素个数
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primTypedArrayCount(VM *vm UNUSED, Value *args) {
+    RET_NUM(VALUE_TO_OBJTYPEDARRAY(args[0])->length);
+}
+
+/**
+ * array[index] 返回第index个元素，负数从末尾倒数
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primTypedArraySubscript(VM *vm, Value *args) {
+    ObjTypedArray *array = VALUE_TO_OBJTYPEDARRAY(args[0]);
+    uint32_t index;
+    if (!validateIndex(vm, args[1], array->length, &index)) {
+        return false;
+    }
+    RET_NUM(typedArrayGet(array, index));
+}
+
+/**
+ * array[index] = num 设置第index个元素，整数数组按二进制补码截断
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primTypedArraySubscriptSetter(VM *vm, Value *args) {
+    ObjTypedArray *array = VALUE_TO_OBJTYPEDARRAY(args[0]);
+    uint32_t index;
+    if (!validateIndex(vm, args[1], array->length, &index) || !validateNum(vm, args[2])) {
+        return false;
+    }
+    typedArraySet(array, index, VALUE_TO_NUM(args[2]));
+    RET_VALUE(args[2]);
+}
+
+/**
+ * array.sum 返回元素之和
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primTypedArraySum(VM *vm UNUSED, Value *args) {
+    RET_NUM(typedArraySum(VALUE_TO_OBJTYPEDARRAY(args[0])));
+}
+
+/**
+ * array.min 返回最小元素，空数组报错
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primTypedArrayMin(VM *vm, Value *args) {
+    ObjTypedArray *array = VALUE_TO_OBJTYPEDARRAY(args[0]);
+    if (array->length == 0) {
+        SET_ERROR_FALSE(vm, "typed array is empty!");
+    }
+    RET_NUM(typedArrayMin(array));
+}
+
+/**
+ * array.max 返回最大元素，空数组报错
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primTypedArrayMax(VM *vm, Value *args) {
+    ObjTypedArray *array = VALUE_TO_OBJTYPEDARRAY(args[0]);
+    if (array->length == 0) {
+        SET_ERROR_FALSE(vm, "typed array is empty!");
+    }
+    RET_NUM(typedArrayMax(array));
+}
+
+/**
+ * array.dot(other) 返回与同类型同长度数组的点积
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primTypedArrayDot(VM *vm, Value *args) {
+    ObjTypedArray *array = VALUE_TO_OBJTYPEDARRAY(args[0]);
+    if (!validateSameTypedArray(vm, array, args[1])) {
+        return false;
+    }
+    if (VALUE_TO_OBJTYPEDARRAY(args[1])->length != array->length) {
+        SET_ERROR_FALSE(vm, "typed arrays must have the same length!");
+    }
+    RET_NUM(typedArrayDot(array, VALUE_TO_OBJTYPEDARRAY(args[1])));
+}
+
+/**
+ * array.scale(factor) 每个元素乘以factor，返回array
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primTypedArrayScale(VM *vm, Value *args) {
+    if (!validateNum(vm, args[1])) {
+        return false;
+    }
+    typedArrayScale(VALUE_TO_OBJTYPEDARRAY(args[0]), VALUE_TO_NUM(args[1]));
+    RET_VALUE(args[0]);
+}
+
+/**
+ * array.add(other) 逐个元素加上同类型同长度数组other中的元素，返回array
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primTypedArrayAdd(VM *vm, Value *args) {
+    ObjTypedArray *array = VALUE_TO_OBJTYPEDARRAY(args[0]);
+    if (!validateSameTypedArray(vm, array, args[1])) {
+        return false;
+    }
+    if (VALUE_TO_OBJTYPEDARRAY(args[1])->length != array->length) {
+        SET_ERROR_FALSE(vm, "typed arrays must have the same length!");
+    }
+    typedArrayAdd(array, VALUE_TO_OBJTYPEDARRAY(args[1]));
+    RET_VALUE(args[0]);
+}
+
+/**
+ * array.fill(num) 把所有元素置为num，返回array
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primTypedArrayFill(VM *vm, Value *args) {
+    if (!validateNum(vm, args[1])) {
+        return false;
+    }
+    typedArrayFill(VALUE_TO_OBJTYPEDARRAY(args[0]), VALUE_TO_NUM(args[1]));
+    RET_VALUE(args[0]);
+}
+
+/**
+ * array.copyFrom(index, other) 把other的全部元素拷贝到index起的位置，返回array
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primTypedArrayCopyFrom(VM *vm, Value *args) {
+    ObjTypedArray *array = VALUE_TO_OBJTYPEDARRAY(args[0]);
+    uint32_t index, num;
+    if (!validateSameTypedArray(vm, array, args[2]) ||
+        !validateRange(vm, args[1], NUM_TO_VALUE(VALUE_TO_OBJTYPEDARRAY(args[2])->length), array->length, &index, &num)) {
+        return false;
+    }
+    typedArrayCopy(array, index, VALUE_TO_OBJTYPEDARRAY(args[2]));
+    RET_VALUE(args[0]);
+}
+
+/**
+ * array.slice(start, count) 返回从start起count个元素的切片，与array共享数据，不拷贝
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primTypedArraySlice(VM *vm, Value *args) {
+    ObjTypedArray *array = VALUE_TO_OBJTYPEDARRAY(args[0]);
+    uint32_t start, num;
+    if (!validateRange(vm, args[1], args[2], array->length, &start, &num)) {
+        return false;
+    }
+    RET_OBJ(newTypedArraySlice(vm, array, start, num));
+}
+
+/**
+ * array.equals(other) 类型、长度及各元素均相同时返回true
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primTypedArrayEquals(VM *vm UNUSED, Value *args) {
+    if (!VALUE_IS_CREATIN_OBJ(args[1], OT_TYPED_ARRAY)) {
+        RET_FALSE;
+    }
+    RET_BOOL(typedArrayEquals(VALUE_TO_OBJTYPEDARRAY(args[0]), VALUE_TO_OBJTYPEDARRAY(args[1])));
+}
+
+/**
+ * array.toList 返回由各元素组成的list
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primTypedArrayToList(VM *vm, Value *args) {
+    ObjTypedArray *array = VALUE_TO_OBJTYPEDARRAY(args[0]);
+    ObjList *objList = newObjList(vm, array->length);
+    uint32_t idx = 0;
+    while (idx < array->length) {
+        objList->elements.datas[idx] = NUM_TO_VALUE(typedArrayGet(array, idx));
+        idx ++;
+    }
+    RET_OBJ(objList);
+}
+
+/**
+ * 为数值数组类绑定原生方法
+ * @param vm
+ * @param class
+ */
+static void bindTypedArrayMethods(VM *vm, Class *class) {
+    PRIM_METHOD_BIND(class->objHeader.class, "new(_)", primTypedArrayNew);
+    PRIM_METHOD_BIND(class->objHeader.class, "fromList(_)", primTypedArrayFromList);
+    PRIM_METHOD_BIND(class, "count", primTypedArrayCount);
+    PRIM_METHOD_BIND(class, "[_]", primTypedArraySubscript);
+    PRIM_METHOD_BIND(class, "[_]=(_)", primTypedArraySubscriptSetter);
+    PRIM_METHOD_BIND(class, "sum", primTypedArraySum);
+    PRIM_METHOD_BIND(class, "min", primTypedArrayMin);
+    PRIM_METHOD_BIND(class, "max", primTypedArrayMax);
+    PRIM_METHOD_BIND(class, "dot(_)", primTypedArrayDot);
+    PRIM_METHOD_BIND(class, "scale(_)", primTypedArrayScale);
+    PRIM_METHOD_BIND(class, "add(_)", primTypedArrayAdd);
+    PRIM_METHOD_BIND(class, "fill(_)", primTypedArrayFill);
+    PRIM_METHOD_BIND(class, "copyFrom(_,_)", primTypedArrayCopyFrom);
+    PRIM_METHOD_BIND(class, "slice(_,_)", primTypedArraySlice);
+    PRIM_METHOD_BIND(class, "equals(_)", primTypedArrayEquals);
+    PRIM_METHOD_BIND(class, "toList", primTypedArrayToList);
+}
+
+/**
+ * Shared.freeze(value) 把value深拷贝到共享堆，返回只读的副本
+ * 副本可以发给其它vm而无须拷贝，修改它会报运行时错误
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primSharedFreeze(VM *vm, Value *args) {
+    Value frozen = freezeValue(vm, args[1]);
+    if (frozen.type == VT_UNDEFINED) {
+        SET_ERROR_FALSE(vm, "only null, bool, num, string, range and list or map of them can be frozen!");
+    }
+    RET_VALUE(frozen);
+}
+
+/**
+ * Shared.isFrozen(value) value是否只读，null、bool及数字总是只读
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primSharedIsFrozen(VM *vm UNUSED, Value *args) {
+    RET_BOOL(valueIsFrozen(args[1]));
+}
+
+/**
+ * Shared.bytes 返回共享堆已占用的字节数
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primSharedBytes(VM *vm UNUSED, Value *args) {
+    RET_NUM(sharedHeapBytes());
+}
+
+/**
+ * 导入模块moduleName，已导入的返回null，否则返回执行该模块的线程
+ * 已预编译的模块虽已在vm->allModules中，但尚未执行，仍须载入
+ * @param vm
+ * @param moduleName
+ * @return
+ */
+static Value importModule(VM *vm, Value moduleName) {
+    bool preloaded = vm->preloadedFns != NULL && !VALUE_IS_UNDEFINED(mapGet(vm, vm->preloadedFns, moduleName));
+    if (!preloaded && getModule(vm, moduleName) != NULL) {
+        return VT_TO_VALUE(VT_NULL);
+    }
+
+    // 源码随模块保留，延迟编译的函数体会引用它
+    const char *sourceCode = NULL;
+    if (!preloaded) {
+        ObjString *name = flattenObjString(vm, VALUE_TO_OBJSTR(moduleName));
+        sourceCode = readModuleSource(name->value.start);
+    }
+    ObjThread *moduleThread = loadModule(vm, moduleName, sourceCode);
+    return OBJ_TO_VALUE(moduleThread);
+}
+
+/**
+ * System.importModule(moduleName) 导入并执行模块，执行完后回到当前线程
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primSystemImportModule(VM *vm, Value *args) {
+    if (!validateString(vm, args[1])) {
+        return false;
+    }
+
+    Value result = importModule(vm, args[1]);
+    if (VALUE_IS_NULL(result)) {
+        RET_NULL;
+    }
+
+    // 回收参数的空间，模块线程结束时返回值写入args[0]
+    vm->curThread->esp --;
+    ObjThread *nextThread = VALUE_TO_OBJTHREAD(result);
+    nextThread->caller = vm->curThread;
+    vm->curThread = nextThread;
+    return false;
+}
+
+/**
+ * System.getModuleVariable(moduleName, variableName) 获取已导入模块中的模块变量
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primSystemGetModuleVariable(VM *vm, Value *args) {
+    if (!validateString(vm, args[1]) || !validateString(vm, args[2])) {
+        return false;
+    }
+
+    ObjModule *objModule = getModule(vm, args[1]);
+    if (objModule == NULL) {
+        SET_ERROR_FALSE(vm, "module is not loaded!");
+    }
+
+    ObjString *varName = VALUE_TO_OBJSTR(args[2]);
+    int index = getIndexFromSymbolTable(&objModule->moduleVarName, varName->value.start, varName->value.length);
+    if (index == -1) {
+        SET_ERROR_FALSE(vm, "variable is not defined in module!");
+    }
+    RET_VALUE(objModule->moduelVarValue.datas[index]);
+}
+
+/**
+ * System.clock 返回以秒为单位的单调时钟
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primSystemClock(VM *vm UNUSED, Value *args) {
+    RET_NUM((double)getNowNs() / 1000000000.0);
+}
+
+/**
+ * System.writeString_(str) 把字符串输出到标准输出
+ * @param vm
+ * @param args
+ * @return
+ */
+static bool primSystemWriteString(VM *vm, Value *args) {
+    if (!validateString(vm, args[1])) {
+        return false;
+    }
+    ObjString *objString = VALUE_TO_OBJSTR(args[1]);
+    fwrite(objString->value.start, 1, objString->value.length, stdout);
+    RET_VALUE(args[1]);
+}
+
+/**
+ * @brief 编译核心模块
+ *
+ * @param vm
+ */
+void buildCore(VM *vm) {
+    // 创建核心模块 录入到vm->allModules
+    ObjModule *coreModule = newObjModule(vm, NULL);
+
+    // 创建核心模块
+    mapSet(vm, vm->allModules, CORE_MODULE, OBJ_TO_VALUE(coreModule));
+
+    // 创建object类并绑定方法
+    vm->objectClass = defineClass(vm, coreModule, "object");
+    PRIM_METHOD_BIND(vm->objectClass, "!", primObjectNot);
+    PRIM_METHOD_BIND(vm->objectClass, "==(_)", primObjectEqual);
+    PRIM_METHOD_BIND(vm->objectClass, "!=(_)", primObjectNotEqual);
+    PRIM_METHOD_BIND(vm->objectClass, "is(_)", primObjectIs);
+    PRIM_METHOD_BIND(vm->objectClass, "toString", primObjectToString);
+    PRIM_METHOD_BIND(vm->objectClass, "type", primObjectType);
+    vm->equalIndex = ensureSymbolExist(vm, &vm->allMethodNames, "==(_)", 5);
+    vm->hashCodeIndex = ensureSymbolExist(vm, &vm->allMethodNames, "hashCode", 8);
+    vm->toStringIndex = ensureSymbolExist(vm, &vm->allMethodNames, "toString", 8);
+
+    // 定义classOfClass类
+    vm->classOfClass = defineClass(vm, coreModule, "class");
+
+    // objectClass是任何类的基类
+    bindSuperClass(vm, vm->classOfClass, vm->objectClass);
+    PRIM_METHOD_BIND(vm->classOfClass, "name", primClassName);
+    PRIM_METHOD_BIND(vm->classOfClass, "supertype", primClassSupertype);
+    PRIM_METHOD_BIND(vm->classOfClass, "toString", primClassToString);
+
+    // 定义object类的元信息类，他无需挂在到vm
+    Class *objectMetaclass = defineClass(vm, coreModule, "objectMeta");
+    bindSuperClass(vm, objectMetaclass, vm->classOfClass);
+
+    // 类型比较
+    PRIM_METHOD_BIND(objectMetaclass, "same(_,_)", primObjectmetaSame);
+
+    // 绑定各自的meta类
+    vm->objectClass->objHeader.class = objectMetaclass;
+    objectMetaclass->objHeader.class = vm->classOfClass;
+    vm->classOfClass->objHeader.class = vm->classOfClass;
+
+    // 执行核心模块
+    if (executeModule(vm, CORE_MODULE, coreModuleCode) != VM_RESULT_SUCCESS) {
+        RUN_ERROR("build core module failed!");
+    }
+
+    // Null类和Bool类
+    vm->nullClass = VALUE_TO_CLASS(getCoreClassValue(coreModule, "Null"));
+    PRIM_METHOD_BIND(vm->nullClass, "!", primNullNot);
+    PRIM_METHOD_BIND(vm->nullClass, "toString", primNullToString);
+
+    vm->boolClass = VALUE_TO_CLASS(getCoreClassValue(coreModule, "Bool"));
+    PRIM_METHOD_BIND(vm->boolClass, "!", primBoolNot);
+    PRIM_METHOD_BIND(vm->boolClass, "toString", primBoolToString);
+
+    // Fn类，call的各个重载由解释器直接调用闭包
+    vm->fnClass = VALUE_TO_CLASS(getCoreClassValue(coreModule, "Fn"));
+    PRIM_METHOD_BIND(vm->fnClass->objHeader.class, "new(_)", primFnNew);
+    bindFnOverloadCall(vm, "call()");
+    bindFnOverloadCall(vm, "call(_)");
+    bindFnOverloadCall(vm, "call(_,_)");
+    bindFnOverloadCall(vm, "call(_,_,_)");
+    bindFnOverloadCall(vm, "call(_,_,_,_)");
+    bindFnOverloadCall(vm, "call(_,_,_,_,_)");
+    bindFnOverloadCall(vm, "call(_,_,_,_,_,_)");
+    bindFnOverloadCall(vm, "call(_,_,_,_,_,_,_)");
+    bindFnOverloadCall(vm, "call(_,_,_,_,_,_,_,_)");
+    bindFnOverloadCall(vm, "call(_,_,_,_,_,_,_,_,_)");
+    bindFnOverloadCall(vm, "call(_,_,_,_,_,_,_,_,_,_)");
+    bindFnOverloadCall(vm, "call(_,_,_,_,_,_,_,_,_,_,_)");
+    bindFnOverloadCall(vm, "call(_,_,_,_,_,_,_,_,_,_,_,_)");
+    bindFnOverloadCall(vm, "call(_,_,_,_,_,_,_,_,_,_,_,_,_)");
+    bindFnOverloadCall(vm, "call(_,_,_,_,_,_,_,_,_,_,_,_,_,_)");
+    bindFnOverloadCall(vm, "call(_,_,_,_,_,_,_,_,_,_,_,_,_,_,_)");
+    bindFnOverloadCall(vm, "call(_,_,_,_,_,_,_,_,_,_,_,_,_,_,_,_)");
+
+    // System类，方法均为类方法
+    Class *systemClass = VALUE_TO_CLASS(getCoreClassValue(coreModule, "System"));
+    PRIM_METHOD_BIND(systemClass->objHeader.class, "clock", primSystemClock);
+    PRIM_METHOD_BIND(systemClass->objHeader.class, "importModule(_)", primSystemImportModule);
+    PRIM_METHOD_BIND(systemClass->objHeader.class, "getModuleVariable(_,_)", primSystemGetModuleVariable);
+    PRIM_METHOD_BIND(systemClass->objHeader.class, "writeString_(_)", primSystemWriteString);
+
+    // Thread类
+    vm->threadClass = VALUE_TO_CLASS(getCoreClassValue(coreModule, "Thread"));
+    // 以下是类方法
+    PRIM_METHOD_BIND(vm->threadClass->objHeader.class, "new(_)", primThreadNew);
+    PRIM_METHOD_BIND(vm->threadClass->objHeader.class, "abort(_)", primThreadAbort);
+    PRIM_METHOD_BIND(vm->threadClass->objHeader.class, "current", primThreadCurrent);
+    PRIM_METHOD_BIND(vm->threadClass->objHeader.class, "suspend()", primThreadSuspend);
+    PRIM_METHOD_BIND(vm->threadClass->objHeader.class, "yield(_)", primThreadYieldWithArg);
+    PRIM_METHOD_BIND(vm->threadClass->objHeader.class, "yield()", primThreadYieldWithoutArg);
+    // 以下是实例方法
+    PRIM_METHOD_BIND(vm->threadClass, "call()", primThreadCallWithoutArg);
+    PRIM_METHOD_BIND(vm->threadClass, "call(_)", primThreadCallWithArg);
+    PRIM_METHOD_BIND(vm->threadClass, "transfer()", primThreadTransferWithoutArg);
+    PRIM_METHOD_BIND(vm->threadClass, "transfer(_)", primThreadTransferWithArg);
+    PRIM_METHOD_BIND(vm->threadClass, "schedule()", primThreadSchedule);
+    PRIM_METHOD_BIND(vm->threadClass, "isDone", primThreadIsDone);
+
+    // IO类，方法均为类方法，fd以数字表示
+    Class *ioClass = VALUE_TO_CLASS(getCoreClassValue(coreModule, "IO"));
+    PRIM_METHOD_BIND(ioClass->objHeader.class, "pipe()", primIoPipe);
+    PRIM_METHOD_BIND(ioClass->objHeader.class, "socketPair()", primIoSocketPair);
+    PRIM_METHOD_BIND(ioClass->objHeader.class, "listen(_)", primIoListen);
+    PRIM_METHOD_BIND(ioClass->objHeader.class, "port(_)", primIoPort);
+    PRIM_METHOD_BIND(ioClass->objHeader.class, "connect(_)", primIoConnect);
+    PRIM_METHOD_BIND(ioClass->objHeader.class, "accept(_)", primIoAccept);
+    PRIM_METHOD_BIND(ioClass->objHeader.class, "read(_,_)", primIoRead);
+    PRIM_METHOD_BIND(ioClass->objHeader.class, "write(_,_)", primIoWrite);
+    PRIM_METHOD_BIND(ioClass->objHeader.class, "sleep(_)", primIoSleep);
+    PRIM_METHOD_BIND(ioClass->objHeader.class, "close(_)", primIoClose);
+
+    // Worker类，在worker池中运行的模块经它与宿主及其它worker通信
+    Class *workerClass = VALUE_TO_CLASS(getCoreClassValue(coreModule, "Worker"));
+    PRIM_METHOD_BIND(workerClass->objHeader.class, "id", primWorkerId);
+    PRIM_METHOD_BIND(workerClass->objHeader.class, "count", primWorkerCount);
+    PRIM_METHOD_BIND(workerClass->objHeader.class, "send(_)", primWorkerSend);
+    PRIM_METHOD_BIND(workerClass->objHeader.class, "sendTo(_,_)", primWorkerSendTo);
+    PRIM_METHOD_BIND(workerClass->objHeader.class, "receive()", primWorkerReceive);
+
+    // Channel类
+    vm->channelClass = VALUE_TO_CLASS(getCoreClassValue(coreModule, "Channel"));
+    PRIM_METHOD_BIND(vm->channelClass->objHeader.class, "new(_)", primChannelNew);
+    PRIM_METHOD_BIND(vm->channelClass, "send(_)", primChannelSend);
+    PRIM_METHOD_BIND(vm->channelClass, "sendAll(_)", primChannelSendAll);
+    PRIM_METHOD_BIND(vm->channelClass, "receive()", primChannelReceive);
+    PRIM_METHOD_BIND(vm->channelClass, "receiveUpTo(_)", primChannelReceiveUpTo);
+    PRIM_METHOD_BIND(vm->channelClass, "count", primChannelCount);
+    PRIM_METHOD_BIND(vm->channelClass, "capacity", primChannelCapacity);
+
+    // Shared类，方法均为类方法
+    Class *sharedClass = VALUE_TO_CLASS(getCoreClassValue(coreModule, "Shared"));
+    PRIM_METHOD_BIND(sharedClass->objHeader.class, "freeze(_)", primSharedFreeze);
+    PRIM_METHOD_BIND(sharedClass->objHeader.class, "isFrozen(_)", primSharedIsFrozen);
+    PRIM_METHOD_BIND(sharedClass->objHeader.class, "bytes", primSharedBytes);
+
+    // String类
+    vm->stringClass = VALUE_TO_CLASS(getCoreClassValue(coreModule, "String"));
+    PRIM_METHOD_BIND(vm->stringClass, "+(_)", primStringPlus);
+    PRIM_METHOD_BIND(vm->stringClass, "byteCount", primStringByteCount);
+    PRIM_METHOD_BIND(vm->stringClass, "count", primStringCount);
+    PRIM_METHOD_BIND(vm->stringClass, "[_]", primStringSubscript);
+    PRIM_METHOD_BIND(vm->stringClass, "codePointAt(_)", primStringCodePointAt);
+    PRIM_METHOD_BIND(vm->stringClass, "toString", primStringToString);
+
+    // StringBuilder类
+    vm->stringBuilderClass = VALUE_TO_CLASS(getCoreClassValue(coreModule, "StringBuilder"));
+    PRIM_METHOD_BIND(vm->stringBuilderClass->objHeader.class, "new()", primStringBuilderNew);
+    PRIM_METHOD_BIND(vm->stringBuilderClass, "append(_)", primStringBuilderAppend);
+    PRIM_METHOD_BIND(vm->stringBuilderClass, "count", primStringBuilderCount);
+    PRIM_METHOD_BIND(vm->stringBuilderClass, "clear()", primStringBuilderClear);
+    PRIM_METHOD_BIND(vm->stringBuilderClass, "toString", primStringBuilderToString);
+
+    // List类
+    vm->listClass = VALUE_TO_CLASS(getCoreClassValue(coreModule, "List"));
+    PRIM_METHOD_BIND(vm->listClass->objHeader.class, "new()", primListNew);
+    PRIM_METHOD_BIND(vm->listClass->objHeader.class, "new(_)", primListNewWithCapacity);
+    PRIM_METHOD_BIND(vm->listClass, "reserve(_)", primListReserve);
+    PRIM_METHOD_BIND(vm->listClass, "addCore_(_)", primListAddCore);
+    PRIM_METHOD_BIND(vm->listClass, "count", primListCount);
+    PRIM_METHOD_BIND(vm->listClass, "iterate(_)", primListIterate);
+    PRIM_METHOD_BIND(vm->listClass, "iteratorValue(_)", primListIteratorValue);
+    PRIM_METHOD_BIND(vm->listClass, "[_]", primListSubscript);
+    PRIM_METHOD_BIND(vm->listClass, "[_]=(_)", primListSubscriptSetter);
+    PRIM_METHOD_BIND(vm->listClass, "add(_)", primListAdd);
+    PRIM_METHOD_BIND(vm->listClass, "insert(_,_)", primListInsert);
+    PRIM_METHOD_BIND(vm->listClass, "removeAt(_)", primListRemoveAt);
+    PRIM_METHOD_BIND(vm->listClass, "addAll(_)", primListAddAll);
+    PRIM_METHOD_BIND(vm->listClass, "insertAll(_,_)", primListInsertAll);
+    PRIM_METHOD_BIND(vm->listClass, "removeRange(_,_)", primListRemoveRange);
+    PRIM_METHOD_BIND(vm->listClass, "slice(_,_)", primListSlice);
+    PRIM_METHOD_BIND(vm->listClass, "+(_)", primListPlus);
+    PRIM_METHOD_BIND(vm->listClass, "sortNatural_()", primListSortNatural);
+
+    // Map类
+    vm->mapClass = VALUE_TO_CLASS(getCoreClassValue(coreModule, "Map"));
+    PRIM_METHOD_BIND(vm->mapClass->objHeader.class, "new()", primMapNew);
+    PRIM_METHOD_BIND(vm->mapClass->objHeader.class, "new(_)", primMapNewWithCapacity);
+    PRIM_METHOD_BIND(vm->mapClass, "reserve(_)", primMapReserve);
+    PRIM_METHOD_BIND(vm->mapClass, "addCore_(_,_)", primMapAddCore);
+    PRIM_METHOD_BIND(vm->mapClass, "[_]", primMapSubscript);
+    PRIM_METHOD_BIND(vm->mapClass, "[_]=(_)", primMapSubscriptSetter);
+    PRIM_METHOD_BIND(vm->mapClass, "count", primMapCount);
+    PRIM_METHOD_BIND(vm->mapClass, "containsKey(_)", primMapContainsKey);
+    PRIM_METHOD_BIND(vm->mapClass, "remove(_)", primMapRemove);
+    PRIM_METHOD_BIND(vm->mapClass, "clear()", primMapClear);
+    PRIM_METHOD_BIND(vm->mapClass, "iterate(_)", primMapIterate);
+    PRIM_METHOD_BIND(vm->mapClass, "iteratorValue(_)", primMapIteratorValue);
+    PRIM_METHOD_BIND(vm->mapClass, "keys", primMapKeys);
+    PRIM_METHOD_BIND(vm->mapClass, "values", primMapValues);
+
+    // Set类
+    vm->setClass = VALUE_TO_CLASS(getCoreClassValue(coreModule, "Set"));
+    PRIM_METHOD_BIND(vm->setClass->objHeader.class, "new()", primSetNew);
+    PRIM_METHOD_BIND(vm->setClass, "add(_)", primSetAdd);
+    PRIM_METHOD_BIND(vm->setClass, "contains(_)", primSetContains);
+    PRIM_METHOD_BIND(vm->setClass, "remove(_)", primSetRemove);
+    PRIM_METHOD_BIND(vm->setClass, "count", primSetCount);
+    PRIM_METHOD_BIND(vm->setClass, "clear()", primSetClear);
+    PRIM_METHOD_BIND(vm->setClass, "union(_)", primSetUnion);
+    PRIM_METHOD_BIND(vm->setClass, "intersect(_)", primSetIntersect);
+    PRIM_METHOD_BIND(vm->setClass, "difference(_)", primSetDifference);
+    PRIM_METHOD_BIND(vm->setClass, "iterate(_)", primSetIterate);
+    PRIM_METHOD_BIND(vm->setClass, "iteratorValue(_)", primSetIteratorValue);
+    PRIM_METHOD_BIND(vm->setClass, "toList", primSetToList);
+
+    // Tuple类，==(_)继承自Object，由valueIsEqual逐个比较元素
+    vm->tupleClass = VALUE_TO_CLASS(getCoreClassValue(coreModule, "Tuple"));
+    PRIM_METHOD_BIND(vm->tupleClass->objHeader.class, "fromList(_)", primTupleFromList);
+    PRIM_METHOD_BIND(vm->tupleClass->objHeader.class, "new(_,_)", primTupleNew2);
+    PRIM_METHOD_BIND(vm->tupleClass->objHeader.class, "new(_,_,_)", primTupleNew3);
+    PRIM_METHOD_BIND(vm->tupleClass->objHeader.class, "new(_,_,_,_)", primTupleNew4);
+    PRIM_METHOD_BIND(vm->tupleClass, "count", primTupleCount);
+    PRIM_METHOD_BIND(vm->tupleClass, "[_]", primTupleSubscript);
+    PRIM_METHOD_BIND(vm->tupleClass, "hashCode", primTupleHashCode);
+    PRIM_METHOD_BIND(vm->tupleClass, "toList", primTupleToList);
+
+    // Vector类
+    vm->vectorClass = VALUE_TO_CLASS(getCoreClassValue(coreModule, "Vector"));
+    PRIM_METHOD_BIND(vm->vectorClass->objHeader.class, "new()", primVectorNew);
+    PRIM_METHOD_BIND(vm->vectorClass->objHeader.class, "fromList(_)", primVectorFromList);
+    PRIM_METHOD_BIND(vm->vectorClass, "count", primVectorCount);
+    PRIM_METHOD_BIND(vm->vectorClass, "[_]", primVectorSubscript);
+    PRIM_METHOD_BIND(vm->vectorClass, "set(_,_)", primVectorSet);
+    PRIM_METHOD_BIND(vm->vectorClass, "add(_)", primVectorAdd);
+    PRIM_METHOD_BIND(vm->vectorClass, "removeLast", primVectorRemoveLast);
+    PRIM_METHOD_BIND(vm->vectorClass, "toTransient", primVectorToTransient);
+    PRIM_METHOD_BIND(vm->vectorClass, "toPersistent", primVectorToPersistent);
+    PRIM_METHOD_BIND(vm->vectorClass, "isTransient", primVectorIsTransient);
+    PRIM_METHOD_BIND(vm->vectorClass, "toList", primVectorToList);
+    PRIM_METHOD_BIND(vm->vectorClass, "iterate(_)", primVectorIterate);
+    PRIM_METHOD_BIND(vm->vectorClass, "iteratorValue(_)", primVectorIteratorValue);
+
+    // HashMap类
+    vm->hashMapClass = VALUE_TO_CLASS(getCoreClassValue(coreModule, "HashMap"));
+    PRIM_METHOD_BIND(vm->hashMapClass->objHeader.class, "new()", primHashMapNew);
+    PRIM_METHOD_BIND(vm->hashMapClass, "count", primHashMapCount);
+    PRIM_METHOD_BIND(vm->hashMapClass, "[_]", primHashMapSubscript);
+    PRIM_METHOD_BIND(vm->hashMapClass, "containsKey(_)", primHashMapContainsKey);
+    PRIM_METHOD_BIND(vm->hashMapClass, "set(_,_)", primHashMapSet);
+    PRIM_METHOD_BIND(vm->hashMapClass, "remove(_)", primHashMapRemove);
+    PRIM_METHOD_BIND(vm->hashMapClass, "toTransient", primHashMapToTransient);
+    PRIM_METHOD_BIND(vm->hashMapClass, "toPersistent", primHashMapToPersistent);
+    PRIM_METHOD_BIND(vm->hashMapClass, "isTransient", primHashMapIsTransient);
+    PRIM_METHOD_BIND(vm->hashMapClass, "keys", primHashMapKeys);
+    PRIM_METHOD_BIND(vm->hashMapClass, "values", primHashMapValues);
+
+    // Num类
+    vm->numClass = VALUE_TO_CLASS(getCoreClassValue(coreModule, "Num"));
+    PRIM_METHOD_BIND(vm->numClass, "+(_)", primNumPlus);
+    PRIM_METHOD_BIND(vm->numClass, "-(_)", primNumMinus);
+    PRIM_METHOD_BIND(vm->numClass, "*(_)", primNumMul);
+    PRIM_METHOD_BIND(vm->numClass, "/(_)", primNumDiv);
+    PRIM_METHOD_BIND(vm->numClass, "%(_)", primNumMod);
+    PRIM_METHOD_BIND(vm->numClass, ">(_)", primNumGt);
+    PRIM_METHOD_BIND(vm->numClass, ">=(_)", primNumGe);
+    PRIM_METHOD_BIND(vm->numClass, "<(_)", primNumLt);
+    PRIM_METHOD_BIND(vm->numClass, "<=(_)", primNumLe);
+    PRIM_METHOD_BIND(vm->numClass, "&(_)", primNumBitAnd);
+    PRIM_METHOD_BIND(vm->numClass, "|(_)", primNumBitOr);
+    PRIM_METHOD_BIND(vm->numClass, ">>(_)", primNumBitShiftRight);
+    PRIM_METHOD_BIND(vm->numClass, "<<(_)", primNumBitShiftLeft);
+    PRIM_METHOD_BIND(vm->numClass, "-", primNumNegate);
+    PRIM_METHOD_BIND(vm->numClass, "~", primNumBitNot);
+    PRIM_METHOD_BIND(vm->numClass, "abs", primNumAbs);
+    PRIM_METHOD_BIND(vm->numClass, "ceil", primNumCeil);
+    PRIM_METHOD_BIND(vm->numClass, "floor", primNumFloor);
+    PRIM_METHOD_BIND(vm->numClass, "sqrt", primNumSqrt);
+    PRIM_METHOD_BIND(vm->numClass, "truncate", primNumTruncate);
+    PRIM_METHOD_BIND(vm->numClass, "isInteger", primNumIsInteger);
+    PRIM_METHOD_BIND(vm->numClass, "toString", primNumToString);
+    PRIM_METHOD_BIND(vm->numClass, "..(_)", primNumRange);
+
+    // Range类
+    vm->rangeClass = VALUE_TO_CLASS(getCoreClassValue(coreModule, "Range"));
+    PRIM_METHOD_BIND(vm->rangeClass, "from", primRangeFrom);
+    PRIM_METHOD_BIND(vm->rangeClass, "to", primRangeTo);
+    PRIM_METHOD_BIND(vm->rangeClass, "step", primRangeStep);
+    PRIM_METHOD_BIND(vm->rangeClass, "by(_)", primRangeBy);
+    PRIM_METHOD_BIND(vm->rangeClass, "iterate(_)", primRangeIterate);
+    PRIM_METHOD_BIND(vm->rangeClass, "iteratorValue(_)", primRangeIteratorValue);
+
+    // 数值数组类，三者的方法相同
+    vm->float64ArrayClass = VALUE_TO_CLASS(getCoreClassValue(coreModule, "Float64Array"));
+    vm->int32ArrayClass = VALUE_TO_CLASS(getCoreClassValue(coreModule, "Int32Array"));
+    vm->byteArrayClass = VALUE_TO_CLASS(getCoreClassValue(coreModule, "ByteArray"));
+    bindTypedArrayMethods(vm, vm->float64ArrayClass);
+    bindTypedArrayMethods(vm, vm->int32ArrayClass);
+    bindTypedArrayMethods(vm, vm->byteArrayClass);
+
+    // 自举过程中创建的字符串及vm->allModules早于vm->stringClass和vm->mapClass，现在补上它们的类
+    ObjHeader *objHeader = vm->allObjects;
+    while (objHeader != NULL) {
+        if (objHeader->type == OT_STRING) {
+            objHeader->class = vm->stringClass;
+        }
+        else if (objHeader->type == OT_MAP) {
+            objHeader->class = vm->mapClass;
+        }
+        objHeader = objHeader->next;
+    }
+}
+
+/**
+ * 从modules中获取名为moduleName的模块
+ * @param vm
+ * @param moduleName
+ * @return
+ */
+static ObjModule* getModule(VM *vm, Value moduleName) {
+    Value value = mapGet(vm, vm->allModules, moduleName);
+    if (value.type == VT_UNDEFINED) {
+        return NULL;
+    }
+
+    return VALUE_TO_OBJMODULE(value);
+}
+
+/**
+ * 获取模块moduleName，未载入时创建并继承核心模块中的变量
+ * @param vm
+ * @param moduleName
+ * @return
+ */
+ObjModule* ensureModule(VM *vm, Value moduleName) {
+    // 确保模块已经在到vm->allModules
+    // 先查看是否已经导入了该模块，避免重新载入
+    ObjModule* module = getModule(vm, moduleName);
+
+    // 若该模块未加载将其载入，并继承核心模块中的变量
+    if (module == NULL ){
+        // 创建模块并添加到vm->allModules
+        ObjString* modName= flattenObjString(vm, VALUE_TO_OBJSTR(moduleName));
+        ASSERT(modName->value.start[modName->value.length] == '\0', "string.value.start is not termionated!");
+
+        module = newObjModule(vm, modName->value.start);
+        mapSet(vm, vm->allModules, moduleName, OBJ_TO_VALUE(module));
+
+        // 继承核心模块中的变量
+        ObjModule *coreModule = getModule(vm, CORE_MODULE);
+        uint32_t idx = 0;
+        while (idx < coreModule->moduleVarName.count) {
+            defineModuleVar(vm, module, coreModule->moduleVarName.datas[idx].str,
+                            strlen(coreModule->moduleVarName.datas[idx].str),
+                            coreModule->moduelVarValue.datas[idx]);
+            idx ++;
+        }
+
+    }
+    return module;
+}
+
+/**
+ * 载入模块moduleName并编译，模块已由preloadModules预编译时直接取其顶层函数
+ * @param vm
+ * @param moduleName
+ * @param moduleCode
+ * @return
+ */
+static ObjThread* loadModule(VM *vm, Value moduleName, const char *moduleCode) {
+    // 模块及其编译结果随vm存在，不在分配区域中
+    pauseArena(vm);
+    ObjFn *fn = takePreloadedFn(vm, moduleName);
+    if (fn == NULL) {
+        ObjModule *module = ensureModule(vm, moduleName);
+        fn = compileModule(vm, module, moduleCode);
+    }
+    ObjClosure *objClosure = newObjClosure(vm, fn);
+    ObjThread *moduleThread = newObjThread(vm, objClosure);
+    resumeArena(vm);
+
+    return moduleThread;
+}
+
+/**
+ * 执行模块
+ * @param vm
+ * @param moduleName
+ * @param moduleCode
+ * @return
+ */
+VMResult executeModule(VM *vm, Value moduleName, const char *moduleCode) {
+    ObjThread *objThread = loadModule(vm, moduleName, moduleCode);
+    return executeInstruction(vm, objThread);
+}
+
+/**
+ * 确保符号已添加到符号表
+ * @param vm
+ * @param table
+ * @param symbol
+ * @param length
+ * @return
+ */
+int ensureSymbolExist(VM *vm, SymbolTable *table, const char *symbol, uint32_t length) {
+    CompileStats *stats = &vm->compileStats;
+    uint64_t start = stats->enabled ? getNowNs() : 0;
+
+    int symbolIndex = getIndexFromSymbolTable(table, symbol, length);
+    if (symbolIndex == -1) {
+        symbolIndex = addSymbol(vm, table, symbol, length);
+    }
+
+    if (stats->enabled) {
+        stats->symbolNs += getNowNs() - start;
+        stats->symbolCallNum ++;
     }
     return symbolIndex;
 }
@@ -10,6 +10,9 @@ char *readFile(const char *sourceFile);
 
 VMResult executeModule(VM *vm, Value moduleName, const char *moduleCode);
 void buildCore(VM *vm);
+bool rangeIterateFast(Value seq, Value iter, uint32_t methodIndex, Value *result);
+bool rangeIteratorValueFast(Value seq, Value iter, uint32_t methodIndex, Value *result);
+ObjString* num2str(VM *vm, double num);
 static bool primObjectNot(VM *vm UNUSED, Value *args);
 static bool primObjectEqual(VM *vm, Value *args);
 static bool primObjectNotEqual(VM *vm UNUSED, Value *args);
@@ -22,10 +25,12 @@ static bool primClassToString(VM *vm UNUSED, Value *args);
 static bool primObjectmetaSame(VM *vm UNUSED, Value *args);
 int getIndexFromSymbolTable(SymbolTable *table, const char *symbol, uint32_t length);
 int addSymbol(VM *vm, SymbolTable *table, const char *symbol, uint32_t length);
+int ensureSymbolExist(VM *vm, SymbolTable *table, const char *symbol, uint32_t length);
 static Class* defineClass(VM *vm, ObjModule *objModule, const char *name);
 void bindMethod(VM *vm, Class *class, uint32_t index, Method method);
 void bindSuperClass(VM *vm, Class *subClass, Class *superClass);
 static ObjModule* getModule(VM *vm, Value moduleName);
+ObjModule* ensureModule(VM *vm, Value moduleName);
 static ObjThread* loadModule(VM *vm, Value moduleName, const char *moduleCode);
 
 /**
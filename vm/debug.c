@@ -0,0 +1,20 @@
+//
+// Created by ZiXuan on 2022/8/1.
+//
+
+#include "debug.h"
+#include <string.h>
+
+/**
+ * 为函数绑定调试用的函数名
+ * @param vm
+ * @param fnDebug
+ * @param name
+ * @param length
+ */
+void bindDebugFnName(VM *vm, FnDebug *fnDebug, const char *name, uint32_t length) {
+    ASSERT(fnDebug->fnName == NULL, "debug.name has bound!");
+    fnDebug->fnName = ALLOCATE_ARRAY(vm, char, length + 1);
+    memcpy(fnDebug->fnName, name, length);
+    fnDebug->fnName[length] = '\0';
+}
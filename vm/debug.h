@@ -0,0 +1,12 @@
+//
+// Created by ZiXuan on 2022/8/1.
+//
+
+#ifndef SPARROW_DEBUG_H
+#define SPARROW_DEBUG_H
+
+#include "../object/obj_fn.h"
+
+void bindDebugFnName(VM *vm, FnDebug *fnDebug, const char *name, uint32_t length);
+
+#endif //SPARROW_DEBUG_H
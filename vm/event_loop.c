@@ -0,0 +1,482 @@
+//
+// Created by ZiXuan on 2022/7/9.
+//
+
+#include "event_loop.h"
+#include "vm.h"
+#include "../object/class.h"
+
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+// 一次epoll_wait最多取回的事件数
+#define MAX_EPOLL_EVENTS 64
+// 单次读取不超过此大小时使用栈上的缓冲区
+#define READ_STACK_BUF_SIZE 4096
+
+DEFINE_BUFFER_METHOD(FdWaiter)
+DEFINE_BUFFER_METHOD(IoTimer)
+
+/**
+ * 初始化事件循环，epoll实例在首次挂起线程时才创建
+ * @param loop
+ */
+void initEventLoop(EventLoop *loop) {
+    loop->epollFd = -1;
+    FdWaiterBufferInit(&loop->waiters);
+    IoTimerBufferInit(&loop->timers);
+    loop->pendingNum = 0;
+}
+
+/**
+ * 释放事件循环
+ * @param vm
+ * @param loop
+ */
+void freeEventLoop(VM *vm, EventLoop *loop) {
+    if (loop->epollFd != -1) {
+        close(loop->epollFd);
+    }
+    FdWaiterBufferClear(vm, &loop->waiters);
+    IoTimerBufferClear(vm, &loop->timers);
+    initEventLoop(loop);
+}
+
+/**
+ * 把fd设为非阻塞
+ * @param fd
+ * @return 失败时返回-1
+ */
+int setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1) {
+        return -1;
+    }
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/**
+ * 把当前errno对应的错误信息写入result
+ * @param vm
+ * @param result
+ * @return
+ */
+static IoStatus ioFailed(VM *vm, Value *result) {
+    const char *msg = strerror(errno);
+    *result = OBJ_TO_VALUE(newObjString(vm, msg, strlen(msg)));
+    return IO_FAILED;
+}
+
+/**
+ * 尝试从fd读取至多size个字节
+ * @param vm
+ * @param fd
+ * @param size
+ * @param result 读到的字符串，对端关闭时为空串
+ * @return
+ */
+IoStatus ioTryRead(VM *vm, int fd, uint32_t size, Value *result) {
+    char stackBuf[READ_STACK_BUF_SIZE];
+    char *buf = size <= READ_STACK_BUF_SIZE ? stackBuf : ALLOCATE_ARRAY(vm, char, size);
+
+    ssize_t n;
+    do {
+        n = read(fd, buf, size);
+    } while (n == -1 && errno == EINTR);
+
+    IoStatus status = IO_DONE;
+    if (n >= 0) {
+        *result = OBJ_TO_VALUE(newObjString(vm, buf, (uint32_t)n));
+    }
+    else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        status = IO_AGAIN;
+    }
+    else {
+        status = ioFailed(vm, result);
+    }
+
+    if (buf != stackBuf) {
+        DEALLOCATE_ARRAY(vm, buf, size);
+    }
+    return status;
+}
+
+/**
+ * 尝试在监听fd上接受新连接，新连接为非阻塞
+ * @param vm
+ * @param fd
+ * @param result 新连接的fd
+ * @return
+ */
+IoStatus ioTryAccept(VM *vm, int fd, Value *result) {
+    int conn;
+    do {
+        conn = accept(fd, NULL, NULL);
+    } while (conn == -1 && errno == EINTR);
+
+    if (conn >= 0) {
+        setNonBlocking(conn);
+        *result = NUM_TO_VALUE(conn);
+        return IO_DONE;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return IO_AGAIN;
+    }
+    return ioFailed(vm, result);
+}
+
+/**
+ * 尝试把data从第*written个字节起写入fd，直到写完或fd不可写
+ * @param vm
+ * @param fd
+ * @param data
+ * @param written 已写的字节数，随写入更新
+ * @param result 写完时为写入的总字节数
+ * @return
+ */
+IoStatus ioTryWrite(VM *vm, int fd, ObjString *data, uint32_t *written, Value *result) {
+    while (*written < data->value.length) {
+        ssize_t n = write(fd, data->value.start + *written, data->value.length - *written);
+        if (n >= 0) {
+            *written += (uint32_t)n;
+            continue;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return IO_AGAIN;
+        }
+        return ioFailed(vm, result);
+    }
+    *result = NUM_TO_VALUE(*written);
+    return IO_DONE;
+}
+
+/**
+ * 非阻塞connect的fd可写后，查询连接结果
+ * @param vm
+ * @param fd
+ * @param result 连接成功时为fd
+ * @return
+ */
+IoStatus ioTryConnect(VM *vm, int fd, Value *result) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1) {
+        return ioFailed(vm, result);
+    }
+    if (err == EINPROGRESS) {
+        return IO_AGAIN;
+    }
+    if (err != 0) {
+        errno = err;
+        return ioFailed(vm, result);
+    }
+    *result = NUM_TO_VALUE(fd);
+    return IO_DONE;
+}
+
+/**
+ * 使epoll中fd的注册事件与其挂起的操作一致
+ * @param vm
+ * @param fd
+ */
+static void updateInterest(VM *vm, int fd) {
+    EventLoop *loop = &vm->eventLoop;
+    FdWaiter *waiter = &loop->waiters.datas[fd];
+
+    uint32_t events = 0;
+    if (waiter->readOp.type != IO_OP_NONE) {
+        events |= EPOLLIN;
+    }
+    if (waiter->writeOp.type != IO_OP_NONE) {
+        events |= EPOLLOUT;
+    }
+    if (events == waiter->events) {
+        return;
+    }
+
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.fd = fd;
+    int op = waiter->events == 0 ? EPOLL_CTL_ADD : (events == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD);
+    if (epoll_ctl(loop->epollFd, op, fd, &ev) == -1 && op != EPOLL_CTL_DEL) {
+        IO_ERROR("epoll_ctl on fd %d failed: %s", fd, strerror(errno));
+    }
+    waiter->events = events;
+}
+
+/**
+ * 把op.thread挂起在fd上，直到op可以完成
+ * 调用前线程须已回收参数，使esp[-1]为存放结果的slot
+ * @param vm
+ * @param fd
+ * @param op
+ * @return fd上已有同方向的挂起操作时返回false
+ */
+bool ioWait(VM *vm, int fd, IoOp op) {
+    EventLoop *loop = &vm->eventLoop;
+    if (loop->epollFd == -1) {
+        loop->epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (loop->epollFd == -1) {
+            IO_ERROR("epoll_create1 failed: %s", strerror(errno));
+        }
+    }
+
+    if ((uint32_t)fd >= loop->waiters.count) {
+        FdWaiter empty;
+        memset(&empty, 0, sizeof(empty));
+        FdWaiterBufferFillWrite(vm, &loop->waiters, empty, fd + 1 - loop->waiters.count);
+    }
+
+    FdWaiter *waiter = &loop->waiters.datas[fd];
+    bool isRead = op.type == IO_OP_READ || op.type == IO_OP_ACCEPT || op.type == IO_OP_CUSTOM;
+    IoOp *slot = isRead ? &waiter->readOp : &waiter->writeOp;
+    if (slot->type != IO_OP_NONE) {
+        return false;
+    }
+
+    *slot = op;
+    op.thread->isParked = true;
+    loop->pendingNum ++;
+    updateInterest(vm, fd);
+    return true;
+}
+
+/**
+ * 操作结束，唤醒等待的线程
+ * @param vm
+ * @param op
+ * @param status
+ * @param result
+ */
+static void wakeOp(VM *vm, IoOp *op, IoStatus status, Value result) {
+    ObjThread *objThread = op->thread;
+    if (status == IO_DONE) {
+        objThread->esp[-1] = result;
+    }
+    else {
+        objThread->errorObj = result;
+    }
+    op->type = IO_OP_NONE;
+    op->thread = NULL;
+    op->data = NULL;
+    op->arg = NULL;
+    vm->eventLoop.pendingNum --;
+    objThread->isParked = false;
+    scheduleThread(vm, objThread);
+}
+
+/**
+ * fd就绪后继续执行挂起的操作，仍无法完成时继续等待
+ * @param vm
+ * @param fd
+ * @param op
+ * @return 是否唤醒了线程
+ */
+static bool completeOp(VM *vm, int fd, IoOp *op) {
+    Value result = VT_TO_VALUE(VT_NULL);
+    IoStatus status = IO_AGAIN;
+    switch (op->type) {
+        case IO_OP_READ:
+            status = ioTryRead(vm, fd, op->size, &result);
+            break;
+        case IO_OP_ACCEPT:
+            status = ioTryAccept(vm, fd, &result);
+            break;
+        case IO_OP_WRITE:
+            status = ioTryWrite(vm, fd, op->data, &op->written, &result);
+            break;
+        case IO_OP_CONNECT:
+            status = ioTryConnect(vm, fd, &result);
+            break;
+        case IO_OP_CUSTOM:
+            status = op->complete(vm, fd, op, &result);
+            break;
+        default:
+            return false;
+    }
+    if (status == IO_AGAIN) {
+        return false;
+    }
+    wakeOp(vm, op, status, result);
+    return true;
+}
+
+/**
+ * 交换堆中的两个定时器
+ * @param timers
+ * @param a
+ * @param b
+ */
+static void swapTimer(IoTimer *timers, uint32_t a, uint32_t b) {
+    IoTimer tmp = timers[a];
+    timers[a] = timers[b];
+    timers[b] = tmp;
+}
+
+/**
+ * 使objThread在ns纳秒后被唤醒，期间yield返回null
+ * @param vm
+ * @param objThread
+ * @param ns
+ */
+void ioSleep(VM *vm, ObjThread *objThread, uint64_t ns) {
+    EventLoop *loop = &vm->eventLoop;
+    if (loop->epollFd == -1) {
+        loop->epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (loop->epollFd == -1) {
+            IO_ERROR("epoll_create1 failed: %s", strerror(errno));
+        }
+    }
+
+    IoTimer timer = {getNowNs() + ns, objThread};
+    IoTimerBufferAdd(vm, &loop->timers, timer);
+    objThread->isParked = true;
+    loop->pendingNum ++;
+
+    // 上浮
+    IoTimer *timers = loop->timers.datas;
+    uint32_t idx = loop->timers.count - 1;
+    while (idx > 0) {
+        uint32_t parent = (idx - 1) / 2;
+        if (timers[parent].deadline <= timers[idx].deadline) {
+            break;
+        }
+        swapTimer(timers, parent, idx);
+        idx = parent;
+    }
+}
+
+/**
+ * 弹出最早到期的定时器
+ * @param loop
+ * @return
+ */
+static IoTimer popTimer(EventLoop *loop) {
+    IoTimer *timers = loop->timers.datas;
+    IoTimer top = timers[0];
+    timers[0] = timers[-- loop->timers.count];
+
+    // 下沉
+    uint32_t idx = 0;
+    while (true) {
+        uint32_t left = idx * 2 + 1;
+        uint32_t right = left + 1;
+        uint32_t smallest = idx;
+        if (left < loop->timers.count && timers[left].deadline < timers[smallest].deadline) {
+            smallest = left;
+        }
+        if (right < loop->timers.count && timers[right].deadline < timers[smallest].deadline) {
+            smallest = right;
+        }
+        if (smallest == idx) {
+            break;
+        }
+        swapTimer(timers, idx, smallest);
+        idx = smallest;
+    }
+    return top;
+}
+
+/**
+ * fd即将关闭，以错误唤醒挂起在其上的线程
+ * @param vm
+ * @param fd
+ */
+void ioCancel(VM *vm, int fd) {
+    EventLoop *loop = &vm->eventLoop;
+    if ((uint32_t)fd >= loop->waiters.count) {
+        return;
+    }
+
+    FdWaiter *waiter = &loop->waiters.datas[fd];
+    const char *msg = "fd closed while waiting on it!";
+    if (waiter->readOp.type != IO_OP_NONE) {
+        wakeOp(vm, &waiter->readOp, IO_FAILED, OBJ_TO_VALUE(newObjString(vm, msg, strlen(msg))));
+    }
+    if (waiter->writeOp.type != IO_OP_NONE) {
+        wakeOp(vm, &waiter->writeOp, IO_FAILED, OBJ_TO_VALUE(newObjString(vm, msg, strlen(msg))));
+    }
+    updateInterest(vm, fd);
+}
+
+/**
+ * 处理一轮已就绪的fd和到期的定时器，把完成操作的线程加入就绪队列
+ * @param vm
+ * @param block 为真时阻塞到有事件发生或最早的定时器到期
+ * @return 是否有线程被唤醒
+ */
+bool runEventLoopOnce(VM *vm, bool block) {
+    EventLoop *loop = &vm->eventLoop;
+    if (loop->pendingNum == 0) {
+        return false;
+    }
+
+    int timeout = 0;
+    if (block) {
+        timeout = -1;
+        if (loop->timers.count > 0) {
+            uint64_t now = getNowNs();
+            uint64_t deadline = loop->timers.datas[0].deadline;
+            // 向上取整到毫秒，避免提前醒来后空转
+            timeout = deadline <= now ? 0 : (int)((deadline - now + 999999) / 1000000);
+        }
+    }
+
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int num = epoll_wait(loop->epollFd, events, MAX_EPOLL_EVENTS, timeout);
+    if (num == -1 && errno != EINTR) {
+        IO_ERROR("epoll_wait failed: %s", strerror(errno));
+    }
+
+    bool woken = false;
+    int idx = 0;
+    while (idx < num) {
+        int fd = events[idx].data.fd;
+        uint32_t happened = events[idx].events;
+        FdWaiter *waiter = &loop->waiters.datas[fd];
+
+        // 出错或挂断时也让操作执行一次，由其返回具体的错误
+        if (happened & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+            woken |= completeOp(vm, fd, &waiter->readOp);
+        }
+        if (happened & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
+            woken |= completeOp(vm, fd, &waiter->writeOp);
+        }
+        updateInterest(vm, fd);
+        idx ++;
+    }
+
+    uint64_t now = getNowNs();
+    while (loop->timers.count > 0 && loop->timers.datas[0].deadline <= now) {
+        IoTimer timer = popTimer(loop);
+        timer.thread->esp[-1] = VT_TO_VALUE(VT_NULL);
+        timer.thread->isParked = false;
+        loop->pendingNum --;
+        scheduleThread(vm, timer.thread);
+        woken = true;
+    }
+    return woken;
+}
+
+/**
+ * 返回下一个可运行的线程
+ * 就绪队列为空时驱动事件循环，直到有线程被唤醒
+ * @param vm
+ * @return 没有就绪线程也没有挂起在io上的线程时返回NULL
+ */
+ObjThread* nextRunnableThread(VM *vm) {
+    while (true) {
+        ObjThread *objThread = nextReadyThread(vm);
+        if (objThread != NULL || vm->eventLoop.pendingNum == 0) {
+            return objThread;
+        }
+        runEventLoopOnce(vm, true);
+    }
+}
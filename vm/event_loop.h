@@ -0,0 +1,71 @@
+//
+// Created by ZiXuan on 2022/7/9.
+//
+
+#ifndef SPARROW_EVENT_LOOP_H
+#define SPARROW_EVENT_LOOP_H
+
+#include "../object/obj_thread.h"
+#include "../object/obj_string.h"
+
+typedef enum {
+    IO_OP_NONE,
+    IO_OP_READ,    // 读取至多size个字节，结果为字符串，对端关闭时为空串
+    IO_OP_ACCEPT,  // 接受连接，结果为新连接的fd
+    IO_OP_WRITE,   // 写完data，结果为写入的字节数
+    IO_OP_CONNECT, // 等待非阻塞connect完成，结果为fd
+    IO_OP_CUSTOM   // fd可读时由complete完成，用于eventfd等通知型fd
+} IoOpType;
+
+typedef enum {
+    IO_DONE,   // 操作已完成，结果已写入result
+    IO_AGAIN,  // 暂时无法完成，须挂起线程等待fd就绪
+    IO_FAILED  // 操作出错，错误信息已写入result
+} IoStatus;
+
+typedef struct ioOp {
+    IoOpType type;
+    ObjThread *thread; // 挂起等待此操作的线程
+    uint32_t size;     // IO_OP_READ最多读取的字节数
+    ObjString *data;   // IO_OP_WRITE待写的字符串
+    uint32_t written;  // IO_OP_WRITE已写的字节数
+    // IO_OP_CUSTOM的完成函数及其参数
+    IoStatus (*complete)(VM *vm, int fd, struct ioOp *op, Value *result);
+    void *arg;
+} IoOp;  // fd上挂起的一个操作
+
+typedef struct {
+    IoOp readOp;   // 等待可读的操作，每个fd同时只允许一个
+    IoOp writeOp;  // 等待可写的操作
+    uint32_t events; // 已在epoll中注册的事件
+} FdWaiter;
+
+typedef struct {
+    uint64_t deadline; // 到期时刻，单位纳秒
+    ObjThread *thread;
+} IoTimer;
+
+DECLARE_BUFFER_TYPE(FdWaiter)
+DECLARE_BUFFER_TYPE(IoTimer)
+
+typedef struct {
+    int epollFd;
+    FdWaiterBuffer waiters; // 以fd为下标
+    IoTimerBuffer timers;   // 按deadline排列的最小堆
+    uint32_t pendingNum;    // 挂起在fd或定时器上的线程数，gc须把它们作为根
+} EventLoop;  // 每个vm一个，用单个os线程驱动大量挂起在io上的线程
+
+void initEventLoop(EventLoop *loop);
+void freeEventLoop(VM *vm, EventLoop *loop);
+int setNonBlocking(int fd);
+IoStatus ioTryRead(VM *vm, int fd, uint32_t size, Value *result);
+IoStatus ioTryAccept(VM *vm, int fd, Value *result);
+IoStatus ioTryWrite(VM *vm, int fd, ObjString *data, uint32_t *written, Value *result);
+IoStatus ioTryConnect(VM *vm, int fd, Value *result);
+bool ioWait(VM *vm, int fd, IoOp op);
+void ioSleep(VM *vm, ObjThread *objThread, uint64_t ns);
+void ioCancel(VM *vm, int fd);
+bool runEventLoopOnce(VM *vm, bool block);
+ObjThread* nextRunnableThread(VM *vm);
+
+#endif //SPARROW_EVENT_LOOP_H
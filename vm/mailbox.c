@@ -0,0 +1,266 @@
+//
+// Created by ZiXuan on 2022/7/16.
+//
+
+#include "mailbox.h"
+#include "vm.h"
+#include "../object/class.h"
+
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+// 单批收发不超过此数时，序列化结果暂存在栈上
+#define MAILBOX_STACK_BATCH 64
+
+/**
+ * 新建容量为capacity的邮箱，capacity向上取整到2的幂
+ * 邮箱不属于任何vm，由引用计数管理
+ * @param capacity
+ * @return
+ */
+Mailbox* newMailbox(uint32_t capacity) {
+    capacity = ceilToPowerOf2(capacity);
+
+    Mailbox *mailbox = NULL;
+    if (posix_memalign((void **)&mailbox, CACHE_LINE_SIZE, sizeof(Mailbox)) != 0) {
+        MEM_ERROR("allocate mailbox failed!");
+    }
+    memset(mailbox, 0, sizeof(Mailbox));
+
+    mailbox->cells = (MailboxCell *)malloc(sizeof(MailboxCell) * capacity);
+    if (mailbox->cells == NULL) {
+        MEM_ERROR("allocate mailbox cells failed!");
+    }
+    uint32_t idx = 0;
+    while (idx < capacity) {
+        mailbox->cells[idx].seq = idx;
+        mailbox->cells[idx].msg = NULL;
+        idx ++;
+    }
+
+    mailbox->capacity = capacity;
+    mailbox->mask = capacity - 1;
+    mailbox->eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (mailbox->eventFd == -1) {
+        IO_ERROR("create eventfd for mailbox failed!");
+    }
+    mailbox->refCount = 1;
+    return mailbox;
+}
+
+/**
+ * 增加邮箱的引用
+ * @param mailbox
+ */
+void retainMailbox(Mailbox *mailbox) {
+    __atomic_add_fetch(&mailbox->refCount, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * 减少邮箱的引用，最后一个引用释放时连同未取走的消息一起释放
+ * 消息中的channel持有的邮箱引用随消息归还，邮箱不会持有自己的引用
+ * @param mailbox
+ */
+void releaseMailbox(Mailbox *mailbox) {
+    if (__atomic_sub_fetch(&mailbox->refCount, 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+    uint32_t idx = 0;
+    while (idx < mailbox->capacity) {
+        if (mailbox->cells[idx].msg != NULL) {
+            freeMessage(mailbox->cells[idx].msg);
+        }
+        idx ++;
+    }
+    close(mailbox->eventFd);
+    free(mailbox->cells);
+    free(mailbox);
+}
+
+/**
+ * 通过eventFd唤醒挂起的消费者
+ * @param mailbox
+ */
+static void signalMailbox(Mailbox *mailbox) {
+    uint64_t one = 1;
+    ssize_t n = write(mailbox->eventFd, &one, sizeof(one));
+    (void)n;
+}
+
+/**
+ * 把values中的前num个值发入邮箱，邮箱剩余空间不足时只发送能放下的前缀
+ * 全部值先在锁外序列化好，再以一次CAS为整批抢占下标
+ * @param vm
+ * @param mailbox
+ * @param values
+ * @param num
+ * @param unsupported 遇到不可发送的值时置为真，只发送它之前的值
+ * @return 实际发送的个数
+ */
+uint32_t mailboxSend(VM *vm, Mailbox *mailbox, Value *values, uint32_t num, bool *unsupported) {
+    Message *stackMsgs[MAILBOX_STACK_BATCH];
+    Message **msgs = num <= MAILBOX_STACK_BATCH ? stackMsgs : (Message **)malloc(sizeof(Message *) * num);
+
+    *unsupported = false;
+    uint32_t ready = 0;
+    while (ready < num) {
+        Value value = values[ready];
+        msgs[ready] = NULL;
+        if (value.type == VT_OBJ && !VALUE_TO_OBJ(value)->isFrozen) {
+            Message *msg = newMessage();
+            if (!serializeValue(vm, value, msg)) {
+                freeMessage(msg);
+                *unsupported = true;
+                break;
+            }
+            msgs[ready] = msg;
+        }
+        ready ++;
+    }
+
+    // 抢占连续的ready个下标，消费者按序释放，只要不超出tail+capacity即可写
+    uint64_t pos = __atomic_load_n(&mailbox->head, __ATOMIC_RELAXED);
+    uint32_t reserved = 0;
+    while (ready > 0) {
+        uint64_t tail = __atomic_load_n(&mailbox->tail, __ATOMIC_ACQUIRE);
+        uint64_t used = pos > tail ? pos - tail : 0;
+        uint64_t freeNum = mailbox->capacity - used;
+        reserved = freeNum < ready ? (uint32_t)freeNum : ready;
+        if (reserved == 0) {
+            break;
+        }
+        if (__atomic_compare_exchange_n(&mailbox->head, &pos, pos + reserved, true,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    uint32_t idx = 0;
+    while (idx < reserved) {
+        // 消费者先推进tail再归还下标，须等它取走上一轮的值
+        MailboxCell *cell = &mailbox->cells[(pos + idx) & mailbox->mask];
+        while (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != pos + idx) {
+            sched_yield();
+        }
+        cell->msg = msgs[idx];
+        cell->value = values[idx];
+        __atomic_store_n(&cell->seq, pos + idx + 1, __ATOMIC_RELEASE);
+        idx ++;
+    }
+
+    // 放不下的部分丢弃，其中channel持有的邮箱引用一并归还
+    while (idx < ready) {
+        if (msgs[idx] != NULL) {
+            freeMessage(msgs[idx]);
+        }
+        idx ++;
+    }
+    if (msgs != stackMsgs) {
+        free(msgs);
+    }
+
+    // 与mailboxPrepareWait中的屏障配对，保证不会错过挂起的消费者
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (reserved > 0 && __atomic_load_n(&mailbox->waiting, __ATOMIC_RELAXED) != 0) {
+        signalMailbox(mailbox);
+    }
+    return reserved;
+}
+
+/**
+ * 邮箱的下一个下标是否可读
+ * @param mailbox
+ * @return
+ */
+static bool mailboxHasNext(Mailbox *mailbox) {
+    uint64_t tail = __atomic_load_n(&mailbox->tail, __ATOMIC_ACQUIRE);
+    MailboxCell *cell = &mailbox->cells[tail & mailbox->mask];
+    return __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) == tail + 1;
+}
+
+/**
+ * 从邮箱中取出至多maxNum个值，多个vm可同时调用
+ * 每个下标以CAS抢占，取走cell中的内容并归还下标后再反序列化
+ * @param vm 值在此vm中重建
+ * @param mailbox
+ * @param values
+ * @param maxNum
+ * @return 取出的个数，邮箱为空时为0
+ */
+uint32_t mailboxReceive(VM *vm, Mailbox *mailbox, Value *values, uint32_t maxNum) {
+    uint64_t tail = __atomic_load_n(&mailbox->tail, __ATOMIC_RELAXED);
+    uint32_t num = 0;
+    while (num < maxNum) {
+        MailboxCell *cell = &mailbox->cells[tail & mailbox->mask];
+        uint64_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        if (seq == tail) {
+            break;
+        }
+        if (seq != tail + 1) {
+            // 已被其它消费者取走，tail过时
+            tail = __atomic_load_n(&mailbox->tail, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (!__atomic_compare_exchange_n(&mailbox->tail, &tail, tail + 1, true,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            continue;
+        }
+
+        Message *msg = cell->msg;
+        Value value = cell->value;
+        cell->msg = NULL;
+        __atomic_store_n(&cell->seq, tail + mailbox->capacity, __ATOMIC_RELEASE);
+        if (msg != NULL) {
+            value = deserializeValue(vm, msg);
+            freeMessage(msg);
+        }
+        values[num ++] = value;
+        tail ++;
+    }
+
+    // 一次唤醒可能被别的消费者抢先清空，邮箱中还有值时接力唤醒仍在等待的消费者
+    if (num > 0 && __atomic_load_n(&mailbox->waiting, __ATOMIC_RELAXED) != 0 && mailboxHasNext(mailbox)) {
+        signalMailbox(mailbox);
+    }
+    return num;
+}
+
+/**
+ * 消费者挂起前调用，登记等待后再检查一次邮箱
+ * @param mailbox
+ * @return 为真时可以挂起在eventFd上，被唤醒后须调用mailboxDrainEvent；为假时邮箱已有值，应直接读取
+ */
+bool mailboxPrepareWait(Mailbox *mailbox) {
+    __atomic_add_fetch(&mailbox->waiting, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (mailboxHasNext(mailbox)) {
+        __atomic_sub_fetch(&mailbox->waiting, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * 清空eventFd中的计数并注销等待，消费者被唤醒后调用
+ * @param mailbox
+ */
+void mailboxDrainEvent(Mailbox *mailbox) {
+    __atomic_sub_fetch(&mailbox->waiting, 1, __ATOMIC_RELAXED);
+    uint64_t count;
+    ssize_t n = read(mailbox->eventFd, &count, sizeof(count));
+    (void)n;
+}
+
+/**
+ * 邮箱中已被抢占的个数，含尚未写完的，仅供参考
+ * @param mailbox
+ * @return
+ */
+uint32_t mailboxCount(Mailbox *mailbox) {
+    uint64_t head = __atomic_load_n(&mailbox->head, __ATOMIC_ACQUIRE);
+    uint64_t tail = __atomic_load_n(&mailbox->tail, __ATOMIC_ACQUIRE);
+    return head > tail ? (uint32_t)(head - tail) : 0;
+}
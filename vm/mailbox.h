@@ -0,0 +1,43 @@
+//
+// Created by ZiXuan on 2022/7/16.
+//
+
+#ifndef SPARROW_MAILBOX_H
+#define SPARROW_MAILBOX_H
+
+#include "message.h"
+
+// 避免生产者与消费者的下标落在同一cache line上
+#define CACHE_LINE_SIZE 64
+
+typedef struct {
+    uint64_t seq;    // 等于下标时可写，等于下标加1时可读
+    Value value;     // null、bool、数字及冻结对象直接存放，无须序列化
+    Message *msg;    // 其余的值序列化后存放在此，为NULL时取value
+} MailboxCell;
+
+typedef struct mailbox {
+    MailboxCell *cells;
+    uint32_t capacity;  // 2的幂
+    uint32_t mask;
+    int eventFd;        // 消费者挂起时等待的eventfd
+    uint32_t refCount;  // 引用此邮箱的ObjChannel个数，可分属不同vm
+
+    char pad0[CACHE_LINE_SIZE];
+    uint64_t head;      // 生产者抢占的下一个下标
+    char pad1[CACHE_LINE_SIZE - sizeof(uint64_t)];
+    uint64_t tail;      // 消费者抢占的下一个下标，以CAS推进
+    uint32_t waiting;   // 已挂起或即将挂起的消费者个数，不为0时生产者须通过eventFd唤醒
+    char pad2[CACHE_LINE_SIZE - sizeof(uint64_t) - sizeof(uint32_t)];
+} Mailbox;  // 有界的多生产者多消费者环形队列，收发都不加锁
+
+Mailbox* newMailbox(uint32_t capacity);
+void retainMailbox(Mailbox *mailbox);
+void releaseMailbox(Mailbox *mailbox);
+uint32_t mailboxSend(VM *vm, Mailbox *mailbox, Value *values, uint32_t num, bool *unsupported);
+uint32_t mailboxReceive(VM *vm, Mailbox *mailbox, Value *values, uint32_t maxNum);
+bool mailboxPrepareWait(Mailbox *mailbox);
+void mailboxDrainEvent(Mailbox *mailbox);
+uint32_t mailboxCount(Mailbox *mailbox);
+
+#endif //SPARROW_MAILBOX_H
@@ -0,0 +1,1064 @@
+//
+// Created by ZiXuan on 2022/7/12.
+//
+
+#include "message.h"
+#include "vm.h"
+#include "../object/class.h"
+#include "../object/obj_list.h"
+#include "../object/obj_map.h"
+#include "../object/obj_range.h"
+#include "../object/obj_channel.h"
+#include "../object/obj_tuple.h"
+#include "../object/obj_set.h"
+#include "../object/obj_typed_array.h"
+#include "../object/obj_vector.h"
+#include "../object/obj_hash_map.h"
+#include "../object/obj_string_builder.h"
+
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+    const uint8_t *datas;
+    uint32_t count;
+    uint32_t pos;
+} MessageReader;  // 反序列化时的读取位置
+
+typedef struct {
+    ObjMemo copies; // 源对象到副本，使共享及循环引用在副本中保持
+    char error[128]; // 拷贝失败的原因
+} CopyMemo;  // 一次copyValue的状态
+
+/**
+ * 跳过消息中的length个字节
+ * @param reader
+ * @param length
+ * @return 消息不足length个字节时返回false
+ */
+static bool messageSkip(MessageReader *reader, uint64_t length) {
+    if (reader->pos + length > reader->count) {
+        return false;
+    }
+    reader->pos += (uint32_t)length;
+    return true;
+}
+
+/**
+ * 读取消息中的4字节无符号数
+ * @param reader
+ * @param num
+ * @return 消息不足4个字节时返回false
+ */
+static bool messagePeekU32(MessageReader *reader, uint32_t *num) {
+    if (reader->pos + sizeof(uint32_t) > reader->count) {
+        return false;
+    }
+    memcpy(num, reader->datas + reader->pos, sizeof(uint32_t));
+    reader->pos += sizeof(uint32_t);
+    return true;
+}
+
+/**
+ * 遍历消息中的一个值，归还其中channel持有的邮箱引用
+ * 序列化失败的消息内容不完整，读到末尾时停止
+ * @param reader
+ * @param remaining 尚未归还的引用数，为0时停止
+ * @return 读到末尾或已全部归还时返回false
+ */
+static bool releaseMessageMailboxes(MessageReader *reader, uint32_t *remaining) {
+    if (*remaining == 0 || reader->pos >= reader->count) {
+        return false;
+    }
+    uint8_t tag = reader->datas[reader->pos ++];
+    uint32_t count;
+    uint64_t num;
+    switch ((MessageTag)tag) {
+        case MSG_NULL:
+        case MSG_FALSE:
+        case MSG_TRUE:
+            return true;
+        case MSG_NUM:
+            return messageSkip(reader, sizeof(double));
+        case MSG_RANGE:
+            return messageSkip(reader, sizeof(double) * 3);
+        case MSG_FROZEN:
+            return messageSkip(reader, sizeof(ObjHeader *));
+        case MSG_REF:
+            return messageSkip(reader, sizeof(uint32_t));
+        case MSG_STRING:
+        case MSG_STRING_BUILDER:
+            return messagePeekU32(reader, &count) && messageSkip(reader, count);
+        case MSG_TYPED_ARRAY: {
+            if (!messageSkip(reader, 1) || !messagePeekU32(reader, &count)) {
+                return false;
+            }
+            uint8_t kind = reader->datas[reader->pos - sizeof(uint32_t) - 1];
+            return kind <= TA_BYTE && messageSkip(reader, (uint64_t)count * typedArrayElementSize(kind));
+        }
+        case MSG_TYPED_SLICE:
+            return releaseMessageMailboxes(reader, remaining) && messageSkip(reader, sizeof(uint32_t) * 2);
+        case MSG_INSTANCE:
+            if (!messagePeekU32(reader, &count) || !messageSkip(reader, count) || !messagePeekU32(reader, &count)) {
+                return false;
+            }
+            num = count;
+            break;
+        case MSG_VECTOR:
+        case MSG_HASH_MAP:
+            if (!messageSkip(reader, 1) || !messagePeekU32(reader, &count)) {
+                return false;
+            }
+            num = tag == MSG_HASH_MAP ? (uint64_t)count * 2 : count;
+            break;
+        case MSG_LIST:
+        case MSG_TUPLE:
+        case MSG_SET:
+        case MSG_MAP:
+            if (!messagePeekU32(reader, &count)) {
+                return false;
+            }
+            num = tag == MSG_MAP ? (uint64_t)count * 2 : count;
+            break;
+        case MSG_CHANNEL: {
+            Mailbox *mailbox;
+            if (reader->pos + sizeof(Mailbox *) > reader->count) {
+                return false;
+            }
+            memcpy(&mailbox, reader->datas + reader->pos, sizeof(Mailbox *));
+            reader->pos += sizeof(Mailbox *);
+            releaseMailbox(mailbox);
+            (*remaining) --;
+            return true;
+        }
+        default:
+            return false;
+    }
+
+    // 容器的各元素
+    uint64_t idx = 0;
+    while (idx < num) {
+        if (!releaseMessageMailboxes(reader, remaining)) {
+            return false;
+        }
+        idx ++;
+    }
+    return true;
+}
+
+/**
+ * 新建空消息
+ * @return
+ */
+Message* newMessage(void) {
+    Message *msg = (Message *)malloc(sizeof(Message));
+    if (msg == NULL) {
+        MEM_ERROR("allocate message failed!");
+    }
+    msg->datas = NULL;
+    msg->count = msg->capacity = 0;
+    msg->sender = 0;
+    msg->mailboxNum = 0;
+    msg->next = NULL;
+    return msg;
+}
+
+/**
+ * 释放消息，归还其中channel持有的邮箱引用
+ * @param msg
+ */
+void freeMessage(Message *msg) {
+    if (msg->mailboxNum > 0) {
+        MessageReader reader = {msg->datas, msg->count, 0};
+        releaseMessageMailboxes(&reader, &msg->mailboxNum);
+    }
+    free(msg->datas);
+    free(msg);
+}
+
+/**
+ * 向消息追加length个字节
+ * @param msg
+ * @param bytes
+ * @param length
+ */
+static void messageWrite(Message *msg, const void *bytes, uint32_t length) {
+    if (msg->count + length > msg->capacity) {
+        msg->capacity = ceilToPowerOf2(msg->count + length);
+        msg->datas = (uint8_t *)realloc(msg->datas, msg->capacity);
+        if (msg->datas == NULL) {
+            MEM_ERROR("grow message failed!");
+        }
+    }
+    memcpy(msg->datas + msg->count, bytes, length);
+    msg->count += length;
+}
+
+/**
+ * 追加1字节的类型标记
+ * @param msg
+ * @param tag
+ */
+static void messageWriteTag(Message *msg, MessageTag tag) {
+    uint8_t byte = (uint8_t)tag;
+    messageWrite(msg, &byte, 1);
+}
+
+/**
+ * 追加4字节无符号数
+ * @param msg
+ * @param num
+ */
+static void messageWriteU32(Message *msg, uint32_t num) {
+    messageWrite(msg, &num, sizeof(num));
+}
+
+/**
+ * 追加4字节长度及其后的length个字节
+ * @param msg
+ * @param bytes
+ * @param length
+ */
+static void messageWriteBytes(Message *msg, const void *bytes, uint32_t length) {
+    messageWriteU32(msg, length);
+    messageWrite(msg, bytes, length);
+}
+
+/**
+ * 递归序列化value，对象首次出现时按顺序编号记入memo，再次出现时只写编号
+ * @param vm
+ * @param value
+ * @param msg
+ * @param memo 已序列化的对象到其编号
+ * @param depth 当前嵌套层数
+ * @return value或其中的元素不可序列化时返回false
+ */
+static bool serializeValueAt(VM *vm, Value value, Message *msg, ObjMemo *memo, uint32_t depth) {
+    if (depth > MAX_SERIALIZE_DEPTH) {
+        return false;
+    }
+
+    switch (value.type) {
+        case VT_NULL:
+            messageWriteTag(msg, MSG_NULL);
+            return true;
+        case VT_FALSE:
+            messageWriteTag(msg, MSG_FALSE);
+            return true;
+        case VT_TRUE:
+            messageWriteTag(msg, MSG_TRUE);
+            return true;
+        case VT_NUM:
+            messageWriteTag(msg, MSG_NUM);
+            messageWrite(msg, &value.num, sizeof(double));
+            return true;
+        case VT_OBJ:
+            break;
+        default:
+            return false;
+    }
+
+    ObjHeader *objHeader = VALUE_TO_OBJ(value);
+    if (objHeader->isFrozen) {
+        // 共享堆中的对象不拷贝，只传指针
+        messageWriteTag(msg, MSG_FROZEN);
+        messageWrite(msg, &objHeader, sizeof(ObjHeader *));
+        return true;
+    }
+    Value *serialized = objMemoFind(memo, objHeader);
+    if (serialized != NULL) {
+        messageWriteTag(msg, MSG_REF);
+        messageWriteU32(msg, (uint32_t)serialized->num);
+        return true;
+    }
+    switch (objHeader->type) {
+        case OT_STRING:
+        case OT_LIST:
+        case OT_MAP:
+        case OT_RANGE:
+        case OT_CHANNEL:
+        case OT_TUPLE:
+        case OT_SET:
+        case OT_TYPED_ARRAY:
+        case OT_VECTOR:
+        case OT_HASH_MAP:
+        case OT_INSTANCE:
+        case OT_STRING_BUILDER:
+            // 先编号再写元素，元素再引用它时写MSG_REF
+            objMemoAdd(memo, objHeader, NUM_TO_VALUE(memo->count));
+            break;
+        default:
+            // 函数、闭包、线程、类及模块引用了本vm的状态，不能传到其它vm
+            return false;
+    }
+
+    uint32_t idx = 0;
+    switch (objHeader->type) {
+        case OT_STRING: {
+            ObjString *objString = flattenObjString(vm, (ObjString *)objHeader);
+            messageWriteTag(msg, MSG_STRING);
+            messageWriteBytes(msg, objString->value.start, objString->value.length);
+            return true;
+        }
+        case OT_LIST: {
+            ObjList *objList = (ObjList *)objHeader;
+            messageWriteTag(msg, MSG_LIST);
+            messageWriteU32(msg, objList->elements.count);
+            while (idx < objList->elements.count) {
+                if (!serializeValueAt(vm, objList->elements.datas[idx], msg, memo, depth + 1)) {
+                    return false;
+                }
+                idx ++;
+            }
+            return true;
+        }
+        case OT_MAP: {
+            ObjMap *objMap = (ObjMap *)objHeader;
+            messageWriteTag(msg, MSG_MAP);
+            messageWriteU32(msg, objMap->count);
+            while (idx < objMap->entryNum) {
+                Entry *entry = &objMap->entries[idx];
+                if (entry->key.type != VT_UNDEFINED) {
+                    if (!serializeValueAt(vm, entry->key, msg, memo, depth + 1) ||
+                        !serializeValueAt(vm, entry->value, msg, memo, depth + 1)) {
+                        return false;
+                    }
+                }
+                idx ++;
+            }
+            return true;
+        }
+        case OT_RANGE: {
+            ObjRange *objRange = (ObjRange *)objHeader;
+            messageWriteTag(msg, MSG_RANGE);
+            messageWrite(msg, &objRange->from, sizeof(double));
+            messageWrite(msg, &objRange->to, sizeof(double));
+            messageWrite(msg, &objRange->step, sizeof(double));
+            return true;
+        }
+        case OT_CHANNEL: {
+            // 接收方的channel对象共享同一个邮箱
+            Mailbox *mailbox = ((ObjChannel *)objHeader)->mailbox;
+            retainMailbox(mailbox);
+            messageWriteTag(msg, MSG_CHANNEL);
+            messageWrite(msg, &mailbox, sizeof(Mailbox *));
+            msg->mailboxNum ++;
+            return true;
+        }
+        case OT_TUPLE: {
+            ObjTuple *objTuple = (ObjTuple *)objHeader;
+            messageWriteTag(msg, MSG_TUPLE);
+            messageWriteU32(msg, objTuple->length);
+            while (idx < objTuple->length) {
+                if (!serializeValueAt(vm, objTuple->elements[idx], msg, memo, depth + 1)) {
+                    return false;
+                }
+                idx ++;
+            }
+            return true;
+        }
+        case OT_SET: {
+            ObjSet *objSet = (ObjSet *)objHeader;
+            messageWriteTag(msg, MSG_SET);
+            messageWriteU32(msg, objSet->count);
+            idx = setNextKey(objSet, 0);
+            while (idx < objSet->keyNum) {
+                if (!serializeValueAt(vm, objSet->keys[idx], msg, memo, depth + 1)) {
+                    return false;
+                }
+                idx = setNextKey(objSet, idx + 1);
+            }
+            return true;
+        }
+        case OT_TYPED_ARRAY: {
+            ObjTypedArray *array = (ObjTypedArray *)objHeader;
+            uint32_t elementSize = typedArrayElementSize(array->kind);
+            if (array->base != NULL) {
+                // 切片先写base，接收方的切片仍与base共享数据
+                messageWriteTag(msg, MSG_TYPED_SLICE);
+                if (!serializeValueAt(vm, OBJ_TO_VALUE(array->base), msg, memo, depth + 1)) {
+                    return false;
+                }
+                messageWriteU32(msg, (uint32_t)(array->data - array->base->data) / elementSize);
+                messageWriteU32(msg, array->length);
+                return true;
+            }
+            uint8_t kind = (uint8_t)array->kind;
+            messageWriteTag(msg, MSG_TYPED_ARRAY);
+            messageWrite(msg, &kind, 1);
+            messageWriteU32(msg, array->length);
+            messageWrite(msg, array->data, array->length * elementSize);
+            return true;
+        }
+        case OT_VECTOR: {
+            ObjVector *objVector = (ObjVector *)objHeader;
+            uint8_t isTransient = objVector->isTransient;
+            messageWriteTag(msg, MSG_VECTOR);
+            messageWrite(msg, &isTransient, 1);
+            messageWriteU32(msg, objVector->count);
+            while (idx < objVector->count) {
+                if (!serializeValueAt(vm, vectorGet(objVector, idx), msg, memo, depth + 1)) {
+                    return false;
+                }
+                idx ++;
+            }
+            return true;
+        }
+        case OT_HASH_MAP: {
+            ObjHashMap *objHashMap = (ObjHashMap *)objHeader;
+            uint8_t isTransient = objHashMap->isTransient;
+            messageWriteTag(msg, MSG_HASH_MAP);
+            messageWrite(msg, &isTransient, 1);
+            messageWriteU32(msg, objHashMap->count);
+            Value *keys = (Value *)malloc(sizeof(Value) * 2 * (objHashMap->count + 1));
+            if (keys == NULL) {
+                MEM_ERROR("allocate hash map serialize buffer failed!");
+            }
+            Value *values = keys + objHashMap->count + 1;
+            hashMapCollect(objHashMap, keys, values);
+            while (idx < objHashMap->count) {
+                if (!serializeValueAt(vm, keys[idx], msg, memo, depth + 1) ||
+                    !serializeValueAt(vm, values[idx], msg, memo, depth + 1)) {
+                    free(keys);
+                    return false;
+                }
+                idx ++;
+            }
+            free(keys);
+            return true;
+        }
+        case OT_INSTANCE: {
+            // 接收方按类名及字段数查找同名的类
+            ObjInstance *objInstance = (ObjInstance *)objHeader;
+            Class *class = objHeader->class;
+            messageWriteTag(msg, MSG_INSTANCE);
+            messageWriteBytes(msg, class->name->value.start, class->name->value.length);
+            messageWriteU32(msg, class->fieldNum);
+            while (idx < class->fieldNum) {
+                if (!serializeValueAt(vm, objInstance->fields[idx], msg, memo, depth + 1)) {
+                    return false;
+                }
+                idx ++;
+            }
+            return true;
+        }
+        default: {
+            ObjStringBuilder *builder = (ObjStringBuilder *)objHeader;
+            messageWriteTag(msg, MSG_STRING_BUILDER);
+            messageWriteBytes(msg, builder->buffer.datas, builder->buffer.count);
+            return true;
+        }
+    }
+}
+
+/**
+ * 把value序列化后追加到msg
+ * 支持的类型与copyValue相同，共享及循环引用在接收方保持
+ * @param vm
+ * @param value
+ * @param msg
+ * @return value不可序列化时返回false，此时msg内容不完整
+ */
+bool serializeValue(VM *vm, Value value, Message *msg) {
+    ObjMemo memo;
+    initObjMemo(&memo);
+    bool ok = serializeValueAt(vm, value, msg, &memo, 0);
+    freeObjMemo(&memo);
+    return ok;
+}
+
+/**
+ * 从消息中读取length个字节
+ * @param reader
+ * @param bytes
+ * @param length
+ */
+static void messageRead(MessageReader *reader, void *bytes, uint32_t length) {
+    if (reader->pos + length > reader->count) {
+        RUN_ERROR("message is truncated!");
+    }
+    memcpy(bytes, reader->datas + reader->pos, length);
+    reader->pos += length;
+}
+
+/**
+ * 读取4字节无符号数
+ * @param reader
+ * @return
+ */
+static uint32_t messageReadU32(MessageReader *reader) {
+    uint32_t num;
+    messageRead(reader, &num, sizeof(num));
+    return num;
+}
+
+/**
+ * 在vm的各模块中查找名为name且有fieldNum个字段的类，实例的副本属于该类
+ * @param vm
+ * @param name
+ * @param length
+ * @param fieldNum
+ * @return 没有时返回NULL
+ */
+static Class* findClassLike(VM *vm, const char *name, uint32_t length, uint32_t fieldNum) {
+    ObjMap *modules = vm->allModules;
+    uint32_t entryIdx = mapNextEntry(modules, 0);
+    while (entryIdx < modules->entryNum) {
+        ObjModule *objModule = VALUE_TO_OBJMODULE(modules->entries[entryIdx].value);
+        uint32_t idx = 0;
+        while (idx < objModule->moduelVarValue.count) {
+            Value value = objModule->moduelVarValue.datas[idx ++];
+            if (VALUE_IS_CLASS(value)) {
+                Class *class = VALUE_TO_CLASS(value);
+                if (class->fieldNum == fieldNum && class->name->value.length == length &&
+                    memcmp(class->name->value.start, name, length) == 0) {
+                    return class;
+                }
+            }
+        }
+        entryIdx = mapNextEntry(modules, entryIdx + 1);
+    }
+    return NULL;
+}
+
+/**
+ * 读取4字节长度及其后的内容，返回内容在消息中的起始位置
+ * @param reader
+ * @param length
+ * @return
+ */
+static const char* messageReadBytes(MessageReader *reader, uint32_t *length) {
+    *length = messageReadU32(reader);
+    if (reader->pos + *length > reader->count) {
+        RUN_ERROR("message is truncated!");
+    }
+    const char *bytes = (const char *)reader->datas + reader->pos;
+    reader->pos += *length;
+    return bytes;
+}
+
+/**
+ * 递归反序列化出一个值，创建的对象都属于vm
+ * 对象按消息中首次出现的顺序记入refs，先记入再读元素，MSG_REF按编号取回
+ * @param vm
+ * @param reader
+ * @param refs
+ * @return
+ */
+static Value deserializeValueAt(VM *vm, MessageReader *reader, ValueBuffer *refs) {
+    uint8_t tag;
+    messageRead(reader, &tag, 1);
+
+    uint32_t length;
+    uint32_t count;
+    uint32_t idx = 0;
+    switch ((MessageTag)tag) {
+        case MSG_NULL:
+            return VT_TO_VALUE(VT_NULL);
+        case MSG_FALSE:
+            return VT_TO_VALUE(VT_FALSE);
+        case MSG_TRUE:
+            return VT_TO_VALUE(VT_TRUE);
+        case MSG_NUM: {
+            double num;
+            messageRead(reader, &num, sizeof(double));
+            return NUM_TO_VALUE(num);
+        }
+        case MSG_REF: {
+            uint32_t ref = messageReadU32(reader);
+            if (ref >= refs->count) {
+                RUN_ERROR("message refers to an unknown object!");
+            }
+            return refs->datas[ref];
+        }
+        case MSG_STRING: {
+            const char *bytes = messageReadBytes(reader, &length);
+            Value value = OBJ_TO_VALUE(newObjString(vm, bytes, length));
+            ValueBufferAdd(vm, refs, value);
+            return value;
+        }
+        case MSG_LIST: {
+            count = messageReadU32(reader);
+            ObjList *objList = newObjList(vm, count);
+            while (idx < count) {
+                objList->elements.datas[idx ++] = VT_TO_VALUE(VT_NULL);
+            }
+            ValueBufferAdd(vm, refs, OBJ_TO_VALUE(objList));
+            idx = 0;
+            while (idx < count) {
+                objList->elements.datas[idx] = deserializeValueAt(vm, reader, refs);
+                idx ++;
+            }
+            return OBJ_TO_VALUE(objList);
+        }
+        case MSG_MAP: {
+            count = messageReadU32(reader);
+            ObjMap *objMap = newObjMap(vm);
+            ValueBufferAdd(vm, refs, OBJ_TO_VALUE(objMap));
+            while (idx < count) {
+                Value key = deserializeValueAt(vm, reader, refs);
+                Value value = deserializeValueAt(vm, reader, refs);
+                mapSet(vm, objMap, key, value);
+                idx ++;
+            }
+            return OBJ_TO_VALUE(objMap);
+        }
+        case MSG_RANGE: {
+            double from, to, step;
+            messageRead(reader, &from, sizeof(double));
+            messageRead(reader, &to, sizeof(double));
+            messageRead(reader, &step, sizeof(double));
+            Value value = OBJ_TO_VALUE(newObjRange(vm, from, to, step));
+            ValueBufferAdd(vm, refs, value);
+            return value;
+        }
+        case MSG_CHANNEL: {
+            Mailbox *mailbox;
+            // 消息的引用在释放消息时归还，channel另持一个
+            messageRead(reader, &mailbox, sizeof(Mailbox *));
+            retainMailbox(mailbox);
+            Value value = OBJ_TO_VALUE(newObjChannel(vm, mailbox));
+            ValueBufferAdd(vm, refs, value);
+            return value;
+        }
+        case MSG_FROZEN: {
+            ObjHeader *objHeader;
+            messageRead(reader, &objHeader, sizeof(ObjHeader *));
+            return OBJ_TO_VALUE(objHeader);
+        }
+        case MSG_TUPLE: {
+            // 元素先置为null，记入refs后再逐个读出
+            count = messageReadU32(reader);
+            ObjTuple *objTuple = newObjTuple(vm, NULL, count);
+            ValueBufferAdd(vm, refs, OBJ_TO_VALUE(objTuple));
+            while (idx < count) {
+                objTuple->elements[idx] = deserializeValueAt(vm, reader, refs);
+                idx ++;
+            }
+            return OBJ_TO_VALUE(objTuple);
+        }
+        case MSG_SET: {
+            count = messageReadU32(reader);
+            ObjSet *objSet = newObjSet(vm);
+            ValueBufferAdd(vm, refs, OBJ_TO_VALUE(objSet));
+            while (idx < count) {
+                setAdd(vm, objSet, deserializeValueAt(vm, reader, refs));
+                idx ++;
+            }
+            return OBJ_TO_VALUE(objSet);
+        }
+        case MSG_TYPED_ARRAY: {
+            uint8_t kind;
+            messageRead(reader, &kind, 1);
+            count = messageReadU32(reader);
+            if (kind > TA_BYTE) {
+                RUN_ERROR("unknown typed array kind %d!", kind);
+            }
+            uint64_t size = (uint64_t)count * typedArrayElementSize(kind);
+            if (reader->pos + size > reader->count) {
+                RUN_ERROR("message is truncated!");
+            }
+            ObjTypedArray *array = newObjTypedArray(vm, (TypedArrayKind)kind, count);
+            messageRead(reader, array->data, (uint32_t)size);
+            ValueBufferAdd(vm, refs, OBJ_TO_VALUE(array));
+            return OBJ_TO_VALUE(array);
+        }
+        case MSG_TYPED_SLICE: {
+            // 切片的编号在base之前
+            uint32_t ref = refs->count;
+            ValueBufferAdd(vm, refs, VT_TO_VALUE(VT_NULL));
+            Value base = deserializeValueAt(vm, reader, refs);
+            uint32_t start = messageReadU32(reader);
+            count = messageReadU32(reader);
+            if (!VALUE_IS_CREATIN_OBJ(base, OT_TYPED_ARRAY)) {
+                RUN_ERROR("base of typed array slice must be a typed array!");
+            }
+            Value value = OBJ_TO_VALUE(newTypedArraySlice(vm, (ObjTypedArray *)VALUE_TO_OBJ(base), start, count));
+            refs->datas[ref] = value;
+            return value;
+        }
+        case MSG_VECTOR: {
+            // 以暂态逐个追加，最后恢复发送方的状态
+            uint8_t isTransient;
+            messageRead(reader, &isTransient, 1);
+            count = messageReadU32(reader);
+            ObjVector *objVector = vectorTransient(vm, newObjVector(vm));
+            ValueBufferAdd(vm, refs, OBJ_TO_VALUE(objVector));
+            while (idx < count) {
+                vectorAdd(vm, objVector, deserializeValueAt(vm, reader, refs));
+                idx ++;
+            }
+            objVector->isTransient = isTransient;
+            return OBJ_TO_VALUE(objVector);
+        }
+        case MSG_HASH_MAP: {
+            uint8_t isTransient;
+            messageRead(reader, &isTransient, 1);
+            count = messageReadU32(reader);
+            ObjHashMap *objHashMap = hashMapTransient(vm, newObjHashMap(vm));
+            ValueBufferAdd(vm, refs, OBJ_TO_VALUE(objHashMap));
+            while (idx < count) {
+                Value key = deserializeValueAt(vm, reader, refs);
+                Value value = deserializeValueAt(vm, reader, refs);
+                hashMapSet(vm, objHashMap, key, value);
+                idx ++;
+            }
+            objHashMap->isTransient = isTransient;
+            return OBJ_TO_VALUE(objHashMap);
+        }
+        case MSG_INSTANCE: {
+            const char *name = messageReadBytes(reader, &length);
+            count = messageReadU32(reader);
+            Class *class = findClassLike(vm, name, length, count);
+            if (class == NULL) {
+                RUN_ERROR("class %.*s is not defined in the receiving vm!", (int)length, name);
+            }
+            ObjInstance *objInstance = newObjInstance(vm, class);
+            ValueBufferAdd(vm, refs, OBJ_TO_VALUE(objInstance));
+            while (idx < count) {
+                objInstance->fields[idx] = deserializeValueAt(vm, reader, refs);
+                idx ++;
+            }
+            return OBJ_TO_VALUE(objInstance);
+        }
+        case MSG_STRING_BUILDER: {
+            const char *bytes = messageReadBytes(reader, &length);
+            ObjStringBuilder *builder = newObjStringBuilder(vm);
+            if (length > 0) {
+                ByteBufferFillWrite(vm, &builder->buffer, 0, length);
+                memcpy(builder->buffer.datas, bytes, length);
+            }
+            ValueBufferAdd(vm, refs, OBJ_TO_VALUE(builder));
+            return OBJ_TO_VALUE(builder);
+        }
+        default:
+            RUN_ERROR("unknown message tag %d!", tag);
+    }
+    return VT_TO_VALUE(VT_NULL);
+}
+
+/**
+ * 在vm中重建msg所表示的值
+ * @param vm
+ * @param msg
+ * @return
+ */
+Value deserializeValue(VM *vm, Message *msg) {
+    MessageReader reader = {msg->datas, msg->count, 0};
+    ValueBuffer refs;
+    ValueBufferInit(&refs);
+    Value value = deserializeValueAt(vm, &reader, &refs);
+    ValueBufferClear(vm, &refs);
+    return value;
+}
+
+/**
+ * 递归拷贝value，新建的对象先记入memo再拷贝其元素，元素再引用它时直接取副本
+ * @param vm
+ * @param value
+ * @param memo
+ * @param depth 当前嵌套层数
+ * @return value或其中的元素不可拷贝时返回VT_UNDEFINED，原因写入memo->error
+ */
+static Value copyValueAt(VM *vm, Value value, CopyMemo *memo, uint32_t depth) {
+    if (value.type != VT_OBJ || VALUE_TO_OBJ(value)->isFrozen) {
+        return value;
+    }
+    ObjHeader *objHeader = VALUE_TO_OBJ(value);
+    Value *copied = objMemoFind(&memo->copies, objHeader);
+    if (copied != NULL) {
+        return *copied;
+    }
+    if (depth > MAX_SERIALIZE_DEPTH) {
+        snprintf(memo->error, sizeof(memo->error), "value nested too deep to copy!");
+        return VT_TO_VALUE(VT_UNDEFINED);
+    }
+
+    switch (objHeader->type) {
+        case OT_STRING: {
+            // 源串属于别的vm，不可展开其中的拼接串
+            Value copy = OBJ_TO_VALUE(copyObjString(vm, (ObjString *)objHeader));
+            objMemoAdd(&memo->copies, objHeader, copy);
+            return copy;
+        }
+        case OT_LIST: {
+            ObjList *src = (ObjList *)objHeader;
+            ObjList *objList = newObjList(vm, src->elements.count);
+            objMemoAdd(&memo->copies, objHeader, OBJ_TO_VALUE(objList));
+            uint32_t idx = 0;
+            while (idx < src->elements.count) {
+                objList->elements.datas[idx] = VT_TO_VALUE(VT_NULL);
+                idx ++;
+            }
+            idx = 0;
+            while (idx < src->elements.count) {
+                objList->elements.datas[idx] = copyValueAt(vm, src->elements.datas[idx], memo, depth + 1);
+                if (objList->elements.datas[idx].type == VT_UNDEFINED) {
+                    return VT_TO_VALUE(VT_UNDEFINED);
+                }
+                idx ++;
+            }
+            return OBJ_TO_VALUE(objList);
+        }
+        case OT_MAP: {
+            ObjMap *src = (ObjMap *)objHeader;
+            ObjMap *objMap = newObjMap(vm);
+            objMemoAdd(&memo->copies, objHeader, OBJ_TO_VALUE(objMap));
+            mapReserve(vm, objMap, src->count);
+            uint32_t idx = mapNextEntry(src, 0);
+            while (idx < src->entryNum) {
+                Value key = copyValueAt(vm, src->entries[idx].key, memo, depth + 1);
+                Value entryValue = copyValueAt(vm, src->entries[idx].value, memo, depth + 1);
+                if (key.type == VT_UNDEFINED || entryValue.type == VT_UNDEFINED) {
+                    return VT_TO_VALUE(VT_UNDEFINED);
+                }
+                mapSet(vm, objMap, key, entryValue);
+                idx = mapNextEntry(src, idx + 1);
+            }
+            return OBJ_TO_VALUE(objMap);
+        }
+        case OT_RANGE: {
+            ObjRange *src = (ObjRange *)objHeader;
+            Value copy = OBJ_TO_VALUE(newObjRange(vm, src->from, src->to, src->step));
+            objMemoAdd(&memo->copies, objHeader, copy);
+            return copy;
+        }
+        case OT_CHANNEL: {
+            Mailbox *mailbox = ((ObjChannel *)objHeader)->mailbox;
+            retainMailbox(mailbox);
+            Value copy = OBJ_TO_VALUE(newObjChannel(vm, mailbox));
+            objMemoAdd(&memo->copies, objHeader, copy);
+            return copy;
+        }
+        case OT_TUPLE: {
+            // 元素先原样放入，记入memo后再逐个换成副本
+            ObjTuple *src = (ObjTuple *)objHeader;
+            ObjTuple *objTuple = newObjTuple(vm, src->elements, src->length);
+            objMemoAdd(&memo->copies, objHeader, OBJ_TO_VALUE(objTuple));
+            uint32_t idx = 0;
+            while (idx < src->length) {
+                objTuple->elements[idx] = copyValueAt(vm, src->elements[idx], memo, depth + 1);
+                if (objTuple->elements[idx].type == VT_UNDEFINED) {
+                    return VT_TO_VALUE(VT_UNDEFINED);
+                }
+                idx ++;
+            }
+            return OBJ_TO_VALUE(objTuple);
+        }
+        case OT_SET: {
+            ObjSet *src = (ObjSet *)objHeader;
+            ObjSet *objSet = newObjSet(vm);
+            objMemoAdd(&memo->copies, objHeader, OBJ_TO_VALUE(objSet));
+            uint32_t idx = setNextKey(src, 0);
+            while (idx < src->keyNum) {
+                Value key = copyValueAt(vm, src->keys[idx], memo, depth + 1);
+                if (key.type == VT_UNDEFINED) {
+                    return VT_TO_VALUE(VT_UNDEFINED);
+                }
+                setAdd(vm, objSet, key);
+                idx = setNextKey(src, idx + 1);
+            }
+            return OBJ_TO_VALUE(objSet);
+        }
+        case OT_TYPED_ARRAY: {
+            ObjTypedArray *src = (ObjTypedArray *)objHeader;
+            ObjTypedArray *array;
+            if (src->base != NULL) {
+                // 切片仍与base的副本共享数据
+                Value base = copyValueAt(vm, OBJ_TO_VALUE(src->base), memo, depth + 1);
+                uint32_t start = (uint32_t)(src->data - src->base->data) / typedArrayElementSize(src->kind);
+                array = newTypedArraySlice(vm, (ObjTypedArray *)VALUE_TO_OBJ(base), start, src->length);
+            }
+            else {
+                array = newObjTypedArray(vm, src->kind, src->length);
+                memcpy(array->data, src->data, (size_t)src->length * typedArrayElementSize(src->kind));
+            }
+            objMemoAdd(&memo->copies, objHeader, OBJ_TO_VALUE(array));
+            return OBJ_TO_VALUE(array);
+        }
+        case OT_STRING_BUILDER: {
+            ObjStringBuilder *src = (ObjStringBuilder *)objHeader;
+            ObjStringBuilder *builder = newObjStringBuilder(vm);
+            if (src->buffer.count > 0) {
+                ByteBufferFillWrite(vm, &builder->buffer, 0, src->buffer.count);
+                memcpy(builder->buffer.datas, src->buffer.datas, src->buffer.count);
+            }
+            objMemoAdd(&memo->copies, objHeader, OBJ_TO_VALUE(builder));
+            return OBJ_TO_VALUE(builder);
+        }
+        case OT_VECTOR: {
+            // 以暂态逐个追加，节点全部新建，不与源vm共享
+            ObjVector *src = (ObjVector *)objHeader;
+            ObjVector *objVector = vectorTransient(vm, newObjVector(vm));
+            objMemoAdd(&memo->copies, objHeader, OBJ_TO_VALUE(objVector));
+            uint32_t idx = 0;
+            while (idx < src->count) {
+                Value element = copyValueAt(vm, vectorGet(src, idx), memo, depth + 1);
+                if (element.type == VT_UNDEFINED) {
+                    return VT_TO_VALUE(VT_UNDEFINED);
+                }
+                vectorAdd(vm, objVector, element);
+                idx ++;
+            }
+            objVector->isTransient = src->isTransient;
+            return OBJ_TO_VALUE(objVector);
+        }
+        case OT_HASH_MAP: {
+            ObjHashMap *src = (ObjHashMap *)objHeader;
+            ObjHashMap *objHashMap = hashMapTransient(vm, newObjHashMap(vm));
+            objMemoAdd(&memo->copies, objHeader, OBJ_TO_VALUE(objHashMap));
+            Value *keys = (Value *)malloc(sizeof(Value) * 2 * (src->count + 1));
+            if (keys == NULL) {
+                MEM_ERROR("allocate hash map copy buffer failed!");
+            }
+            Value *values = keys + src->count + 1;
+            hashMapCollect(src, keys, values);
+            uint32_t idx = 0;
+            while (idx < src->count) {
+                Value key = copyValueAt(vm, keys[idx], memo, depth + 1);
+                Value entryValue = copyValueAt(vm, values[idx], memo, depth + 1);
+                if (key.type == VT_UNDEFINED || entryValue.type == VT_UNDEFINED) {
+                    free(keys);
+                    return VT_TO_VALUE(VT_UNDEFINED);
+                }
+                hashMapSet(vm, objHashMap, key, entryValue);
+                idx ++;
+            }
+            free(keys);
+            objHashMap->isTransient = src->isTransient;
+            return OBJ_TO_VALUE(objHashMap);
+        }
+        case OT_INSTANCE: {
+            CharValue *name = &objHeader->class->name->value;
+            Class *class = findClassLike(vm, name->start, name->length, objHeader->class->fieldNum);
+            if (class == NULL) {
+                snprintf(memo->error, sizeof(memo->error), "class %.*s is not defined in the receiving vm!",
+                         (int)name->length, name->start);
+                return VT_TO_VALUE(VT_UNDEFINED);
+            }
+            ObjInstance *src = (ObjInstance *)objHeader;
+            ObjInstance *objInstance = newObjInstance(vm, class);
+            objMemoAdd(&memo->copies, objHeader, OBJ_TO_VALUE(objInstance));
+            uint32_t idx = 0;
+            while (idx < class->fieldNum) {
+                objInstance->fields[idx] = copyValueAt(vm, src->fields[idx], memo, depth + 1);
+                if (objInstance->fields[idx].type == VT_UNDEFINED) {
+                    return VT_TO_VALUE(VT_UNDEFINED);
+                }
+                idx ++;
+            }
+            return OBJ_TO_VALUE(objInstance);
+        }
+        default:
+            // 函数、闭包、线程、类及模块引用了源vm的状态
+            snprintf(memo->error, sizeof(memo->error), "functions, threads, classes and modules can`t be copied!");
+            return VT_TO_VALUE(VT_UNDEFINED);
+    }
+}
+
+/**
+ * 把另一个vm中的value深拷贝到vm，不经过序列化
+ * 要求源vm在拷贝期间不被修改，共享堆中的对象原样返回，同一对象只拷贝一次
+ * @param vm
+ * @param value
+ * @return 不可拷贝时返回VT_UNDEFINED，vm有当前线程时设置其错误，已拷贝的部分留在vm中
+ */
+Value copyValue(VM *vm, Value value) {
+    CopyMemo memo;
+    initObjMemo(&memo.copies);
+    memo.error[0] = '\0';
+    Value copy = copyValueAt(vm, value, &memo, 0);
+    freeObjMemo(&memo.copies);
+    if (copy.type == VT_UNDEFINED && vm->curThread != NULL) {
+        vm->curThread->errorObj = OBJ_TO_VALUE(newObjString(vm, memo.error, strlen(memo.error)));
+    }
+    return copy;
+}
+
+/**
+ * 初始化跨线程消息队列
+ * @param channel
+ */
+void initVmChannel(VmChannel *channel) {
+    pthread_mutex_init(&channel->lock, NULL);
+    pthread_cond_init(&channel->notEmpty, NULL);
+    channel->head = channel->tail = NULL;
+    channel->length = 0;
+    channel->closed = false;
+}
+
+/**
+ * 销毁队列，释放其中未被接收的消息
+ * @param channel
+ */
+void destroyVmChannel(VmChannel *channel) {
+    Message *msg = channel->head;
+    while (msg != NULL) {
+        Message *next = msg->next;
+        freeMessage(msg);
+        msg = next;
+    }
+    channel->head = channel->tail = NULL;
+    pthread_cond_destroy(&channel->notEmpty);
+    pthread_mutex_destroy(&channel->lock);
+}
+
+/**
+ * 发送消息，msg的所有权转移给队列
+ * @param channel
+ * @param msg
+ * @return 队列已关闭时返回false，msg仍归调用方
+ */
+bool vmChannelSend(VmChannel *channel, Message *msg) {
+    pthread_mutex_lock(&channel->lock);
+    if (channel->closed) {
+        pthread_mutex_unlock(&channel->lock);
+        return false;
+    }
+    msg->next = NULL;
+    if (channel->tail == NULL) {
+        channel->head = msg;
+    }
+    else {
+        channel->tail->next = msg;
+    }
+    channel->tail = msg;
+    channel->length ++;
+    pthread_cond_signal(&channel->notEmpty);
+    pthread_mutex_unlock(&channel->lock);
+    return true;
+}
+
+/**
+ * 接收消息，队列为空时阻塞当前os线程
+ * @param channel
+ * @return 队列已关闭且为空时返回NULL
+ */
+Message* vmChannelReceive(VmChannel *channel) {
+    pthread_mutex_lock(&channel->lock);
+    while (channel->head == NULL && !channel->closed) {
+        pthread_cond_wait(&channel->notEmpty, &channel->lock);
+    }
+    Message *msg = channel->head;
+    if (msg != NULL) {
+        channel->head = msg->next;
+        if (channel->head == NULL) {
+            channel->tail = NULL;
+        }
+        channel->length --;
+        msg->next = NULL;
+    }
+    pthread_mutex_unlock(&channel->lock);
+    return msg;
+}
+
+/**
+ * 关闭队列，阻塞在接收上的线程取完剩余消息后得到NULL
+ * @param channel
+ */
+void vmChannelClose(VmChannel *channel) {
+    pthread_mutex_lock(&channel->lock);
+    channel->closed = true;
+    pthread_cond_broadcast(&channel->notEmpty);
+    pthread_mutex_unlock(&channel->lock);
+}
@@ -0,0 +1,66 @@
+//
+// Created by ZiXuan on 2022/7/12.
+//
+
+#ifndef SPARROW_MESSAGE_H
+#define SPARROW_MESSAGE_H
+
+#include <pthread.h>
+#include "../object/header_obj.h"
+
+// 序列化及拷贝时容器的最大嵌套层数，循环引用由memo处理，不受此限制
+#define MAX_SERIALIZE_DEPTH 128
+
+typedef enum {
+    MSG_NULL,
+    MSG_FALSE,
+    MSG_TRUE,
+    MSG_NUM,     // 8字节double
+    MSG_STRING,  // 4字节长度 + 内容
+    MSG_LIST,    // 4字节元素个数 + 各元素
+    MSG_MAP,     // 4字节entry个数 + 各key、value
+    MSG_RANGE,   // 4字节from + 4字节to
+    MSG_CHANNEL, // Mailbox指针，消息持有其一个引用
+    MSG_FROZEN,  // 共享堆中对象的指针，接收方直接引用
+    MSG_TUPLE,   // 4字节元素个数 + 各元素
+    MSG_SET,     // 4字节key个数 + 各key
+    MSG_TYPED_ARRAY, // 1字节元素类型 + 4字节元素个数 + 数据
+    MSG_TYPED_SLICE, // base + 4字节起始下标 + 4字节元素个数
+    MSG_VECTOR,  // 1字节是否暂态 + 4字节元素个数 + 各元素
+    MSG_HASH_MAP, // 1字节是否暂态 + 4字节entry个数 + 各key、value
+    MSG_INSTANCE, // 4字节类名长度 + 类名 + 4字节字段数 + 各字段
+    MSG_STRING_BUILDER, // 4字节长度 + 内容
+    MSG_REF      // 4字节编号，引用消息中先出现的第几个对象
+} MessageTag;  // 对象按首次出现的顺序编号，再次出现时只写MSG_REF
+
+typedef struct message {
+    uint8_t *datas; // 序列化后的值，用malloc分配，不属于任何vm
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t sender; // 发送方worker的id
+    uint32_t mailboxNum; // 消息中channel持有的邮箱引用数，释放消息时一并归还
+    struct message *next;
+} Message;  // 在vm之间传递的值，发送时把所有权转移给接收方
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty;
+    Message *head;
+    Message *tail;
+    uint32_t length;
+    bool closed;
+} VmChannel;  // 跨os线程的消息队列
+
+Message* newMessage(void);
+void freeMessage(Message *msg);
+bool serializeValue(VM *vm, Value value, Message *msg);
+Value deserializeValue(VM *vm, Message *msg);
+Value copyValue(VM *vm, Value value);
+
+void initVmChannel(VmChannel *channel);
+void destroyVmChannel(VmChannel *channel);
+bool vmChannelSend(VmChannel *channel, Message *msg);
+Message* vmChannelReceive(VmChannel *channel);
+void vmChannelClose(VmChannel *channel);
+
+#endif //SPARROW_MESSAGE_H
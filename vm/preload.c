@@ -0,0 +1,251 @@
+//
+// Created by ZiXuan on 2022/7/20.
+//
+
+#include "preload.h"
+#include "core.h"
+#include "../parser/parser.h"
+#include "../object/class.h"
+
+#include <string.h>
+
+/**
+ * 读取模块name的源码，路径为rootDir/name.sp
+ * @param name
+ * @return
+ */
+const char* readModuleSource(const char *name) {
+    const char *root = rootDir == NULL ? "" : rootDir;
+    char *path = (char *)malloc(strlen(root) + strlen(name) + 4);
+    if (path == NULL) {
+        MEM_ERROR("allocate module path failed!");
+    }
+    sprintf(path, "%s%s.sp", root, name);
+    const char *source = readFile(path);
+    free(path);
+    return source;
+}
+
+/**
+ * 查找模块，不存在时加入依赖图，调用方须持有锁
+ * @param graph
+ * @param name
+ * @param length
+ * @return 模块在图中的下标
+ */
+static uint32_t ensureGraphModule(ModuleGraph *graph, const char *name, uint32_t length) {
+    uint32_t idx = 0;
+    while (idx < graph->count) {
+        if (strlen(graph->modules[idx].name) == length &&
+            memcmp(graph->modules[idx].name, name, length) == 0) {
+            return idx;
+        }
+        idx ++;
+    }
+
+    if (graph->count == graph->capacity) {
+        graph->capacity = graph->capacity == 0 ? MIN_CAPACITY : graph->capacity * CAPACITY_GROW_FACTOR;
+        graph->modules = (PreloadModule *)realloc(graph->modules, sizeof(PreloadModule) * graph->capacity);
+        if (graph->modules == NULL) {
+            MEM_ERROR("grow module graph failed!");
+        }
+    }
+    PreloadModule *module = &graph->modules[graph->count];
+    memset(module, 0, sizeof(PreloadModule));
+    module->name = (char *)malloc(length + 1);
+    if (module->name == NULL) {
+        MEM_ERROR("allocate module name failed!");
+    }
+    memcpy(module->name, name, length);
+    module->name[length] = '\0';
+    pthread_cond_broadcast(&graph->changed);
+    return graph->count ++;
+}
+
+/**
+ * 记录模块from依赖模块to，调用方须持有锁
+ * @param graph
+ * @param from
+ * @param to
+ */
+static void addDependency(ModuleGraph *graph, uint32_t from, uint32_t to) {
+    PreloadModule *module = &graph->modules[from];
+    if (module->depNum == module->depCapacity) {
+        module->depCapacity = module->depCapacity == 0 ? MIN_CAPACITY : module->depCapacity * CAPACITY_GROW_FACTOR;
+        module->deps = (uint32_t *)realloc(module->deps, sizeof(uint32_t) * module->depCapacity);
+        if (module->deps == NULL) {
+            MEM_ERROR("grow module dependencies failed!");
+        }
+    }
+    module->deps[module->depNum ++] = to;
+}
+
+/**
+ * 只做词法分析，找出源码中的import语句并把被导入的模块加入依赖图
+ * 新加入的模块立即可被其它线程领取，无须等本模块编译完
+ * @param vm
+ * @param graph
+ * @param moduleIdx
+ * @param source
+ */
+static void scanImports(VM *vm, ModuleGraph *graph, uint32_t moduleIdx, const char *source) {
+    Parser parser;
+    initParser(vm, &parser, "import scan", source, NULL);
+    getNextToken(&parser);
+    while (parser.curToken.type != TOKEN_EOF) {
+        if (parser.curToken.type == TOKEN_IMPORT) {
+            getNextToken(&parser);
+            if (parser.curToken.type == TOKEN_ID) {
+                pthread_mutex_lock(&graph->lock);
+                uint32_t depIdx = ensureGraphModule(graph, parser.curToken.start, parser.curToken.length);
+                addDependency(graph, moduleIdx, depIdx);
+                pthread_mutex_unlock(&graph->lock);
+            }
+            continue;
+        }
+        getNextToken(&parser);
+    }
+}
+
+/**
+ * 编译线程：领取未编译的模块，扫描其import后在独立的vm中编译
+ * 所有已发现的模块都编译完成时退出
+ * @param arg
+ * @return
+ */
+static void* preloadMain(void *arg) {
+    ModuleGraph *graph = (ModuleGraph *)arg;
+
+    pthread_mutex_lock(&graph->lock);
+    while (true) {
+        while (graph->nextJob == graph->count && graph->doneNum < graph->count) {
+            pthread_cond_wait(&graph->changed, &graph->lock);
+        }
+        if (graph->nextJob == graph->count) {
+            break;
+        }
+        uint32_t idx = graph->nextJob ++;
+        char *name = graph->modules[idx].name;
+        const char *source = graph->modules[idx].source;
+        pthread_mutex_unlock(&graph->lock);
+
+        if (source == NULL) {
+            source = readModuleSource(name);
+        }
+        VM *vm = newVM();
+        scanImports(vm, graph, idx, source);
+        CompiledImage *image = compileImage(vm, name, source);
+
+        pthread_mutex_lock(&graph->lock);
+        graph->modules[idx].source = source;
+        graph->modules[idx].image = image;
+        graph->doneNum ++;
+        pthread_cond_broadcast(&graph->changed);
+    }
+    pthread_mutex_unlock(&graph->lock);
+    return NULL;
+}
+
+/**
+ * 按依赖顺序把模块及其依赖链接到vm，被依赖者先链接，循环导入时按发现顺序打断
+ * @param vm
+ * @param graph
+ * @param idx
+ */
+static void linkModule(VM *vm, ModuleGraph *graph, uint32_t idx) {
+    PreloadModule *module = &graph->modules[idx];
+    if (module->linked) {
+        return;
+    }
+    module->linked = true;
+
+    uint32_t depIdx = 0;
+    while (depIdx < module->depNum) {
+        linkModule(vm, graph, module->deps[depIdx]);
+        depIdx ++;
+    }
+
+    ObjFn *fn = instantiateImage(vm, module->image);
+    if (vm->preloadedFns == NULL) {
+        vm->preloadedFns = newObjMap(vm);
+    }
+    Value name = OBJ_TO_VALUE(newObjString(vm, module->name, strlen(module->name)));
+    mapSet(vm, vm->preloadedFns, name, OBJ_TO_VALUE(fn));
+}
+
+/**
+ * 从根模块出发，经import语句找出全部依赖模块，用threadNum个线程并行编译，
+ * 再在当前线程按依赖顺序链接到vm->allModules
+ * 链接后的模块尚未执行，其顶层函数留待loadModule取用
+ * @param vm
+ * @param rootName 根模块名
+ * @param rootSource 根模块源码
+ * @param threadNum
+ * @return 预编译的模块数
+ */
+uint32_t preloadModules(VM *vm, const char *rootName, const char *rootSource, uint32_t threadNum) {
+    ModuleGraph graph;
+    memset(&graph, 0, sizeof(ModuleGraph));
+    pthread_mutex_init(&graph.lock, NULL);
+    pthread_cond_init(&graph.changed, NULL);
+    uint32_t rootIdx = ensureGraphModule(&graph, rootName, strlen(rootName));
+    graph.modules[rootIdx].source = rootSource;
+
+    if (threadNum == 0) {
+        threadNum = 1;
+    }
+    pthread_t *tids = (pthread_t *)malloc(sizeof(pthread_t) * threadNum);
+    if (tids == NULL) {
+        MEM_ERROR("allocate compile threads failed!");
+    }
+    uint32_t idx = 0;
+    while (idx < threadNum) {
+        if (pthread_create(&tids[idx], NULL, preloadMain, &graph) != 0) {
+            MEM_ERROR("create compile thread %d failed!", idx);
+        }
+        idx ++;
+    }
+    idx = 0;
+    while (idx < threadNum) {
+        pthread_join(tids[idx], NULL);
+        idx ++;
+    }
+    free(tids);
+
+    linkModule(vm, &graph, rootIdx);
+
+    // 编译用的vm随镜像保留，gc实现前没有逐对象释放vm的途径
+    uint32_t moduleNum = graph.count;
+    idx = 0;
+    while (idx < graph.count) {
+        PreloadModule *module = &graph.modules[idx];
+        if (module->source != rootSource) {
+            free((char *)module->source);
+        }
+        free(module->name);
+        free(module->deps);
+        idx ++;
+    }
+    free(graph.modules);
+    pthread_cond_destroy(&graph.changed);
+    pthread_mutex_destroy(&graph.lock);
+    return moduleNum;
+}
+
+/**
+ * 取出模块moduleName已预编译链接的顶层函数，每个模块只能取一次
+ * @param vm
+ * @param moduleName
+ * @return 未预编译时返回NULL
+ */
+ObjFn* takePreloadedFn(VM *vm, Value moduleName) {
+    if (vm->preloadedFns == NULL) {
+        return NULL;
+    }
+    Value fn = mapGet(vm, vm->preloadedFns, moduleName);
+    if (fn.type == VT_UNDEFINED) {
+        return NULL;
+    }
+    removeKey(vm, vm->preloadedFns, moduleName);
+    return VALUE_TO_OBJFN(fn);
+}
@@ -0,0 +1,34 @@
+//
+// Created by ZiXuan on 2022/7/20.
+//
+
+#ifndef SPARROW_PRELOAD_H
+#define SPARROW_PRELOAD_H
+
+#include "worker.h"
+
+typedef struct {
+    char *name;             // 模块名，即import后的标识符，根模块为其文件路径
+    const char *source;
+    CompiledImage *image;   // 编译完成前为NULL
+    uint32_t *deps;         // 本模块import的模块在图中的下标
+    uint32_t depNum;
+    uint32_t depCapacity;
+    bool linked;
+} PreloadModule;  // 依赖图中的一个模块
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;  // 有新模块加入或有模块编译完成
+    PreloadModule *modules;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t nextJob;        // 下一个待编译的模块
+    uint32_t doneNum;        // 已编译完成的模块数
+} ModuleGraph;  // 由import语句发现的模块依赖图
+
+const char* readModuleSource(const char *name);
+uint32_t preloadModules(VM *vm, const char *rootName, const char *rootSource, uint32_t threadNum);
+ObjFn* takePreloadedFn(VM *vm, Value moduleName);
+
+#endif //SPARROW_PRELOAD_H
@@ -0,0 +1,284 @@
+//
+// Created by ZiXuan on 2022/7/18.
+//
+
+#include "shared_heap.h"
+#include "vm.h"
+#include "../object/class.h"
+#include "../object/obj_list.h"
+#include "../object/obj_map.h"
+#include "../object/obj_range.h"
+
+#include <string.h>
+#include <pthread.h>
+
+typedef struct {
+    pthread_mutex_t lock;
+    ObjHeader *allObjects; // 所有冻结对象，不在任何vm的allObjects中
+    uint64_t allocatedBytes;
+} SharedHeap;  // 进程内各vm共享的只读堆，对象一经冻结便不再移动也不被回收
+
+static SharedHeap sharedHeap = {PTHREAD_MUTEX_INITIALIZER, NULL, 0};
+
+typedef struct {
+    ObjMemo frozen; // 源对象到冻结副本，使共享及循环引用在副本中保持
+    ObjHeader *created; // 本次新建的冻结对象，全部成功后才挂到共享堆
+    ObjHeader *lastCreated;
+} FreezeState;  // 一次freezeValue的状态
+
+/**
+ * 在共享堆中分配size字节
+ * @param size
+ * @return
+ */
+static void* sharedAlloc(size_t size) {
+    void *ptr = malloc(size);
+    if (ptr == NULL) {
+        MEM_ERROR("allocate shared heap memory failed!");
+    }
+    __atomic_add_fetch(&sharedHeap.allocatedBytes, size, __ATOMIC_RELAXED);
+    return ptr;
+}
+
+/**
+ * 释放sharedAlloc分配的size字节
+ * @param ptr 可为NULL
+ * @param size
+ */
+static void sharedFree(void *ptr, size_t size) {
+    if (ptr == NULL) {
+        return;
+    }
+    free(ptr);
+    __atomic_sub_fetch(&sharedHeap.allocatedBytes, size, __ATOMIC_RELAXED);
+}
+
+/**
+ * 释放冻结对象及其附属的数组
+ * @param objHeader
+ */
+static void freeFrozenObject(ObjHeader *objHeader) {
+    switch (objHeader->type) {
+        case OT_STRING: {
+            ObjString *objString = (ObjString *)objHeader;
+            sharedFree(objString->utf8Index, utf8IndexBytes(objString->value.length));
+            sharedFree(objString, sizeof(ObjString) + objString->value.length + 1);
+            break;
+        }
+        case OT_LIST: {
+            ObjList *objList = (ObjList *)objHeader;
+            sharedFree(objList->elements.datas, sizeof(Value) * objList->elements.capacity);
+            sharedFree(objList, sizeof(ObjList));
+            break;
+        }
+        case OT_MAP: {
+            ObjMap *objMap = (ObjMap *)objHeader;
+            sharedFree(objMap->indices, sizeof(uint32_t) * objMap->capacity);
+            sharedFree(objMap->entries, sizeof(Entry) * objMap->entryNum);
+            sharedFree(objMap, sizeof(ObjMap));
+            break;
+        }
+        default:
+            sharedFree(objHeader, sizeof(ObjRange));
+            break;
+    }
+}
+
+/**
+ * 初始化冻结对象的对象头，记入本次冻结新建的对象
+ * 类置为NULL，由getClassOfObj按读取方vm的核心类解析
+ * @param state
+ * @param objHeader
+ * @param objType
+ */
+static void initFrozenHeader(FreezeState *state, ObjHeader *objHeader, ObjType objType) {
+    objHeader->type = objType;
+    objHeader->isDark = false;
+    objHeader->isFrozen = true;
+    objHeader->isRemembered = false;
+    objHeader->class = NULL;
+    objHeader->next = state->created;
+    state->created = objHeader;
+    if (state->lastCreated == NULL) {
+        state->lastCreated = objHeader;
+    }
+}
+
+/**
+ * 递归冻结value
+ * 容器先建好对象头并记入memo再冻结元素，元素再引用它时直接取副本
+ * @param vm
+ * @param state
+ * @param value
+ * @param depth 当前嵌套层数
+ * @return value或其中的元素不可冻结时返回VT_UNDEFINED
+ */
+static Value freezeValueAt(VM *vm, FreezeState *state, Value value, uint32_t depth) {
+    if (value.type != VT_OBJ) {
+        return value;
+    }
+    ObjHeader *objHeader = VALUE_TO_OBJ(value);
+    if (objHeader->isFrozen) {
+        return value;
+    }
+    Value *frozen = objMemoFind(&state->frozen, objHeader);
+    if (frozen != NULL) {
+        return *frozen;
+    }
+    if (depth > MAX_FREEZE_DEPTH) {
+        return VT_TO_VALUE(VT_UNDEFINED);
+    }
+
+    switch (objHeader->type) {
+        case OT_STRING: {
+            ObjString *src = flattenObjString(vm, (ObjString *)objHeader);
+            uint32_t length = src->value.length;
+            ObjString *objString = (ObjString *)sharedAlloc(sizeof(ObjString) + length + 1);
+            // 只读对象可被多个os线程同时读取，哈希码须事先算好
+            objString->hashCode = objStringHash(src);
+            objString->left = objString->right = NULL;
+            objString->isAscii = src->isAscii;
+            // 码点索引同理须事先建好
+            objString->utf8Index = NULL;
+            if (!src->isAscii) {
+                objString->utf8Index = (Utf8Index *)sharedAlloc(utf8IndexBytes(length));
+                fillUtf8Index(src->value.start, length, objString->utf8Index);
+            }
+            objString->value.length = length;
+            memcpy(objString->value.start, src->value.start, length + 1);
+            initFrozenHeader(state, &objString->objHeader, OT_STRING);
+            objMemoAdd(&state->frozen, objHeader, OBJ_TO_VALUE(objString));
+            return OBJ_TO_VALUE(objString);
+        }
+        case OT_LIST: {
+            ObjList *src = (ObjList *)objHeader;
+            uint32_t count = src->elements.count;
+            ObjList *objList = (ObjList *)sharedAlloc(sizeof(ObjList));
+            objList->elements.datas = count > 0 ? (Value *)sharedAlloc(sizeof(Value) * count) : NULL;
+            objList->elements.count = objList->elements.capacity = count;
+            initFrozenHeader(state, &objList->objHeader, OT_LIST);
+            objMemoAdd(&state->frozen, objHeader, OBJ_TO_VALUE(objList));
+            uint32_t idx = 0;
+            while (idx < count) {
+                objList->elements.datas[idx] = freezeValueAt(vm, state, src->elements.datas[idx], depth + 1);
+                if (objList->elements.datas[idx].type == VT_UNDEFINED) {
+                    return VT_TO_VALUE(VT_UNDEFINED);
+                }
+                idx ++;
+            }
+            return OBJ_TO_VALUE(objList);
+        }
+        case OT_MAP: {
+            // 冻结后的key与原key哈希值相同，索引表及entries可原样拷贝
+            ObjMap *src = (ObjMap *)objHeader;
+            ObjMap *objMap = (ObjMap *)sharedAlloc(sizeof(ObjMap));
+            objMap->entries = src->entryNum > 0 ? (Entry *)sharedAlloc(sizeof(Entry) * src->entryNum) : NULL;
+            objMap->indices = NULL;
+            if (src->capacity > 0) {
+                objMap->indices = (uint32_t *)sharedAlloc(sizeof(uint32_t) * src->capacity);
+                memcpy(objMap->indices, src->indices, sizeof(uint32_t) * src->capacity);
+            }
+            objMap->capacity = src->capacity;
+            objMap->count = src->count;
+            objMap->entryNum = src->entryNum;
+            if (src->entryNum > 0) {
+                memcpy(objMap->entries, src->entries, sizeof(Entry) * src->entryNum);
+            }
+            initFrozenHeader(state, &objMap->objHeader, OT_MAP);
+            objMemoAdd(&state->frozen, objHeader, OBJ_TO_VALUE(objMap));
+
+            uint32_t idx = 0;
+            while (idx < src->entryNum) {
+                Entry *entry = &objMap->entries[idx];
+                if (entry->key.type != VT_UNDEFINED) {
+                    entry->key = freezeValueAt(vm, state, entry->key, depth + 1);
+                    entry->value = freezeValueAt(vm, state, entry->value, depth + 1);
+                    if (entry->key.type == VT_UNDEFINED || entry->value.type == VT_UNDEFINED) {
+                        return VT_TO_VALUE(VT_UNDEFINED);
+                    }
+                }
+                idx ++;
+            }
+            return OBJ_TO_VALUE(objMap);
+        }
+        case OT_RANGE: {
+            ObjRange *src = (ObjRange *)objHeader;
+            ObjRange *objRange = (ObjRange *)sharedAlloc(sizeof(ObjRange));
+            objRange->from = src->from;
+            objRange->to = src->to;
+            objRange->step = src->step;
+            initFrozenHeader(state, &objRange->objHeader, OT_RANGE);
+            objMemoAdd(&state->frozen, objHeader, OBJ_TO_VALUE(objRange));
+            return OBJ_TO_VALUE(objRange);
+        }
+        default:
+            // 函数、实例、线程等引用了vm的可变状态，不能冻结
+            return VT_TO_VALUE(VT_UNDEFINED);
+    }
+}
+
+/**
+ * 把value深拷贝到共享堆，得到可被所有vm直接读取的只读副本
+ * 支持null、bool、数字、字符串、range及由它们组成的list和map，已冻结的部分不再拷贝
+ * 同一对象只冻结一次，循环引用在副本中保持；失败时本次新建的对象全部释放，共享堆不变
+ * @param vm
+ * @param value
+ * @return value不可冻结时返回VT_UNDEFINED
+ */
+Value freezeValue(VM *vm, Value value) {
+    FreezeState state;
+    initObjMemo(&state.frozen);
+    state.created = state.lastCreated = NULL;
+    Value frozen = freezeValueAt(vm, &state, value, 0);
+    freeObjMemo(&state.frozen);
+
+    if (frozen.type == VT_UNDEFINED) {
+        ObjHeader *objHeader = state.created;
+        while (objHeader != NULL) {
+            ObjHeader *next = objHeader->next;
+            freeFrozenObject(objHeader);
+            objHeader = next;
+        }
+        return frozen;
+    }
+    if (state.created != NULL) {
+        pthread_mutex_lock(&sharedHeap.lock);
+        state.lastCreated->next = sharedHeap.allObjects;
+        sharedHeap.allObjects = state.created;
+        pthread_mutex_unlock(&sharedHeap.lock);
+    }
+    return frozen;
+}
+
+/**
+ * value是否位于共享堆
+ * @param value
+ * @return
+ */
+bool valueIsFrozen(Value value) {
+    return value.type != VT_OBJ || VALUE_TO_OBJ(value)->isFrozen;
+}
+
+/**
+ * 共享堆已分配的字节数
+ * @return
+ */
+uint64_t sharedHeapBytes(void) {
+    return __atomic_load_n(&sharedHeap.allocatedBytes, __ATOMIC_RELAXED);
+}
+
+/**
+ * 释放共享堆中的全部对象，只能在所有vm都不再使用它们之后调用，如进程退出前
+ */
+void freeSharedHeap(void) {
+    pthread_mutex_lock(&sharedHeap.lock);
+    ObjHeader *objHeader = sharedHeap.allObjects;
+    while (objHeader != NULL) {
+        ObjHeader *next = objHeader->next;
+        freeFrozenObject(objHeader);
+        objHeader = next;
+    }
+    sharedHeap.allObjects = NULL;
+    sharedHeap.allocatedBytes = 0;
+    pthread_mutex_unlock(&sharedHeap.lock);
+}
@@ -0,0 +1,18 @@
+//
+// Created by ZiXuan on 2022/7/18.
+//
+
+#ifndef SPARROW_SHARED_HEAP_H
+#define SPARROW_SHARED_HEAP_H
+
+#include "../object/header_obj.h"
+
+// 冻结时容器的最大嵌套层数
+#define MAX_FREEZE_DEPTH 128
+
+Value freezeValue(VM *vm, Value value);
+bool valueIsFrozen(Value value);
+uint64_t sharedHeapBytes(void);
+void freeSharedHeap(void);
+
+#endif //SPARROW_SHARED_HEAP_H
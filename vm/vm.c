@@ -1,5 +1,21 @@
 #include "vm.h"
 #include "core.h"
+#include "../compiler/compiler.h"
+#include "../object/class.h"
+#include "../object/obj_list.h"
+#include "../object/obj_range.h"
+#include "../object/obj_channel.h"
+#include "../object/obj_string_builder.h"
+#include "../object/obj_typed_array.h"
+#include "../object/obj_set.h"
+#include "../object/obj_tuple.h"
+#include "../object/obj_vector.h"
+#include "../object/obj_hash_map.h"
+#include "arena.h"
+
+#include <string.h>
+
+#define MAX_ERROR_LEN 512 // 运行时错误信息的最大长度
 
 /**
  * @brief 初始化虚拟机
@@ -7,12 +23,27 @@
  * @param vm
  */
 void initVM(VM *vm) {
+    // 核心类在buildCore中逐个建立，之前须为NULL，否则会与新建的类混淆
+    memset(vm, 0, sizeof(VM));
+    vm->arena = NULL;
     vm->allocatedBytes = 0;
+    vm->allocatedNum = 0;
     vm->allObjects = NULL;
     vm->curParser = NULL;
     StringBufferInit(&vm->allMethodNames);
     vm->allObjects = NULL;
     vm->curParser = NULL;
+    vm->curThread = NULL;
+    vm->readyHead = vm->readyTail = NULL;
+    initThreadPool(&vm->threadPool);
+    initEventLoop(&vm->eventLoop);
+    vm->worker = NULL;
+    memset(&vm->compileStats, 0, sizeof(CompileStats));
+    vm->lazyCompile = false;
+    initStringPool(&vm->shortStrings);
+    vm->allModules = newObjMap(vm);
+    vm->preloadedFns = NULL;
+    vm->syncThread = NULL;
 }
 
 /**
@@ -28,4 +59,1017 @@ VM* newVM(void) {
     initVM(vm);
     buildCore(vm);
     return vm;
-}
\ No newline at end of file
+}
+
+/**
+ * 释放单个对象及其独占的内存
+ * capacity为0的缓冲区与其它vm共享，不可释放；延迟编译的函数体归镜像所有，也不释放
+ * @param vm
+ * @param objHeader
+ */
+static void freeObject(VM *vm, ObjHeader *objHeader) {
+    switch (objHeader->type) {
+        case OT_CLASS:
+            MethodBufferClear(vm, &((Class *)objHeader)->methods);
+            break;
+        case OT_LIST:
+            ValueBufferClear(vm, &((ObjList *)objHeader)->elements);
+            break;
+        case OT_MAP: {
+            ObjMap *objMap = (ObjMap *)objHeader;
+            DEALLOCATE_ARRAY(vm, objMap->indices, objMap->capacity);
+            DEALLOCATE_ARRAY(vm, objMap->entries, mapEntryCapacity(objMap->capacity));
+            break;
+        }
+        case OT_MODULE: {
+            ObjModule *objModule = (ObjModule *)objHeader;
+            symbolTableClear(vm, &objModule->moduleVarName);
+            ValueBufferClear(vm, &objModule->moduelVarValue);
+            DEALLOCATE(vm, objModule->source);
+            break;
+        }
+        case OT_STRING:
+            DEALLOCATE(vm, ((ObjString *)objHeader)->utf8Index);
+            break;
+        case OT_FUNCTION: {
+            ObjFn *objFn = (ObjFn *)objHeader;
+            if (objFn->instrStream.capacity != 0) {
+                ByteBufferClear(vm, &objFn->instrStream);
+            }
+            ValueBufferClear(vm, &objFn->constants);
+#if DEBUG
+            if (objFn->debug.lineNo.capacity != 0) {
+                IntBufferClear(vm, &objFn->debug.lineNo);
+                DEALLOCATE(vm, objFn->debug.fnName);
+            }
+#endif
+            break;
+        }
+        case OT_THREAD: {
+            ObjThread *objThread = (ObjThread *)objHeader;
+            objThread->usedFrameNum = 0;
+            recycleThreadStack(vm, objThread);
+            break;
+        }
+        case OT_CHANNEL:
+            freeObjChannel(vm, (ObjChannel *)objHeader);
+            return;
+        case OT_STRING_BUILDER:
+            freeObjStringBuilder(vm, (ObjStringBuilder *)objHeader);
+            return;
+        case OT_TYPED_ARRAY:
+            freeObjTypedArray(vm, (ObjTypedArray *)objHeader);
+            return;
+        case OT_SET:
+            freeObjSet(vm, (ObjSet *)objHeader);
+            return;
+        case OT_TUPLE:
+            freeObjTuple(vm, (ObjTuple *)objHeader);
+            return;
+        case OT_VECTOR:
+            freeObjVector(vm, (ObjVector *)objHeader);
+            return;
+        case OT_HASH_MAP:
+            freeObjHashMap(vm, (ObjHashMap *)objHeader);
+            return;
+        default:
+            break;
+    }
+    DEALLOCATE(vm, objHeader);
+}
+
+/**
+ * 释放虚拟机及其全部对象，调用前不可有打开的分配区域
+ * @param vm
+ */
+void freeVM(VM *vm) {
+    ASSERT(vm->arena == NULL, "free vm with an open arena!");
+    ObjHeader *objHeader = vm->allObjects;
+    while (objHeader != NULL) {
+        ObjHeader *next = objHeader->next;
+        freeObject(vm, objHeader);
+        objHeader = next;
+    }
+    vm->allObjects = NULL;
+
+    symbolTableClear(vm, &vm->allMethodNames);
+    freeStringPool(vm, &vm->shortStrings);
+    freeEventLoop(vm, &vm->eventLoop);
+    clearThreadPool(vm, &vm->threadPool);
+    free(vm);
+}
+
+/**
+ * 输出编译耗时统计，每项为key=value形式，便于脚本解析
+ * @param vm
+ * @param out
+ */
+void dumpCompileStats(VM *vm, FILE *out) {
+    CompileStats *stats = &vm->compileStats;
+    uint64_t otherNs = stats->lexNs + stats->symbolNs;
+    uint64_t parseNs = stats->totalNs > otherNs ? stats->totalNs - otherNs : 0;
+
+    fprintf(out, "compile-stats: modules=%u source_bytes=%llu tokens=%llu "
+                 "total_us=%.1f lex_us=%.1f parse_codegen_us=%.1f symbol_us=%.1f symbol_calls=%llu "
+                 "constants=%llu constant_pool_grows=%llu constant_pool_grow_bytes=%llu\n",
+            stats->moduleNum,
+            (unsigned long long)stats->sourceBytes,
+            (unsigned long long)stats->tokenNum,
+            stats->totalNs / 1000.0,
+            stats->lexNs / 1000.0,
+            parseNs / 1000.0,
+            stats->symbolNs / 1000.0,
+            (unsigned long long)stats->symbolCallNum,
+            (unsigned long long)stats->constantNum,
+            (unsigned long long)stats->constantGrowNum,
+            (unsigned long long)stats->constantGrowBytes);
+}
+
+/**
+ * 把线程加入就绪队列末尾，已在队列中或已运行结束的线程忽略
+ * @param vm
+ * @param objThread
+ */
+void scheduleThread(VM *vm, ObjThread *objThread) {
+    if (objThread->isReady || objThread->usedFrameNum == 0) {
+        return;
+    }
+    objThread->isReady = true;
+    objThread->nextReady = NULL;
+    objThread->prevReady = vm->readyTail;
+    if (vm->readyTail == NULL) {
+        vm->readyHead = objThread;
+    }
+    else {
+        vm->readyTail->nextReady = objThread;
+    }
+    vm->readyTail = objThread;
+}
+
+/**
+ * 从就绪队列队首取出一个线程，队列为空时返回NULL
+ * @param vm
+ * @return
+ */
+ObjThread* nextReadyThread(VM *vm) {
+    ObjThread *objThread = vm->readyHead;
+    if (objThread != NULL) {
+        unscheduleThread(vm, objThread);
+    }
+    return objThread;
+}
+
+/**
+ * 把就绪队列中的线程移出队列，不在队列中的线程忽略
+ * @param vm
+ * @param objThread
+ */
+void unscheduleThread(VM *vm, ObjThread *objThread) {
+    if (!objThread->isReady) {
+        return;
+    }
+    if (objThread->prevReady == NULL) {
+        vm->readyHead = objThread->nextReady;
+    }
+    else {
+        objThread->prevReady->nextReady = objThread->nextReady;
+    }
+    if (objThread->nextReady == NULL) {
+        vm->readyTail = objThread->prevReady;
+    }
+    else {
+        objThread->nextReady->prevReady = objThread->prevReady;
+    }
+    objThread->nextReady = NULL;
+    objThread->prevReady = NULL;
+    objThread->isReady = false;
+}
+
+/**
+ * 线程最后一个frame返回后调用，其返回值须已由解释器写入调用者的栈中
+ * 把栈和frame数组归还线程池，返回接下来要运行的线程：
+ * 有调用者时回到调用者，否则运行下一个可运行的线程
+ * @param vm
+ * @param objThread
+ * @return 为NULL时表示没有可运行的线程，也没有线程在等待io了
+ */
+ObjThread* finishThread(VM *vm, ObjThread *objThread) {
+    ObjThread *next = objThread->caller;
+    objThread->caller = NULL;
+    recycleThreadStack(vm, objThread);
+    if (next == NULL) {
+        next = nextRunnableThread(vm);
+    }
+    return next;
+}
+
+/**
+ * 关闭地址大于等于lastSlot的open upvalue，把局部变量的值拷贝到upvalue中
+ * @param vm
+ * @param objThread
+ * @param lastSlot
+ */
+static void closeUpvalue(VM *vm, ObjThread *objThread, Value *lastSlot) {
+    ObjUpvalue *upvalue = objThread->openUpvalues;
+    while (upvalue != NULL && upvalue->localVarPtr >= lastSlot) {
+        ARENA_REMEMBER(vm, upvalue);
+        upvalue->closedUpvalue = *(upvalue->localVarPtr);
+        upvalue->localVarPtr = &(upvalue->closedUpvalue);
+        upvalue = upvalue->next;
+    }
+    objThread->openUpvalues = upvalue;
+}
+
+/**
+ * 为局部变量localVarPtr创建open upvalue，已存在时直接返回
+ * openUpvalues链表按localVarPtr从大到小排列
+ * @param vm
+ * @param objThread
+ * @param localVarPtr
+ * @return
+ */
+static ObjUpvalue* createOpenUpvalue(VM *vm, ObjThread *objThread, Value *localVarPtr) {
+    if (objThread->openUpvalues == NULL) {
+        objThread->openUpvalues = newObjUpvalue(vm, localVarPtr);
+        return objThread->openUpvalues;
+    }
+
+    ObjUpvalue *preUpvalue = NULL;
+    ObjUpvalue *upvalue = objThread->openUpvalues;
+    while (upvalue != NULL && upvalue->localVarPtr > localVarPtr) {
+        preUpvalue = upvalue;
+        upvalue = upvalue->next;
+    }
+
+    if (upvalue != NULL && upvalue->localVarPtr == localVarPtr) {
+        return upvalue;
+    }
+
+    ObjUpvalue *newUpvalue = newObjUpvalue(vm, localVarPtr);
+    if (preUpvalue == NULL) {
+        objThread->openUpvalues = newUpvalue;
+    }
+    else {
+        preUpvalue->next = newUpvalue;
+    }
+    newUpvalue->next = upvalue;
+    return newUpvalue;
+}
+
+/**
+ * 校验基类是否合法，不合法时设置线程报错
+ * @param vm
+ * @param className
+ * @param fieldNum
+ * @param superClassValue
+ * @return
+ */
+static bool validateSuperClass(VM *vm, Value className, uint32_t fieldNum, Value superClassValue) {
+    char msg[MAX_ERROR_LEN];
+    if (!VALUE_IS_CLASS(superClassValue)) {
+        snprintf(msg, MAX_ERROR_LEN, "class \"%s\" 's superClass is not a valid class!",
+                 VALUE_TO_OBJSTR(className)->value.start);
+        vm->curThread->errorObj = OBJ_TO_VALUE(newObjString(vm, msg, strlen(msg)));
+        return false;
+    }
+
+    // 内建类的实例不是ObjInstance，不允许被继承
+    Class *superClass = VALUE_TO_CLASS(superClassValue);
+    if (superClass == vm->stringClass || superClass == vm->mapClass || superClass == vm->rangeClass ||
+        superClass == vm->listClass || superClass == vm->nullClass || superClass == vm->boolClass ||
+        superClass == vm->numClass || superClass == vm->fnClass || superClass == vm->threadClass ||
+        superClass == vm->channelClass || superClass == vm->stringBuilderClass ||
+        superClass == vm->float64ArrayClass || superClass == vm->int32ArrayClass ||
+        superClass == vm->byteArrayClass || superClass == vm->setClass || superClass == vm->tupleClass ||
+        superClass == vm->vectorClass || superClass == vm->hashMapClass) {
+        snprintf(msg, MAX_ERROR_LEN, "superClass mustn't be a buildin class!");
+        vm->curThread->errorObj = OBJ_TO_VALUE(newObjString(vm, msg, strlen(msg)));
+        return false;
+    }
+
+    if (superClass->fieldNum + fieldNum > MAX_FILED_NUM) {
+        snprintf(msg, MAX_ERROR_LEN, "number of field including super exceed %d!", MAX_FILED_NUM);
+        vm->curThread->errorObj = OBJ_TO_VALUE(newObjString(vm, msg, strlen(msg)));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * 修正方法指令流中的操作数：
+ * 字段索引加上基类的字段数，super调用的常量槽位填入基类，并递归修正内层函数
+ * @param class
+ * @param fn
+ */
+void patchOperand(Class *class, ObjFn *fn) {
+    // 延迟编译的函数体此时还没有指令，记下所属类，编译后再修正
+    if (fn->lazyBody != NULL) {
+        bindLazyClass(fn, class);
+        return;
+    }
+
+    int ip = 0;
+    OpCode opCode;
+    while (true) {
+        opCode = (OpCode)fn->instrStream.datas[ip ++];
+        switch (opCode) {
+            case OPCODE_LOAD_FIELD:
+            case OPCODE_STORE_FIELD:
+            case OPCODE_LOAD_THIS_FIELD:
+            case OPCODE_STORE_THIS_FIELD:
+                // 子类的字段排在基类字段之后
+                fn->instrStream.datas[ip ++] += class->superClass->fieldNum;
+                break;
+
+            case OPCODE_SUPER0:
+            case OPCODE_SUPER1:
+            case OPCODE_SUPER2:
+            case OPCODE_SUPER3:
+            case OPCODE_SUPER4:
+            case OPCODE_SUPER5:
+            case OPCODE_SUPER6:
+            case OPCODE_SUPER7:
+            case OPCODE_SUPER8:
+            case OPCODE_SUPER9:
+            case OPCODE_SUPER10:
+            case OPCODE_SUPER11:
+            case OPCODE_SUPER12:
+            case OPCODE_SUPER13:
+            case OPCODE_SUPER14:
+            case OPCODE_SUPER15:
+            case OPCODE_SUPER16: {
+                // 跳过方法索引，其后是存放基类的常量索引
+                ip += 2;
+                uint32_t superClassIdx = (fn->instrStream.datas[ip] << 8) | fn->instrStream.datas[ip + 1];
+                fn->constants.datas[superClassIdx] = OBJ_TO_VALUE(class->superClass);
+                ip += 2;
+                break;
+            }
+
+            case OPCODE_CREATE_CLOSURE: {
+                uint32_t fnIdx = (fn->instrStream.datas[ip] << 8) | fn->instrStream.datas[ip + 1];
+                patchOperand(class, VALUE_TO_OBJFN(fn->constants.datas[fnIdx]));
+                ip += getBytesOfOperands(fn->instrStream.datas, fn->constants.datas, ip - 1);
+                break;
+            }
+
+            case OPCODE_END:
+                return;
+
+            default:
+                ip += getBytesOfOperands(fn->instrStream.datas, fn->constants.datas, ip - 1);
+                break;
+        }
+    }
+}
+
+/**
+ * 绑定方法并修正其指令流中的操作数，类方法绑定在元类上
+ * @param vm
+ * @param opCode
+ * @param methodIndex
+ * @param class
+ * @param methodValue
+ */
+static void bindMethodAndPatch(VM *vm, OpCode opCode, uint32_t methodIndex, Class *class, Value methodValue) {
+    if (opCode == OPCODE_STATIC_METHOD) {
+        class = class->objHeader.class;
+    }
+
+    Method method;
+    method.type = MT_SCRIPT;
+    method.obj = VALUE_TO_OBJCLOSURE(methodValue);
+
+    patchOperand(class, method.obj->fn);
+    ARENA_REMEMBER(vm, class);
+    bindMethod(vm, class, methodIndex, method);
+}
+
+/**
+ * 报告线程中的运行时错误，错误信息可能是拼接串，先展开再输出
+ * @param vm
+ * @param objThread
+ */
+static void reportRuntimeError(VM *vm, ObjThread *objThread) {
+    if (VALUE_IS_CREATIN_OBJ(objThread->errorObj, OT_STRING)) {
+        ObjString *errorMsg = flattenObjString(vm, VALUE_TO_OBJSTR(objThread->errorObj));
+        fprintf(stderr, "runtime error: %.*s\n", (int)errorMsg->value.length, errorMsg->value.start);
+    }
+    else {
+        fprintf(stderr, "runtime error: thread aborted!\n");
+    }
+#if DEBUG
+    // 自内向外输出调用链中各函数的名字及出错时的行号
+    int32_t idx = (int32_t)objThread->usedFrameNum - 1;
+    while (idx >= 0) {
+        Frame *frame = &objThread->frames[idx];
+        ObjFn *fn = frame->closure->fn;
+        uint32_t offset = (uint32_t)(frame->ip - fn->instrStream.datas);
+        uint32_t lineNo = offset > 0 && offset <= fn->debug.lineNo.count ? fn->debug.lineNo.datas[offset - 1] : 0;
+        fprintf(stderr, "    at %s:%u\n", fn->debug.fnName != NULL ? fn->debug.fnName : "?", lineNo);
+        idx --;
+    }
+#endif
+}
+
+/**
+ * 把插值的片段转为字符串：数字、bool及null直接格式化，只有对象才调用其toString
+ * @param vm
+ * @param piece 转换结果写回此处
+ * @return 出错时返回false，错误已写入当前线程
+ */
+static bool interpolatePiece(VM *vm, Value *piece) {
+    Value source = *piece;
+    switch (source.type) {
+        case VT_NUM:
+            *piece = OBJ_TO_VALUE(num2str(vm, VALUE_TO_NUM(source)));
+            return true;
+        case VT_TRUE:
+            *piece = OBJ_TO_VALUE(newObjString(vm, "true", 4));
+            return true;
+        case VT_FALSE:
+            *piece = OBJ_TO_VALUE(newObjString(vm, "false", 5));
+            return true;
+        case VT_NULL:
+            *piece = OBJ_TO_VALUE(newObjString(vm, "null", 4));
+            return true;
+        case VT_OBJ:
+            break;
+        default:
+            setNativeError(vm, "value can`t be interpolated!");
+            return false;
+    }
+    if (VALUE_IS_CREATIN_OBJ(source, OT_STRING)) {
+        return true;
+    }
+
+    Class *class = source.objHeader->class;
+    if ((uint32_t)vm->toStringIndex >= class->methods.count ||
+        class->methods.datas[vm->toStringIndex].type == MT_NONE) {
+        setNativeError(vm, "method toString not found!");
+        return false;
+    }
+    Method *method = &class->methods.datas[vm->toStringIndex];
+    Value result;
+    if (method->type == MT_SCRIPT) {
+        if (!callClosure(vm, method->obj, piece, 1, &result)) {
+            return false;
+        }
+    }
+    else {
+        Value args[1] = {source};
+        if (!method->primFn(vm, args)) {
+            return false;
+        }
+        result = args[0];
+    }
+    if (!VALUE_IS_CREATIN_OBJ(result, OT_STRING)) {
+        setNativeError(vm, "toString should return a string!");
+        return false;
+    }
+    *piece = result;
+    return true;
+}
+
+/**
+ * 执行线程objThread中的指令，直到所有线程运行结束
+ * @param vm
+ * @param objThread
+ * @return
+ */
+VMResult executeInstruction(VM *vm, register ObjThread *curThread) {
+    vm->curThread = curThread;
+    register Frame *curFrame;
+    register Value *stackStart;
+    register uint8_t *ip;
+    register ObjFn *fn;
+    OpCode opCode;
+    // 方法调用的参数个数(含接收者)、方法索引、参数起始地址及接收者的类
+    int argNum;
+    int index;
+    Value *args;
+    Class *class;
+    Method *method;
+
+// esp须存放在线程中，原生方法切换线程或挂起时会修改它
+#define PUSH(value) (*curThread->esp ++ = value)
+#define POP() (*(-- curThread->esp))
+#define DROP() (curThread->esp --)
+#define PEEK() (*(curThread->esp - 1))
+#define PEEK2() (*(curThread->esp - 2))
+
+#define READ_BYTE() (*ip ++)
+// 操作数按大端字节序存储
+#define READ_SHORT() (ip += 2, (uint16_t)((ip[-2] << 8) | ip[-1]))
+
+// 离开当前frame前把ip写回frame，返回时据此继续
+#define STORE_CUR_FRAME() curFrame->ip = ip
+
+#define LOAD_CUR_FRAME() \
+    curFrame = &curThread->frames[curThread->usedFrameNum - 1]; \
+    stackStart = curFrame->stackStart; \
+    ip = curFrame->ip; \
+    fn = curFrame->closure->fn;
+
+#define DECODE loopStart: \
+    opCode = (OpCode)READ_BYTE(); \
+    switch (opCode)
+
+#define CASE(shortOpCode) case OPCODE_##shortOpCode
+#define LOOP() goto loopStart
+
+// 线程被切换或挂起后运行vm->curThread，没有可运行的线程时执行结束
+#define SWITCH_THREAD() \
+    do { \
+        if (vm->curThread == NULL) { \
+            return VM_RESULT_SUCCESS; \
+        } \
+        curThread = vm->curThread; \
+        ARENA_REMEMBER(vm, curThread); \
+        if (!VALUE_IS_NULL(curThread->errorObj)) { \
+            goto runtimeError; \
+        } \
+        LOAD_CUR_FRAME(); \
+    } while (0)
+
+    // 区域打开时运行的线程，其栈及frame会引用区域中的对象
+    ARENA_REMEMBER(vm, curThread);
+    LOAD_CUR_FRAME();
+    DECODE {
+        CASE(LOAD_LOCAL_VAR):
+            PUSH(stackStart[READ_BYTE()]);
+            LOOP();
+
+        CASE(LOAD_THIS_FIELD): {
+            uint8_t fieldIdx = READ_BYTE();
+            ASSERT(VALUE_IS_CREATIN_OBJ(stackStart[0], OT_INSTANCE), "method receiver should be objInstance!");
+            ObjInstance *objInstance = VALUE_TO_OBJINSTANCE(stackStart[0]);
+            ASSERT(fieldIdx < objInstance->objHeader.class->fieldNum, "out of bounds field!");
+            PUSH(objInstance->fields[fieldIdx]);
+            LOOP();
+        }
+
+        CASE(POP):
+            DROP();
+            LOOP();
+
+        CASE(PUSH_NULL):
+            PUSH(VT_TO_VALUE(VT_NULL));
+            LOOP();
+
+        CASE(PUSH_FALSE):
+            PUSH(VT_TO_VALUE(VT_FALSE));
+            LOOP();
+
+        CASE(PUSH_TRUE):
+            PUSH(VT_TO_VALUE(VT_TRUE));
+            LOOP();
+
+        CASE(STORE_LOCAL_VAR):
+            // 赋值表达式的值留在栈顶
+            stackStart[READ_BYTE()] = PEEK();
+            LOOP();
+
+        CASE(LOAD_CONSTANT):
+            PUSH(fn->constants.datas[READ_SHORT()]);
+            LOOP();
+
+        CASE(CALL0):
+        CASE(CALL1):
+        CASE(CALL2):
+        CASE(CALL3):
+        CASE(CALL4):
+        CASE(CALL5):
+        CASE(CALL6):
+        CASE(CALL7):
+        CASE(CALL8):
+        CASE(CALL9):
+        CASE(CALL10):
+        CASE(CALL11):
+        CASE(CALL12):
+        CASE(CALL13):
+        CASE(CALL14):
+        CASE(CALL15):
+        CASE(CALL16):
+            // 参数个数含接收者
+            argNum = opCode - OPCODE_CALL0 + 1;
+            index = READ_SHORT();
+            args = curThread->esp - argNum;
+            class = getClassOfObj(vm, args[0]);
+            goto invokeMethod;
+
+        CASE(SUPER0):
+        CASE(SUPER1):
+        CASE(SUPER2):
+        CASE(SUPER3):
+        CASE(SUPER4):
+        CASE(SUPER5):
+        CASE(SUPER6):
+        CASE(SUPER7):
+        CASE(SUPER8):
+        CASE(SUPER9):
+        CASE(SUPER10):
+        CASE(SUPER11):
+        CASE(SUPER12):
+        CASE(SUPER13):
+        CASE(SUPER14):
+        CASE(SUPER15):
+        CASE(SUPER16):
+            argNum = opCode - OPCODE_SUPER0 + 1;
+            index = READ_SHORT();
+            args = curThread->esp - argNum;
+            // 基类在绑定方法时已由patchOperand写入常量表
+            class = VALUE_TO_CLASS(fn->constants.datas[READ_SHORT()]);
+
+        invokeMethod:
+            if ((uint32_t)index >= class->methods.count ||
+                (method = &class->methods.datas[index])->type == MT_NONE) {
+                char msg[MAX_ERROR_LEN];
+                snprintf(msg, MAX_ERROR_LEN, "method \"%s\" not found in class \"%s\"!",
+                         vm->allMethodNames.datas[index].str, class->name->value.start);
+                STORE_CUR_FRAME();
+                curThread->errorObj = OBJ_TO_VALUE(newObjString(vm, msg, strlen(msg)));
+                goto runtimeError;
+            }
+
+            switch (method->type) {
+                case MT_PRIMITIVE:
+                    // 原生方法可能修改接收者
+                    if (VALUE_IS_OBJ(args[0])) {
+                        ARENA_REMEMBER(vm, args[0].objHeader);
+                    }
+                    // 原生方法的结果在args[0]中，回收参数的空间
+                    if (method->primFn(vm, args)) {
+                        curThread->esp -= argNum - 1;
+                    }
+                    else {
+                        // 出错或切换了线程
+                        STORE_CUR_FRAME();
+                        if (!VALUE_IS_NULL(curThread->errorObj)) {
+                            goto runtimeError;
+                        }
+                        SWITCH_THREAD();
+                    }
+                    break;
+
+                case MT_SCRIPT:
+                    STORE_CUR_FRAME();
+                    createFrame(vm, curThread, method->obj, argNum);
+                    LOAD_CUR_FRAME();
+                    break;
+
+                case MT_FN_CALL: {
+                    // 调用的是函数对象本身，接收者即闭包
+                    ASSERT(VALUE_IS_CREATIN_OBJ(args[0], OT_CLOSURE), "instance must be a closure!");
+                    ObjClosure *objClosure = VALUE_TO_OBJCLOSURE(args[0]);
+                    if (argNum - 1 < objClosure->fn->argNum) {
+                        STORE_CUR_FRAME();
+                        curThread->errorObj = OBJ_TO_VALUE(newObjString(vm, "arguments less!", 15));
+                        goto runtimeError;
+                    }
+                    STORE_CUR_FRAME();
+                    createFrame(vm, curThread, objClosure, argNum);
+                    LOAD_CUR_FRAME();
+                    break;
+                }
+
+                default:
+                    NOT_REACHED();
+            }
+            LOOP();
+
+        CASE(LOAD_UPVALUE):
+            PUSH(*((curFrame->closure->upvalues[READ_BYTE()])->localVarPtr));
+            LOOP();
+
+        CASE(STORE_UPVALUE): {
+            ObjUpvalue *upvalue = curFrame->closure->upvalues[READ_BYTE()];
+            ARENA_REMEMBER(vm, upvalue);
+            *(upvalue->localVarPtr) = PEEK();
+            LOOP();
+        }
+
+        CASE(LOAD_MODULE_VAR):
+            PUSH(fn->module->moduelVarValue.datas[READ_SHORT()]);
+            LOOP();
+
+        CASE(STORE_MODULE_VAR):
+            ARENA_REMEMBER(vm, fn->module);
+            fn->module->moduelVarValue.datas[READ_SHORT()] = PEEK();
+            LOOP();
+
+        CASE(STORE_THIS_FIELD): {
+            uint8_t fieldIdx = READ_BYTE();
+            ASSERT(VALUE_IS_CREATIN_OBJ(stackStart[0], OT_INSTANCE), "receiver should be instance!");
+            ObjInstance *objInstance = VALUE_TO_OBJINSTANCE(stackStart[0]);
+            ASSERT(fieldIdx < objInstance->objHeader.class->fieldNum, "out of bounds field!");
+            ARENA_REMEMBER(vm, objInstance);
+            objInstance->fields[fieldIdx] = PEEK();
+            LOOP();
+        }
+
+        CASE(LOAD_FIELD): {
+            uint8_t fieldIdx = READ_BYTE();
+            Value receiver = POP();
+            ASSERT(VALUE_IS_CREATIN_OBJ(receiver, OT_INSTANCE), "receiver should be instance!");
+            ObjInstance *objInstance = VALUE_TO_OBJINSTANCE(receiver);
+            ASSERT(fieldIdx < objInstance->objHeader.class->fieldNum, "out of bounds field!");
+            PUSH(objInstance->fields[fieldIdx]);
+            LOOP();
+        }
+
+        CASE(STORE_FIELD): {
+            uint8_t fieldIdx = READ_BYTE();
+            Value receiver = POP();
+            ASSERT(VALUE_IS_CREATIN_OBJ(receiver, OT_INSTANCE), "receiver should be instance!");
+            ObjInstance *objInstance = VALUE_TO_OBJINSTANCE(receiver);
+            ASSERT(fieldIdx < objInstance->objHeader.class->fieldNum, "out of bounds field!");
+            ARENA_REMEMBER(vm, objInstance);
+            objInstance->fields[fieldIdx] = PEEK();
+            LOOP();
+        }
+
+        CASE(JUMP): {
+            int16_t offset = READ_SHORT();
+            ASSERT(offset > 0, "OPCODE_JUMP`s operand must be positive!");
+            ip += offset;
+            LOOP();
+        }
+
+        CASE(LOOP): {
+            int16_t offset = READ_SHORT();
+            ASSERT(offset > 0, "OPCODE_LOOP`s operand must be positive!");
+            ip -= offset;
+            LOOP();
+        }
+
+        CASE(JUMP_IF_FALSE): {
+            int16_t offset = READ_SHORT();
+            ASSERT(offset > 0, "OPCODE_JUMP_IF_FALSE`s operand must be positive!");
+            Value condition = POP();
+            if (VALUE_IS_FALSE(condition) || VALUE_IS_NULL(condition)) {
+                ip += offset;
+            }
+            LOOP();
+        }
+
+        CASE(AND): {
+            int16_t offset = READ_SHORT();
+            ASSERT(offset > 0, "OPCODE_AND`s operand must be positive!");
+            Value condition = PEEK();
+            // 左操作数为假时它就是结果，跳过右操作数
+            if (VALUE_IS_FALSE(condition) || VALUE_IS_NULL(condition)) {
+                ip += offset;
+            }
+            else {
+                DROP();
+            }
+            LOOP();
+        }
+
+        CASE(OR): {
+            int16_t offset = READ_SHORT();
+            ASSERT(offset > 0, "OPCODE_OR`s operand must be positive!");
+            Value condition = PEEK();
+            if (VALUE_IS_FALSE(condition) || VALUE_IS_NULL(condition)) {
+                DROP();
+            }
+            else {
+                ip += offset;
+            }
+            LOOP();
+        }
+
+        CASE(CLOSE_UPVALUE):
+            closeUpvalue(vm, curThread, curThread->esp - 1);
+            DROP();
+            LOOP();
+
+        CASE(RETURN): {
+            Value retVal = POP();
+            curThread->usedFrameNum --;
+            closeUpvalue(vm, curThread, stackStart);
+
+            if (curThread->usedFrameNum == 0) {
+                if (curThread->isSync) {
+                    // 返回值留在栈底，由callClosure取走
+                    curThread->stack[0] = retVal;
+                    return VM_RESULT_SUCCESS;
+                }
+                // 线程运行结束，返回值交给调用者
+                if (curThread->caller != NULL) {
+                    ARENA_REMEMBER(vm, curThread->caller);
+                    curThread->caller->esp[-1] = retVal;
+                }
+                vm->curThread = finishThread(vm, curThread);
+                SWITCH_THREAD();
+                LOOP();
+            }
+
+            // 返回值放在接收者的位置，回收参数及局部变量的空间
+            stackStart[0] = retVal;
+            curThread->esp = stackStart + 1;
+            LOAD_CUR_FRAME();
+            LOOP();
+        }
+
+        CASE(CONSTRUCT): {
+            ASSERT(VALUE_IS_CLASS(stackStart[0]), "stackStart[0] should be a class for OPCODE_CONSTRUCT!");
+            ObjInstance *objInstance = newObjInstance(vm, VALUE_TO_CLASS(stackStart[0]));
+            stackStart[0] = OBJ_TO_VALUE(objInstance);
+            LOOP();
+        }
+
+        CASE(CREATE_CLOSURE): {
+            ObjFn *closureFn = VALUE_TO_OBJFN(fn->constants.datas[READ_SHORT()]);
+            ObjClosure *objClosure = newObjClosure(vm, closureFn);
+            PUSH(OBJ_TO_VALUE(objClosure));
+
+            uint32_t idx = 0;
+            while (idx < closureFn->upvalueNum) {
+                uint8_t isEnclosingLocalVar = READ_BYTE();
+                uint8_t index = READ_BYTE();
+                if (isEnclosingLocalVar) {
+                    objClosure->upvalues[idx] = createOpenUpvalue(vm, curThread, curFrame->stackStart + index);
+                }
+                else {
+                    objClosure->upvalues[idx] = curFrame->closure->upvalues[index];
+                }
+                idx ++;
+            }
+            LOOP();
+        }
+
+        CASE(CREATE_CLASS): {
+            // 栈中依次为类名和基类，基类出栈，类名的位置换成新建的类
+            uint32_t fieldNum = READ_BYTE();
+            Value superClass = PEEK();
+            Value className = PEEK2();
+            DROP();
+
+            STORE_CUR_FRAME();
+            if (!validateSuperClass(vm, className, fieldNum, superClass)) {
+                goto runtimeError;
+            }
+            class = newClass(vm, VALUE_TO_OBJSTR(className), fieldNum, VALUE_TO_CLASS(superClass));
+            PEEK() = OBJ_TO_VALUE(class);
+            LOOP();
+        }
+
+        CASE(INSTANCE_METHOD):
+        CASE(STATIC_METHOD): {
+            // 栈顶为类，次栈顶为方法的闭包
+            uint32_t methodNameIndex = READ_SHORT();
+            class = VALUE_TO_CLASS(PEEK());
+            bindMethodAndPatch(vm, opCode, methodNameIndex, class, PEEK2());
+            DROP();
+            DROP();
+            LOOP();
+        }
+
+        CASE(INTERPOLATE): {
+            uint32_t pieceNum = READ_BYTE();
+            Value *pieces = curThread->esp - pieceNum;
+            // 各片段就地转为字符串，对象的toString可能运行脚本
+            STORE_CUR_FRAME();
+            uint32_t idx = 0;
+            while (idx < pieceNum) {
+                if (!interpolatePiece(vm, &pieces[idx])) {
+                    goto runtimeError;
+                }
+                idx ++;
+            }
+            ObjString *result = newObjStringFromPieces(vm, pieces, pieceNum);
+            curThread->esp -= pieceNum - 1;
+            PEEK() = OBJ_TO_VALUE(result);
+            LOOP();
+        }
+
+        CASE(ITERATE):
+        CASE(ITERATOR_VALUE): {
+            uint8_t seqSlot = READ_BYTE();
+            uint8_t iterSlot = READ_BYTE();
+            uint16_t methodIndex = READ_SHORT();
+            Value seq = stackStart[seqSlot];
+            Value iter = stackStart[iterSlot];
+            Value result;
+            bool isFast = opCode == OPCODE_ITERATE ?
+                          rangeIterateFast(seq, iter, methodIndex, &result) :
+                          rangeIteratorValueFast(seq, iter, methodIndex, &result);
+            if (isFast) {
+                PUSH(result);
+                LOOP();
+            }
+
+            // 不适用快速路径时等同于压入seq和iter后调用方法
+            PUSH(seq);
+            PUSH(iter);
+            argNum = 2;
+            index = methodIndex;
+            args = curThread->esp - argNum;
+            class = getClassOfObj(vm, seq);
+            goto invokeMethod;
+        }
+
+        CASE(END):
+            NOT_REACHED();
+    }
+
+    NOT_REACHED();
+
+runtimeError:
+    // 同步调用中的错误由callClosure交给原生代码的调用方
+    if (curThread->isSync) {
+        return VM_RESULT_ERROR;
+    }
+    reportRuntimeError(vm, curThread);
+    vm->curThread = NULL;
+    return VM_RESULT_ERROR;
+
+#undef PUSH
+#undef POP
+#undef DROP
+#undef PEEK
+#undef PEEK2
+#undef READ_BYTE
+#undef READ_SHORT
+#undef STORE_CUR_FRAME
+#undef LOAD_CUR_FRAME
+#undef DECODE
+#undef CASE
+#undef LOOP
+#undef SWITCH_THREAD
+}
+
+/**
+ * 原生代码中出错：有当前线程时把msg写入其errorObj，由解释器在原生方法返回后报告，否则直接报错退出
+ * @param vm
+ * @param msg
+ */
+void setNativeError(VM *vm, const char *msg) {
+    if (vm->curThread == NULL) {
+        RUN_ERROR("%s", msg);
+    }
+    vm->curThread->errorObj = OBJ_TO_VALUE(newObjString(vm, msg, strlen(msg)));
+}
+
+/**
+ * 在原生代码中同步调用闭包，args为接收者及参数共argNum个
+ * 闭包在复用的线程中运行到返回，其间可以call其他线程；若挂起后没有线程可运行则视为出错
+ * @param vm
+ * @param objClosure
+ * @param args
+ * @param argNum
+ * @param result 存放返回值
+ * @return 出错时返回false，错误已由setNativeError写入当前线程
+ */
+bool callClosure(VM *vm, ObjClosure *objClosure, Value *args, uint32_t argNum, Value *result) {
+    ObjThread *caller = vm->curThread;
+    // 同一原生方法中前一次调用已出错时不再调用，保留最先的错误
+    if (caller != NULL && !VALUE_IS_NULL(caller->errorObj)) {
+        return false;
+    }
+    // 闭包中可能再次同步调用，空闲线程取走后由嵌套的调用另建
+    ObjThread *objThread = vm->syncThread;
+    vm->syncThread = NULL;
+    if (objThread == NULL) {
+        // 线程随vm复用，不在分配区域中
+        pauseArena(vm);
+        objThread = newObjThread(vm, objClosure);
+        resumeArena(vm);
+        objThread->isSync = true;
+    }
+    objThread->esp = objThread->stack;
+    objThread->usedFrameNum = 0;
+    objThread->openUpvalues = NULL;
+    objThread->caller = NULL;
+    objThread->errorObj = VT_TO_VALUE(VT_NULL);
+    ensureStack(vm, objThread, argNum);
+    memcpy(objThread->stack, args, sizeof(Value) * argNum);
+    objThread->esp = objThread->stack + argNum;
+    createFrame(vm, objThread, objClosure, argNum);
+
+    VMResult vmResult = executeInstruction(vm, objThread);
+    vm->curThread = caller;
+    if (vmResult == VM_RESULT_SUCCESS && objThread->usedFrameNum == 0) {
+        *result = objThread->stack[0];
+        objThread->esp = objThread->stack;
+        vm->syncThread = objThread;
+        return true;
+    }
+
+    // 出错或挂起未返回的线程不再复用，挂起的线程此后按普通线程结束
+    objThread->isSync = false;
+    unscheduleThread(vm, objThread);
+    if (VALUE_IS_CREATIN_OBJ(objThread->errorObj, OT_STRING)) {
+        ObjString *errorMsg = flattenObjString(vm, VALUE_TO_OBJSTR(objThread->errorObj));
+        setNativeError(vm, errorMsg->value.start);
+    }
+    else if (vmResult == VM_RESULT_ERROR) {
+        setNativeError(vm, "a thread called by a method called from native code failed!");
+    }
+    else {
+        setNativeError(vm, "method called from native code did not return!");
+    }
+    return false;
+}
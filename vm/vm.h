@@ -6,6 +6,8 @@
 #include "../object/header_obj.h"
 #include "../object/obj_map.h"
 #include "../object/obj_thread.h"
+#include "../object/obj_string.h"
+#include "event_loop.h"
 
 // 为定义opcode.inc中的操作码加上前缀OPCODE_
 #define OPCODE_SLOTS(opcode, effect) OPCODE_##opcode,
@@ -20,6 +22,20 @@ typedef enum vmResult {
 } VMResult;  // 虚拟机执行结果
 // 如果输出无误，可以将字节码输出到文件缓存，避免下次重新编译
 
+typedef struct {
+    bool enabled; // 为真时compileModule才统计各阶段耗时
+    uint32_t moduleNum; // 已编译的模块数
+    uint64_t sourceBytes; // 已编译的源码字节数
+    uint64_t totalNs; // compileModule总耗时
+    uint64_t lexNs; // 词法分析耗时，编译前单独扫描整个模块测得
+    uint64_t symbolNs; // 符号表耗时，即ensureSymbolExist和defineModuleVar
+    uint64_t tokenNum;
+    uint64_t symbolCallNum;
+    uint64_t constantNum; // 添加到常量表的常量个数
+    uint64_t constantGrowNum; // 常量表扩容次数
+    uint64_t constantGrowBytes; // 常量表扩容累计增加的字节数
+} CompileStats;  // 编译各阶段耗时统计，语法分析及生成指令的耗时为总耗时减去其余部分
+
 struct vm {
     Class *classOfClass;
     Class *objectClass;
@@ -32,15 +48,49 @@ struct vm {
     Class *listClass;
     Class *fnClass;
     Class *stringClass;
+    Class *channelClass;
+    Class *stringBuilderClass;
+    Class *float64ArrayClass;
+    Class *int32ArrayClass;
+    Class *byteArrayClass;
+    Class *setClass;
+    Class *tupleClass;
+    Class *vectorClass;
+    Class *hashMapClass;
     uint32_t allocatedBytes; // 累计已分配的内存量
+    uint64_t allocatedNum; // 累计调用malloc/realloc的次数，用于基准测试统计
     Parser *curParser; // 当前词法分析器
-    struct ObjHeader *allObjects; // 所有已分配对象链表
+    struct objHeader *allObjects; // 所有已分配对象链表
     SymbolTable allMethodNames; // 所有类的方法名
     ObjMap *allModules;
+    ObjMap *preloadedFns; // 已并行编译并链接、尚未执行的模块顶层函数，以模块名为key
     ObjThread *curThread; // 当前正在执行的线程
+    ObjThread *readyHead; // 就绪队列队首，通过线程的nextReady链接
+    ObjThread *readyTail; // 就绪队列队尾
+    ThreadPool threadPool; // 线程栈及frame数组的缓存
+    EventLoop eventLoop; // 驱动挂起在io及定时器上的线程
+    struct worker *worker; // 在worker池中运行时所属的worker，否则为NULL
+    CompileStats compileStats; // 编译耗时统计
+    bool lazyCompile; // 为真时模块中的函数及方法体在首次调用时才编译
+    StringPool shortStrings; // 驻留的短字符串，map以它们为key时查找无须分配
+    struct arena *arena; // 打开的分配区域，为NULL时都在堆上分配
+    int hashCodeIndex; // hashCode及==(_)的方法索引，以实例为key时据此调用脚本中的定义
+    int equalIndex;
+    int toStringIndex; // 字符串插值时对象的toString方法索引
+    ObjThread *syncThread; // callClosure复用的空闲线程，没有时为NULL
 };
 
 void initVM(struct vm *vm);
 VM* newVM(void);
+void freeVM(VM *vm);
+void dumpCompileStats(VM *vm, FILE *out);
+void scheduleThread(VM *vm, ObjThread *objThread);
+ObjThread* nextReadyThread(VM *vm);
+void unscheduleThread(VM *vm, ObjThread *objThread);
+ObjThread* finishThread(VM *vm, ObjThread *objThread);
+void patchOperand(Class *class, ObjFn *fn);
+VMResult executeInstruction(VM *vm, ObjThread *objThread);
+bool callClosure(VM *vm, ObjClosure *objClosure, Value *args, uint32_t argNum, Value *result);
+void setNativeError(VM *vm, const char *msg);
 
 #endif // !__SPARROW_VM_H__
\ No newline at end of file
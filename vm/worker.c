@@ -0,0 +1,303 @@
+//
+// Created by ZiXuan on 2022/7/12.
+//
+
+#include "worker.h"
+#include "core.h"
+#include "../compiler/compiler.h"
+#include "../object/class.h"
+
+#include <string.h>
+
+/**
+ * 在vm中编译模块，得到供各worker共享的镜像，vm此后归镜像所有
+ * @param vm
+ * @param moduleName
+ * @param moduleCode
+ * @return
+ */
+CompiledImage* compileImage(VM *vm, const char *moduleName, const char *moduleCode) {
+    CompiledImage *image = (CompiledImage *)malloc(sizeof(CompiledImage));
+    if (image == NULL) {
+        MEM_ERROR("allocate compiled image failed!");
+    }
+    image->vm = vm;
+    Value name = OBJ_TO_VALUE(newObjString(image->vm, moduleName, strlen(moduleName)));
+    image->module = ensureModule(image->vm, name);
+    image->moduleFn = compileModule(image->vm, image->module, moduleCode);
+    return image;
+}
+
+/**
+ * 在独立的vm中编译模块，得到供各worker共享的镜像
+ * @param moduleName
+ * @param moduleCode
+ * @return
+ */
+CompiledImage* newCompiledImage(const char *moduleName, const char *moduleCode) {
+    return compileImage(newVM(), moduleName, moduleCode);
+}
+
+/**
+ * 建立镜像的方法索引到vm的方法索引的映射，vm中没有的方法名依次添加
+ * 两个vm经过相同的buildCore，通常只有编译模块时新增的方法名需要添加
+ * @param vm
+ * @param imageVm
+ * @return 映射为恒等时返回NULL，字节码中的方法索引可以通用
+ */
+static uint32_t* mapMethodNames(VM *vm, VM *imageVm) {
+    uint32_t *methodMap = (uint32_t *)malloc(sizeof(uint32_t) * (imageVm->allMethodNames.count + 1));
+    if (methodMap == NULL) {
+        MEM_ERROR("allocate method map failed!");
+    }
+    bool identity = true;
+    uint32_t idx = 0;
+    while (idx < imageVm->allMethodNames.count) {
+        String *name = &imageVm->allMethodNames.datas[idx];
+        int index = getIndexFromSymbolTable(&vm->allMethodNames, name->str, name->length);
+        if (index == -1) {
+            index = addSymbol(vm, &vm->allMethodNames, name->str, name->length);
+        }
+        methodMap[idx] = (uint32_t)index;
+        identity = identity && (uint32_t)index == idx;
+        idx ++;
+    }
+    if (identity) {
+        free(methodMap);
+        return NULL;
+    }
+    return methodMap;
+}
+
+/**
+ * 指令流中是否有字段操作码，有则绑定方法时patchOperand会原地改写其操作数
+ * @param fn
+ * @return
+ */
+static bool hasFieldOpCode(ObjFn *fn) {
+    uint32_t ip = 0;
+    while (ip < fn->instrStream.count) {
+        OpCode opCode = (OpCode)fn->instrStream.datas[ip];
+        if (opCode == OPCODE_LOAD_FIELD || opCode == OPCODE_STORE_FIELD ||
+            opCode == OPCODE_LOAD_THIS_FIELD || opCode == OPCODE_STORE_THIS_FIELD) {
+            return true;
+        }
+        ip += 1 + getBytesOfOperands(fn->instrStream.datas, fn->constants.datas, ip);
+    }
+    return false;
+}
+
+/**
+ * 拷贝src的指令流到objFn，methodMap不为NULL时改写其中的方法索引
+ * @param vm
+ * @param objFn
+ * @param src
+ * @param methodMap
+ */
+static void remapInstrStream(VM *vm, ObjFn *objFn, ObjFn *src, uint32_t *methodMap) {
+    uint32_t count = src->instrStream.count;
+    Byte *instrStream = ALLOCATE_ARRAY(vm, Byte, count);
+    memcpy(instrStream, src->instrStream.datas, count);
+
+    uint32_t ip = 0;
+    while (methodMap != NULL && ip < count) {
+        OpCode opCode = (OpCode)instrStream[ip];
+        if ((opCode >= OPCODE_CALL0 && opCode <= OPCODE_SUPER16) ||
+            opCode == OPCODE_INSTANCE_METHOD || opCode == OPCODE_STATIC_METHOD) {
+            // 方法索引是紧跟操作码的2字节大端数
+            uint32_t index = methodMap[instrStream[ip + 1] << 8 | instrStream[ip + 2]];
+            instrStream[ip + 1] = (index >> 8) & 0xff;
+            instrStream[ip + 2] = index & 0xff;
+        }
+        ip += 1 + getBytesOfOperands(instrStream, src->constants.datas, ip);
+    }
+
+    objFn->instrStream.datas = instrStream;
+    objFn->instrStream.count = objFn->instrStream.capacity = count;
+}
+
+/**
+ * 在vm中建立src的副本，常量拷贝到vm中
+ * 方法索引一致且没有字段操作码时指令流只读共享，否则拷贝一份：
+ * 字段索引由各vm绑定方法时各自修正，共享会被每个worker重复累加
+ * @param vm
+ * @param module
+ * @param src
+ * @param methodMap 为NULL时方法索引不需改写
+ * @return
+ */
+static ObjFn* instantiateFn(VM *vm, ObjModule *module, ObjFn *src, uint32_t *methodMap) {
+    ObjFn *objFn = newObjFn(vm, module, src->maxStackSlotUsedNum);
+
+    if (methodMap == NULL && !hasFieldOpCode(src)) {
+        // capacity为0表示指令流不归本vm所有，不可释放
+        objFn->instrStream.datas = src->instrStream.datas;
+        objFn->instrStream.count = src->instrStream.count;
+        objFn->instrStream.capacity = 0;
+    }
+    else {
+        remapInstrStream(vm, objFn, src, methodMap);
+    }
+    objFn->upvalueNum = src->upvalueNum;
+    objFn->argNum = src->argNum;
+    // 尚未编译的函数体只读共享，首次调用时在本vm中编译
+    objFn->lazyBody = src->lazyBody;
+#if DEBUG
+    objFn->debug.fnName = src->debug.fnName;
+    objFn->debug.lineNo = src->debug.lineNo;
+    objFn->debug.lineNo.capacity = 0;
+#endif
+
+    uint32_t idx = 0;
+    while (idx < src->constants.count) {
+        Value constant = src->constants.datas[idx];
+        if (VALUE_IS_CREATIN_OBJ(constant, OT_FUNCTION)) {
+            constant = OBJ_TO_VALUE(instantiateFn(vm, module, VALUE_TO_OBJFN(constant), methodMap));
+        }
+        else {
+            constant = copyValue(vm, constant);
+            if (constant.type == VT_UNDEFINED) {
+                RUN_ERROR("constant can`t be copied to worker vm!");
+            }
+        }
+        ValueBufferAdd(vm, &objFn->constants, constant);
+        idx ++;
+    }
+    return objFn;
+}
+
+/**
+ * 在vm中实例化镜像，返回模块的顶层函数
+ * 模块变量按镜像中的顺序建立，继承自核心模块的变量取vm自己的值
+ * 同一vm可实例化多个分别编译的镜像，方法索引不一致时改写字节码
+ * @param vm
+ * @param image
+ * @return
+ */
+ObjFn* instantiateImage(VM *vm, CompiledImage *image) {
+    uint32_t *methodMap = mapMethodNames(vm, image->vm);
+
+    ObjModule *src = image->module;
+    ObjModule *module = newObjModule(vm, src->name->value.start);
+    mapSet(vm, vm->allModules, OBJ_TO_VALUE(module->name), OBJ_TO_VALUE(module));
+
+    ObjModule *coreModule = VALUE_TO_OBJMODULE(mapGet(vm, vm->allModules, VT_TO_VALUE(VT_NULL)));
+    uint32_t idx = 0;
+    while (idx < src->moduleVarName.count) {
+        String *name = &src->moduleVarName.datas[idx];
+        int coreIdx = getIndexFromSymbolTable(&coreModule->moduleVarName, name->str, name->length);
+        Value value = coreIdx != -1 ? coreModule->moduelVarValue.datas[coreIdx]
+                                    : copyValue(vm, src->moduelVarValue.datas[idx]);
+        if (value.type == VT_UNDEFINED) {
+            RUN_ERROR("module variable %.*s can`t be copied to worker vm!", (int)name->length, name->str);
+        }
+        addSymbol(vm, &module->moduleVarName, name->str, name->length);
+        ValueBufferAdd(vm, &module->moduelVarValue, value);
+        idx ++;
+    }
+
+    ObjFn *fn = instantiateFn(vm, module, image->moduleFn, methodMap);
+    free(methodMap);
+    return fn;
+}
+
+/**
+ * worker线程入口：建立自己的vm，实例化镜像并执行
+ * @param arg
+ * @return
+ */
+static void* workerMain(void *arg) {
+    Worker *worker = (Worker *)arg;
+    VM *vm = newVM();
+    vm->worker = worker;
+    worker->vm = vm;
+
+    ObjFn *fn = instantiateImage(vm, worker->pool->image);
+    ObjThread *objThread = newObjThread(vm, newObjClosure(vm, fn));
+    worker->result = executeInstruction(vm, objThread);
+    return NULL;
+}
+
+/**
+ * 启动workerNum个worker，各自在独立的os线程和vm中执行镜像
+ * 镜像须在所有worker结束前保持不变
+ * @param image
+ * @param workerNum
+ * @return
+ */
+WorkerPool* newWorkerPool(CompiledImage *image, uint32_t workerNum) {
+    WorkerPool *pool = (WorkerPool *)malloc(sizeof(WorkerPool));
+    Worker *workers = (Worker *)calloc(workerNum, sizeof(Worker));
+    if (pool == NULL || workers == NULL) {
+        MEM_ERROR("allocate worker pool failed!");
+    }
+    pool->image = image;
+    pool->workers = workers;
+    pool->workerNum = workerNum;
+    initVmChannel(&pool->outbox);
+
+    // 先初始化全部inbox，worker启动后即可互发消息
+    uint32_t idx = 0;
+    while (idx < workerNum) {
+        workers[idx].id = idx;
+        workers[idx].pool = pool;
+        workers[idx].result = VM_RESULT_SUCCESS;
+        initVmChannel(&workers[idx].inbox);
+        idx ++;
+    }
+
+    idx = 0;
+    while (idx < workerNum) {
+        if (pthread_create(&workers[idx].tid, NULL, workerMain, &workers[idx]) != 0) {
+            MEM_ERROR("create worker thread %d failed!", idx);
+        }
+        idx ++;
+    }
+    return pool;
+}
+
+/**
+ * 宿主向worker发送消息，msg的所有权转移
+ * @param pool
+ * @param workerId
+ * @param msg
+ * @return worker已关闭时返回false
+ */
+bool workerPoolSend(WorkerPool *pool, uint32_t workerId, Message *msg) {
+    ASSERT(workerId < pool->workerNum, "workerId out of bounds!");
+    return vmChannelSend(&pool->workers[workerId].inbox, msg);
+}
+
+/**
+ * 宿主接收任一worker发来的消息，阻塞到有消息为止
+ * @param pool
+ * @return 已join时返回NULL
+ */
+Message* workerPoolReceive(WorkerPool *pool) {
+    return vmChannelReceive(&pool->outbox);
+}
+
+/**
+ * 关闭各worker的inbox，等待其结束后释放其vm
+ * worker的vm与镜像共享字节码，镜像须在join之后才能释放
+ * @param pool
+ */
+void workerPoolJoin(WorkerPool *pool) {
+    uint32_t idx = 0;
+    while (idx < pool->workerNum) {
+        vmChannelClose(&pool->workers[idx].inbox);
+        idx ++;
+    }
+
+    idx = 0;
+    while (idx < pool->workerNum) {
+        pthread_join(pool->workers[idx].tid, NULL);
+        freeVM(pool->workers[idx].vm);
+        destroyVmChannel(&pool->workers[idx].inbox);
+        idx ++;
+    }
+    vmChannelClose(&pool->outbox);
+    destroyVmChannel(&pool->outbox);
+    free(pool->workers);
+    free(pool);
+}
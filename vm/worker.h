@@ -0,0 +1,42 @@
+//
+// Created by ZiXuan on 2022/7/12.
+//
+
+#ifndef SPARROW_WORKER_H
+#define SPARROW_WORKER_H
+
+#include <pthread.h>
+#include "vm.h"
+#include "message.h"
+
+typedef struct {
+    VM *vm;            // 编译镜像所用的vm，编译完成后只读
+    ObjModule *module;
+    ObjFn *moduleFn;   // 模块的顶层函数
+} CompiledImage;  // 编译一次后供所有worker共享的字节码
+
+typedef struct worker {
+    pthread_t tid;
+    uint32_t id;
+    VM *vm;                  // 该worker独占的vm
+    struct workerPool *pool;
+    VmChannel inbox;         // 发往该worker的消息
+    VMResult result;         // 模块的执行结果
+} Worker;
+
+typedef struct workerPool {
+    CompiledImage *image;
+    Worker *workers;
+    uint32_t workerNum;
+    VmChannel outbox;        // 各worker发往宿主的消息
+} WorkerPool;  // 每个worker在自己的os线程上运行一个独立的vm
+
+CompiledImage* compileImage(VM *vm, const char *moduleName, const char *moduleCode);
+CompiledImage* newCompiledImage(const char *moduleName, const char *moduleCode);
+ObjFn* instantiateImage(VM *vm, CompiledImage *image);
+WorkerPool* newWorkerPool(CompiledImage *image, uint32_t workerNum);
+bool workerPoolSend(WorkerPool *pool, uint32_t workerId, Message *msg);
+Message* workerPoolReceive(WorkerPool *pool);
+void workerPoolJoin(WorkerPool *pool);
+
+#endif //SPARROW_WORKER_H